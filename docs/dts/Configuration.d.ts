@@ -257,6 +257,14 @@ interface Configuration {
    *   - _alpn_ - (optional) An array of allowed protocol names, or a function that receives an array of client-preferred protocol names
    *       and returns the index of the server-chosen protocol in that array.
    *   - _handshake_ - (optional) A callback function that receives the negotiated protocol name after handshake.
+   *   - _sessionTicket_ - (optional) Whether to issue session tickets to clients. Defaults to `true`.
+   *   - _sessionTicketKey_ - (optional) Secret from which ticket keys are derived, shared by all instances that should
+   *       accept each other's tickets. Defaults to a random secret generated once per process.
+   *   - _sessionTicketRotation_ - (optional) Interval at which ticket keys rotate. Defaults to 1 hour.
+   *   - _sessionCache_ - (optional) Maximum number of sessions in the process-wide session cache, or 0 to disable it.
+   *       Defaults to 20480.
+   *   - _ktls_ - (optional) Hands encryption of outgoing data over to the kernel after a TLSv1.2 handshake on Linux,
+   *       when this filter is the last one in the pipeline of a TCP inbound connection. Defaults to `false`.
    * @returns The same _Configuration_ object.
    */
   acceptTLS(
@@ -266,6 +274,11 @@ interface Configuration {
       verify?: (ok: boolean, cert: Certificate) => boolean,
       alpn?: string[] | ((protocolNames: string[]) => number),
       handshake?: (protocolName: string | undefined) => void,
+      sessionTicket?: boolean,
+      sessionTicketKey?: string | Data,
+      sessionTicketRotation?: number | string,
+      sessionCache?: number,
+      ktls?: boolean,
     }
   ): Configuration;
 
@@ -315,6 +328,42 @@ interface Configuration {
     ...restBranches: (((msg: Message) => boolean)|string|((pipelineConfigurator: Configuration) => void))[]
   ): Configuration;
 
+  /**
+   * Appends a _cacheHTTP_ filter to the current pipeline layout.
+   *
+   * A _cacheHTTP_ filter serves HTTP requests from a process-wide response cache,
+   * and forwards the ones it cannot serve to a newly created sub-pipeline.
+   *
+   * - **INPUT** - HTTP _Messages_ from the client.
+   * - **OUTPUT** - HTTP _Messages_ from the cache or from the sub-pipeline.
+   * - **SUB-INPUT** - HTTP _Messages_ that could not be served from the cache.
+   * - **SUB-OUTPUT** - HTTP _Messages_ from the upstream.
+   *
+   * @param options Options including:
+   *   - _store_ - (optional) Name of the cache store. Filters with the same store name share cached responses. Defaults to `""`.
+   *   - _memoryLimit_ - (optional) Maximum total size of cached responses in the store. Defaults to `"64m"`.
+   *       All filters using the same store must give the same limit.
+   *   - _maxBodySize_ - (optional) Responses with a larger body are not cached. Defaults to `"1m"`.
+   *   - _ttl_ - (optional) Freshness lifetime for responses with no explicit expiration or _Last-Modified_ header. Defaults to 0.
+   *   - _coalesce_ - (optional) Whether concurrent misses on the same key wait for one upstream request. Defaults to `true`.
+   *   - _coalesceTimeout_ - (optional) How long a coalesced request waits before going upstream on its own. Defaults to 5 seconds.
+   *   - _key_ - (optional) A function that receives the request head and returns the cache key.
+   *       Defaults to the scheme, host and path. HTTP/1 requests carry no scheme and count as `"http"`,
+   *       so set _head.scheme_ to `"https"` on requests decrypted by _acceptTLS_ when serving both from one store.
+   * @returns The same _Configuration_ object.
+   */
+  cacheHTTP(
+    options?: {
+      store?: string,
+      memoryLimit?: number | string,
+      maxBodySize?: number | string,
+      ttl?: number | string,
+      coalesce?: boolean,
+      coalesceTimeout?: number | string,
+      key?: (head: HttpRequestHead) => string,
+    }
+  ): Configuration;
+
   /**
    * Appends a _chain_ filter to the current pipeline layout.
    *
@@ -343,10 +392,19 @@ interface Configuration {
    * - **OUTPUT** - Compressed _Messages_.
    *
    * @param algorithm Compression algorithm or a function that returns the compression algorithm.
-   *       Available compression algorithms are `"deflate"`, `"gzip"`.
+   *       Available compression algorithms are `"deflate"`, `"gzip"`, `"br"` and `"zstd"`.
+   * @param options Options including:
+   *   - _level_ - (optional) Compression level. Defaults to 6 for deflate and gzip, 5 for br and 3 for zstd.
+   *   - _window_ - (optional) Base-2 logarithm of the window size. Defaults to the default of the algorithm.
    * @returns The same _Configuration_ object.
    */
-  compress(algorithm: string | (() => string)): Configuration;
+  compress(
+    algorithm: string | (() => string),
+    options?: {
+      level?: number,
+      window?: number,
+    }
+  ): Configuration;
 
   /**
    * Appends a _compressHTTP_ filter to the current pipeline layout.
@@ -356,19 +414,22 @@ interface Configuration {
    * - **INPUT** - HTTP _Messages_ to compress.
    * - **OUTPUT** - Compressed HTTP _Messages_.
    *
+   * @param algorithm Compression algorithm, or an array of candidate algorithms to negotiate with _acceptEncoding_,
+   *       or a function that receives the _MessageStart_ and returns either of them.
+   *       Available compression algorithms are `"deflate"`, `"gzip"`, `"br"` and `"zstd"`.
    * @param options Options including:
-   *   - method - Compression method or a function that returns the compression method.
-   *       Available compression methods are `"deflate"`, `"gzip"` and  `""` for no compression.
-   *       Default is `""`.
-   *   - level - Compression level or a function that returns the compression level.
-   *       Available compression levels are `"default"`, `"speed"` and `"best"`.
-   *       Default is `"default"`.
+   *   - _level_ - (optional) Compression level. Defaults to 6 for deflate and gzip, 5 for br and 3 for zstd.
+   *   - _window_ - (optional) Base-2 logarithm of the window size. Defaults to the default of the algorithm.
+   *   - _acceptEncoding_ - (optional) The _Accept-Encoding_ header of the request, or a function that returns it,
+   *       against which an array of candidate algorithms is negotiated. Required when _algorithm_ is or returns an array.
    * @returns The same _Configuration_ object.
    */
   compressHTTP(
+    algorithm: string | string[] | ((msg: MessageStart) => string | string[]),
     options?: {
-      method?: '' | 'deflate' | 'gzip' | (() => (''|'deflate'|'gzip')),
-      level?: 'default' | 'speed' | 'best' | (() => ('default'|'speed'|'best')),
+      level?: number,
+      window?: number,
+      acceptEncoding?: string | (() => string),
     }
   ): Configuration;
 
@@ -499,6 +560,9 @@ interface Configuration {
    *   - _sni_ - (optional) SNI server name or a function that returns it
    *   - _alpn_ - (optional) Requested protocol name or an array of preferred protocol names
    *   - _handshake_ - (optional) A callback function that receives the negotiated protocol name after handshake.
+   *   - _sessionReuse_ - (optional) Whether to resume sessions previously established with the same server name. Defaults to `true`. Not applied when _onVerify_ is given, since a resumed session skips certificate verification.
+   *   - _ktls_ - (optional) Hands encryption of outgoing data over to the kernel after a TLSv1.2 handshake on Linux,
+   *       when the sub-pipeline consists of a single _connect_ filter. Defaults to `false`.
    * @returns The same _Configuration_ object.
    */
   connectTLS(
@@ -509,6 +573,8 @@ interface Configuration {
       alpn?: string | string[],
       sni?: string | (() => string),
       handshake?: (protocolName: string | undefined) => void,
+      sessionReuse?: boolean,
+      ktls?: boolean,
     }
   ): Configuration;
 
@@ -623,11 +689,11 @@ interface Configuration {
    * - **OUTPUT** - Decompressed _Data_.
    *
    * @param algorithm Algorithm used in decompression.
-   *   Available algorithms include `"inflate"`, `"brotli"`.
+   *   Available algorithms include `"inflate"`, `"gzip"`, `"brotli"` and `"zstd"`.
    *   Can be one of these strings or a function that returns one of them.
    * @returns The same _Configuration_ object.
    */
-  decompress(algorithm: string | (() => 'inflate' | 'brotli')): Configuration;
+  decompress(algorithm: string | (() => 'inflate' | 'gzip' | 'brotli' | 'zstd')): Configuration;
 
   /**
    * Appends a _decompressHTTP_ filter to the current pipeline layout.
@@ -187,6 +187,14 @@ interface Data extends Event {
    */
   shiftWhile(callback: (byte: number) => boolean): Data;
 
+  /**
+   * Checks if the bytes, read as UTF-8 text, match a regular expression.
+   *
+   * @param pattern A _RegExp_ to search for in the bytes.
+   * @returns A boolean value indicating whether a match is found.
+   */
+  test(pattern: RegExp): boolean;
+
   /**
    * Converts to an array of bytes.
    *
@@ -0,0 +1,46 @@
+/**
+ * Longest-prefix-match map from IPv4 and IPv6 address blocks to values.
+ */
+interface IPMap {
+
+  /**
+   * Adds an address block.
+   *
+   * @param cidr A string in CIDR notation, a single IP address or a _Netmask_ object.
+   * @param value The value that addresses in the block map to. Defaults to `true`.
+   */
+  add(cidr: string | Netmask, value?: any): void;
+
+  /**
+   * Finds the value of the longest address block containing an address.
+   *
+   * @param ip A string containing an IPv4 or IPv6 address.
+   * @returns The value of the most specific matching block, or `undefined` if none matches.
+   */
+  find(ip: string): any;
+}
+
+interface IPMapConstructor {
+
+  /**
+   * Creates an instance of _IPMap_.
+   *
+   * @param blocks An object of key-value pairs where keys are address blocks in CIDR notation,
+   *   or an array of address blocks that all map to `true`.
+   * @returns An _IPMap_ object with the provided initial mapping.
+   */
+  new(blocks?: { [cidr: string]: any } | string[]): IPMap;
+
+  /**
+   * Creates an instance of _IPMap_ from a file.
+   *
+   * Each line has an address block in CIDR notation, optionally followed by a string value
+   * separated by whitespaces. Blocks without a value map to `true`. Text after `#` is ignored.
+   *
+   * @param filename Pathname of the file to load.
+   * @returns An _IPMap_ object with the address blocks from the file.
+   */
+  load(filename: string): IPMap;
+}
+
+declare var IPMap: IPMapConstructor;
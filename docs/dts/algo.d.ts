@@ -46,6 +46,12 @@ interface CacheConstructor {
    *   - _size_ - Maximum number of entries allowed in the cache.
    *   - _ttl_ - Time-to-live for the entries in the cache.
    *       Can be a number in seconds or a string with one of the time unit suffixes such as `'s'`, `'m'` and `'h'`.
+   *   - _shared_ - Name of a process-wide cache shared by all worker threads. Instances with the same name use the same entries
+   *       and must be given the same _size_, _ttl_, _memoryLimit_ and _policy_. Entries of a shared cache that expire
+   *       are passed to _onFree_ on the next access from a thread whose instance has an _onFree_ callback.
+   *   - _memoryLimit_ - Maximum estimated memory used by the entries of a shared cache.
+   *       Can be a number in bytes or a string with one of the unit suffixes such as `'k'`, `'m'` and `'g'`.
+   *   - _policy_ - Eviction policy of a shared cache, either `'lru'` (default) or `'tinylfu'`.
    * @returns An empty _Cache_ object.
    */
   new(
@@ -54,6 +60,9 @@ interface CacheConstructor {
     options?: {
       size?: number,
       ttl?: number | string,
+      shared?: string,
+      memoryLimit?: number | string,
+      policy?: 'lru' | 'tinylfu',
     }
   ): Cache;
 }
@@ -123,6 +132,9 @@ interface URLRouter {
   /**
    * Appends a route.
    *
+   * A path can start with a host name, where `*` matches a single label (as in `*.example.com/`).
+   * A path segment `:name` captures one segment, and a trailing `*` or `*name` captures the rest of the path.
+   *
    * @param path A string containing a path.
    * @param value The value that the given _path_ is mapped to.
    */
@@ -135,6 +147,15 @@ interface URLRouter {
    * @returns The value that the queried path maps to, or `undefined` if the path is not found.
    */
   find(...pathSegments: string[]): any;
+
+  /**
+   * Finds a route along with the parameters captured from the path.
+   *
+   * @param pathSegments A series of strings that make up a path to look up.
+   * @returns An object containing the _value_ of the matching route and the captured _params_,
+   *   or `undefined` if the path is not found.
+   */
+  match(...pathSegments: string[]): { value: any, params: { [name: string]: string } } | undefined;
 }
 
 interface URLRouterConstructor {
@@ -171,12 +192,22 @@ interface LoadBalancerBase {
  */
 interface HashingLoadBalancer extends LoadBalancerBase {
 
+  /**
+   * Replaces all targets.
+   *
+   * @param targets An array of strings representing the targets, or an object of key-value pairs
+   *   where keys are the targets and values are the weights.
+   */
+  set(targets: string[] | { [id: string]: number }): void;
+
   /**
    * Adds a target.
    *
    * @param target A string representing the target to add in the target list.
+   * @param weight A number as the weight of the target. Defaults to 1.
+   *   Adding an existing target again adds up to its current weight.
    */
-  add(target: string): void;
+  add(target: string, weight?: number): void;
 }
 
 interface HashingLoadBalancerConstructor {
@@ -184,11 +215,12 @@ interface HashingLoadBalancerConstructor {
   /**
    * Creates an instance of _HashingLoadBalancer_.
    *
-   * @param targets An array of strings. Each string represents a target.
+   * @param targets An array of strings representing the targets, or an object of key-value pairs
+   *   where keys are the targets and values are the weights.
    * @param unhealthy A _Cache_ object storing _unhealthy_ targets.
    * @returns A _HashingLoadBalancer_ object with the specified targets.
    */
-  new(targets: string[], unhealthy?: Cache): HashingLoadBalancer;
+  new(targets: string[] | { [id: string]: number }, unhealthy?: Cache): HashingLoadBalancer;
 }
 
 /**
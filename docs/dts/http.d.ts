@@ -121,10 +121,11 @@ interface HttpDirectoryConstructor {
       defaultContentType?: string,
       compression?: (
         request: HttpRequestHead,
-        acceptEncoding: { [algorithm: string]: true },
+        acceptEncoding: { [algorithm: string]: number },
         pathname: string,
         size: number,
       ) => string,
+      compressionLevel?: number,
     }
   ): HttpDirectory;
 
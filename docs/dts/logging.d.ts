@@ -21,9 +21,26 @@ interface Logger {
    * Adds output to a file.
    *
    * @param filename Pathname of the file to write to.
+   * @param options Options including:
+   *   - _maxFileSize_ - Rotates the file when it grows over this size. Can be a number or a string such as `"10m"`. Default is no limit.
+   *   - _maxFileAge_ - Rotates the file when it has been open for this long. Can be a number in seconds or a string such as `"1d"`. Default is no limit.
+   *   - _maxFiles_ - Maximum number of rotated files to keep. Default is no limit.
+   *   - _gzip_ - Compresses rotated files in the background. Default is `false`.
+   *   - _bufferLimit_ - Maximum size of messages waiting to be written. Default is `"8m"`.
+   *   - _overflow_ - What to do when the buffer is full, either `"drop"` (Default) or `"block"`.
+   *       Blocking holds up the event loop of the logging worker thread, for up to 1 second,
+   *       after which the message is dropped. A message larger than _bufferLimit_ is written
+   *       once all messages before it have been written.
    * @returns The same logger object.
    */
-  toFile(filename: string): Logger;
+  toFile(filename: string, options?: {
+    maxFileSize?: number | string,
+    maxFileAge?: number | string,
+    maxFiles?: number,
+    gzip?: boolean,
+    bufferLimit?: number | string,
+    overflow?: "drop" | "block",
+  }): Logger;
 
   /**
    * Adds output to the [Syslog](https://en.wikipedia.org/wiki/Syslog).
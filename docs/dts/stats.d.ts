@@ -123,10 +123,53 @@ interface HistogramConstructor {
   new(name: string, buckets: number[], labelNames?: string[]): Histogram;
 }
 
+/**
+ * Sketch metric.
+ */
+interface Sketch extends Metric {
+
+  /**
+   * Clears all buckets.
+   */
+  zero(): void;
+
+  /**
+   * Adds a sample to the sketch.
+   *
+   * @param n A sample to add to the sketch.
+   */
+  observe(n: number): void;
+
+  /**
+   * Estimates a quantile from the samples.
+   *
+   * @param q Quantile between 0 and 1.
+   * @returns Estimated value at the quantile within the relative error.
+   */
+  quantile(q: number): number;
+}
+
+interface SketchConstructor {
+
+  /**
+   * Creates an instance of _Sketch_.
+   *
+   * @param name Name of the sketch metric.
+   * @param labelNames An array of label names.
+   * @param options Options including:
+   *   - _relativeError_ - Maximum relative error of quantiles. Defaults to 0.05.
+   *   - _min_ - Lower bound of the value range with bounded error. Defaults to 0.001.
+   *   - _max_ - Upper bound of the value range with bounded error. Defaults to 1e7.
+   * @returns A _Sketch_ object with the specified name and labels.
+   */
+  new(name: string, labelNames?: string[], options?: { relativeError?: number, min?: number, max?: number }): Sketch;
+}
+
 interface Stats {
   Counter: CounterConstructor,
   Gauge: GaugeConstructor,
   Histogram: HistogramConstructor,
+  Sketch: SketchConstructor,
 }
 
 declare var stats: Stats;
@@ -25,10 +25,16 @@
 
 #include "algo.hpp"
 #include "context.hpp"
+#include "shared-table.hpp"
 #include "utils.hpp"
 #include "log.hpp"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
 
 namespace pipy {
 namespace algo {
@@ -43,6 +49,76 @@ auto Algo::hash(const pjs::Value &value) -> size_t {
   return h;
 }
 
+static auto mix_hash(uint64_t h) -> uint64_t {
+  h += 0x9e3779b97f4a7c15ull;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  return h ^ (h >> 31);
+}
+
+//
+// Keys and value sizes for shared caches
+//
+
+static bool encode_shared_key(const pjs::Value &key, std::string &str) {
+  switch (key.type()) {
+    case pjs::Value::Type::Empty:
+    case pjs::Value::Type::Undefined:
+      str = "u";
+      return true;
+    case pjs::Value::Type::Boolean:
+      str = key.b() ? "t" : "f";
+      return true;
+    case pjs::Value::Type::Number: {
+      auto n = key.n();
+      str = "n";
+      str.append((const char *)&n, sizeof(n));
+      return true;
+    }
+    case pjs::Value::Type::String:
+      str = "s";
+      str += key.s()->str();
+      return true;
+    case pjs::Value::Type::Object:
+      if (key.is_null()) {
+        str = "z";
+        return true;
+      }
+      return false;
+  }
+  return false;
+}
+
+static void decode_shared_key(const std::string &str, pjs::Value &key) {
+  switch (str[0]) {
+    case 't': key.set(true); break;
+    case 'f': key.set(false); break;
+    case 'n': {
+      double n;
+      std::memcpy(&n, str.c_str() + 1, sizeof(n));
+      key.set(n);
+      break;
+    }
+    case 's': key.set(pjs::Str::make(str.c_str() + 1, str.length() - 1)); break;
+    case 'z': key = pjs::Value::null; break;
+    default: key = pjs::Value::undefined; break;
+  }
+}
+
+static auto shared_value_size(const pjs::Value &value, int depth = 0) -> size_t {
+  if (value.is_string()) return value.s()->size();
+  if (value.is_object() && value.o() && depth < 8) {
+    size_t size = 0;
+    value.o()->iterate_all(
+      [&](pjs::Str *k, pjs::Value &v) {
+        size += k->size() + shared_value_size(v, depth + 1) + sizeof(pjs::SharedValue);
+      }
+    );
+    return size;
+  }
+  return sizeof(double);
+}
+
 //
 // Cache::Options
 //
@@ -52,9 +128,18 @@ Cache::Options::Options(pjs::Object *options) {
   Value(options, str_size)
     .get(size)
     .check_nullable();
+  Value(options, "memoryLimit")
+    .get_binary_size(memory_limit)
+    .check_nullable();
   Value(options, str_ttl)
     .get_seconds(ttl)
     .check_nullable();
+  Value(options, "shared")
+    .get(shared)
+    .check_nullable();
+  Value(options, "policy")
+    .get_enum(policy)
+    .check_nullable();
 }
 
 //
@@ -67,14 +152,33 @@ Cache::Cache(const Options &options, pjs::Function *allocate, pjs::Function *fre
   , m_free(free)
   , m_cache(pjs::OrderedHash<pjs::Value, Entry>::make())
 {
+  if (options.shared) {
+    m_shared = Shared::get(options.shared->str(), options);
+    if (m_free) m_shared->listen_expired(true);
+  }
   m_options.ttl *= 1000;
 }
 
 Cache::~Cache()
 {
+  if (m_shared && m_free) m_shared->listen_expired(false);
 }
 
 bool Cache::get(pjs::Context &ctx, const pjs::Value &key, pjs::Value &value) {
+  if (m_shared) {
+    shared_free_expired(ctx);
+    std::string k;
+    if (!shared_key(ctx, key, k)) return false;
+    if (m_shared->get(k, value)) return true;
+    if (!m_allocate) return false;
+    pjs::Value arg(key);
+    (*m_allocate)(ctx, 1, &arg, value);
+    if (!ctx.ok()) return false;
+    std::vector<Shared::Node*> evicted;
+    m_shared->set(k, value, evicted);
+    shared_free(ctx, evicted);
+    return true;
+  }
   return get(
     key, value,
     [&](pjs::Value &value) {
@@ -87,6 +191,15 @@ bool Cache::get(pjs::Context &ctx, const pjs::Value &key, pjs::Value &value) {
 }
 
 void Cache::set(pjs::Context &ctx, const pjs::Value &key, const pjs::Value &value) {
+  if (m_shared) {
+    shared_free_expired(ctx);
+    std::string k;
+    if (!shared_key(ctx, key, k)) return;
+    std::vector<Shared::Node*> evicted;
+    m_shared->set(k, value, evicted);
+    shared_free(ctx, evicted);
+    return;
+  }
   set(
     key, value,
     [&](const pjs::Value &key, const pjs::Value &value) {
@@ -101,14 +214,28 @@ void Cache::set(pjs::Context &ctx, const pjs::Value &key, const pjs::Value &valu
 }
 
 bool Cache::get(const pjs::Value &key, pjs::Value &value) {
+  if (m_shared) return find(key, value);
   return get(key, value, nullptr);
 }
 
 void Cache::set(const pjs::Value &key, const pjs::Value &value) {
+  if (m_shared) {
+    std::string k;
+    if (!encode_shared_key(key, k)) return;
+    std::vector<Shared::Node*> evicted;
+    m_shared->set(k, value, evicted);
+    for (auto *node : evicted) delete node;
+    return;
+  }
   set(key, value, nullptr);
 }
 
 bool Cache::find(const pjs::Value &key, pjs::Value &value) {
+  if (m_shared) {
+    std::string k;
+    if (!encode_shared_key(key, k)) return false;
+    return m_shared->get(k, value);
+  }
   Entry entry;
   bool found = m_cache->use(key, entry);
   if (!found) return false;
@@ -124,11 +251,28 @@ bool Cache::find(const pjs::Value &key, pjs::Value &value) {
 }
 
 bool Cache::remove(const pjs::Value &key) {
+  if (m_shared) {
+    std::string k;
+    if (!encode_shared_key(key, k)) return false;
+    auto *node = m_shared->remove(k);
+    delete node;
+    return node;
+  }
   return m_cache->erase(key);
 }
 
 bool Cache::remove(pjs::Context &ctx, const pjs::Value &key) {
-  if (m_free) {
+  if (m_shared) {
+    shared_free_expired(ctx);
+    std::string k;
+    if (!shared_key(ctx, key, k)) return false;
+    auto *node = m_shared->remove(k);
+    if (!node) return false;
+    auto found = (!node->expiration || node->expiration > utils::now());
+    std::vector<Shared::Node*> removed(1, node);
+    shared_free(ctx, removed);
+    return found;
+  } else if (m_free) {
     Entry entry;
     auto found = m_cache->get(key, entry);
     if (found) {
@@ -149,7 +293,13 @@ bool Cache::remove(pjs::Context &ctx, const pjs::Value &key) {
 }
 
 bool Cache::clear(pjs::Context &ctx) {
-  if (m_free) {
+  if (m_shared) {
+    shared_free_expired(ctx);
+    std::vector<Shared::Node*> removed;
+    m_shared->clear(removed);
+    shared_free(ctx, removed);
+    return ctx.ok();
+  } else if (m_free) {
     pjs::OrderedHash<pjs::Value, Entry>::Iterator it(m_cache);
     while (auto *p = it.next()) {
       pjs::Value argv[2], ret;
@@ -220,6 +370,513 @@ void Cache::set(
   }
 }
 
+bool Cache::shared_key(pjs::Context &ctx, const pjs::Value &key, std::string &str) {
+  if (encode_shared_key(key, str)) return true;
+  ctx.error("objects cannot be keys in a shared cache");
+  return false;
+}
+
+void Cache::shared_free(pjs::Context &ctx, std::vector<Shared::Node*> &nodes) {
+  for (auto *node : nodes) {
+    if (m_free && ctx.ok()) {
+      pjs::Value argv[2], ret;
+      decode_shared_key(node->key, argv[0]);
+      node->value.to_value(argv[1]);
+      (*m_free)(ctx, 2, argv, ret);
+    }
+    delete node;
+  }
+  nodes.clear();
+}
+
+void Cache::shared_free_expired(pjs::Context &ctx) {
+  if (!m_free) return;
+  std::vector<Shared::Node*> expired;
+  m_shared->take_expired(expired);
+  if (!expired.empty()) shared_free(ctx, expired);
+}
+
+//
+// Cache::Shared
+//
+
+static const int s_shared_cache_shards = 16;
+static const double s_shared_cache_tick = 100;
+static const size_t s_shared_cache_wheel_size = 1024;
+static const size_t s_shared_cache_sketch_width_max = 1 << 16;
+
+// Never destructed so that the sweeper can outlive static destruction
+static auto s_shared_caches = new std::map<std::string, Cache::Shared*>;
+static auto s_shared_caches_mutex = new std::mutex;
+
+//
+// SharedCacheSweeper
+//
+// Expires entries of shared caches with a TTL every tick. Started by
+// the first such cache and stopped at exit.
+//
+
+class SharedCacheSweeper {
+public:
+  ~SharedCacheSweeper() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+      m_cv.notify_one();
+    }
+    if (m_thread.joinable()) m_thread.join();
+  }
+
+  void start() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_thread.joinable() || m_stopping) return;
+    m_thread = std::thread([this]() { main(); });
+  }
+
+private:
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stopping = false;
+
+  void main() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+      m_cv.wait_for(lock, std::chrono::milliseconds(int(s_shared_cache_tick)));
+      if (m_stopping) break;
+      lock.unlock();
+      Cache::Shared::sweep_all();
+      lock.lock();
+    }
+  }
+};
+
+static SharedCacheSweeper s_shared_caches_sweeper;
+
+auto Cache::Shared::get(const std::string &name, const Options &options) -> Shared* {
+  std::lock_guard<std::mutex> lock(*s_shared_caches_mutex);
+  auto &p = (*s_shared_caches)[name];
+  if (p) {
+    // Limits and TTL are shared by all users, so they have to agree
+    if (!p->matches(options)) {
+      throw std::runtime_error("shared cache '" + name + "' already exists with different options");
+    }
+  } else {
+    p = new Shared(name, options);
+  }
+  if (options.ttl > 0) s_shared_caches_sweeper.start();
+  return p;
+}
+
+void Cache::Shared::sweep_all() {
+  std::lock_guard<std::mutex> lock(*s_shared_caches_mutex);
+  auto now = utils::now();
+  for (const auto &i : *s_shared_caches) {
+    auto *cache = i.second;
+    if (cache->m_ttl.load() > 0) cache->sweep(now);
+  }
+}
+
+void Cache::Shared::for_each(const std::function<void(Shared*)> &callback) {
+  std::lock_guard<std::mutex> lock(*s_shared_caches_mutex);
+  for (const auto &i : *s_shared_caches) {
+    callback(i.second);
+  }
+}
+
+void Cache::Shared::Lock::lock() {
+  m_waiting_writers.fetch_add(1, std::memory_order_relaxed);
+  for (;;) {
+    int unlocked = 0;
+    if (m_state.compare_exchange_weak(unlocked, -1, std::memory_order_acquire)) break;
+    std::this_thread::yield();
+  }
+  m_waiting_writers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool Cache::Shared::Lock::try_lock() {
+  int unlocked = 0;
+  return m_state.compare_exchange_strong(unlocked, -1, std::memory_order_acquire);
+}
+
+void Cache::Shared::Lock::lock_shared() {
+  for (;;) {
+    if (!m_waiting_writers.load(std::memory_order_relaxed)) {
+      auto n = m_state.load(std::memory_order_relaxed);
+      if (n >= 0 && m_state.compare_exchange_weak(n, n + 1, std::memory_order_acquire)) break;
+    }
+    std::this_thread::yield();
+  }
+}
+
+Cache::Shared::Shared(const std::string &name, const Options &options)
+  : m_name(name)
+  , m_max_count(options.size)
+  , m_max_bytes(options.memory_limit)
+  , m_ttl(options.ttl * 1000)
+  , m_tiny_lfu(options.policy == Policy::TINY_LFU)
+  , m_shards(
+      [&]() -> size_t {
+        // Fewer shards for small caches so that per-shard limits stay meaningful
+        size_t n = s_shared_cache_shards;
+        if (options.size > 0) while (n > 1 && size_t(options.size) < n * 8) n >>= 1;
+        return n;
+      }()
+    )
+{
+  auto tick = uint64_t(utils::now() / s_shared_cache_tick);
+  for (auto &shard : m_shards) {
+    shard.wheel.resize(s_shared_cache_wheel_size);
+    shard.wheel_tick = tick;
+  }
+  m_expired_listeners = 0;
+}
+
+bool Cache::Shared::matches(const Options &options) const {
+  return (
+    m_max_count.load() == options.size &&
+    m_max_bytes.load() == options.memory_limit &&
+    m_ttl.load() == options.ttl * 1000 &&
+    m_tiny_lfu.load() == (options.policy == Policy::TINY_LFU)
+  );
+}
+
+void Cache::Shared::listen_expired(bool listen) {
+  if (listen) {
+    m_expired_listeners++;
+  } else if (!--m_expired_listeners) {
+    std::vector<Node*> expired;
+    take_expired(expired);
+    for (auto *node : expired) delete node;
+  }
+}
+
+void Cache::Shared::take_expired(std::vector<Node*> &expired) {
+  std::lock_guard<std::mutex> lock(m_expired_mutex);
+  if (m_expired.empty()) return;
+  m_expired.swap(expired);
+}
+
+void Cache::Shared::retire(Node *node) {
+  if (m_expired_listeners.load() > 0) {
+    std::lock_guard<std::mutex> lock(m_expired_mutex);
+    m_expired.push_back(node);
+  } else {
+    delete node;
+  }
+}
+
+bool Cache::Shared::get(const std::string &key, pjs::Value &value) {
+  auto hash = std::hash<std::string>()(key);
+  auto &shard = shard_of(hash);
+  Node *found = nullptr;
+  bool hit = false, full = false;
+  {
+    SharedLock lock(shard.lock);
+    auto i = shard.map.find(key);
+    if (i != shard.map.end()) {
+      found = i->second;
+      if (found->expiration <= 0 || found->expiration > utils::now()) {
+        found->value.to_value(value);
+        full = record_read(shard, found, hash);
+        hit = true;
+      }
+    } else {
+      full = record_read(shard, nullptr, hash);
+    }
+  }
+
+  if (full && shard.lock.try_lock()) {
+    drain_reads(shard);
+    shard.lock.unlock();
+  }
+
+  if (hit) {
+    shard.hits++;
+    return true;
+  }
+
+  shard.misses++;
+  if (!found) return false;
+
+  // Expired, but it may have been replaced or removed since
+  {
+    std::lock_guard<Lock> lock(shard.lock);
+    auto i = shard.map.find(key);
+    if (i == shard.map.end() || i->second != found) return false;
+    drain_reads(shard);
+    detach(shard, found);
+    shard.map.erase(i);
+    shard.stats.expirations++;
+  }
+  retire(found);
+  return false;
+}
+
+void Cache::Shared::set(const std::string &key, const pjs::Value &value, std::vector<Node*> &evicted) {
+  auto ttl = m_ttl.load();
+  auto *node = new Node;
+  node->key = key;
+  node->value = value;
+  node->size = sizeof(Node) + key.size() * 2 + shared_value_size(value);
+  node->hash = std::hash<std::string>()(key);
+  if (ttl > 0) {
+    node->expiration = utils::now() + ttl;
+    node->tick = uint64_t(std::ceil(node->expiration / s_shared_cache_tick));
+  }
+
+  Node *replaced = nullptr;
+  auto &shard = shard_of(node->hash);
+  {
+    std::lock_guard<Lock> lock(shard.lock);
+    drain_reads(shard);
+    if (m_tiny_lfu) touch(shard, node->hash);
+    auto &slot = shard.map[key];
+    if (slot) {
+      replaced = slot;
+      detach(shard, replaced);
+    }
+    slot = node;
+    if (node->tick) {
+      link(shard.wheel[node->tick % s_shared_cache_wheel_size], node, &Node::timer);
+    }
+    admit(shard, node, evicted);
+  }
+  delete replaced;
+}
+
+auto Cache::Shared::remove(const std::string &key) -> Node* {
+  auto hash = std::hash<std::string>()(key);
+  auto &shard = shard_of(hash);
+  std::lock_guard<Lock> lock(shard.lock);
+  drain_reads(shard);
+  auto i = shard.map.find(key);
+  if (i == shard.map.end()) return nullptr;
+  auto *node = i->second;
+  detach(shard, node);
+  shard.map.erase(i);
+  return node;
+}
+
+void Cache::Shared::clear(std::vector<Node*> &removed) {
+  for (auto &shard : m_shards) {
+    std::lock_guard<Lock> lock(shard.lock);
+    shard.read_count = 0;
+    for (const auto &i : shard.map) removed.push_back(i.second);
+    shard.map.clear();
+    shard.window = Chain();
+    shard.main = Chain();
+    for (auto &slot : shard.wheel) slot = Chain();
+  }
+}
+
+void Cache::Shared::stats(Stats &stats) {
+  stats = Stats();
+  for (auto &shard : m_shards) {
+    std::lock_guard<Lock> lock(shard.lock);
+    stats.hits += shard.hits.load();
+    stats.misses += shard.misses.load();
+    stats.evictions += shard.stats.evictions;
+    stats.expirations += shard.stats.expirations;
+    stats.entries += shard.window.count + shard.main.count;
+    stats.bytes += shard.window.bytes + shard.main.bytes;
+  }
+}
+
+auto Cache::Shared::shard_of(size_t hash) -> Shard& {
+  return m_shards[mix_hash(hash) >> 48 & (m_shards.size() - 1)];
+}
+
+//
+// With LRU, all entries live in the main chain and the least recently
+// used ones are evicted. With TinyLFU, new entries land in a small
+// admission window first. Entries leaving the window only enter the
+// main chain if they have been seen more often than the main chain's
+// eviction victim, according to a count-min sketch of access frequency.
+//
+
+void Cache::Shared::admit(Shard &shard, Node *node, std::vector<Node*> &evicted) {
+  auto n = m_shards.size();
+  auto max_count = size_t(std::max(0, m_max_count.load()));
+  auto max_bytes = m_max_bytes.load();
+  size_t count_limit = (max_count + n - 1) / n;
+  size_t bytes_limit = max_bytes ? std::max<size_t>(1, max_bytes / n) : 0;
+
+  auto over = [](size_t count, size_t bytes, size_t count_limit, size_t bytes_limit) {
+    return (count_limit && count > count_limit) || (bytes_limit && bytes > bytes_limit);
+  };
+
+  if (m_tiny_lfu) {
+    auto window_count = count_limit ? std::max<size_t>(1, count_limit / 100) : 0;
+    auto window_bytes = bytes_limit ? std::max<size_t>(1, bytes_limit / 100) : 0;
+    auto main_count = count_limit - window_count;
+    auto main_bytes = bytes_limit - window_bytes;
+    auto &window = shard.window;
+    auto &main = shard.main;
+    link(window, node, &Node::lru);
+    while (window.head && over(window.count, window.bytes, window_count, window_bytes)) {
+      auto *candidate = window.head;
+      unlink(window, candidate, &Node::lru);
+      link(main, candidate, &Node::lru);
+      if (!over(main.count, main.bytes, main_count, main_bytes)) continue;
+      auto *victim = main.head;
+      if (victim != candidate && frequency(shard, candidate->hash) > frequency(shard, victim->hash)) {
+        evict(shard, victim, evicted);
+      } else {
+        evict(shard, candidate, evicted);
+      }
+    }
+  } else {
+    link(shard.main, node, &Node::lru);
+  }
+
+  for (;;) {
+    auto count = shard.window.count + shard.main.count;
+    auto bytes = shard.window.bytes + shard.main.bytes;
+    if (!over(count, bytes, count_limit, bytes_limit)) break;
+    auto *victim = shard.main.head ? shard.main.head : shard.window.head;
+    if (!victim) break;
+    evict(shard, victim, evicted);
+  }
+}
+
+void Cache::Shared::evict(Shard &shard, Node *node, std::vector<Node*> &evicted) {
+  detach(shard, node);
+  shard.map.erase(node->key);
+  shard.stats.evictions++;
+  evicted.push_back(node);
+}
+
+void Cache::Shared::detach(Shard &shard, Node *node) {
+  if (auto *chain = node->chain) {
+    unlink(*chain, node, &Node::lru);
+  }
+  if (node->tick) {
+    unlink(shard.wheel[node->tick % s_shared_cache_wheel_size], node, &Node::timer);
+  }
+}
+
+void Cache::Shared::touch(Shard &shard, size_t hash) {
+  auto &sketch = shard.sketch;
+  if (sketch.empty()) {
+    auto n = m_shards.size();
+    auto max_count = size_t(std::max(0, m_max_count.load()));
+    auto max_bytes = m_max_bytes.load();
+    auto estimate = max_count ? max_count / n : max_bytes ? max_bytes / n / 256 : 1024;
+    size_t width = 64;
+    while (width < estimate && width < s_shared_cache_sketch_width_max) width <<= 1;
+    sketch.resize(width * 4);
+    shard.sketch_mask = width - 1;
+  }
+  auto width = shard.sketch_mask + 1;
+  auto x = mix_hash(hash);
+  for (int i = 0; i < 4; i++) {
+    auto &c = sketch[i * width + ((x >> (i * 16)) & shard.sketch_mask)];
+    if (c < 15) c++;
+  }
+  if (++shard.sketch_samples >= width * 10) {
+    for (auto &c : sketch) c >>= 1;
+    shard.sketch_samples /= 2;
+  }
+}
+
+//
+// Readers can't reorder the LRU chains or bump the sketch under a
+// shared lock, so they note what they looked up in a small per-shard
+// buffer instead. The buffer is drained by the next writer, or by the
+// reader that fills it up if the lock happens to be free. Reads beyond
+// a full buffer are not recorded, so recency and frequency are sampled
+// under heavy read load.
+//
+
+bool Cache::Shared::record_read(Shard &shard, Node *node, size_t hash) {
+  auto i = shard.read_count.fetch_add(1, std::memory_order_relaxed);
+  if (i < READ_BUFFER_SIZE) {
+    auto &r = shard.reads[i];
+    r.node = node;
+    r.hash = hash;
+  }
+  return i + 1 >= READ_BUFFER_SIZE;
+}
+
+void Cache::Shared::drain_reads(Shard &shard) {
+  auto n = std::min<size_t>(shard.read_count.load(std::memory_order_relaxed), READ_BUFFER_SIZE);
+  for (size_t i = 0; i < n; i++) {
+    const auto &r = shard.reads[i];
+    if (m_tiny_lfu) touch(shard, r.hash);
+    if (auto *node = r.node) {
+      auto &chain = *node->chain;
+      unlink(chain, node, &Node::lru);
+      link(chain, node, &Node::lru);
+    }
+  }
+  shard.read_count.store(0, std::memory_order_relaxed);
+}
+
+auto Cache::Shared::frequency(Shard &shard, size_t hash) -> int {
+  auto &sketch = shard.sketch;
+  if (sketch.empty()) return 0;
+  auto width = shard.sketch_mask + 1;
+  auto x = mix_hash(hash);
+  int f = 15;
+  for (int i = 0; i < 4; i++) {
+    f = std::min(f, int(sketch[i * width + ((x >> (i * 16)) & shard.sketch_mask)]));
+  }
+  return f;
+}
+
+void Cache::Shared::sweep(double now) {
+  auto now_tick = uint64_t(now / s_shared_cache_tick);
+  std::vector<Node*> expired;
+  for (auto &shard : m_shards) {
+    std::lock_guard<Lock> lock(shard.lock);
+    drain_reads(shard);
+    if (now_tick > shard.wheel_tick + s_shared_cache_wheel_size) {
+      shard.wheel_tick = now_tick - s_shared_cache_wheel_size;
+    }
+    while (shard.wheel_tick <= now_tick) {
+      auto &slot = shard.wheel[shard.wheel_tick % s_shared_cache_wheel_size];
+      for (auto *node = slot.head; node; ) {
+        auto *next = node->timer.next;
+        if (node->tick <= now_tick) {
+          detach(shard, node);
+          shard.map.erase(node->key);
+          shard.stats.expirations++;
+          expired.push_back(node);
+        }
+        node = next;
+      }
+      shard.wheel_tick++;
+    }
+  }
+  for (auto *node : expired) retire(node);
+}
+
+void Cache::Shared::link(Chain &chain, Node *node, Link Node::*link) {
+  auto &l = node->*link;
+  l.prev = chain.tail;
+  l.next = nullptr;
+  if (chain.tail) (chain.tail->*link).next = node; else chain.head = node;
+  chain.tail = node;
+  if (link == &Node::lru) {
+    node->chain = &chain;
+    chain.count++;
+    chain.bytes += node->size;
+  }
+}
+
+void Cache::Shared::unlink(Chain &chain, Node *node, Link Node::*link) {
+  auto &l = node->*link;
+  if (l.prev) (l.prev->*link).next = l.next; else chain.head = l.next;
+  if (l.next) (l.next->*link).prev = l.prev; else chain.tail = l.prev;
+  l.prev = l.next = nullptr;
+  if (link == &Node::lru) {
+    node->chain = nullptr;
+    chain.count--;
+    chain.bytes -= node->size;
+  }
+}
+
 //
 // Quota
 //
@@ -492,7 +1149,6 @@ void Quota::Counter::on_produce() {
 //
 
 URLRouter::URLRouter()
-  : m_root(new Node())
 {
 }
 
@@ -509,120 +1165,52 @@ URLRouter::URLRouter(pjs::Object *rules)
 }
 
 URLRouter::~URLRouter() {
-  delete m_root;
 }
 
 void URLRouter::add(const std::string &url, const pjs::Value &value) {
-  auto segs = utils::split(url, '/');
-  auto domain = segs.front();
-  segs.pop_front();
+  URLRouteTable::validate(url);
+  m_patterns.push_back(url);
+  m_values.push_back(value);
+  m_table = nullptr;
+}
 
-  if (segs.empty() || domain.find_first_of(':') != std::string::npos) {
-    throw std::runtime_error("invalid URL pattern");
-  }
+bool URLRouter::find(const std::string &url, pjs::Value &value, pjs::Object *params) {
+  if (!m_table) build();
 
-  auto node = m_root;
+  URLRouteTable::Params captures;
+  auto id = m_table->find(url, params ? &captures : nullptr);
+  if (id < 0) return false;
 
-  if (!domain.empty()) {
-    auto segs = utils::split(domain, '.');
-    for (const auto &seg : segs) {
-      node = node->new_child(seg);
+  value = m_values[id];
+  if (params) {
+    for (const auto &p : captures) {
+      params->set(p.first, pjs::Str::make(p.second));
     }
   }
-
-  node = node->new_child("/");
-
-  if (segs.back() == "*") {
-    for (const auto &seg : segs) {
-      if (!seg.empty()) {
-        node = node->new_child(seg);
-      }
-    }
-    node->value = value;
-  } else {
-    auto i = url.find_first_of('/');
-    node->new_child(url.substr(i))->value = value;
-  }
+  return true;
 }
 
-bool URLRouter::find(const std::string &url, pjs::Value &value) {
-  static const std::string s_slash("/");
-  static const std::string s_asterisk("*");
-
-  auto path_start = url.find_first_of('/');
-  if (path_start == std::string::npos) return false;
-
-  auto path_end = url.find_first_of('?', path_start);
-  if (path_end == std::string::npos) path_end = url.length();
-
-  auto domain_end = url.find_last_of(':', path_start);
-  if (domain_end == std::string::npos) domain_end = path_start;
-
-  std::function<Node*(Node*, int)> find_host, find_path;
-
-  find_host = [&](Node *node, int p) -> Node* {
-    auto i = p;
-    while (i < domain_end && url[i] != '.') i++;
-    auto s = url.substr(p, i - p);
-    node = node->child(s);
-    if (!node) return nullptr;
-    p = i + 1;
-    if (p <= domain_end) return find_host(node, p);
-    node = node->child(s_slash);
-    if (!node) return nullptr;
-    if (auto exact = node->child(url.substr(path_start, path_end - path_start))) {
-      return exact;
-    }
-    return find_path(node, path_start + 1);
-  };
-
-  find_path = [&](Node *node, int p) -> Node* {
-    auto i = p;
-    while (i < path_end && url[i] != '/') i++;
-    auto s = url.substr(p, i - p);
-    if (auto c = node->child(s)) {
-      p = i + 1;
-      c = p >= path_end ? c->child(s_asterisk) : find_path(c, p);
-      if (c) return c;
-    }
-    if (auto c = node->child(s_asterisk)) return c;
-    return nullptr;
-  };
+//
+// Routers created with the same patterns share the same table.
+// Only the values stay thread-local.
+//
 
-  auto node = find_host(m_root, 0);
-  if (!node) {
-    auto i = 0;
-    while (i < domain_end && url[i] != '.') i++;
-    if (i < domain_end) {
-      if (auto c = m_root->child(s_asterisk)) {
-        node = find_host(c, i + 1);
-      }
-    }
+void URLRouter::build() {
+  std::string key;
+  for (const auto &p : m_patterns) {
+    key += p;
+    key += '\n';
   }
-  if (!node) {
-    if (auto c = m_root->child(s_slash)) {
-      if (auto exact = c->child(url.substr(path_start, path_end - path_start))) {
-        node = exact;
-      } else {
-        node = find_path(c, path_start + 1);
+
+  m_table = SharedTable<URLRouteTable>::get(
+    key, [this]() {
+      URLRouteTable::Builder builder;
+      for (size_t i = 0; i < m_patterns.size(); i++) {
+        builder.add(m_patterns[i], i);
       }
+      return builder.build();
     }
-  }
-
-  if (node) {
-    value = node->value;
-    return true;
-  }
-
-  return false;
-}
-
-void URLRouter::dump(Node *node, int level) {
-  for (auto &i : node->children) {
-    std::cout << std::string(level * 2, ' ');
-    std::cout << i.first << std::endl;
-    dump(i.second, level + 1);
-  }
+  );
 }
 
 //
@@ -960,35 +1548,112 @@ HashingLoadBalancer::~HashingLoadBalancer()
 void HashingLoadBalancer::set(pjs::Object *targets) {
   if (targets) {
     m_targets.clear();
+    m_lookup_dirty = true;
     if (targets->is_array()) {
       targets->as<pjs::Array>()->iterate_all(
         [this](pjs::Value &v, int i) {
           auto s = v.to_string();
-          m_targets.push_back(s);
+          add(s);
           s->release();
         }
       );
     } else {
       targets->iterate_all(
-        [this](pjs::Str *k, pjs::Value &) {
-          m_targets.push_back(k);
+        [this](pjs::Str *k, pjs::Value &v) {
+          add(k, v.is_number() ? v.to_int32() : 1);
         }
       );
     }
   }
 }
 
-void HashingLoadBalancer::add(pjs::Str *target) {
-  m_targets.push_back(target);
+void HashingLoadBalancer::add(pjs::Str *target, int weight) {
+  m_lookup_dirty = true;
+  for (auto &t : m_targets) {
+    if (t.id == target) {
+      t.weight += weight;
+      return;
+    }
+  }
+  m_targets.push_back({ target, weight });
+}
+
+void HashingLoadBalancer::build_lookup() {
+  static const size_t s_sizes[] = {
+    16381, 32749, 65521, 131071, 262139, 524287, 1048573,
+  };
+
+  m_lookup_dirty = false;
+  m_lookup.clear();
+
+  // Sort by name so the table doesn't depend on the order targets were given
+  std::sort(
+    m_targets.begin(), m_targets.end(),
+    [](const Target &a, const Target &b) { return a.id->str() < b.id->str(); }
+  );
+
+  int max_weight = 0;
+  for (const auto &t : m_targets) max_weight = std::max(max_weight, t.weight);
+  if (max_weight <= 0) return;
+
+  // Table size should be well over 100 times the number of targets,
+  // and stays the same as long as the number of targets is small
+  size_t n = m_targets.size(), size = 0;
+  for (auto s : s_sizes) {
+    size = s;
+    if (s >= n * 100) break;
+  }
+
+  std::vector<uint64_t> offset(n), skip(n), next(n, 0);
+  std::vector<double> credit(n, 0);
+  std::hash<std::string> hash;
+  for (size_t i = 0; i < n; i++) {
+    auto h = hash(m_targets[i].id->str());
+    offset[i] = mix_hash(h) % size;
+    skip[i] = mix_hash(h ^ 0x5bd1e995) % (size - 1) + 1;
+  }
+
+  m_lookup.assign(size, -1);
+  size_t filled = 0;
+  while (filled < size) {
+    for (size_t i = 0; i < n && filled < size; i++) {
+      auto w = m_targets[i].weight;
+      if (w <= 0) continue;
+      credit[i] += double(w) / max_weight;
+      if (credit[i] < 1) continue;
+      credit[i] -= 1;
+      uint64_t c;
+      do {
+        c = (offset[i] + skip[i] * next[i]++) % size;
+      } while (m_lookup[c] >= 0);
+      m_lookup[c] = i;
+      filled++;
+    }
+  }
 }
 
 auto HashingLoadBalancer::select(const pjs::Value &key, Cache *unhealthy) -> pjs::Str* {
-  if (m_targets.empty()) return nullptr;
+  if (m_lookup_dirty) build_lookup();
+  if (m_lookup.empty()) return nullptr;
   std::hash<pjs::Value> hash;
-  auto h = hash(key);
-  auto s = m_targets[h % m_targets.size()].get();
-  if (s && !is_healthy(s, unhealthy)) return nullptr;
-  return s;
+  auto size = m_lookup.size();
+  auto slot = mix_hash(hash(key)) % size;
+  auto s = m_targets[m_lookup[slot]].id.get();
+  if (is_healthy(s, unhealthy)) return s;
+
+  // Probe the following slots for the next healthy target
+  auto &tried = m_tried;
+  tried.assign(m_targets.size(), false);
+  size_t tried_count = 0;
+  for (size_t i = 1; i < size; i++) {
+    auto t = m_lookup[(slot + i) % size];
+    if (tried[t]) continue;
+    auto s = m_targets[t].id.get();
+    if (is_healthy(s, unhealthy)) return s;
+    tried[t] = true;
+    if (++tried_count >= m_targets.size()) break;
+  }
+  return nullptr;
 }
 
 //
@@ -1336,6 +2001,9 @@ Percentile::Percentile(pjs::Array *buckets)
   buckets->iterate_all(
     [&](pjs::Value &v, int i) {
       auto limit = v.to_number();
+      if (std::isnan(limit) || (i > 0 && !(limit > last))) {
+        m_ascending = false;
+      }
       if (limit <= last) {
         Log::warn(
           "buckets are not in ascending order: changed from %f to %f at #%d",
@@ -1373,6 +2041,15 @@ void Percentile::set(int bucket, size_t count) {
 }
 
 void Percentile::observe(double sample) {
+  if (m_ascending) {
+    if (std::isnan(sample)) return;
+    auto i = std::lower_bound(m_buckets.begin(), m_buckets.end(), sample);
+    if (i != m_buckets.end()) {
+      m_counts[i - m_buckets.begin()]++;
+      m_sample_count++;
+    }
+    return;
+  }
   for (size_t i = 0, n = m_counts.size(); i < n; i++) {
     if (sample <= m_buckets[i]) {
       m_counts[i]++;
@@ -1416,12 +2093,22 @@ using namespace pipy::algo;
 // Cache
 //
 
+template<> void EnumDef<Cache::Policy>::init() {
+  define(Cache::Policy::LRU, "lru");
+  define(Cache::Policy::TINY_LFU, "tinylfu");
+}
+
 template<> void ClassDef<Cache>::init() {
   ctor([](Context &ctx) -> Object* {
     Function *allocate = nullptr, *free = nullptr;
     Object *options = nullptr;
     if (!ctx.arguments(0, &allocate, &free, &options)) return nullptr;
-    return Cache::make(options, allocate, free);
+    try {
+      return Cache::make(options, allocate, free);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
   });
 
   method("get", [](Context &ctx, Object *obj, Value &ret) {
@@ -1543,6 +2230,30 @@ template<> void ClassDef<URLRouter>::init() {
     }
     obj->as<URLRouter>()->find(url, ret);
   });
+
+  method("match", [](Context &ctx, Object *obj, Value &ret) {
+    std::string url;
+    for (int i = 0; i < ctx.argc(); i++) {
+      const auto &seg = ctx.arg(i);
+      if (!seg.is_nullish()) {
+        auto s = seg.to_string();
+        if (url.empty()) {
+          url = s->str();
+        } else {
+          url = pipy::utils::path_join(url, s->str());
+        }
+        s->release();
+      }
+    }
+    pjs::Value value;
+    pjs::Ref<pjs::Object> params = pjs::Object::make();
+    if (obj->as<URLRouter>()->find(url, value, params)) {
+      auto result = pjs::Object::make();
+      result->set("value", value);
+      result->set("params", params.get());
+      ret.set(result);
+    }
+  });
 }
 
 template<> void ClassDef<Constructor<URLRouter>>::init() {
@@ -1674,8 +2385,9 @@ template<> void ClassDef<HashingLoadBalancer>::init() {
 
   method("add", [](Context &ctx, Object *obj, Value &ret) {
     Str *target;
-    if (!ctx.arguments(1, &target)) return;
-    obj->as<HashingLoadBalancer>()->add(target);
+    int weight = 1;
+    if (!ctx.arguments(1, &target, &weight)) return;
+    obj->as<HashingLoadBalancer>()->add(target, weight);
   });
 }
 
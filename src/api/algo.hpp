@@ -31,13 +31,17 @@
 #include "net.hpp"
 #include "timer.hpp"
 #include "options.hpp"
+#include "url-router.hpp"
 
 #include <atomic>
+#include <functional>
 #include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <unordered_map>
+#include <vector>
 
 namespace pipy {
 namespace algo {
@@ -48,14 +52,164 @@ namespace algo {
 
 class Cache : public pjs::ObjectTemplate<Cache> {
 public:
+  enum class Policy {
+    LRU,
+    TINY_LFU,
+  };
+
   struct Options : public pipy::Options {
     int size = 0;
+    size_t memory_limit = 0;
     double ttl = 0;
+    pjs::Ref<pjs::Str> shared;
+    Policy policy = Policy::LRU;
 
     Options() {}
     Options(pjs::Object *options);
   };
 
+  //
+  // Cache::Shared
+  //
+  // A process-wide cache identified by name and visible to all worker
+  // threads. Entries are spread over independently locked shards and
+  // hold values as pjs::SharedValue. Lookups only take a shard's lock
+  // for reading. The recency and frequency updates they cause are
+  // buffered and applied later by whoever holds the lock for writing.
+  //
+
+  class Shared {
+  public:
+    struct Node;
+
+    struct Link {
+      Node* prev = nullptr;
+      Node* next = nullptr;
+    };
+
+    struct Chain {
+      Node* head = nullptr;
+      Node* tail = nullptr;
+      size_t count = 0;
+      size_t bytes = 0;
+    };
+
+    struct Node {
+      std::string key;
+      pjs::SharedValue value;
+      size_t size = 0;
+      size_t hash = 0;
+      double expiration = 0;
+      uint64_t tick = 0;
+      Chain* chain = nullptr;
+      Link lru;
+      Link timer;
+    };
+
+    struct Stats {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint64_t evictions = 0;
+      uint64_t expirations = 0;
+      size_t entries = 0;
+      size_t bytes = 0;
+    };
+
+    static auto get(const std::string &name, const Options &options) -> Shared*;
+    static void for_each(const std::function<void(Shared*)> &callback);
+    static void sweep_all();
+
+    auto name() const -> const std::string& { return m_name; }
+    bool get(const std::string &key, pjs::Value &value);
+    void set(const std::string &key, const pjs::Value &value, std::vector<Node*> &evicted);
+    auto remove(const std::string &key) -> Node*;
+    void clear(std::vector<Node*> &removed);
+    void stats(Stats &stats);
+    void listen_expired(bool listen);
+    void take_expired(std::vector<Node*> &expired);
+
+  private:
+    Shared(const std::string &name, const Options &options);
+
+    //
+    // Cache::Shared::Lock
+    //
+    // A reader-writer spin lock for the short critical sections of a
+    // shard. Waiting writers hold off new readers so they can't starve.
+    //
+
+    class Lock {
+    public:
+      void lock();
+      void unlock() { m_state.store(0, std::memory_order_release); }
+      bool try_lock();
+      void lock_shared();
+      void unlock_shared() { m_state.fetch_sub(1, std::memory_order_release); }
+
+    private:
+      std::atomic<int> m_state{0}; // -1 for a writer, or the number of readers
+      std::atomic<int> m_waiting_writers{0};
+    };
+
+    struct SharedLock {
+      Lock &lock;
+      SharedLock(Lock &l) : lock(l) { lock.lock_shared(); }
+      ~SharedLock() { lock.unlock_shared(); }
+    };
+
+    struct Read {
+      Node* node;
+      size_t hash;
+    };
+
+    enum { READ_BUFFER_SIZE = 64 };
+
+    struct Shard {
+      Lock lock;
+      std::unordered_map<std::string, Node*> map;
+      Read reads[READ_BUFFER_SIZE];
+      std::atomic<size_t> read_count{0};
+      std::atomic<uint64_t> hits{0};
+      std::atomic<uint64_t> misses{0};
+      Chain window;
+      Chain main;
+      std::vector<uint8_t> sketch;
+      size_t sketch_mask = 0;
+      size_t sketch_samples = 0;
+      std::vector<Chain> wheel;
+      uint64_t wheel_tick = 0;
+      Stats stats;
+    };
+
+    std::string m_name;
+    std::atomic<int> m_max_count;
+    std::atomic<size_t> m_max_bytes;
+    std::atomic<double> m_ttl;
+    std::atomic<bool> m_tiny_lfu;
+    std::vector<Shard> m_shards;
+
+    // Entries expired while some instance has an onFree callback, kept
+    // for a worker thread to hand over to the callback on its next access
+    std::mutex m_expired_mutex;
+    std::vector<Node*> m_expired;
+    std::atomic<int> m_expired_listeners;
+
+    bool matches(const Options &options) const;
+    void retire(Node *node);
+    auto shard_of(size_t hash) -> Shard&;
+    void admit(Shard &shard, Node *node, std::vector<Node*> &evicted);
+    void evict(Shard &shard, Node *node, std::vector<Node*> &evicted);
+    void detach(Shard &shard, Node *node);
+    void touch(Shard &shard, size_t hash);
+    bool record_read(Shard &shard, Node *node, size_t hash);
+    void drain_reads(Shard &shard);
+    auto frequency(Shard &shard, size_t hash) -> int;
+    void sweep(double now);
+
+    static void link(Chain &chain, Node *node, Link Node::*link);
+    static void unlink(Chain &chain, Node *node, Link Node::*link);
+  };
+
   bool get(pjs::Context &ctx, const pjs::Value &key, pjs::Value &value);
   void set(pjs::Context &ctx, const pjs::Value &key, const pjs::Value &value);
   bool get(const pjs::Value &key, pjs::Value &value);
@@ -78,6 +232,7 @@ private:
   pjs::Ref<pjs::Function> m_allocate;
   pjs::Ref<pjs::Function> m_free;
   pjs::Ref<pjs::OrderedHash<pjs::Value, Entry>> m_cache;
+  Shared* m_shared = nullptr;
 
   bool get(
     const pjs::Value &key, pjs::Value &value,
@@ -89,6 +244,10 @@ private:
     const std::function<bool(const pjs::Value &, const pjs::Value &)> &free
   );
 
+  bool shared_key(pjs::Context &ctx, const pjs::Value &key, std::string &str);
+  void shared_free(pjs::Context &ctx, std::vector<Shared::Node*> &nodes);
+  void shared_free_expired(pjs::Context &ctx);
+
   friend class pjs::ObjectTemplate<Cache>;
 };
 
@@ -247,38 +406,18 @@ private:
 class URLRouter : public pjs::ObjectTemplate<URLRouter> {
 public:
   void add(const std::string &url, const pjs::Value &value);
-  bool find(const std::string &url, pjs::Value &value);
+  bool find(const std::string &url, pjs::Value &value, pjs::Object *params = nullptr);
 
 private:
   URLRouter();
   URLRouter(pjs::Object *rules);
   ~URLRouter();
 
-  struct Node {
-    std::map<std::string, Node*> children;
-    pjs::Value value;
-
-    auto child(const std::string &name) -> Node* {
-      auto i = children.find(name);
-      return i == children.end() ? nullptr : i->second;
-    }
-
-    auto new_child(const std::string &name) -> Node* {
-      auto i = children.find(name);
-      if (i != children.end()) return i->second;
-      return children[name] = new Node;
-    }
-
-    ~Node() {
-      for (auto &i : children) {
-        delete i.second;
-      }
-    }
-  };
+  std::vector<std::string> m_patterns;
+  std::vector<pjs::Value> m_values;
+  std::shared_ptr<const URLRouteTable> m_table;
 
-  Node* m_root;
-
-  void dump(Node *node, int level);
+  void build();
 
   friend class pjs::ObjectTemplate<URLRouter>;
 };
@@ -478,7 +617,7 @@ private:
 class HashingLoadBalancer : public pjs::ObjectTemplate<HashingLoadBalancer, LoadBalancerBase> {
 public:
   void set(pjs::Object *targets);
-  void add(pjs::Str *target);
+  void add(pjs::Str *target, int weight = 1);
 
   virtual auto select(const pjs::Value &key, Cache *unhealthy) -> pjs::Str* override;
   virtual void deselect(pjs::Str *target) override {}
@@ -487,7 +626,19 @@ private:
   HashingLoadBalancer(pjs::Object *targets, Cache *unhealthy = nullptr);
   ~HashingLoadBalancer();
 
-  std::vector<pjs::Ref<pjs::Str>> m_targets;
+  struct Target {
+    pjs::Ref<pjs::Str> id;
+    int weight;
+  };
+
+  // Keys are looked up in a Maglev table, so that changing the
+  // target set only moves keys to or from the targets that changed
+  std::vector<Target> m_targets;
+  std::vector<int> m_lookup;
+  std::vector<bool> m_tried;
+  bool m_lookup_dirty = true;
+
+  void build_lookup();
 
   friend class pjs::ObjectTemplate<HashingLoadBalancer, LoadBalancerBase>;
 };
@@ -573,6 +724,7 @@ private:
   std::vector<size_t> m_counts;
   std::vector<double> m_buckets;
   size_t m_sample_count;
+  bool m_ascending = true;
 
   friend class pjs::ObjectTemplate<Percentile>;
 };
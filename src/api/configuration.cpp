@@ -38,6 +38,7 @@
 // all filters
 #include "filters/bgp.hpp"
 #include "filters/branch.hpp"
+#include "filters/cache.hpp"
 #include "filters/chain.hpp"
 #include "filters/connect.hpp"
 #include "filters/compress.hpp"
@@ -138,6 +139,10 @@ void FilterConfigurator::branch_message(int count, pjs::Function **conds, const
   append_filter(new BranchMessage(count, conds, layouts));
 }
 
+void FilterConfigurator::cache_http(pjs::Object *options) {
+  require_sub_pipeline(append_filter(new CacheHTTP(options)));
+}
+
 void FilterConfigurator::chain(const std::list<JSModule*> modules) {
   append_filter(new Chain(modules));
 }
@@ -146,12 +151,12 @@ void FilterConfigurator::chain_next() {
   append_filter(new ChainNext());
 }
 
-void FilterConfigurator::compress(const pjs::Value &algorithm) {
-  append_filter(new Compress(algorithm));
+void FilterConfigurator::compress(const pjs::Value &algorithm, pjs::Object *options) {
+  append_filter(new Compress(algorithm, options));
 }
 
-void FilterConfigurator::compress_http(const pjs::Value &algorithm) {
-  append_filter(new CompressHTTP(algorithm));
+void FilterConfigurator::compress_http(const pjs::Value &algorithm, pjs::Object *options) {
+  append_filter(new CompressHTTP(algorithm, options));
 }
 
 void FilterConfigurator::connect(const pjs::Value &target, pjs::Object *options) {
@@ -1159,6 +1164,24 @@ template<> void ClassDef<FilterConfigurator>::init() {
     }
   });
 
+  // FilterConfigurator.cacheHTTP
+  method("cacheHTTP", [](Context &ctx, Object *thiz, Value &result) {
+    auto config = thiz->as<FilterConfigurator>()->trace_location(ctx);
+    try {
+      Str *layout;
+      Object *options = nullptr;
+      if (ctx.try_arguments(1, &layout, &options)) {
+        config->cache_http(options);
+        config->to(layout);
+      } else if (ctx.arguments(0, &options)) {
+        config->cache_http(options);
+      }
+      result.set(thiz);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+    }
+  });
+
   // FilterConfigurator.chain
   method("chain", [](Context &ctx, Object *thiz, Value &result) {
     auto config = thiz->as<FilterConfigurator>()->trace_location(ctx);
@@ -1206,9 +1229,10 @@ template<> void ClassDef<FilterConfigurator>::init() {
   method("compress", [](Context &ctx, Object *thiz, Value &result) {
     auto config = thiz->as<FilterConfigurator>()->trace_location(ctx);
     Value algorithm;
-    if (!ctx.arguments(1, &algorithm)) return;
+    Object *options = nullptr;
+    if (!ctx.arguments(1, &algorithm, &options)) return;
     try {
-      config->compress(algorithm);
+      config->compress(algorithm, options);
       result.set(thiz);
     } catch (std::runtime_error &err) {
       ctx.error(err);
@@ -1219,9 +1243,10 @@ template<> void ClassDef<FilterConfigurator>::init() {
   method("compressHTTP", [](Context &ctx, Object *thiz, Value &result) {
     auto config = thiz->as<FilterConfigurator>()->trace_location(ctx);
     Value algorithm;
-    if (!ctx.arguments(1, &algorithm)) return;
+    Object *options = nullptr;
+    if (!ctx.arguments(1, &algorithm, &options)) return;
     try {
-      config->compress_http(algorithm);
+      config->compress_http(algorithm, options);
       result.set(thiz);
     } catch (std::runtime_error &err) {
       ctx.error(err);
@@ -27,6 +27,7 @@
 
 #include "dns.hpp"
 #include "net.hpp"
+#include "resolver.hpp"
 
 namespace pipy {
 
@@ -896,43 +897,6 @@ static int dns_encode(pjs::Object *dns, Data::Builder &db) {
   return skip;
 }
 
-//
-// DNSResolver
-//
-
-class DNSResolver : public pjs::Pooled<DNSResolver> {
-public:
-  DNSResolver(const std::string &hostname, const std::function<void(pjs::Array*)> &cb)
-    : m_resolver(Net::context())
-    , m_cb(cb)
-  {
-    m_resolver.async_resolve(
-      hostname, std::string(),
-      [this](
-        const std::error_code &ec,
-        asio::ip::icmp::resolver::results_type results
-      ) {
-        if (ec) {
-          m_cb(nullptr);
-        } else {
-          auto a = pjs::Array::make(results.size());
-          int i = 0;
-          for (const auto &result : results) {
-            pjs::Value v(result.endpoint().address().to_string());
-            a->set(i++, v);
-          }
-          m_cb(a);
-        }
-        delete this;
-      }
-    );
-  }
-
-private:
-  asio::ip::icmp::resolver m_resolver;
-  std::function<void(pjs::Array*)> m_cb;
-};
-
 //
 // DNS
 //
@@ -956,7 +920,20 @@ void DNS::encode(pjs::Object *dns, Data::Builder &db) {
 }
 
 void DNS::resolve(const std::string &hostname, const std::function<void(pjs::Array*)> &cb) {
-  new DNSResolver(hostname, cb);
+  Resolver::resolve(
+    hostname,
+    [=](const Resolver::Addresses &addresses, const char *error) {
+      if (error) {
+        cb(nullptr);
+      } else {
+        auto a = pjs::Array::make(addresses.size());
+        for (size_t i = 0; i < addresses.size(); i++) {
+          a->set(i, pjs::Str::make(addresses[i].to_string()));
+        }
+        cb(a);
+      }
+    }
+  );
 }
 
 } // namespace pipy
@@ -32,6 +32,10 @@
 #include "compressor.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
 namespace pipy {
 namespace http {
 
@@ -62,6 +66,7 @@ thread_local static const pjs::ConstStr s_content_type("content-type");
 thread_local static const pjs::ConstStr s_application_octet_stream("application/octet-stream");
 thread_local static const pjs::ConstStr s_gzip("gzip");
 thread_local static const pjs::ConstStr s_br("br");
+thread_local static const pjs::ConstStr s_zstd("zstd");
 
 static const std::map<std::string, std::string> s_default_content_types = {
   { "html"  , "text/html" },
@@ -79,6 +84,70 @@ static const std::map<std::string, std::string> s_default_content_types = {
   { "json"  , "application/json" },
 };
 
+auto MessageHead::header_names() -> pjs::Object* {
+  if (m_has_raw_header_names) {
+    auto names = pjs::Object::make();
+    const auto &raw = m_raw_header_names;
+    size_t i = 0, n = raw.length();
+    std::string lower;
+    while (i < n) {
+      auto j = raw.find('\n', i);
+      if (j == std::string::npos) j = n;
+      lower.resize(j - i);
+      for (size_t k = i; k < j; k++) lower[k - i] = std::tolower(raw[k]);
+      pjs::Ref<pjs::Str> key(pjs::Str::make(lower));
+      names->set(key, pjs::Str::make(raw.c_str() + i, j - i));
+      i = j + 1;
+    }
+    m_header_names = names;
+    m_raw_header_names.clear();
+    m_has_raw_header_names = false;
+  }
+  return m_header_names;
+}
+
+void MessageHead::header_names(pjs::Object *names) {
+  m_header_names = names;
+  m_raw_header_names.clear();
+  m_has_raw_header_names = false;
+}
+
+void MessageHead::header_names(std::string &&raw_names) {
+  m_header_names = nullptr;
+  m_raw_header_names = std::move(raw_names);
+  m_has_raw_header_names = true;
+}
+
+auto MessageHead::header_name(pjs::Str *key, size_t &hint, size_t &len) const -> const char* {
+  if (m_has_raw_header_names) {
+    const auto &raw = m_raw_header_names;
+    auto n = raw.length();
+    auto size = key->size();
+    if (hint > n) hint = 0;
+    for (size_t pass = 0; pass < 2; pass++) {
+      auto i = pass ? 0 : hint;
+      auto end = pass ? hint : n;
+      while (i < end) {
+        auto j = raw.find('\n', i);
+        if (j == std::string::npos) j = n;
+        if (j - i == size && utils::iequals(raw.c_str() + i, key->c_str(), size)) {
+          hint = j + 1;
+          len = size;
+          return raw.c_str() + i;
+        }
+        i = j + 1;
+      }
+    }
+  } else if (auto names = m_header_names.get()) {
+    pjs::Value v;
+    if (names->get(key, v) && v.is_string()) {
+      len = v.s()->size();
+      return v.s()->c_str();
+    }
+  }
+  return nullptr;
+}
+
 bool MessageHead::is_final() const {
   pjs::Value v;
   if (headers && headers->get(s_connection, v)) {
@@ -388,6 +457,9 @@ Directory::Options::Options(pjs::Object *options) {
   Value(options, "compression")
     .get(compression_f)
     .check_nullable();
+  Value(options, "compressionLevel")
+    .get(compression_level)
+    .check_nullable();
 }
 
 //
@@ -468,7 +540,7 @@ auto Directory::serve(pjs::Context &ctx, Message *request) -> Message* {
   auto k = path;
   auto i = m_cache.find(k);
   if (i == m_cache.end()) {
-    Data raw, gz, br;
+    Data raw, gz, br, zst;
     if (!m_loader->load_file(path, raw)) {
       if (path.empty() || path.back() != '/') path += '/';
       bool found = false;
@@ -484,12 +556,14 @@ auto Directory::serve(pjs::Context &ctx, Message *request) -> Message* {
     }
     m_loader->load_file(path + ".gz", gz);
     m_loader->load_file(path + ".br", br);
+    m_loader->load_file(path + ".zst", zst);
 
     auto &f = m_cache[k];
     f.pathname = pjs::Str::make(path);
     f.raw = std::move(raw);
     f.gz = std::move(gz);
     f.br = std::move(br);
+    f.zst = std::move(zst);
 
     std::string ext;
     auto p = path.find('.', path.rfind('/'));
@@ -539,84 +613,140 @@ void Directory::set_content_types(pjs::Object *obj) {
   }
 }
 
+//
+// Picks up the q-values of the encodings we can serve from an
+// Accept-Encoding header. Encodings not mentioned get the q-value of
+// "*" if present, or 0 otherwise.
+//
+
+static void parse_accept_encoding(const std::string &s, double &q_gz, double &q_br, double &q_zstd) {
+  double q_any = -1;
+  q_gz = q_br = q_zstd = -1;
+  size_t i = 0;
+  while (i < s.length()) {
+    auto j = s.find(',', i);
+    if (j == std::string::npos) j = s.length();
+    auto k = i; while (k < j && std::isblank((unsigned char)s[k])) k++;
+    auto n = 0; while (k + n < j && (std::isalpha((unsigned char)s[k+n]) || s[k+n] == '*')) n++;
+    double q = 1;
+    auto p = s.find(';', k + n);
+    if (p < j) {
+      p++; while (p < j && std::isblank((unsigned char)s[p])) p++;
+      if (p + 1 < j && (s[p] == 'q' || s[p] == 'Q') && s[p+1] == '=') q = std::atof(s.c_str() + p + 2);
+    }
+    if (n == 4 && utils::iequals(&s[k], "gzip", n)) q_gz = q;
+    else if (n == 2 && utils::iequals(&s[k], "br", n)) q_br = q;
+    else if (n == 4 && utils::iequals(&s[k], "zstd", n)) q_zstd = q;
+    else if (n == 1 && s[k] == '*') q_any = q;
+    i = j + 1;
+  }
+  if (q_gz < 0) q_gz = std::max(0.0, q_any);
+  if (q_br < 0) q_br = std::max(0.0, q_any);
+  if (q_zstd < 0) q_zstd = std::max(0.0, q_any);
+}
+
+//
+// Encodings are chosen by the client's q-values, with ties going to
+// br, then gzip, then zstd. When there is a compression callback, it
+// has the final say, and the encoding it picks is served from the
+// precompressed file if there is one, or compressed on the fly.
+// Results of compressing on the fly are kept in CompressionCache, not
+// in the file, so they never pass for precompressed files.
+//
+
 auto Directory::get_encoded_response(pjs::Context &ctx, File &file, RequestHead *request) -> Message* {
-  bool has_gz = false;
-  bool has_br = false;
+  struct Encoding {
+    pjs::Str* name;
+    Compressor::Algorithm algorithm;
+    const Data* precompressed;
+    double q;
+  };
+
+  Encoding encodings[] = {
+    { s_br, Compressor::Algorithm::BROTLI, &file.br, 0 },
+    { s_gzip, Compressor::Algorithm::GZIP, &file.gz, 0 },
+    { s_zstd, Compressor::Algorithm::ZSTD, &file.zst, 0 },
+  };
 
   pjs::Value accept_encoding;
   if (auto headers = request->headers.get()) {
     headers->get(s_accept_encoding.get(), accept_encoding);
   }
   if (accept_encoding.is_string()) {
-    auto &s = accept_encoding.s()->str();
-    for (size_t i = 0; i < s.length(); i++) {
-      while (i < s.length() && std::isblank(s[i])) i++;
-      if (i < s.length()) {
-        auto n = 0; while (std::isalpha(s[i+n])) n++;
-        if (n == 4 && utils::iequals(&s[i], "gzip", n)) has_gz = true;
-        else if (n == 2 && utils::iequals(&s[i], "br", n)) has_br = true;
-        i += n;
-        while (i < s.length() && s[i] != ',') i++;
-      }
-    }
+    parse_accept_encoding(
+      accept_encoding.s()->str(),
+      encodings[1].q, encodings[0].q, encodings[2].q
+    );
   }
 
-  Message *response = nullptr;
+  std::stable_sort(
+    std::begin(encodings), std::end(encodings),
+    [](const Encoding &a, const Encoding &b) { return a.q > b.q; }
+  );
+
   auto head = ResponseHead::make();
   auto headers = Object::make();
   head->headers = headers;
   headers->set(s_content_type.get(), file.content_type.get());
 
-  if (has_br && !file.br.empty()) {
-    headers->set(s_content_encoding.get(), s_br.get());
-    response = Message::make(head, Data::make(file.br));
+  const Encoding *chosen = nullptr;
 
-  } else if (has_gz && !file.gz.empty()) {
-    headers->set(s_content_encoding.get(), s_gzip.get());
-    response = Message::make(head, Data::make(file.gz));
-
-  } else {
-    Data *body = nullptr;
-    Compressor *compressor = nullptr;
-    auto output = [&](const Data &data) { body->push(data); };
-
-    if ((has_gz || has_br) && m_options.compression_f) {
-      auto accept_encoding = pjs::Object::make();
-      if (has_gz) accept_encoding->set(s_gzip, true);
-      if (has_br) accept_encoding->set(s_br, true);
+  if (auto *cb = m_options.compression_f.get()) {
+    if (encodings[0].q > 0) {
+      auto accepted = pjs::Object::make();
+      for (const auto &e : encodings) {
+        if (e.q > 0) accepted->set(e.name, e.q);
+      }
       pjs::Value args[4], ret;
       args[0].set(request);
-      args[1].set(accept_encoding);
+      args[1].set(accepted);
       args[2].set(file.pathname.get());
       args[3].set(file.raw.size());
-      (*m_options.compression_f)(ctx, 4, args, ret);
+      (*cb)(ctx, 4, args, ret);
       if (!ctx.ok()) return nullptr;
       if (ret.to_boolean()) {
         if (!ret.is_string()) {
           ctx.error("callback expected to return a string");
           return nullptr;
         }
-        if (ret.s() == s_gzip) {
-          compressor = Compressor::gzip(output);
-          body = &file.gz;
-          headers->set(s_content_encoding.get(), s_gzip.get());
-        } else {
+        if (ret.s() != s_gzip && ret.s() != s_br && ret.s() != s_zstd) {
           ctx.error("callback returned an unsupported compression algorithm");
           return nullptr;
         }
+        for (const auto &e : encodings) {
+          if (e.q > 0 && e.name == ret.s()) {
+            chosen = &e;
+            break;
+          }
+        }
       }
     }
+  } else {
+    for (const auto &e : encodings) {
+      if (e.q > 0 && !e.precompressed->empty()) {
+        chosen = &e;
+        break;
+      }
+    }
+  }
 
-    if (compressor) {
-      compressor->input(file.raw, true);
-      compressor->finalize();
-      response = Message::make(head, Data::make(*body));
-    } else {
-      response = Message::make(head, Data::make(file.raw));
+  if (chosen) {
+    if (!chosen->precompressed->empty()) {
+      headers->set(s_content_encoding.get(), chosen->name);
+      return Message::make(head, Data::make(*chosen->precompressed));
+    }
+
+    // Identical content is compressed only once across all threads
+    // and directories
+    Data body;
+    Compressor::Params params(m_options.compression_level);
+    if (CompressionCache::get(chosen->algorithm, params, file.raw, body)) {
+      headers->set(s_content_encoding.get(), chosen->name);
+      return Message::make(head, Data::make(std::move(body)));
     }
   }
 
-  return response;
+  return Message::make(head, Data::make(file.raw));
 }
 
 //
@@ -872,7 +1002,11 @@ template<> void EnumDef<StringConstants>::init() {
 template<> void ClassDef<MessageHead>::init() {
   field<Ref<Str>>("protocol", [](MessageHead *obj) { return &obj->protocol; });
   field<Ref<Object>>("headers", [](MessageHead *obj) { return &obj->headers; });
-  field<Ref<Object>>("headerNames", [](MessageHead *obj) { return &obj->headerNames; });
+  accessor("headerNames",
+    [](Object *obj, Value &ret) { ret.set(obj->as<MessageHead>()->header_names()); },
+    [](Object *obj, const Value &val) { obj->as<MessageHead>()->header_names(val.is_object() ? val.o() : nullptr); },
+    Field::Enumerable
+  );
 }
 
 template<> void ClassDef<MessageTail>::init() {
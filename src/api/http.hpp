@@ -54,10 +54,22 @@ class MessageHead : public pjs::ObjectTemplate<MessageHead> {
 public:
   pjs::Ref<pjs::Str> protocol;
   pjs::Ref<pjs::Object> headers;
-  pjs::Ref<pjs::Object> headerNames;
+
+  auto header_names() -> pjs::Object*;
+  void header_names(pjs::Object *names);
+  void header_names(std::string &&raw_names);
+  auto header_name(pjs::Str *key, size_t &hint, size_t &len) const -> const char*;
 
   bool is_final() const;
   bool is_final(pjs::Str *header_connection) const;
+
+private:
+
+  // Original spellings of header names from a decoder, one per line,
+  // only turned into the headerNames object when something reads it
+  pjs::Ref<pjs::Object> m_header_names;
+  std::string m_raw_header_names;
+  bool m_has_raw_header_names = false;
 };
 
 class MessageTail : public pjs::ObjectTemplate<MessageTail> {
@@ -182,6 +194,7 @@ public:
     pjs::Ref<pjs::Function> content_types_f;
     pjs::Ref<pjs::Str> default_content_type;
     pjs::Ref<pjs::Function> compression_f;
+    int compression_level = -1;
     Options() {}
     Options(pjs::Object *options);
   };
@@ -197,7 +210,7 @@ private:
   struct File {
     pjs::Ref<pjs::Str> pathname;
     pjs::Ref<pjs::Str> content_type;
-    Data raw, gz, br;
+    Data raw, gz, br, zst;
   };
 
   class Loader {
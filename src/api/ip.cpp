@@ -24,6 +24,9 @@
  */
 
 #include "ip.hpp"
+#include "codebase.hpp"
+#include "data.hpp"
+#include "shared-table.hpp"
 #include "utils.hpp"
 
 #include <cmath>
@@ -435,6 +438,135 @@ void IPMask::init_mask() {
   }
 }
 
+//
+// IPMap
+//
+
+IPMap::IPMap(pjs::Object *entries) {
+  if (!entries) return;
+  if (entries->is_array()) {
+    entries->as<pjs::Array>()->iterate_all(
+      [this](pjs::Value &v, int) {
+        auto *s = v.to_string();
+        add(s->str(), true);
+        s->release();
+      }
+    );
+  } else {
+    entries->iterate_all(
+      [this](pjs::Str *k, pjs::Value &v) {
+        add(k->str(), v);
+      }
+    );
+  }
+}
+
+//
+// Each line in the file has a CIDR optionally followed by a value
+// separated by whitespaces. Entries without a value are mapped to true.
+// Comments start with '#'.
+//
+
+auto IPMap::load(const std::string &filename) -> IPMap* {
+  auto path = utils::path_normalize(filename);
+  auto *sd = Codebase::current()->get(path);
+  if (!sd) throw std::runtime_error("file not found: " + filename);
+
+  Data data;
+  sd->to_data(data);
+  sd->release();
+
+  auto text = data.to_string();
+  auto *map = IPMap::make();
+  pjs::Ref<IPMap> ref(map);
+
+  size_t i = 0, line = 0;
+  while (i < text.length()) {
+    auto j = text.find('\n', i);
+    if (j == std::string::npos) j = text.length();
+    auto str = text.substr(i, j - i);
+    i = j + 1;
+    line++;
+
+    auto p = str.find('#');
+    if (p != std::string::npos) str.erase(p);
+    str = utils::trim(str);
+    if (str.empty()) continue;
+
+    p = str.find_first_of(" \t");
+    try {
+      if (p == std::string::npos) {
+        map->add(str, true);
+      } else {
+        map->add(str.substr(0, p), pjs::Str::make(utils::trim(str.substr(p))));
+      }
+    } catch (std::runtime_error &err) {
+      throw std::runtime_error(filename + ":" + std::to_string(line) + ": " + err.what());
+    }
+  }
+
+  return ref.release();
+}
+
+void IPMap::add(const std::string &cidr, const pjs::Value &value) {
+  IPPrefixTable::Prefix prefix;
+  if (!IPPrefixTable::Prefix::parse(cidr, prefix)) {
+    throw std::runtime_error("invalid CIDR notation: " + cidr);
+  }
+  m_prefixes.push_back(prefix);
+  m_values.push_back(value);
+  m_table = nullptr;
+}
+
+bool IPMap::find(const std::string &addr, pjs::Value &value) {
+  if (!m_table) build();
+  auto id = m_table->find(addr);
+  if (id < 0) return false;
+  value = m_values[id];
+  return true;
+}
+
+bool IPMap::find(IP *ip, pjs::Value &value) {
+  if (!m_table) build();
+  uint8_t ipv4[4];
+  uint16_t ipv6[8];
+  int id;
+  if (ip->data().decompose_v4(ipv4)) {
+    id = m_table->find_v4(ipv4);
+  } else {
+    ip->data().decompose_v6(ipv6);
+    id = m_table->find_v6(ipv6);
+  }
+  if (id < 0) return false;
+  value = m_values[id];
+  return true;
+}
+
+//
+// Maps built from the same prefixes share the same table.
+// Only the values stay thread-local.
+//
+
+void IPMap::build() {
+  std::string key;
+  key.reserve(m_prefixes.size() * 17);
+  for (const auto &p : m_prefixes) {
+    key.append((const char *)&p.hi, sizeof(p.hi));
+    key.append((const char *)&p.lo, sizeof(p.lo));
+    key += char(p.is_v6 ? 128 + p.length : p.length);
+  }
+
+  m_table = SharedTable<IPPrefixTable>::get(
+    key, [this]() {
+      IPPrefixTable::Builder builder;
+      for (size_t i = 0; i < m_prefixes.size(); i++) {
+        builder.add(m_prefixes[i], i);
+      }
+      return builder.build();
+    }
+  );
+}
+
 //
 // IPEndpoint
 //
@@ -580,6 +712,68 @@ template<> void ClassDef<Constructor<IPMask>>::init() {
   ctor();
 }
 
+//
+// IPMap
+//
+
+template<> void ClassDef<IPMap>::init() {
+  ctor([](Context &ctx) -> Object* {
+    Object *entries = nullptr;
+    if (!ctx.arguments(0, &entries)) return nullptr;
+    try {
+      return IPMap::make(entries);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
+  });
+
+  method("add", [](Context &ctx, Object *obj, Value &ret) {
+    Str *cidr;
+    IPMask *mask;
+    Value value(true);
+    if (ctx.argc() > 1) value = ctx.arg(1);
+    try {
+      if (ctx.get(0, cidr)) {
+        obj->as<IPMap>()->add(cidr->str(), value);
+      } else if (ctx.get(0, mask)) {
+        obj->as<IPMap>()->add(mask->to_string(), value);
+      } else {
+        ctx.error_argument_type(0, "a string or an IPMask");
+      }
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+    }
+  });
+
+  method("find", [](Context &ctx, Object *obj, Value &ret) {
+    Str *addr;
+    IP *ip;
+    if (ctx.get(0, addr)) {
+      obj->as<IPMap>()->find(addr->str(), ret);
+    } else if (ctx.get(0, ip)) {
+      obj->as<IPMap>()->find(ip, ret);
+    } else {
+      ctx.error_argument_type(0, "a string or an IP");
+    }
+  });
+}
+
+template<> void ClassDef<Constructor<IPMap>>::init() {
+  super<Function>();
+  ctor();
+
+  method("load", [](Context &ctx, Object*, Value &ret) {
+    std::string filename;
+    if (!ctx.arguments(1, &filename)) return;
+    try {
+      ret.set(IPMap::load(filename));
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+    }
+  });
+}
+
 //
 // IPEndpoint
 //
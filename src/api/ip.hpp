@@ -27,6 +27,9 @@
 #define NETMASK_HPP
 
 #include "pjs/pjs.hpp"
+#include "ip-table.hpp"
+
+#include <memory>
 
 namespace pipy {
 
@@ -139,6 +142,30 @@ private:
   friend class pjs::ObjectTemplate<IPMask>;
 };
 
+//
+// IPMap
+//
+
+class IPMap : public pjs::ObjectTemplate<IPMap> {
+public:
+  static auto load(const std::string &filename) -> IPMap*;
+
+  void add(const std::string &cidr, const pjs::Value &value);
+  bool find(const std::string &addr, pjs::Value &value);
+  bool find(IP *ip, pjs::Value &value);
+
+private:
+  IPMap(pjs::Object *entries = nullptr);
+
+  std::vector<IPPrefixTable::Prefix> m_prefixes;
+  std::vector<pjs::Value> m_values;
+  std::shared_ptr<const IPPrefixTable> m_table;
+
+  void build();
+
+  friend class pjs::ObjectTemplate<IPMap>;
+};
+
 //
 // IPEndpoint
 //
@@ -40,10 +40,25 @@
 #include "filters/mux.hpp"
 #include "filters/http.hpp"
 #include "filters/connect.hpp"
+#include "spsc-queue.hpp"
+#include "log.hpp"
 
-#ifndef _WIN32
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <thread>
+
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
 #include <unistd.h>
 #include <syslog.h>
+#include <sys/uio.h>
 #endif
 
 namespace pipy {
@@ -301,70 +316,493 @@ void Logger::StdoutTarget::write(const Data &msg) {
 }
 
 //
-// Logger::FileTarget
+// Logger::FileTarget::Options
 //
 
-void Logger::FileTarget::close_all_writers() {
-  s_all_writers.clear();
+Logger::FileTarget::Options::Options(pjs::Object *options) {
+  Value(options, "maxFileSize")
+    .get_binary_size(max_file_size)
+    .check_nullable();
+  Value(options, "maxFileAge")
+    .get_seconds(max_file_age)
+    .check_nullable();
+  Value(options, "maxFiles")
+    .get(max_files)
+    .check_nullable();
+  Value(options, "gzip")
+    .get(gzip)
+    .check_nullable();
+  Value(options, "bufferLimit")
+    .get_binary_size(buffer_limit)
+    .check_nullable();
+  Value(options, "overflow")
+    .get_enum(overflow)
+    .check_nullable();
 }
 
-Logger::FileTarget::FileTarget(pjs::Str *filename)
-  : m_filename(pjs::Str::make(fs::abs_path(filename->str())))
-{
+//
+// Logger::FileTarget::Record
+//
+
+struct Logger::FileTarget::Record {
+  Writer* writer;
+  size_t size;
+  char data[1];
+
+  static auto make(Writer *writer, const Data &msg) -> Record* {
+    auto size = msg.size() + 1;
+    auto r = (Record*)std::malloc(sizeof(Record) + size);
+    r->writer = writer;
+    r->size = size;
+    msg.to_bytes((uint8_t*)r->data);
+    r->data[size - 1] = '\n';
+    return r;
+  }
+
+  void free() { std::free(this); }
+};
+
+//
+// Logger::FileTarget::IOThread
+//
+// Worker threads push records into their own lock-free queue, which
+// the I/O thread drains every few milliseconds, coalescing records
+// into one writev() per file. Rotated files are compressed and
+// removed by a second thread so that gzip never stalls the writing.
+//
+
+class Logger::FileTarget::IOThread {
+public:
+  enum {
+    FLUSH_INTERVAL = 5,
+    MAX_BATCH = 1024,
+  };
+
+  struct Job {
+    std::string compress;
+    std::string remove;
+  };
+
+  static auto get() -> IOThread& {
+    static IOThread s_io_thread;
+    return s_io_thread;
+  }
+
+  ~IOThread() {
+    shutdown();
+  }
+
+  void post(Record *r) {
+    thread_local static SPSCQueue<Record*>* s_queue = nullptr;
+    if (!s_queue) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_queues.emplace_back(new SPSCQueue<Record*>);
+      s_queue = m_queues.back().get();
+      if (!m_thread.joinable()) {
+        m_thread = std::thread([this]() { main(); });
+      }
+    }
+    s_queue->push(r);
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_space_cv.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL));
+  }
+
+  void schedule(Job &&job) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(std::move(job));
+    if (!m_job_thread.joinable()) {
+      m_job_thread = std::thread([this]() { run_jobs(); });
+    }
+    m_job_cv.notify_one();
+  }
+
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+      m_cv.notify_one();
+    }
+    if (m_thread.joinable()) m_thread.join();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_job_cv.notify_one();
+    }
+    if (m_job_thread.joinable()) m_job_thread.join();
+  }
+
+private:
+  std::thread m_thread;
+  std::thread m_job_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::condition_variable m_space_cv;
+  std::condition_variable m_job_cv;
+  std::vector<std::unique_ptr<SPSCQueue<Record*>>> m_queues;
+  std::deque<Job> m_jobs;
+  bool m_stopping = false;
+
+  void main();
+  bool drain();
+  void run_jobs();
+};
+
+//
+// Logger::FileTarget::Writer
+//
+
+class Logger::FileTarget::Writer {
+public:
+  Writer(const std::string &filename, const Options &options)
+    : m_filename(filename)
+    , m_options(options)
+    , m_pending(0)
+    , m_dropped(0) {}
+
+  ~Writer() { close(); }
+
+  auto filename() const -> const std::string& { return m_filename; }
+  auto dropped() const -> size_t { return m_dropped.load(std::memory_order_relaxed); }
+
+  //
+  // Called on worker threads
+  //
+
+  void write(const Data &msg) {
+    size_t size = msg.size() + 1;
+    int waits = 0;
+    for (;;) {
+      auto pending = m_pending.load(std::memory_order_relaxed);
+
+      // A message larger than the whole buffer goes through once
+      // everything before it has been written
+      if (!pending || pending + size <= m_options.buffer_limit) break;
+
+      // Blocking stalls the event loop of the calling worker thread,
+      // so give up and drop after MAX_BLOCK_TIME
+      if (m_options.overflow == Overflow::DROP || ++waits > MAX_BLOCK_WAITS) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      IOThread::get().wait();
+    }
+    m_pending.fetch_add(size, std::memory_order_relaxed);
+    IOThread::get().post(Record::make(this, msg));
+  }
+
+  //
+  // Called on the I/O thread
+  //
+
+  bool append(Record *r) {
+    auto size = m_file_size + m_batch_size;
+    if (m_options.max_file_size > 0 && size > 0 && size + r->size > m_options.max_file_size) {
+      flush();
+      rotate();
+    } else if (m_batch.size() >= MAX_BATCH) {
+      flush();
+    }
+    m_batch.push_back(r);
+    m_batch_size += r->size;
+    return m_batch.size() == 1;
+  }
+
+  void flush();
+  void check_age();
+
+private:
+  enum {
+    MAX_BATCH = IOThread::MAX_BATCH,
+    MAX_BLOCK_TIME = 1000,
+    MAX_BLOCK_WAITS = MAX_BLOCK_TIME / IOThread::FLUSH_INTERVAL,
+  };
+
+  std::string m_filename;
+  Options m_options;
+  int m_fd = -1;
+  bool m_failed = false;
+  size_t m_file_size = 0;
+  std::chrono::steady_clock::time_point m_open_time;
+  std::vector<Record*> m_batch;
+  size_t m_batch_size = 0;
+  std::deque<std::string> m_rotated;
+  std::atomic<size_t> m_pending;
+  std::atomic<size_t> m_dropped;
+
+  bool open();
+  void close();
+  void rotate();
+};
+
+static bool mkdir_p(const std::string &path) {
+  if (path.empty() || fs::is_dir(path)) return true;
+  if (!mkdir_p(utils::path_dirname(path))) return false;
+  return fs::make_dir(path);
 }
 
-void Logger::FileTarget::write(const Data &msg) {
-  auto name = m_filename->data()->retain();
-  auto sd = SharedData::make(msg)->retain();
-  Net::main().post(
-    [=]() {
-      Writer *writer = nullptr;
-      const auto &filename = name->str();
-      auto i = s_all_writers.find(filename);
-      if (i != s_all_writers.end()) {
-        writer = i->second.get();
+#ifdef _WIN32
+
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+
+static auto writev(int fd, const struct iovec *iov, int n) -> long {
+  long total = 0;
+  for (int i = 0; i < n; i++) {
+    auto r = _write(fd, iov[i].iov_base, iov[i].iov_len);
+    if (r < 0) return total > 0 ? total : -1;
+    total += r;
+    if (size_t(r) < iov[i].iov_len) break;
+  }
+  return total;
+}
+
+#endif // _WIN32
+
+static bool write_all(int fd, struct iovec *iov, int n) {
+  while (n > 0) {
+    auto r = writev(fd, iov, n);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    while (n > 0 && size_t(r) >= iov->iov_len) {
+      r -= iov->iov_len;
+      iov++; n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (char*)iov->iov_base + r;
+      iov->iov_len -= r;
+    }
+  }
+  return true;
+}
+
+static bool gzip_file(const std::string &src, const std::string &dst) {
+  auto f = std::fopen(src.c_str(), "rb");
+  if (!f) return false;
+  auto gz = gzopen(dst.c_str(), "wb");
+  if (!gz) {
+    std::fclose(f);
+    return false;
+  }
+  bool ok = true;
+  char buf[0x10000];
+  while (auto n = std::fread(buf, 1, sizeof(buf), f)) {
+    if (gzwrite(gz, buf, n) != int(n)) {
+      ok = false;
+      break;
+    }
+  }
+  std::fclose(f);
+  if (gzclose(gz) != Z_OK) ok = false;
+  return ok;
+}
+
+bool Logger::FileTarget::Writer::open() {
+  if (m_fd >= 0) return true;
+  if (!mkdir_p(utils::path_dirname(m_filename))) {
+    if (!m_failed) Log::error("[logger] cannot create directory for %s", m_filename.c_str());
+    m_failed = true;
+    return false;
+  }
+#ifdef _WIN32
+  m_fd = _open(m_filename.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+  m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+#endif
+  if (m_fd < 0) {
+    if (!m_failed) Log::error("[logger] cannot open log file %s", m_filename.c_str());
+    m_failed = true;
+    return false;
+  }
+  struct stat st;
+  m_file_size = (fstat(m_fd, &st) == 0 ? st.st_size : 0);
+  m_open_time = std::chrono::steady_clock::now();
+  m_failed = false;
+  return true;
+}
+
+void Logger::FileTarget::Writer::close() {
+  if (m_fd >= 0) {
+#ifdef _WIN32
+    _close(m_fd);
+#else
+    ::close(m_fd);
+#endif
+    m_fd = -1;
+  }
+}
+
+void Logger::FileTarget::Writer::flush() {
+  auto n = m_batch.size();
+  if (!n) return;
+
+  if (open()) {
+    struct iovec iov[MAX_BATCH];
+    for (size_t i = 0; i < n; i++) {
+      iov[i].iov_base = m_batch[i]->data;
+      iov[i].iov_len = m_batch[i]->size;
+    }
+    if (write_all(m_fd, iov, n)) {
+      m_file_size += m_batch_size;
+    } else {
+      Log::error("[logger] cannot write to log file %s", m_filename.c_str());
+      m_dropped.fetch_add(n, std::memory_order_relaxed);
+      close();
+    }
+  } else {
+    m_dropped.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  for (auto *r : m_batch) r->free();
+  m_pending.fetch_sub(m_batch_size, std::memory_order_relaxed);
+  m_batch.clear();
+  m_batch_size = 0;
+}
+
+void Logger::FileTarget::Writer::check_age() {
+  if (m_options.max_file_age > 0 && m_fd >= 0 && m_file_size > 0) {
+    std::chrono::duration<double> age = std::chrono::steady_clock::now() - m_open_time;
+    if (age.count() >= m_options.max_file_age) {
+      rotate();
+    }
+  }
+}
+
+void Logger::FileTarget::Writer::rotate() {
+  close();
+
+  char suffix[100];
+  auto t = std::time(nullptr);
+  struct tm tm;
+#ifdef _WIN32
+  localtime_s(&tm, &t);
+#else
+  localtime_r(&t, &tm);
+#endif
+  std::strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &tm);
+
+  auto name = m_filename + suffix;
+  for (int i = 1; fs::exists(name) || fs::exists(name + ".gz"); i++) {
+    name = m_filename + suffix + '-' + std::to_string(i);
+  }
+
+  if (!fs::rename(m_filename, name)) {
+    Log::error("[logger] cannot rotate log file %s", m_filename.c_str());
+    return;
+  }
+
+  IOThread::Job job;
+  if (m_options.gzip) job.compress = name;
+  m_rotated.push_back(std::move(name));
+  if (m_options.max_files > 0 && m_rotated.size() > size_t(m_options.max_files)) {
+    job.remove = std::move(m_rotated.front());
+    m_rotated.pop_front();
+  }
+  if (!job.compress.empty() || !job.remove.empty()) {
+    IOThread::get().schedule(std::move(job));
+  }
+
+  open();
+}
+
+void Logger::FileTarget::IOThread::main() {
+  bool stopping = false;
+  while (!stopping) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      stopping = m_stopping;
+      if (!stopping) m_cv.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL));
+    }
+    while (drain()) {}
+    m_space_cv.notify_all();
+    std::lock_guard<std::mutex> lock(s_all_writers_mutex);
+    for (const auto &i : s_all_writers) i.second->check_age();
+  }
+}
+
+bool Logger::FileTarget::IOThread::drain() {
+  std::vector<SPSCQueue<Record*>*> queues;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto &q : m_queues) queues.push_back(q.get());
+  }
+
+  std::vector<Writer*> writers;
+  for (auto *q : queues) {
+    Record *r;
+    for (int n = 0; n < MAX_BATCH && q->pop(r); n++) {
+      if (r->writer->append(r)) {
+        writers.push_back(r->writer);
+      }
+    }
+  }
+
+  for (auto *w : writers) w->flush();
+  return !writers.empty();
+}
+
+void Logger::FileTarget::IOThread::run_jobs() {
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_job_cv.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+      if (m_jobs.empty()) break;
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+    if (!job.compress.empty()) {
+      auto gz = job.compress + ".gz";
+      if (gzip_file(job.compress, gz)) {
+        fs::unlink(job.compress);
       } else {
-        writer = new Writer(filename);
-        s_all_writers[filename].reset(writer);
+        Log::error("[logger] cannot compress log file %s", job.compress.c_str());
+        fs::unlink(gz);
       }
-      InputContext ic;
-      Data data;
-      sd->to_data(data);
-      writer->write(data);
-      name->release();
-      sd->release();
     }
-  );
+    if (!job.remove.empty()) {
+      fs::unlink(job.remove);
+      fs::unlink(job.remove + ".gz");
+    }
+  }
 }
 
 //
-// Logger::FileTarget::Writer
+// Logger::FileTarget
 //
 
+std::mutex Logger::FileTarget::s_all_writers_mutex;
 std::map<std::string, std::unique_ptr<Logger::FileTarget::Writer>> Logger::FileTarget::s_all_writers;
 
-Logger::FileTarget::Writer::Writer(const std::string &filename)
-  : m_module(new Module)
-{
-  PipelineLayout *ppl = PipelineLayout::make();
-  Tee::Options options;
-  options.append = true;
-  ppl->append(new Tee(filename, options));
+void Logger::FileTarget::close_all_writers() {
+  IOThread::get().shutdown();
+  std::lock_guard<std::mutex> lock(s_all_writers_mutex);
+  for (const auto &i : s_all_writers) i.second->flush();
+  s_all_writers.clear();
+}
 
-  m_pipeline_layout = ppl;
-  m_pipeline = Pipeline::make(ppl, Context::make());
+void Logger::FileTarget::for_each_dropped(const std::function<void(const std::string &, size_t)> &cb) {
+  std::lock_guard<std::mutex> lock(s_all_writers_mutex);
+  for (const auto &i : s_all_writers) {
+    cb(i.first, i.second->dropped());
+  }
 }
 
-void Logger::FileTarget::Writer::write(const Data &msg) {
-  Data *buf = Data::make();
-  s_dp.push(buf, &msg);
-  s_dp.push(buf, '\n');
-  m_pipeline->input()->input(buf);
+Logger::FileTarget::FileTarget(pjs::Str *filename, const Options &options) {
+  auto path = fs::abs_path(filename->str());
+  std::lock_guard<std::mutex> lock(s_all_writers_mutex);
+  auto &w = s_all_writers[path];
+  if (!w) w.reset(new Writer(path, options));
+  m_writer = w.get();
 }
 
-void Logger::FileTarget::Writer::shutdown() {
-  m_module->shutdown();
-  m_pipeline = nullptr;
+void Logger::FileTarget::write(const Data &msg) {
+  m_writer->write(msg);
 }
 
 //
@@ -576,6 +1014,11 @@ using namespace pipy::logging;
 // Logger
 //
 
+template<> void EnumDef<Logger::FileTarget::Overflow>::init() {
+  define(Logger::FileTarget::Overflow::DROP, "drop");
+  define(Logger::FileTarget::Overflow::BLOCK, "block");
+}
+
 template<> void EnumDef<Logger::SyslogTarget::Priority>::init() {
   define(Logger::SyslogTarget::Priority::EMERG, "EMERG");
   define(Logger::SyslogTarget::Priority::ALERT, "ALERT");
@@ -604,9 +1047,14 @@ template<> void ClassDef<Logger>::init() {
 
   method("toFile", [](Context &ctx, Object *obj, Value &ret) {
     pjs::Str *filename;
-    if (!ctx.arguments(1, &filename)) return;
-    obj->as<Logger>()->add_target(new Logger::FileTarget(filename));
-    ret.set(obj);
+    pjs::Object *options = nullptr;
+    if (!ctx.arguments(1, &filename, &options)) return;
+    try {
+      obj->as<Logger>()->add_target(new Logger::FileTarget(filename, options));
+      ret.set(obj);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+    }
   });
 
   method("toSyslog", [](Context &ctx, Object *obj, Value &ret) {
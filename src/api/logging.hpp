@@ -35,7 +35,9 @@
 
 #include <atomic>
 #include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <functional>
 
@@ -97,42 +99,39 @@ public:
 
   class FileTarget : public Target {
   public:
-    static void close_all_writers();
+    enum class Overflow {
+      DROP,
+      BLOCK,
+    };
 
-    FileTarget(pjs::Str *filename);
+    struct Options : public pipy::Options {
+      size_t max_file_size = 0;
+      double max_file_age = 0;
+      int max_files = 0;
+      bool gzip = false;
+      size_t buffer_limit = 8*1024*1024;
+      Overflow overflow = Overflow::DROP;
 
-  private:
-    virtual void write(const Data &msg) override;
+      Options() {}
+      Options(pjs::Object *options);
+    };
 
-    //
-    // Logger::FileTarget::Module
-    //
+    static void close_all_writers();
+    static void for_each_dropped(const std::function<void(const std::string &, size_t)> &cb);
 
-    class Module : public ModuleBase {
-    public:
-      Module() : ModuleBase("Logger::FileTarget") {}
-      virtual auto new_context(pipy::Context *base) -> pipy::Context* override {
-        return Context::make();
-      }
-    };
+    FileTarget(pjs::Str *filename, const Options &options = Options());
 
-    //
-    // Logger::FileTarget::Writer
-    //
+  private:
+    virtual void write(const Data &msg) override;
 
-    class Writer {
-    public:
-      Writer(const std::string &filename);
-      void write(const Data &msg);
-      void shutdown();
-    private:
-      pjs::Ref<Module> m_module;
-      pjs::Ref<PipelineLayout> m_pipeline_layout;
-      pjs::Ref<Pipeline> m_pipeline;
-    };
+    // Messages are written by a dedicated I/O thread, see logging.cpp
+    struct Record;
+    class Writer;
+    class IOThread;
 
-    pjs::Ref<pjs::Str> m_filename;
+    Writer* m_writer;
 
+    static std::mutex s_all_writers_mutex;
     static std::map<std::string, std::unique_ptr<Writer>> s_all_writers;
   };
 
@@ -71,6 +71,7 @@ namespace pipy {
 namespace stats {
 
 static const std::string s_prefix_histogram("Histogram[");
+static const std::string s_prefix_sketch("Sketch[");
 thread_local static pjs::ConstStr s_str_Counter("Counter");
 thread_local static pjs::ConstStr s_str_Gauge("Gauge");
 thread_local static pjs::ConstStr s_str_count("count");
@@ -171,6 +172,7 @@ void Metric::clear() {
   }
   m_subs.clear();
   m_sub_map.clear();
+  m_last_sub = nullptr;
   m_has_value = false;
 }
 
@@ -187,9 +189,16 @@ void Metric::zero_all() {
 
 auto Metric::get_sub(pjs::Str **labels) -> Metric* {
   auto k = labels[m_label_index + 1];
+
+  // Most requests hit the same label as the previous one
+  if (auto *m = m_last_sub) {
+    if (m->m_label == k) return m;
+  }
+
   auto i = m_sub_map.find(k);
-  if (i != m_sub_map.end()) return i->second;
-  return create_new(this, labels);
+  auto m = (i != m_sub_map.end() ? i->second : create_new(this, labels));
+  m_last_sub = m;
+  return m;
 }
 
 auto Metric::get_sub(int i) -> Metric* {
@@ -253,13 +262,17 @@ public:
     const std::vector<std::string> &label_names,
     pjs::Str::CharData *label_values[],
     const char *le_str,
-    const std::function<void(const void *, size_t)> &out
+    const std::function<void(const void *, size_t)> &out,
+    const Sketch::Layout *sketch = nullptr,
+    bool quantiles = false
   ) : m_name(name)
     , m_extra_labels(extra_labels)
     , m_label_names(label_names)
     , m_label_values(label_values)
     , m_le_str(le_str)
-    , m_out(out) {}
+    , m_out(out)
+    , m_sketch(sketch)
+    , m_quantiles(quantiles) {}
 
   void output(Node *node, int level) {
     static const std::string s_bucket("_bucket");
@@ -273,7 +286,10 @@ public:
     }
 
     if (node->has_value) {
-      if (m_le_str) {
+      if (m_sketch) {
+        output_sketch(node->values, level);
+
+      } else if (m_le_str) {
         auto le = 0;
         auto *p = m_le_str;
         while (p) {
@@ -314,6 +330,52 @@ private:
   pjs::Str::CharData **m_label_values;
   const char *m_le_str;
   const std::function<void(const void *, size_t)> &m_out;
+  const Sketch::Layout *m_sketch;
+  bool m_quantiles;
+
+  void output_sketch(const double *values, int level) {
+    static const std::string s_bucket("_bucket");
+    static const std::string s_sum("_sum");
+    static const std::string s_count("_count");
+    static const std::string s_inf("+Inf");
+    static const std::string s_quantile("quantile=");
+    static const double s_quantile_points[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    char str[100];
+    int n = m_sketch->size();
+
+    if (m_quantiles) {
+      for (auto q : s_quantile_points) {
+        auto len = pjs::Number::to_string(str, sizeof(str), q);
+        output(m_name);
+        output(level, m_sketch->quantile(values, q), str, len, &s_quantile);
+      }
+    } else {
+
+      // Only non-empty buckets are exported, the last one
+      // also takes samples over the maximum so it goes to +Inf
+      double sum = 0;
+      for (int i = 0; i < n - 1; i++) {
+        if (values[i] > 0) {
+          sum += values[i];
+          auto len = pjs::Number::to_string(str, sizeof(str), m_sketch->upper_bound(i));
+          output(m_name);
+          output(s_bucket);
+          output(level, sum, str, len);
+        }
+      }
+      output(m_name);
+      output(s_bucket);
+      output(level, sum + values[n-1], s_inf.c_str(), s_inf.length());
+    }
+
+    output(m_name);
+    output(s_count);
+    output(level, values[n]);
+    output(m_name);
+    output(s_sum);
+    output(level, values[n+1]);
+  }
 
   void output(char c) { m_out(&c, 1); }
   void output(const std::string &s) { m_out(s.c_str(), s.length()); }
@@ -321,7 +383,8 @@ private:
 
   void output(
     int level, double num,
-    const char *le = nullptr, int le_len = 0
+    const char *le = nullptr, int le_len = 0,
+    const std::string *le_name = nullptr
   ) {
     static const std::string s_le("le=");
     if (level > 0 || !m_extra_labels.empty() || le) {
@@ -334,7 +397,7 @@ private:
       for (int i = 0, n = (le ? level+1 : level); i < n; i++) {
         if (first) first = false; else output(',');
         if (i == level) {
-          output(s_le);
+          output(le_name ? *le_name : s_le);
           output('"');
           output(le, le_len);
           output('"');
@@ -448,6 +511,8 @@ void MetricData::to_prometheus(const std::string &extra_labels, const std::funct
   static const std::string s_type_counter(" counter\n");
   static const std::string s_type_gauge(" gauge\n");
   static const std::string s_type_histogram(" histogram\n");
+  static const std::string s_type_summary(" summary\n");
+  static const std::string s_suffix_quantiles("_quantiles");
   auto print = [&](const std::string &str) { out(str.c_str(), str.length()); };
   for (auto *ent = m_entries; ent; ent = ent->next) {
     if (auto root = ent->root.get()) {
@@ -457,9 +522,16 @@ void MetricData::to_prometheus(const std::string &extra_labels, const std::funct
       auto *name = ent->name.get();
       auto *type = ent->type.get();
       auto *shape = ent->shape.get();
+      Sketch::Layout sketch;
+      bool is_sketch = (
+        Sketch::decode_type(type->str(), sketch) &&
+        sketch.size() + 2 == ent->dimensions
+      );
       if (utils::starts_with(type->str(), s_prefix_histogram)) {
         le_str = type->c_str() + s_prefix_histogram.length();
         print(s_type_histogram);
+      } else if (is_sketch) {
+        print(s_type_histogram);
       } else if (ent->type->str() == "Gauge") {
         print(s_type_gauge);
       } else {
@@ -472,8 +544,16 @@ void MetricData::to_prometheus(const std::string &extra_labels, const std::funct
         for (auto &s : labels) { ent->labels[i++] = std::move(s); }
       }
       pjs::vl_array<pjs::Str::CharData*> label_values(ent->labels.size());
-      Prometheus<Node> prom(name->str(), extra_labels, ent->labels, label_values, le_str, out);
+      Prometheus<Node> prom(name->str(), extra_labels, ent->labels, label_values, le_str, out, is_sketch ? &sketch : nullptr);
       prom.output(root, 0);
+      if (is_sketch) {
+        auto quantiles_name = name->str() + s_suffix_quantiles;
+        print(s_prefix_TYPE);
+        print(quantiles_name);
+        print(s_type_summary);
+        Prometheus<Node> prom(quantiles_name, extra_labels, ent->labels, label_values, nullptr, out, &sketch, true);
+        prom.output(root, 0);
+      }
     }
   }
 }
@@ -646,12 +726,16 @@ void MetricData::Deserializer::string(const char *s, size_t len) {
             return;
           case Level::Field::TYPE:
             if (is_entry) {
-              int dim = 1;
+              int dim = 1, max_dim = 100;
+              Sketch::Layout sketch;
               if (utils::starts_with(str->str(), s_prefix_histogram)) {
                 for (auto c : str->str()) if (c == ',') dim++;
                 dim += 2;
+              } else if (Sketch::decode_type(str->str(), sketch)) {
+                dim = sketch.size() + 2;
+                max_dim = Sketch::MAX_BUCKETS + 2;
               }
-              if (dim <= 100) {
+              if (dim <= max_dim) {
                 auto node = Node::make(dim);
                 m_current_entry->type = str->data();
                 m_current_entry->dimensions = dim;
@@ -986,6 +1070,11 @@ auto MetricDataSum::to_object() -> pjs::Object* {
       m = Gauge::make(ent->name, labels, nullptr, &ms);
     } else if (utils::starts_with(ent->type->str(), s_prefix_histogram)) {
       m = Histogram::make(ent->name, Histogram::decode_type(ent->type->str()), labels, &ms);
+    } else {
+      Sketch::Layout layout;
+      if (Sketch::decode_type(ent->type->str(), layout)) {
+        m = Sketch::make(ent->name, layout, labels, &ms);
+      }
     }
 
     if (m) {
@@ -1014,6 +1103,8 @@ void MetricDataSum::to_prometheus(const std::function<void(const void *, size_t)
   static const std::string s_type_counter(" counter\n");
   static const std::string s_type_gauge(" gauge\n");
   static const std::string s_type_histogram(" histogram\n");
+  static const std::string s_type_summary(" summary\n");
+  static const std::string s_suffix_quantiles("_quantiles");
   auto print = [&](const std::string &str) { out(str.c_str(), str.length()); };
   for (const auto &p : m_entry_map) {
     auto ent = p.second;
@@ -1021,9 +1112,16 @@ void MetricDataSum::to_prometheus(const std::function<void(const void *, size_t)
       print(s_prefix_TYPE);
       print(ent->name->str());
       const char *le_str = nullptr;
+      Sketch::Layout sketch;
+      bool is_sketch = (
+        Sketch::decode_type(ent->type->str(), sketch) &&
+        sketch.size() + 2 == ent->dimensions
+      );
       if (utils::starts_with(ent->type->str(), s_prefix_histogram)) {
         le_str = ent->type->c_str() + s_prefix_histogram.length();
         print(s_type_histogram);
+      } else if (is_sketch) {
+        print(s_type_histogram);
       } else if (ent->type->str() == "Gauge") {
         print(s_type_gauge);
       } else {
@@ -1037,8 +1135,16 @@ void MetricDataSum::to_prometheus(const std::function<void(const void *, size_t)
       }
       pjs::vl_array<pjs::Str::CharData*> label_values(ent->labels.size());
       std::string empty;
-      Prometheus<Node> prom(ent->name->str(), empty, ent->labels, label_values, le_str, out);
+      Prometheus<Node> prom(ent->name->str(), empty, ent->labels, label_values, le_str, out, is_sketch ? &sketch : nullptr);
       prom.output(root, 0);
+      if (is_sketch) {
+        auto quantiles_name = ent->name->str() + s_suffix_quantiles;
+        print(s_prefix_TYPE);
+        print(quantiles_name);
+        print(s_type_summary);
+        Prometheus<Node> prom(quantiles_name, empty, ent->labels, label_values, nullptr, out, &sketch, true);
+        prom.output(root, 0);
+      }
     }
   }
 }
@@ -1519,6 +1625,173 @@ void Histogram::set_value(int dim, double value) {
   create_value();
 }
 
+//
+// Sketch::Options
+//
+
+Sketch::Options::Options(pjs::Object *options) {
+  thread_local static pjs::ConstStr str_relativeError("relativeError");
+  thread_local static pjs::ConstStr str_min("min");
+  thread_local static pjs::ConstStr str_max("max");
+  Value(options, str_relativeError)
+    .get(relative_error)
+    .check_nullable();
+  Value(options, str_min)
+    .get(min)
+    .check_nullable();
+  Value(options, str_max)
+    .get(max)
+    .check_nullable();
+}
+
+//
+// Sketch::Layout
+//
+
+Sketch::Layout::Layout(const Options &options) {
+  if (!(options.relative_error > 0 && options.relative_error < 1)) {
+    throw std::runtime_error("options.relativeError out of range (0, 1)");
+  }
+  if (!(options.min > 0) || !(options.max > options.min)) {
+    throw std::runtime_error("options.min and options.max must be positive and min < max");
+  }
+
+  // Pick the coarsest schema whose relative error is within the requirement
+  for (schema = 0; schema < 8; schema++) {
+    auto base = std::exp2(std::ldexp(1, -schema));
+    if ((base - 1) / (base + 1) <= options.relative_error) break;
+  }
+
+  auto scale = std::ldexp(1, schema);
+  min_index = std::ceil(std::log2(options.min) * scale);
+  max_index = std::ceil(std::log2(options.max) * scale);
+
+  if (size() > MAX_BUCKETS) {
+    throw std::runtime_error("too many buckets for the range and relative error");
+  }
+}
+
+auto Sketch::Layout::locate(double x) const -> int {
+  if (!(x > 0)) return 0;
+  auto i = std::ceil(std::log2(x) * std::ldexp(1, schema));
+  if (i <= min_index) return 0;
+  if (i >= max_index) return max_index - min_index;
+  return int(i) - min_index;
+}
+
+auto Sketch::Layout::upper_bound(int i) const -> double {
+  return std::exp2(std::ldexp(min_index + i, -schema));
+}
+
+auto Sketch::Layout::quantile(const double *counts, double q) const -> double {
+  auto n = size();
+  double total = 0;
+  for (int i = 0; i < n; i++) total += counts[i];
+  if (total <= 0) return 0;
+
+  auto rank = std::max(0.0, std::min(1.0, q)) * total;
+  double sum = 0;
+  for (int i = 0; i < n; i++) {
+    if (counts[i] <= 0) continue;
+    sum += counts[i];
+    if (sum >= rank) {
+      if (i == 0) return upper_bound(0);
+      auto base = std::exp2(std::ldexp(1, -schema));
+      return upper_bound(i) * 2 / (base + 1);
+    }
+  }
+  return upper_bound(n - 1);
+}
+
+//
+// Sketch
+//
+
+Sketch::Sketch(pjs::Str *name, const Layout &layout, pjs::Array *label_names, MetricSet *set)
+  : MetricTemplate<Sketch>(name, label_names, set)
+  , m_layout(layout)
+  , m_counts(layout.size())
+{
+}
+
+Sketch::Sketch(Metric *parent, pjs::Str **labels)
+  : MetricTemplate<Sketch>(parent, labels)
+  , m_layout(static_cast<Sketch*>(parent)->m_layout)
+  , m_counts(m_layout.size())
+{
+}
+
+auto Sketch::encode_type(const Layout &layout) -> std::string {
+  return s_prefix_sketch +
+    std::to_string(layout.schema) + ',' +
+    std::to_string(layout.min_index) + ',' +
+    std::to_string(layout.max_index) + ']';
+}
+
+bool Sketch::decode_type(const std::string &type, Layout &layout) {
+  if (!utils::starts_with(type, s_prefix_sketch)) return false;
+  int schema, min_index, max_index;
+  if (std::sscanf(
+    type.c_str() + s_prefix_sketch.length(), "%d,%d,%d]",
+    &schema, &min_index, &max_index
+  ) != 3) return false;
+  if (schema < 0 || schema > 8) return false;
+  if (max_index < min_index || max_index - min_index >= MAX_BUCKETS) return false;
+  layout.schema = schema;
+  layout.min_index = min_index;
+  layout.max_index = max_index;
+  return true;
+}
+
+void Sketch::zero() {
+  std::fill(m_counts.begin(), m_counts.end(), 0);
+  m_sum = 0;
+  m_count = 0;
+  create_value();
+}
+
+void Sketch::observe(double n) {
+  if (std::isnan(n)) return;
+  m_counts[m_layout.locate(n)]++;
+  m_sum += n;
+  m_count++;
+  create_value();
+}
+
+void Sketch::value_of(pjs::Value &out) {
+  auto *a = pjs::Array::make(m_counts.size());
+  for (size_t i = 0; i < m_counts.size(); i++) a->set(i, m_counts[i]);
+  out.set(a);
+}
+
+auto Sketch::get_type() -> pjs::Str* {
+  return pjs::Str::make(encode_type(m_layout));
+}
+
+auto Sketch::get_dim() -> int {
+  return m_counts.size() + 2;
+}
+
+auto Sketch::get_value(int dim) -> double {
+  int size = m_counts.size();
+  if (0 <= dim && dim < size) return m_counts[dim];
+  switch (dim - size) {
+    case 0: return m_count;
+    case 1: return m_sum;
+  }
+  return 0;
+}
+
+void Sketch::set_value(int dim, double value) {
+  int size = m_counts.size();
+  if (0 <= dim && dim < size) m_counts[dim] = value;
+  switch (dim - size) {
+    case 0: m_count = value; break;
+    case 1: m_sum = value; break;
+  }
+  create_value();
+}
+
 } // namespace stats
 } // namespace pipy
 
@@ -1708,6 +1981,51 @@ template<> void ClassDef<Constructor<Histogram>>::init() {
   ctor();
 }
 
+//
+// Sketch
+//
+
+template<> void ClassDef<Sketch>::init() {
+  super<Metric>();
+
+  ctor([](Context &ctx) -> Object* {
+    Str *name;
+    Array *labels = nullptr;
+    Object *options = nullptr;
+    if (!ctx.check(0, name)) return nullptr;
+    if (!ctx.check(1, labels, labels)) return nullptr;
+    if (!ctx.check(2, options, options)) return nullptr;
+    try {
+      Sketch::Layout layout{ Sketch::Options(options) };
+      return Sketch::make(name, layout, labels);
+    } catch (std::runtime_error &err) {
+      ctx.error(err);
+      return nullptr;
+    }
+  });
+
+  method("zero", [](Context &ctx, Object *obj, Value &ret) {
+    obj->as<Sketch>()->zero();
+  });
+
+  method("observe", [](Context &ctx, Object *obj, Value &ret) {
+    double n;
+    if (!ctx.arguments(1, &n)) return;
+    obj->as<Sketch>()->observe(n);
+  });
+
+  method("quantile", [](Context &ctx, Object *obj, Value &ret) {
+    double q;
+    if (!ctx.arguments(1, &q)) return;
+    ret.set(obj->as<Sketch>()->quantile(q));
+  });
+}
+
+template<> void ClassDef<Constructor<Sketch>>::init() {
+  super<Function>();
+  ctor();
+}
+
 //
 // Stats
 //
@@ -1718,6 +2036,7 @@ template<> void ClassDef<Stats>::init() {
   variable("Counter", class_of<Constructor<Counter>>());
   variable("Gauge", class_of<Constructor<Gauge>>());
   variable("Histogram", class_of<Constructor<Histogram>>());
+  variable("Sketch", class_of<Constructor<Sketch>>());
 
   method("sum", [](Context &ctx, Object *, Value &ret) {
     Array *names = nullptr;
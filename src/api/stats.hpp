@@ -30,6 +30,7 @@
 #include "api/algo.hpp"
 #include "api/json.hpp"
 #include "data.hpp"
+#include "options.hpp"
 #include "signal.hpp"
 
 #include <chrono>
@@ -99,6 +100,7 @@ private:
   std::shared_ptr<std::vector<pjs::Ref<pjs::Str>>> m_label_names;
   std::vector<pjs::Ref<Metric>> m_subs;
   std::unordered_map<pjs::Ref<pjs::Str>, Metric*> m_sub_map;
+  Metric* m_last_sub = nullptr;
 
   friend class pjs::ObjectTemplate<Metric>;
   friend class MetricData;
@@ -550,6 +552,76 @@ private:
   friend class pjs::ObjectTemplate<Histogram, Metric>;
 };
 
+//
+// Sketch
+//
+
+class Sketch : public MetricTemplate<Sketch> {
+public:
+  enum { MAX_BUCKETS = 4096 };
+
+  //
+  // Sketch::Options
+  //
+
+  struct Options : public pipy::Options {
+    double relative_error = 0.05;
+    double min = 0.001;
+    double max = 1e7;
+
+    Options() {}
+    Options(pjs::Object *options);
+  };
+
+  //
+  // Sketch::Layout
+  //
+  // Bucket i covers (base^(i-1), base^i] where base = 2^(2^-schema),
+  // which are the exponential buckets of Prometheus native histograms.
+  // Samples out of [min, max] are clamped into the first/last bucket.
+  //
+
+  struct Layout {
+    int schema = 0;
+    int min_index = 0;
+    int max_index = 0;
+
+    Layout() {}
+    Layout(const Options &options);
+
+    auto size() const -> int { return max_index - min_index + 1; }
+    auto locate(double x) const -> int;
+    auto upper_bound(int i) const -> double;
+    auto quantile(const double *counts, double q) const -> double;
+  };
+
+  static auto encode_type(const Layout &layout) -> std::string;
+  static bool decode_type(const std::string &type, Layout &layout);
+
+  virtual void zero() override;
+
+  auto layout() const -> const Layout& { return m_layout; }
+  auto quantile(double q) const -> double { return m_layout.quantile(m_counts.data(), q); }
+  void observe(double n);
+
+private:
+  Sketch(pjs::Str *name, const Layout &layout, pjs::Array *label_names, MetricSet *set = nullptr);
+  Sketch(Metric *parent, pjs::Str **labels);
+
+  virtual void value_of(pjs::Value &out) override;
+  virtual auto get_type() -> pjs::Str* override;
+  virtual auto get_dim() -> int override;
+  virtual auto get_value(int dim) -> double override;
+  virtual void set_value(int dim, double value) override;
+
+  Layout m_layout;
+  std::vector<double> m_counts;
+  double m_sum = 0;
+  double m_count = 0;
+
+  friend class pjs::ObjectTemplate<Sketch, Metric>;
+};
+
 //
 // Stats
 //
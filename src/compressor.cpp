@@ -31,6 +31,14 @@
 #include <zlib.h>
 
 #include <brotli/decode.h>
+#include <brotli/encode.h>
+#include <zstd.h>
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 namespace pipy {
 
@@ -182,6 +190,64 @@ private:
 
 Data::Producer BrotliDecoder::s_dp("Decompress (brotli)");
 
+//
+// ZstdDecoder
+//
+
+class ZstdDecoder : public pjs::Pooled<ZstdDecoder>, public Decompressor {
+public:
+  ZstdDecoder(const std::function<void(Data&)> &out)
+    : m_out(out)
+    , m_ds(ZSTD_createDCtx())
+  {
+  }
+
+private:
+  const std::function<void(Data&)> m_out;
+  ZSTD_DCtx* m_ds;
+
+  ~ZstdDecoder() {
+    ZSTD_freeDCtx(m_ds);
+  }
+
+  // Input can be several frames back to back (RFC 8878 section 3.1),
+  // so the context is reset for the next one after each frame ends
+  virtual bool input(const Data &data) override {
+    char buf[DATA_CHUNK_SIZE];
+    Data output;
+    Data::Builder db(output, &s_dp);
+
+    for (const auto chk : data.chunks()) {
+      ZSTD_inBuffer in = { std::get<0>(chk), (size_t)std::get<1>(chk), 0 };
+      for (;;) {
+        ZSTD_outBuffer out = { buf, sizeof(buf), 0 };
+        auto ret = ZSTD_decompressStream(m_ds, &out, &in);
+        if (ZSTD_isError(ret)) return false;
+        if (out.pos > 0) db.push(buf, out.pos);
+        if (ret == 0) {
+          ZSTD_DCtx_reset(m_ds, ZSTD_reset_session_only);
+          if (in.pos == in.size) break;
+        } else if (in.pos == in.size && out.pos < out.size) {
+          break;
+        }
+      }
+    }
+
+    db.flush();
+    m_out(output);
+    return true;
+  }
+
+  virtual bool finalize() override {
+    delete this;
+    return true;
+  }
+
+  static Data::Producer s_dp;
+};
+
+Data::Producer ZstdDecoder::s_dp("Decompress (zstd)");
+
 //
 // Deflate
 //
@@ -193,7 +259,7 @@ public:
     gzip,
   };
 
-  Deflate(const Output &out, bool gzip)
+  Deflate(const Output &out, bool gzip, const Params &params)
     : m_out(out)
   {
     m_zs.zalloc = Z_NULL;
@@ -202,11 +268,14 @@ public:
     m_zs.next_in = Z_NULL;
     m_zs.avail_out = 0;
 
+    auto level = params.level < 0 ? Z_DEFAULT_COMPRESSION : std::min(params.level, Z_BEST_COMPRESSION);
+    auto window = params.window > 0 ? std::max(9, std::min(params.window, MAX_WBITS)) : MAX_WBITS;
+
     deflateInit2(
       &m_zs,
-      Z_DEFAULT_COMPRESSION,
+      level,
       Z_DEFLATED,
-      gzip ? 16 + MAX_WBITS : MAX_WBITS,
+      gzip ? 16 + window : window,
       8,
       Z_DEFAULT_STRATEGY
     );
@@ -227,9 +296,12 @@ private:
     for (const auto chk : data.chunks()) {
       auto buf = std::get<0>(chk);
       auto len = std::get<1>(chk);
-      if (!deflate(buf, len, flush, db)) return false;
+      if (!deflate(buf, len, false, db)) return false;
     }
 
+    // Finish only after all chunks are in, or the rest would be dropped
+    if (flush && !deflate(nullptr, 0, true, db)) return false;
+
     db.flush();
     m_out(output);
     return true;
@@ -268,6 +340,174 @@ private:
 
 Data::Producer Deflate::s_dp("Compress (defalte)");
 
+//
+// BrotliEncoder
+//
+
+class BrotliEncoder : public pjs::Pooled<BrotliEncoder>, public Compressor {
+public:
+  BrotliEncoder(const Output &out, const Params &params)
+    : m_out(out)
+    , m_es(BrotliEncoderCreateInstance(NULL, NULL, NULL))
+  {
+    auto quality = params.level < 0 ? 5 : std::min(params.level, BROTLI_MAX_QUALITY);
+    BrotliEncoderSetParameter(m_es, BROTLI_PARAM_QUALITY, quality);
+    if (params.window > 0) {
+      auto window = std::max(BROTLI_MIN_WINDOW_BITS, std::min(params.window, BROTLI_MAX_WINDOW_BITS));
+      BrotliEncoderSetParameter(m_es, BROTLI_PARAM_LGWIN, window);
+    }
+  }
+
+private:
+  Output m_out;
+  BrotliEncoderState* m_es;
+  bool m_done = false;
+
+  ~BrotliEncoder() {
+    BrotliEncoderDestroyInstance(m_es);
+  }
+
+  virtual bool input(const Data &data, bool flush) override {
+    if (m_done) return true;
+
+    Data output;
+    Data::Builder db(output, &s_dp);
+
+    for (const auto chk : data.chunks()) {
+      auto buf = (const uint8_t *)std::get<0>(chk);
+      auto len = std::get<1>(chk);
+      if (!encode(buf, len, BROTLI_OPERATION_PROCESS, db)) return false;
+    }
+
+    if (flush && !encode(nullptr, 0, BROTLI_OPERATION_FINISH, db)) return false;
+
+    db.flush();
+    m_out(output);
+    return true;
+  }
+
+  virtual bool flush() override {
+    if (m_done) return true;
+    Data output;
+    Data::Builder db(output, &s_dp);
+    if (!encode(nullptr, 0, BROTLI_OPERATION_FINISH, db)) return false;
+    db.flush();
+    m_out(output);
+    return true;
+  }
+
+  virtual bool finalize() override {
+    delete this;
+    return true;
+  }
+
+  bool encode(const uint8_t *data, size_t size, BrotliEncoderOperation op, Data::Builder &db) {
+    uint8_t buf[DATA_CHUNK_SIZE];
+    const uint8_t *next_in = data;
+    size_t avail_in = size;
+    for (;;) {
+      uint8_t *next_out = buf;
+      size_t avail_out = sizeof(buf);
+      if (!BrotliEncoderCompressStream(m_es, op, &avail_in, &next_in, &avail_out, &next_out, NULL)) return false;
+      if (auto size = sizeof(buf) - avail_out) db.push(buf, size);
+      if (op == BROTLI_OPERATION_FINISH) {
+        if (BrotliEncoderIsFinished(m_es)) { m_done = true; break; }
+      } else if (avail_in == 0 && !BrotliEncoderHasMoreOutput(m_es)) {
+        break;
+      }
+    }
+    return true;
+  }
+
+  static Data::Producer s_dp;
+};
+
+Data::Producer BrotliEncoder::s_dp("Compress (brotli)");
+
+//
+// ZstdEncoder
+//
+
+class ZstdEncoder : public pjs::Pooled<ZstdEncoder>, public Compressor {
+public:
+  ZstdEncoder(const Output &out, const Params &params)
+    : m_out(out)
+    , m_cs(ZSTD_createCCtx())
+  {
+    auto level = params.level < 0 ? ZSTD_CLEVEL_DEFAULT : std::min(params.level, ZSTD_maxCLevel());
+    ZSTD_CCtx_setParameter(m_cs, ZSTD_c_compressionLevel, level);
+    if (params.window > 0) {
+      auto bounds = ZSTD_cParam_getBounds(ZSTD_c_windowLog);
+      auto window = std::max(bounds.lowerBound, std::min(params.window, bounds.upperBound));
+      ZSTD_CCtx_setParameter(m_cs, ZSTD_c_windowLog, window);
+    }
+  }
+
+private:
+  Output m_out;
+  ZSTD_CCtx* m_cs;
+  bool m_done = false;
+
+  ~ZstdEncoder() {
+    ZSTD_freeCCtx(m_cs);
+  }
+
+  virtual bool input(const Data &data, bool flush) override {
+    if (m_done) return true;
+
+    Data output;
+    Data::Builder db(output, &s_dp);
+
+    for (const auto chk : data.chunks()) {
+      auto buf = std::get<0>(chk);
+      auto len = std::get<1>(chk);
+      if (!encode(buf, len, ZSTD_e_continue, db)) return false;
+    }
+
+    if (flush && !encode(nullptr, 0, ZSTD_e_end, db)) return false;
+
+    db.flush();
+    m_out(output);
+    return true;
+  }
+
+  virtual bool flush() override {
+    if (m_done) return true;
+    Data output;
+    Data::Builder db(output, &s_dp);
+    if (!encode(nullptr, 0, ZSTD_e_end, db)) return false;
+    db.flush();
+    m_out(output);
+    return true;
+  }
+
+  virtual bool finalize() override {
+    delete this;
+    return true;
+  }
+
+  bool encode(const char *data, size_t size, ZSTD_EndDirective mode, Data::Builder &db) {
+    char buf[DATA_CHUNK_SIZE];
+    ZSTD_inBuffer in = { data, size, 0 };
+    for (;;) {
+      ZSTD_outBuffer out = { buf, sizeof(buf), 0 };
+      auto ret = ZSTD_compressStream2(m_cs, &out, &in, mode);
+      if (ZSTD_isError(ret)) return false;
+      if (out.pos > 0) db.push(buf, out.pos);
+      if (mode == ZSTD_e_end) {
+        if (ret == 0) { m_done = true; break; }
+      } else if (in.pos == in.size) {
+        break;
+      }
+    }
+    return true;
+  }
+
+  static Data::Producer s_dp;
+};
+
+Data::Producer ZstdEncoder::s_dp("Compress (zstd)");
+
 //
 // Decompressor
 //
@@ -284,16 +524,149 @@ Decompressor* Decompressor::brotli(const std::function<void(Data&)> &out) {
   return new BrotliDecoder(out);
 }
 
+Decompressor* Decompressor::zstd(const std::function<void(Data&)> &out) {
+  return new ZstdDecoder(out);
+}
+
 //
 // Compressor
 //
 
-Compressor *Compressor::deflate(const Output &out) {
-  return new Deflate(out, false);
+Compressor *Compressor::make(Algorithm algorithm, const Output &out, const Params &params) {
+  switch (algorithm) {
+    case Algorithm::DEFLATE: return deflate(out, params);
+    case Algorithm::GZIP: return gzip(out, params);
+    case Algorithm::BROTLI: return brotli(out, params);
+    case Algorithm::ZSTD: return zstd(out, params);
+  }
+  return nullptr;
+}
+
+Compressor *Compressor::deflate(const Output &out, const Params &params) {
+  return new Deflate(out, false, params);
+}
+
+Compressor *Compressor::gzip(const Output &out, const Params &params) {
+  return new Deflate(out, true, params);
 }
 
-Compressor *Compressor::gzip(const Output &out) {
-  return new Deflate(out, true);
+Compressor *Compressor::brotli(const Output &out, const Params &params) {
+  return new BrotliEncoder(out, params);
+}
+
+Compressor *Compressor::zstd(const Output &out, const Params &params) {
+  return new ZstdEncoder(out, params);
+}
+
+bool Compressor::algorithm(const std::string &name, Algorithm &algorithm) {
+  if (name == "deflate") algorithm = Algorithm::DEFLATE;
+  else if (name == "gzip") algorithm = Algorithm::GZIP;
+  else if (name == "br") algorithm = Algorithm::BROTLI;
+  else if (name == "zstd") algorithm = Algorithm::ZSTD;
+  else return false;
+  return true;
+}
+
+auto Compressor::name(Algorithm algorithm) -> const char* {
+  switch (algorithm) {
+    case Algorithm::DEFLATE: return "deflate";
+    case Algorithm::GZIP: return "gzip";
+    case Algorithm::BROTLI: return "br";
+    case Algorithm::ZSTD: return "zstd";
+  }
+  return "";
+}
+
+//
+// CompressionCache
+//
+
+static const size_t s_compression_cache_limit = 64 * 1024 * 1024;
+
+struct CompressionCacheEntry {
+  std::string key;
+  pjs::Ref<SharedData> data;
+  size_t size;
+};
+
+static std::mutex* s_compression_cache_mutex = new std::mutex;
+static std::list<CompressionCacheEntry>* s_compression_cache_lru = new std::list<CompressionCacheEntry>;
+static std::unordered_map<std::string, std::list<CompressionCacheEntry>::iterator>* s_compression_cache_map =
+  new std::unordered_map<std::string, std::list<CompressionCacheEntry>::iterator>;
+static size_t s_compression_cache_size = 0;
+
+static auto compression_cache_key(
+  Compressor::Algorithm algorithm,
+  const Compressor::Params &params,
+  const Data &input
+) -> std::string {
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_size = 0;
+  auto *ctx = EVP_MD_CTX_new();
+  EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
+  for (const auto chk : input.chunks()) {
+    EVP_DigestUpdate(ctx, std::get<0>(chk), std::get<1>(chk));
+  }
+  EVP_DigestFinal_ex(ctx, digest, &digest_size);
+  EVP_MD_CTX_free(ctx);
+
+  std::string key(Compressor::name(algorithm));
+  key += ':';
+  key += std::to_string(params.level);
+  key += ':';
+  key += std::to_string(params.window);
+  key += ':';
+  key += std::to_string(input.size());
+  key += ':';
+  key.append((const char *)digest, digest_size);
+  return key;
+}
+
+bool CompressionCache::get(
+  Compressor::Algorithm algorithm,
+  const Compressor::Params &params,
+  const Data &input, Data &output
+) {
+  auto key = compression_cache_key(algorithm, params, input);
+
+  {
+    std::lock_guard<std::mutex> lock(*s_compression_cache_mutex);
+    auto i = s_compression_cache_map->find(key);
+    if (i != s_compression_cache_map->end()) {
+      auto e = i->second;
+      s_compression_cache_lru->splice(s_compression_cache_lru->end(), *s_compression_cache_lru, e);
+      e->data->to_data(output);
+      return true;
+    }
+  }
+
+  // Compress outside of the lock. Racing threads might both compress
+  // the same content, but only one of the results is kept.
+  Data compressed;
+  auto *compressor = Compressor::make(algorithm, [&](Data &data) { compressed.push(std::move(data)); }, params);
+  bool ok = compressor->input(input, true);
+  compressor->finalize();
+  if (!ok) return false;
+
+  std::lock_guard<std::mutex> lock(*s_compression_cache_mutex);
+  auto i = s_compression_cache_map->find(key);
+  if (i == s_compression_cache_map->end()) {
+    auto size = compressed.size() + key.size();
+    if (size <= s_compression_cache_limit) {
+      s_compression_cache_lru->push_back({ key, SharedData::make(compressed), size });
+      (*s_compression_cache_map)[key] = std::prev(s_compression_cache_lru->end());
+      s_compression_cache_size += size;
+      while (s_compression_cache_size > s_compression_cache_limit) {
+        auto &e = s_compression_cache_lru->front();
+        s_compression_cache_size -= e.size;
+        s_compression_cache_map->erase(e.key);
+        s_compression_cache_lru->pop_front();
+      }
+    }
+  }
+
+  output.push(std::move(compressed));
+  return true;
 }
 
 } // namespace pipy
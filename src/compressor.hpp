@@ -28,6 +28,7 @@
 
 #include <cstddef>
 #include <functional>
+#include <string>
 
 namespace pipy {
 
@@ -44,6 +45,7 @@ public:
   static Decompressor* inflate(const Output &out);
   static Decompressor* gzip(const Output &out);
   static Decompressor* brotli(const Output &out);
+  static Decompressor* zstd(const Output &out);
 
   virtual bool input(const Data &data) = 0;
   virtual bool finalize() = 0;
@@ -60,8 +62,35 @@ class Compressor {
 public:
   typedef std::function<void(Data&)> Output;
 
-  static Compressor* deflate(const Output &out);
-  static Compressor* gzip(const Output &out);
+  enum class Algorithm {
+    DEFLATE,
+    GZIP,
+    BROTLI,
+    ZSTD,
+  };
+
+  //
+  // Compressor::Params
+  //
+  // A level below 0 or a window of 0 (log2 of the window size)
+  // selects the default of the algorithm.
+  //
+
+  struct Params {
+    int level = -1;
+    int window = 0;
+    Params() {}
+    Params(int l, int w = 0) : level(l), window(w) {}
+  };
+
+  static Compressor* make(Algorithm algorithm, const Output &out, const Params &params = Params());
+  static Compressor* deflate(const Output &out, const Params &params = Params());
+  static Compressor* gzip(const Output &out, const Params &params = Params());
+  static Compressor* brotli(const Output &out, const Params &params = Params());
+  static Compressor* zstd(const Output &out, const Params &params = Params());
+
+  static bool algorithm(const std::string &name, Algorithm &algorithm);
+  static auto name(Algorithm algorithm) -> const char*;
 
   virtual bool input(const Data &data, bool flush) = 0;
   virtual bool flush() = 0;
@@ -70,6 +99,24 @@ public:
 protected:
   ~Compressor() {}
 };
+
+//
+// CompressionCache
+//
+// Process-wide cache of compressed outputs keyed by a digest of the
+// input content, so that identical content is compressed only once
+// by all threads regardless of where it is served from.
+//
+
+class CompressionCache {
+public:
+  static bool get(
+    Compressor::Algorithm algorithm,
+    const Compressor::Params &params,
+    const Data &input, Data &output
+  );
+};
+
 } // namespace pipy
 
 #endif // COMPRESSOR_HPP
@@ -50,12 +50,17 @@ void Data::pack(const Data &data, Producer *producer, double vacancy) {
     auto tail_offset = tail->offset;
     auto tail_length = tail->length;
     if (tail_length < occupancy || view->length + tail_length <= DATA_CHUNK_SIZE) {
-      if (tail_offset > 0 || tail->chunk->retain_count > 1) {
-        tail = tail->clone(producer);
+      auto capacity = tail->chunk->size();
+      if (
+        tail_offset > 0 || tail->chunk->retain_count > 1 ||
+        (capacity < DATA_CHUNK_SIZE && tail_length + view->length > capacity)
+      ) {
+        auto size = std::min(tail_length + view->length, int(DATA_CHUNK_SIZE));
+        tail = tail->clone(producer, std::max(size, Chunk::grow(capacity)));
         delete pop_view();
         push_view(tail);
       }
-      auto tail_room = DATA_CHUNK_SIZE - tail_length;
+      auto tail_room = tail->chunk->size() - tail_length;
       auto length = std::min(view->length, int(tail_room));
       std::memcpy(
         tail->chunk->data + tail_length,
@@ -261,6 +266,16 @@ template<> void ClassDef<pipy::Data>::init() {
     ret.set(out);
   });
 
+  method("test", [](Context &ctx, Object *obj, Value &ret) {
+    RegExp *pattern;
+    if (!ctx.arguments(1, &pattern)) return;
+    Regex::Scanner scanner(pattern->regex());
+    for (const auto c : obj->as<pipy::Data>()->chunks()) {
+      if (scanner.feed(std::get<0>(c), std::get<1>(c))) break;
+    }
+    ret.set(scanner.end());
+  });
+
   method("toArray", [](Context &ctx, Object *obj, Value &ret) {
     auto data = obj->as<pipy::Data>();
     auto a = Array::make(data->size());
@@ -79,12 +79,13 @@ public:
       }
     }
 
-    Producer(const std::string &name) : m_name(pjs::Str::make(name)), m_count(0) {
+    Producer(const std::string &name) : m_name(pjs::Str::make(name)), m_count(0), m_size(0) {
       s_all_producers.push(this);
     }
 
     auto name() const -> pjs::Str::CharData* { return m_name->data(); }
     auto count() const -> size_t { return m_count.load(std::memory_order_relaxed); }
+    auto size() const -> size_t { return m_size.load(std::memory_order_relaxed); }
 
     Data* make(int size) { return Data::make(size, this); }
     Data* make(int size, int value) { return Data::make(size, value, this); }
@@ -105,9 +106,17 @@ public:
   private:
     pjs::Ref<pjs::Str> m_name;
     std::atomic<size_t> m_count;
+    std::atomic<size_t> m_size;
 
-    void increase() { m_count.fetch_add(1, std::memory_order_relaxed); }
-    void decrease() { m_count.fetch_sub(1, std::memory_order_relaxed); }
+    void increase(size_t size) {
+      m_count.fetch_add(1, std::memory_order_relaxed);
+      m_size.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void decrease(size_t size) {
+      m_count.fetch_sub(1, std::memory_order_relaxed);
+      m_size.fetch_sub(size, std::memory_order_relaxed);
+    }
 
     static List<Producer> s_all_producers;
 
@@ -123,10 +132,10 @@ public:
     Builder(Data &data, Producer *producer = nullptr)
       : m_data(data)
       , m_producer(producer)
-      , m_chunk(new Chunk(producer)) {}
+      , m_chunk(Chunk::make(0, producer)) {}
 
     ~Builder() {
-      delete m_chunk;
+      m_chunk->free();
     }
 
     int size() const {
@@ -141,7 +150,7 @@ public:
     void flush() {
       if (m_ptr > 0) {
         m_data.push_view(new View(m_chunk, 0, m_ptr));
-        m_chunk = new Chunk(m_producer);
+        m_chunk = Chunk::make(m_ptr, m_producer);
         m_ptr = 0;
       }
     }
@@ -149,8 +158,8 @@ public:
     void push(char c) {
       m_chunk->data[m_ptr++] = c;
       m_size++;
-      if (m_ptr >= sizeof(m_chunk->data)) {
-        flush();
+      if (m_ptr >= m_chunk->size()) {
+        next();
       }
     }
 
@@ -162,16 +171,12 @@ public:
       auto &p = m_ptr;
       m_size += n;
       while (n > 0) {
-        int l = sizeof(m_chunk->data) - p;
+        int l = m_chunk->size() - p;
         if (l > n) l = n;
         std::memset(m_chunk->data + p, c, l);
         p += l;
         n -= l;
-        if (p >= sizeof(m_chunk->data)) {
-          m_data.push_view(new View(m_chunk, 0, p));
-          m_chunk = new Chunk(m_producer);
-          p = 0;
-        }
+        if (p >= m_chunk->size()) next();
       }
     }
 
@@ -183,17 +188,13 @@ public:
       auto &p = m_ptr;
       m_size += n;
       while (n > 0) {
-        int l = sizeof(m_chunk->data) - p;
+        int l = m_chunk->size() - p;
         if (l > n) l = n;
         std::memcpy(m_chunk->data + p, s, l);
         s += l;
         p += l;
         n -= l;
-        if (p >= sizeof(m_chunk->data)) {
-          m_data.push_view(new View(m_chunk, 0, p));
-          m_chunk = new Chunk(m_producer);
-          p = 0;
-        }
+        if (p >= m_chunk->size()) next();
       }
     }
 
@@ -229,6 +230,15 @@ public:
     Chunk* m_chunk;
     int m_ptr = 0;
     int m_size = 0;
+
+    // Start small and move up one size class each time
+    // a chunk fills up, so short outputs stay in small chunks
+    void next() {
+      auto size = m_chunk->size();
+      m_data.push_view(new View(m_chunk, 0, m_ptr));
+      m_chunk = Chunk::make(Chunk::grow(size), m_producer);
+      m_ptr = 0;
+    }
   };
 
   //
@@ -355,23 +365,51 @@ private:
   // Data::Chunk
   //
 
-  struct Chunk : public Pooled<Chunk> {
+  struct Chunk {
+
+    // Size classes, so that small payloads don't pin a whole
+    // DATA_CHUNK_SIZE block and bulk transfers can use bigger ones
+    enum {
+      TINY = 0x200,
+      SMALL = 0x800,
+      MEDIUM = DATA_CHUNK_SIZE,
+      LARGE = 0x10000,
+    };
+
+    static auto make(int size, Producer *producer) -> Chunk*;
+
+    static auto grow(int size) -> int {
+      if (size < SMALL) return SMALL;
+      if (size < MEDIUM) return MEDIUM;
+      return size;
+    }
+
     std::atomic<int> retain_count;
-    char data[DATA_CHUNK_SIZE];
+    char* const data;
 
-    Chunk(Producer *producer)
+    Chunk(char *buffer, int size, Producer *producer)
       : retain_count(0)
-      , m_producer(producer ? producer : Producer::unknown()) { m_producer->increase(); }
-    ~Chunk() { m_producer->decrease(); }
+      , data(buffer)
+      , m_size(size)
+      , m_producer(producer ? producer : Producer::unknown()) { m_producer->increase(size); }
+    ~Chunk() { m_producer->decrease(m_size); }
 
-    auto size() const -> int { return sizeof(data); }
+    auto size() const -> int { return m_size; }
     void retain() { retain_count.fetch_add(1, std::memory_order_relaxed); }
-    void release() { if (retain_count.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this; }
+    void release() { if (retain_count.fetch_sub(1, std::memory_order_acq_rel) == 1) free(); }
+    void free();
 
   private:
+    int m_size;
     Producer* m_producer;
   };
 
+  template<int N>
+  struct ChunkOf : public Pooled<ChunkOf<N>, Chunk> {
+    char buffer[N];
+    ChunkOf(Producer *producer) : Pooled<ChunkOf<N>, Chunk>(buffer, N, producer) {}
+  };
+
   //
   // Data::View
   //
@@ -427,9 +465,9 @@ private:
       return view;
     }
 
-    View* clone(Producer *producer) {
+    View* clone(Producer *producer, int size = 0) {
       if (!producer) producer = &s_unknown_producer;
-      auto new_chunk = new Chunk(producer);
+      auto new_chunk = Chunk::make(std::max(size, length), producer);
       std::memcpy(new_chunk->data, chunk->data + offset, length);
       return new View(new_chunk, 0, length);
     }
@@ -496,7 +534,7 @@ public:
   {
     if (!producer) producer = &s_unknown_producer;
     while (size > 0) {
-      auto chunk = new Chunk(producer);
+      auto chunk = Chunk::make(size, producer);
       auto length = std::min(size, chunk->size());
       push_view(new View(chunk, 0, length));
       size -= length;
@@ -510,7 +548,7 @@ public:
   {
     if (!producer) producer = &s_unknown_producer;
     while (size > 0) {
-      auto chunk = new Chunk(producer);
+      auto chunk = Chunk::make(size, producer);
       auto length = std::min(size, chunk->size());
       std::memset(chunk->data, value, length);
       push_view(new View(chunk, 0, length));
@@ -718,7 +756,9 @@ public:
       }
     }
     while (n > 0) {
-      auto view = new View(new Chunk(producer), 0, 0);
+      auto size = std::min(n, int(Chunk::MEDIUM));
+      if (m_tail) size = std::max(size, Chunk::grow(m_tail->chunk->size()));
+      auto view = new View(Chunk::make(size, producer), 0, 0);
       auto added = view->push(p, n);
       p += added;
       n -= added;
@@ -744,7 +784,10 @@ public:
         }
       }
     }
-    auto chunk = new Chunk(producer ? producer : &s_unknown_producer);
+    auto chunk = Chunk::make(
+      m_tail ? Chunk::grow(m_tail->chunk->size()) : 1,
+      producer ? producer : &s_unknown_producer
+    );
     auto view = new View(chunk, 0, 1);
     chunk->data[0] = ch;
     push_view(view);
@@ -1132,6 +1175,22 @@ private:
   friend class pjs::RefCountMT<SharedData>;
 };
 
+inline auto Data::Chunk::make(int size, Producer *producer) -> Chunk* {
+  if (size <= TINY) return new ChunkOf<TINY>(producer);
+  if (size <= SMALL) return new ChunkOf<SMALL>(producer);
+  if (size < LARGE) return new ChunkOf<MEDIUM>(producer);
+  return new ChunkOf<LARGE>(producer);
+}
+
+inline void Data::Chunk::free() {
+  switch (m_size) {
+    case TINY: delete static_cast<ChunkOf<TINY>*>(this); break;
+    case SMALL: delete static_cast<ChunkOf<SMALL>*>(this); break;
+    case MEDIUM: delete static_cast<ChunkOf<MEDIUM>*>(this); break;
+    case LARGE: delete static_cast<ChunkOf<LARGE>*>(this); break;
+  }
+}
+
 inline Data::Data(const SharedData &other)
   : m_head(nullptr)
   , m_tail(nullptr)
@@ -0,0 +1,954 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "cache.hpp"
+#include "pipeline.hpp"
+#include "input.hpp"
+#include "utils.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace pipy {
+
+thread_local static const pjs::ConstStr s_GET("GET");
+thread_local static const pjs::ConstStr s_HEAD("HEAD");
+thread_local static const pjs::ConstStr s_POST("POST");
+thread_local static const pjs::ConstStr s_PUT("PUT");
+thread_local static const pjs::ConstStr s_PATCH("PATCH");
+thread_local static const pjs::ConstStr s_DELETE("DELETE");
+thread_local static const pjs::ConstStr s_host("host");
+thread_local static const pjs::ConstStr s_age("age");
+thread_local static const pjs::ConstStr s_authorization("authorization");
+thread_local static const pjs::ConstStr s_cache_control("cache-control");
+thread_local static const pjs::ConstStr s_content_length("content-length");
+thread_local static const pjs::ConstStr s_date("date");
+thread_local static const pjs::ConstStr s_etag("etag");
+thread_local static const pjs::ConstStr s_expires("expires");
+thread_local static const pjs::ConstStr s_if_modified_since("if-modified-since");
+thread_local static const pjs::ConstStr s_if_none_match("if-none-match");
+thread_local static const pjs::ConstStr s_last_modified("last-modified");
+thread_local static const pjs::ConstStr s_pragma("pragma");
+thread_local static const pjs::ConstStr s_set_cookie("set-cookie");
+thread_local static const pjs::ConstStr s_vary("vary");
+
+static bool get_header(pjs::Object *headers, pjs::Str *name, std::string &value) {
+  if (!headers) return false;
+  pjs::Value v;
+  headers->get(name, v);
+  if (v.is_undefined()) return false;
+  if (v.is_string()) {
+    value = v.s()->str();
+  } else {
+    auto *s = v.to_string();
+    value = s->str();
+    s->release();
+  }
+  return true;
+}
+
+static auto trim(const std::string &str) -> std::string {
+  size_t i = 0, j = str.length();
+  while (i < j && std::isspace((unsigned char)str[i])) i++;
+  while (j > i && std::isspace((unsigned char)str[j-1])) j--;
+  return str.substr(i, j - i);
+}
+
+static auto split_list(const std::string &str) -> std::vector<std::string> {
+  std::vector<std::string> list;
+  size_t i = 0;
+  while (i <= str.length()) {
+    auto j = str.find(',', i);
+    if (j == std::string::npos) j = str.length();
+    auto item = trim(str.substr(i, j - i));
+    if (!item.empty()) list.push_back(item);
+    i = j + 1;
+  }
+  return list;
+}
+
+//
+// Parses an IMF-fixdate such as "Sun, 06 Nov 1994 08:49:37 GMT"
+// into milliseconds since the epoch
+//
+
+static bool parse_http_date(const std::string &str, double &ms) {
+  static const char *months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+  };
+  char mon[4] = { 0 };
+  int d, y, h, m, s;
+  auto p = std::strchr(str.c_str(), ',');
+  if (!p) return false;
+  if (std::sscanf(p + 1, " %d %3s %d %d:%d:%d", &d, mon, &y, &h, &m, &s) != 6) return false;
+  int mi = -1;
+  for (int i = 0; i < 12; i++) if (!std::strcmp(mon, months[i])) { mi = i; break; }
+  if (mi < 0) return false;
+
+  // Days from civil, see http://howardhinnant.github.io/date_algorithms.html
+  int yy = y - (mi < 2);
+  int era = (yy >= 0 ? yy : yy - 399) / 400;
+  int yoe = yy - era * 400;
+  int mp = (mi + 10) % 12;
+  int doy = (153 * mp + 2) / 5 + d - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  double days = double(era) * 146097 + doe - 719468;
+
+  ms = ((days * 24 + h) * 60 + m) * 60 + s;
+  ms *= 1000;
+  return true;
+}
+
+static auto lowercase(std::string str) -> std::string {
+  for (auto &c : str) c = std::tolower((unsigned char)c);
+  return str;
+}
+
+//
+// Hop-by-hop headers only make sense for the connection a response
+// came in on, so they are left out of stored responses, along with
+// any header named in Connection (RFC 9111 section 3.1)
+//
+
+static auto end_to_end_headers(pjs::Object *headers) -> pjs::Object* {
+  static const char *hop_by_hop[] = {
+    "connection", "keep-alive", "proxy-authenticate", "proxy-authorization",
+    "proxy-connection", "te", "trailer", "transfer-encoding", "upgrade",
+  };
+  std::set<std::string> names(std::begin(hop_by_hop), std::end(hop_by_hop));
+  headers->iterate_all(
+    [&](pjs::Str *k, pjs::Value &v) {
+      if (lowercase(k->str()) != "connection") return;
+      auto *s = v.to_string();
+      for (const auto &name : split_list(s->str())) names.insert(lowercase(name));
+      s->release();
+    }
+  );
+  auto *obj = pjs::Object::make();
+  headers->iterate_all(
+    [&](pjs::Str *k, pjs::Value &v) {
+      if (!names.count(lowercase(k->str()))) obj->set(k, v);
+    }
+  );
+  return obj;
+}
+
+static auto strip_weak(const std::string &etag) -> std::string {
+  if (etag.length() > 2 && etag[0] == 'W' && etag[1] == '/') return etag.substr(2);
+  return etag;
+}
+
+//
+// CacheHTTP::Response
+//
+
+struct CacheHTTP::Response {
+  int status = 200;
+  std::string status_text;
+  pjs::Ref<pjs::SharedObject> headers;
+  pjs::Ref<SharedData> body;
+  size_t size = 0;
+  double response_time = 0;
+  double initial_age = 0;
+  double lifetime = 0;
+  bool no_cache = false;
+  bool must_revalidate = false;
+  std::string etag;
+  std::string last_modified;
+  std::vector<std::pair<std::string, std::string>> vary;
+};
+
+//
+// CacheHTTP::Store
+//
+// Process-wide response storage shared by all cacheHTTP filters using
+// the same store name. Responses are immutable once stored, so readers
+// only hold the lock long enough to copy a shared pointer.
+//
+
+class CacheHTTP::Store {
+public:
+  static auto get(const std::string &name, size_t memory_limit) -> std::shared_ptr<Store> {
+    static auto *stores = new std::map<std::string, std::shared_ptr<Store>>;
+    static auto *mutex = new std::mutex;
+    std::lock_guard<std::mutex> lock(*mutex);
+    auto &p = (*stores)[name];
+    if (!p) {
+      p = std::make_shared<Store>(memory_limit);
+    } else if (p->m_memory_limit != memory_limit) {
+      std::string msg("cache store '");
+      throw std::runtime_error(msg + name + "' already exists with a different memoryLimit");
+    }
+    return p;
+  }
+
+  Store(size_t memory_limit) : m_memory_limit(memory_limit) {}
+
+  auto find(
+    const std::string &key,
+    const std::function<bool(const Response*)> &match
+  ) -> std::shared_ptr<const Response> {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto i = m_entries.find(key);
+    if (i == m_entries.end()) return nullptr;
+    auto *e = i->second;
+    for (const auto &r : e->variants) {
+      if (match(r.get())) {
+        unlink(e);
+        link(e);
+        return r;
+      }
+    }
+    return nullptr;
+  }
+
+  void insert(const std::string &key, const std::shared_ptr<const Response> &response) {
+    std::vector<std::shared_ptr<const Response>> dropped;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &e = m_entries[key];
+    if (e) {
+      unlink(e);
+    } else {
+      e = new Entry;
+      e->key = key;
+    }
+    auto &variants = e->variants;
+    for (auto i = variants.begin(); i != variants.end(); ++i) {
+      if ((*i)->vary == response->vary) {
+        dropped.push_back(*i);
+        variants.erase(i);
+        break;
+      }
+    }
+    if (variants.size() >= s_max_variants) {
+      dropped.push_back(variants.front());
+      variants.erase(variants.begin());
+    }
+    variants.push_back(response);
+    for (const auto &r : dropped) e->size -= r->size;
+    e->size += response->size;
+    link(e);
+    evict();
+  }
+
+  void erase(const std::string &key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto i = m_entries.find(key);
+    if (i == m_entries.end()) return;
+    auto *e = i->second;
+    unlink(e);
+    m_entries.erase(i);
+    delete e;
+  }
+
+  bool lead(const std::string &key, Waiter *waiter) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto i = m_leads.find(key);
+    if (i == m_leads.end()) {
+      m_leads[key];
+      return true;
+    }
+    i->second.push_back(waiter);
+    return false;
+  }
+
+  void unlead(const std::string &key) {
+    std::vector<pjs::Ref<Waiter>> waiters;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto i = m_leads.find(key);
+      if (i == m_leads.end()) return;
+      waiters.swap(i->second);
+      m_leads.erase(i);
+    }
+    for (const auto &w : waiters) w->wake();
+  }
+
+private:
+  struct Entry {
+    std::string key;
+    std::vector<std::shared_ptr<const Response>> variants;
+    size_t size = 0;
+    Entry* prev = nullptr;
+    Entry* next = nullptr;
+  };
+
+  std::mutex m_mutex;
+  const size_t m_memory_limit;
+  size_t m_size = 0;
+  std::unordered_map<std::string, Entry*> m_entries;
+  std::unordered_map<std::string, std::vector<pjs::Ref<Waiter>>> m_leads;
+  Entry* m_head = nullptr;
+  Entry* m_tail = nullptr;
+
+  static const size_t s_max_variants = 8;
+
+  void link(Entry *e) {
+    e->prev = m_tail;
+    e->next = nullptr;
+    if (m_tail) m_tail->next = e; else m_head = e;
+    m_tail = e;
+    m_size += e->size;
+  }
+
+  void unlink(Entry *e) {
+    if (e->prev) e->prev->next = e->next; else m_head = e->next;
+    if (e->next) e->next->prev = e->prev; else m_tail = e->prev;
+    e->prev = e->next = nullptr;
+    m_size -= e->size;
+  }
+
+  void evict() {
+    while (m_head && m_size > m_memory_limit) {
+      auto *e = m_head;
+      unlink(e);
+      m_entries.erase(e->key);
+      delete e;
+    }
+  }
+};
+
+//
+// CacheHTTP::Directives
+//
+
+void CacheHTTP::Directives::parse(const std::string &str) {
+  for (const auto &item : split_list(str)) {
+    auto i = item.find('=');
+    auto name = trim(item.substr(0, i));
+    std::string value;
+    if (i != std::string::npos) {
+      value = trim(item.substr(i + 1));
+      if (value.length() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.length() - 2);
+      }
+    }
+    for (auto &c : name) c = std::tolower((unsigned char)c);
+    auto seconds = [&]() { return value.empty() ? 0 : std::max(0.0, std::atof(value.c_str())); };
+    if (name == "no-store") no_store = true;
+    else if (name == "no-cache") no_cache = true;
+    else if (name == "private") is_private = true;
+    else if (name == "public") is_public = true;
+    else if (name == "must-revalidate") must_revalidate = true;
+    else if (name == "proxy-revalidate") must_revalidate = true;
+    else if (name == "only-if-cached") only_if_cached = true;
+    else if (name == "max-age") max_age = seconds();
+    else if (name == "s-maxage") s_maxage = seconds();
+    else if (name == "min-fresh") min_fresh = seconds();
+    else if (name == "max-stale") {
+      if (value.empty()) max_stale_any = true; else max_stale = seconds();
+    }
+  }
+}
+
+//
+// CacheHTTP::Waiter
+//
+
+CacheHTTP::Waiter::Waiter(CacheHTTP *filter)
+  : m_filter(filter)
+  , m_net(&Net::current())
+{
+}
+
+void CacheHTTP::Waiter::wake() {
+  retain();
+  m_net->post(
+    [this]() {
+      if (auto *filter = m_filter) {
+        InputContext ic;
+        filter->on_wake();
+      }
+      release();
+    }
+  );
+}
+
+//
+// CacheHTTP::Options
+//
+
+CacheHTTP::Options::Options(pjs::Object *options) {
+  Value(options, "store")
+    .get(store)
+    .check_nullable();
+  Value(options, "memoryLimit")
+    .get_binary_size(memory_limit)
+    .check_nullable();
+  Value(options, "maxBodySize")
+    .get_binary_size(max_body_size)
+    .check_nullable();
+  Value(options, "ttl")
+    .get_seconds(ttl)
+    .check_nullable();
+  Value(options, "coalesce")
+    .get(coalesce)
+    .check_nullable();
+  Value(options, "coalesceTimeout")
+    .get_seconds(coalesce_timeout)
+    .check_nullable();
+  Value(options, "key")
+    .get(key_f)
+    .check_nullable();
+}
+
+//
+// CacheHTTP
+//
+
+CacheHTTP::CacheHTTP(const Options &options)
+  : m_options(options)
+  , m_store(Store::get(options.store, options.memory_limit))
+  , m_buffer(Filter::buffer_stats())
+{
+}
+
+CacheHTTP::CacheHTTP(const CacheHTTP &r)
+  : Filter(r)
+  , m_options(r.m_options)
+  , m_store(r.m_store)
+  , m_buffer(r.m_buffer)
+{
+}
+
+CacheHTTP::~CacheHTTP() {
+  if (m_waiter) m_waiter->cancel();
+  unlead();
+}
+
+void CacheHTTP::dump(Dump &d) {
+  Filter::dump(d);
+  d.name = "cacheHTTP";
+}
+
+auto CacheHTTP::clone() -> Filter* {
+  return new CacheHTTP(*this);
+}
+
+void CacheHTTP::reset() {
+  Filter::reset();
+  EventSource::close();
+  if (m_waiter) {
+    m_waiter->cancel();
+    m_waiter = nullptr;
+  }
+  m_wait_timer.cancel();
+  unlead();
+  m_state = IDLE;
+  m_pipeline = nullptr;
+  m_request = nullptr;
+  m_response = nullptr;
+  m_cached = nullptr;
+  m_capture = nullptr;
+  m_key.clear();
+  m_directives = Directives();
+  m_buffer.clear();
+  m_body.clear();
+  m_is_head = false;
+  m_is_revalidating = false;
+  m_is_swallowing = false;
+  m_has_waited = false;
+  m_invalidate = false;
+  m_request_ended = false;
+}
+
+void CacheHTTP::process(Event *evt) {
+  switch (m_state) {
+    case IDLE:
+      if (auto *start = evt->as<MessageStart>()) {
+        m_buffer.push(evt);
+        begin(start);
+      } else {
+        m_buffer.push(evt);
+        bypass();
+      }
+      break;
+    case BYPASS:
+    case FORWARD:
+      Filter::output(evt, m_pipeline->input());
+      break;
+    case WAIT:
+      if (evt->is<MessageEnd>()) m_request_ended = true;
+      m_buffer.push(evt);
+      break;
+    case SERVE:
+      if (evt->is<MessageEnd>()) {
+        m_request_ended = true;
+        serve(m_cached.get());
+      }
+      break;
+    case DONE:
+      break;
+  }
+}
+
+void CacheHTTP::on_reply(Event *evt) {
+  if (m_is_swallowing) return;
+
+  if (auto *start = evt->as<MessageStart>()) {
+    m_response_time = utils::now();
+    pjs::Ref<http::ResponseHead> head = pjs::coerce<http::ResponseHead>(start->head());
+    m_response = head;
+    if (m_invalidate && head->status < 400) {
+      m_store->erase(m_key);
+    }
+    if (m_is_revalidating && head->status == 304) {
+      std::shared_ptr<const Response> r(revalidate(head));
+      m_store->insert(m_key, r);
+      m_is_swallowing = true;
+      serve(r.get());
+      return;
+    }
+    if (m_state == FORWARD && storable(head)) {
+      m_capture.reset(capture(head));
+      m_body.clear();
+    } else {
+      unlead();
+    }
+
+  } else if (auto *data = evt->as<Data>()) {
+    if (m_capture) {
+      if (m_body.size() + data->size() > m_options.max_body_size) {
+        m_capture = nullptr;
+        m_body.clear();
+        unlead();
+      } else {
+        m_body.push(*data);
+      }
+    }
+
+  } else if (evt->is<MessageEnd>()) {
+    if (auto r = m_capture) {
+      r->body = SharedData::make(m_body);
+      r->size += m_body.size();
+      m_store->insert(m_key, r);
+      m_capture = nullptr;
+      m_body.clear();
+    }
+    unlead();
+
+  } else if (evt->is<StreamEnd>()) {
+    m_capture = nullptr;
+    m_body.clear();
+    unlead();
+  }
+
+  Filter::output(evt);
+}
+
+void CacheHTTP::begin(MessageStart *start) {
+  if (!start->head()) {
+    bypass();
+    return;
+  }
+
+  pjs::Ref<http::RequestHead> head = pjs::coerce<http::RequestHead>(start->head());
+  m_request = head;
+  m_request_time = utils::now();
+
+  auto method = head->method.get();
+  if (method != s_GET && method != s_HEAD) {
+    if (method == s_POST || method == s_PUT || method == s_PATCH || method == s_DELETE) {
+      if (!make_key(head)) return;
+      m_invalidate = true;
+    }
+    bypass();
+    return;
+  }
+
+  std::string str;
+  auto headers = head->headers.get();
+  if (get_header(headers, s_cache_control, str)) {
+    m_directives.parse(str);
+  } else if (get_header(headers, s_pragma, str)) {
+    if (str.find("no-cache") != std::string::npos) m_directives.no_cache = true;
+  }
+
+  if (m_directives.no_store) {
+    bypass();
+    return;
+  }
+
+  if (!make_key(head)) return;
+  m_is_head = (method == s_HEAD);
+  lookup();
+}
+
+bool CacheHTTP::make_key(http::RequestHead *head) {
+  if (auto *f = m_options.key_f.get()) {
+    pjs::Value arg(head), ret;
+    if (!Filter::callback(f, 1, &arg, ret)) return false;
+    auto *s = ret.to_string();
+    m_key = s->str();
+    s->release();
+  } else {
+    std::string host;
+    if (head->authority) {
+      host = head->authority->str();
+    } else {
+      get_header(head->headers, s_host, host);
+    }
+    auto *scheme = head->scheme.get();
+    m_key = scheme && scheme->length() > 0 ? scheme->str() : "http";
+    m_key += "://";
+    m_key += host;
+    if (head->path) m_key += head->path->str();
+  }
+  return true;
+}
+
+void CacheHTTP::lookup() {
+  auto now = utils::now();
+  auto cached = m_store->find(m_key, [this](const Response *r) { return matches(r); });
+
+  if (cached && usable(cached.get(), now)) {
+    m_cached = cached;
+    m_state = SERVE;
+    if (m_request_ended) serve(m_cached.get());
+    return;
+  }
+
+  if (m_directives.only_if_cached) {
+    m_cached = nullptr;
+    m_state = SERVE;
+    if (m_request_ended) serve(nullptr);
+    return;
+  }
+
+  if (m_is_head) {
+    bypass();
+    return;
+  }
+
+  // A conditional request from the client goes upstream as is, since
+  // a 304 to its own validators says nothing about our cached copy
+  auto headers = m_request->headers.get();
+  if (headers && (headers->has(s_if_none_match) || headers->has(s_if_modified_since))) {
+    forward();
+    return;
+  }
+
+  if (cached && (!cached->etag.empty() || !cached->last_modified.empty())) {
+    m_cached = cached;
+    m_is_revalidating = true;
+    forward();
+    return;
+  }
+
+  if (m_options.coalesce && !m_has_waited) {
+    if (!m_waiter) m_waiter = new Waiter(this);
+    if (!m_store->lead(m_key, m_waiter)) {
+      m_state = WAIT;
+      if (m_options.coalesce_timeout > 0) {
+        m_wait_timer.schedule(
+          m_options.coalesce_timeout,
+          [this]() {
+            InputContext ic;
+            on_wait_timeout();
+          }
+        );
+      }
+      return;
+    }
+    m_waiter = nullptr;
+    m_is_leader = true;
+  }
+
+  forward();
+}
+
+void CacheHTTP::bypass() {
+  forward();
+  m_state = BYPASS;
+}
+
+void CacheHTTP::forward() {
+  m_state = FORWARD;
+  m_pipeline = sub_pipeline(0, false, EventSource::reply())->start();
+  auto *input = m_pipeline->input();
+  if (m_is_revalidating) {
+    if (auto *evt = m_buffer.shift()) {
+      auto *head = http::RequestHead::make();
+      auto *headers = pjs::Object::make();
+      head->protocol = m_request->protocol;
+      head->method = m_request->method;
+      head->scheme = m_request->scheme;
+      head->authority = m_request->authority;
+      head->path = m_request->path;
+      head->headers = headers;
+      if (auto *h = m_request->headers.get()) {
+        h->iterate_all([&](pjs::Str *k, pjs::Value &v) { headers->set(k, v); });
+      }
+      if (!m_cached->etag.empty()) {
+        headers->set(s_if_none_match, pjs::Str::make(m_cached->etag));
+      }
+      if (!m_cached->last_modified.empty()) {
+        headers->set(s_if_modified_since, pjs::Str::make(m_cached->last_modified));
+      }
+      Filter::output(MessageStart::make(head), input);
+      evt->release();
+    }
+  }
+  while (auto *evt = m_buffer.shift()) {
+    Filter::output(evt, input);
+    evt->release();
+  }
+}
+
+void CacheHTTP::serve(const Response *r) {
+  m_state = DONE;
+  m_buffer.clear();
+
+  auto head = http::ResponseHead::make();
+
+  if (!r) {
+    head->status = 504;
+    head->headers = pjs::Object::make();
+    Filter::output(MessageStart::make(head));
+    Filter::output(MessageEnd::make());
+    return;
+  }
+
+  auto headers = r->headers ? r->headers->to_object() : pjs::Object::make();
+  auto age = (r->initial_age + utils::now() - r->response_time) / 1000;
+  headers->set(s_age, pjs::Str::make(std::to_string(int64_t(std::max(0.0, age)))));
+  head->headers = headers;
+
+  if (not_modified(r)) {
+    head->status = 304;
+    headers->ht_delete(s_content_length);
+    Filter::output(MessageStart::make(head));
+    Filter::output(MessageEnd::make());
+    return;
+  }
+
+  head->status = r->status;
+  if (!r->status_text.empty()) head->statusText = pjs::Str::make(r->status_text);
+  Filter::output(MessageStart::make(head));
+  if (!m_is_head && r->body) Filter::output(Data::make(*r->body));
+  Filter::output(MessageEnd::make());
+}
+
+void CacheHTTP::unlead() {
+  if (m_is_leader) {
+    m_is_leader = false;
+    m_store->unlead(m_key);
+  }
+}
+
+void CacheHTTP::on_wake() {
+  m_waiter = nullptr;
+  m_wait_timer.cancel();
+  if (m_state != WAIT) return;
+  m_has_waited = true;
+  lookup();
+}
+
+// The leader is taking too long, so stop waiting and go upstream
+void CacheHTTP::on_wait_timeout() {
+  if (m_state != WAIT) return;
+  if (m_waiter) {
+    m_waiter->cancel();
+    m_waiter = nullptr;
+  }
+  m_has_waited = true;
+  lookup();
+}
+
+bool CacheHTTP::storable(http::ResponseHead *head) {
+  switch (head->status) {
+    case 200: case 203: case 204: case 300: case 301: case 308:
+    case 404: case 405: case 410: case 414: case 501:
+      break;
+    default: return false;
+  }
+
+  std::string str;
+  Directives d;
+  auto headers = head->headers.get();
+  if (get_header(headers, s_cache_control, str)) d.parse(str);
+  if (d.no_store || d.is_private) return false;
+
+  if (get_header(m_request->headers, s_authorization, str)) {
+    if (!d.is_public && !d.must_revalidate && d.s_maxage < 0) return false;
+  }
+
+  if (headers) {
+    if (headers->has(s_set_cookie)) return false;
+    if (get_header(headers, s_vary, str) && str.find('*') != std::string::npos) return false;
+    bool all_strings = headers->iterate_while(
+      [](pjs::Str *, pjs::Value &v) { return v.is_string() || v.is_number(); }
+    );
+    if (!all_strings) return false;
+  }
+
+  return true;
+}
+
+auto CacheHTTP::capture(http::ResponseHead *head) -> Response* {
+  auto *r = new Response;
+  r->status = head->status;
+  if (head->statusText) r->status_text = head->statusText->str();
+  r->response_time = m_response_time;
+
+  pjs::Ref<pjs::Object> headers(
+    head->headers ? end_to_end_headers(head->headers) : pjs::Object::make()
+  );
+  r->headers = pjs::SharedObject::make(headers);
+  freshen(r, headers);
+
+  std::string str;
+  if (get_header(headers, s_vary, str)) {
+    for (auto &name : split_list(str)) {
+      for (auto &c : name) c = std::tolower((unsigned char)c);
+      std::string value;
+      pjs::Ref<pjs::Str> key(pjs::Str::make(name));
+      get_header(m_request->headers, key, value);
+      r->vary.emplace_back(name, value);
+    }
+  }
+
+  r->size = sizeof(Response) + m_key.size();
+  headers->iterate_all(
+    [&](pjs::Str *k, pjs::Value &v) {
+      r->size += k->size() + (v.is_string() ? v.s()->size() : sizeof(double));
+    }
+  );
+
+  // Not worth keeping if it can neither be served nor revalidated
+  if (r->lifetime <= r->initial_age && r->etag.empty() && r->last_modified.empty()) {
+    delete r;
+    return nullptr;
+  }
+
+  return r;
+}
+
+auto CacheHTTP::revalidate(http::ResponseHead *head) -> Response* {
+  auto *r = new Response(*m_cached);
+  auto headers = r->headers ? r->headers->to_object() : pjs::Object::make();
+  if (auto *h = head->headers.get()) {
+    pjs::Ref<pjs::Object> updates(end_to_end_headers(h));
+    updates->iterate_all(
+      [&](pjs::Str *k, pjs::Value &v) {
+        if (k == s_content_length) return;
+        headers->set(k, v);
+      }
+    );
+  }
+  r->headers = pjs::SharedObject::make(headers);
+  r->response_time = m_response_time;
+  freshen(r, headers);
+  return r;
+}
+
+void CacheHTTP::freshen(Response *r, pjs::Object *headers) {
+  std::string str;
+  Directives d;
+  if (get_header(headers, s_cache_control, str)) d.parse(str);
+
+  double date = r->response_time;
+  if (get_header(headers, s_date, str)) parse_http_date(str, date);
+
+  double age = 0;
+  if (get_header(headers, s_age, str)) age = std::max(0.0, std::atof(str.c_str())) * 1000;
+
+  auto apparent_age = std::max(0.0, r->response_time - date);
+  auto corrected_age = age + (r->response_time - m_request_time);
+  r->initial_age = std::max(apparent_age, corrected_age);
+
+  r->etag.clear();
+  r->last_modified.clear();
+  get_header(headers, s_etag, r->etag);
+  get_header(headers, s_last_modified, r->last_modified);
+
+  double last_modified, expires;
+  if (d.s_maxage >= 0) {
+    r->lifetime = d.s_maxage * 1000;
+  } else if (d.max_age >= 0) {
+    r->lifetime = d.max_age * 1000;
+  } else if (get_header(headers, s_expires, str)) {
+    r->lifetime = parse_http_date(str, expires) ? std::max(0.0, expires - date) : 0;
+  } else if (!r->last_modified.empty() && parse_http_date(r->last_modified, last_modified)) {
+    r->lifetime = std::min(std::max(0.0, date - last_modified) / 10, 24 * 3600 * 1000.0);
+  } else {
+    r->lifetime = m_options.ttl * 1000;
+  }
+
+  r->no_cache = d.no_cache;
+  r->must_revalidate = d.must_revalidate || d.s_maxage >= 0;
+}
+
+bool CacheHTTP::usable(const Response *r, double now) {
+  if (r->no_cache || m_directives.no_cache) return false;
+  auto age = r->initial_age + (now - r->response_time);
+  auto &d = m_directives;
+  if (d.max_age >= 0 && age > d.max_age * 1000) return false;
+  if (d.min_fresh >= 0 && r->lifetime - age < d.min_fresh * 1000) return false;
+  if (r->lifetime > age) return true;
+  if (r->must_revalidate) return false;
+  if (d.max_stale_any) return true;
+  if (d.max_stale >= 0 && age - r->lifetime <= d.max_stale * 1000) return true;
+  return false;
+}
+
+bool CacheHTTP::matches(const Response *r) {
+  for (const auto &p : r->vary) {
+    std::string value;
+    pjs::Ref<pjs::Str> name(pjs::Str::make(p.first));
+    get_header(m_request->headers, name, value);
+    if (value != p.second) return false;
+  }
+  return true;
+}
+
+bool CacheHTTP::not_modified(const Response *r) {
+  std::string str;
+  auto headers = m_request->headers.get();
+  if (get_header(headers, s_if_none_match, str)) {
+    if (r->etag.empty()) return false;
+    auto etag = strip_weak(r->etag);
+    for (const auto &tag : split_list(str)) {
+      if (tag == "*" || strip_weak(tag) == etag) return true;
+    }
+    return false;
+  }
+  if (get_header(headers, s_if_modified_since, str)) {
+    double since, last_modified;
+    if (r->last_modified.empty()) return false;
+    if (!parse_http_date(str, since)) return false;
+    if (!parse_http_date(r->last_modified, last_modified)) return false;
+    return last_modified <= since;
+  }
+  return false;
+}
+
+} // namespace pipy
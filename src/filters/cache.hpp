@@ -0,0 +1,163 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include "filter.hpp"
+#include "buffer.hpp"
+#include "data.hpp"
+#include "options.hpp"
+#include "net.hpp"
+#include "timer.hpp"
+#include "api/http.hpp"
+
+#include <memory>
+#include <string>
+
+namespace pipy {
+
+//
+// CacheHTTP
+//
+
+class CacheHTTP : public Filter, public EventSource {
+public:
+  struct Options : public pipy::Options {
+    std::string store;
+    size_t memory_limit = 64 * 1024 * 1024;
+    size_t max_body_size = 1024 * 1024;
+    double ttl = 0;
+    bool coalesce = true;
+    double coalesce_timeout = 5;
+    pjs::Ref<pjs::Function> key_f;
+    Options() {}
+    Options(pjs::Object *options);
+  };
+
+  CacheHTTP(const Options &options);
+
+  class Store;
+  struct Response;
+
+private:
+  CacheHTTP(const CacheHTTP &r);
+  ~CacheHTTP();
+
+  virtual auto clone() -> Filter* override;
+  virtual void reset() override;
+  virtual void process(Event *evt) override;
+  virtual void on_reply(Event *evt) override;
+  virtual void dump(Dump &d) override;
+
+  enum State {
+    IDLE,
+    BYPASS,
+    FORWARD,
+    WAIT,
+    SERVE,
+    DONE,
+  };
+
+  //
+  // CacheHTTP::Directives
+  //
+
+  struct Directives {
+    bool no_store = false;
+    bool no_cache = false;
+    bool is_private = false;
+    bool is_public = false;
+    bool must_revalidate = false;
+    bool only_if_cached = false;
+    bool max_stale_any = false;
+    double max_age = -1;
+    double s_maxage = -1;
+    double max_stale = -1;
+    double min_fresh = -1;
+
+    void parse(const std::string &str);
+  };
+
+  //
+  // CacheHTTP::Waiter
+  //
+
+  class Waiter : public pjs::RefCountMT<Waiter> {
+  public:
+    Waiter(CacheHTTP *filter);
+    void wake();
+    void cancel() { m_filter = nullptr; }
+  private:
+    CacheHTTP* m_filter;
+    Net* m_net;
+    friend class pjs::RefCountMT<Waiter>;
+  };
+
+  Options m_options;
+  std::shared_ptr<Store> m_store;
+  State m_state = IDLE;
+  pjs::Ref<Pipeline> m_pipeline;
+  pjs::Ref<http::RequestHead> m_request;
+  pjs::Ref<http::ResponseHead> m_response;
+  pjs::Ref<Waiter> m_waiter;
+  Timer m_wait_timer;
+  std::shared_ptr<const Response> m_cached;
+  std::shared_ptr<Response> m_capture;
+  std::string m_key;
+  Directives m_directives;
+  EventBuffer m_buffer;
+  Data m_body;
+  double m_request_time = 0;
+  double m_response_time = 0;
+  bool m_is_head = false;
+  bool m_is_leader = false;
+  bool m_is_revalidating = false;
+  bool m_is_swallowing = false;
+  bool m_has_waited = false;
+  bool m_invalidate = false;
+  bool m_request_ended = false;
+
+  void begin(MessageStart *start);
+  bool make_key(http::RequestHead *head);
+  void lookup();
+  void bypass();
+  void forward();
+  void serve(const Response *response);
+  void unlead();
+  void on_wake();
+  void on_wait_timeout();
+  bool storable(http::ResponseHead *head);
+  auto capture(http::ResponseHead *head) -> Response*;
+  auto revalidate(http::ResponseHead *head) -> Response*;
+  void freshen(Response *response, pjs::Object *headers);
+  bool usable(const Response *response, double now);
+  bool matches(const Response *response);
+  bool not_modified(const Response *response);
+};
+
+} // namespace pipy
+
+#endif // CACHE_HPP
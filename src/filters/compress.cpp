@@ -28,6 +28,8 @@
 #include "data.hpp"
 #include "api/http.hpp"
 
+#include <map>
+
 namespace pipy {
 
 thread_local static const pjs::ConstStr s_headers("headers");
@@ -35,21 +37,39 @@ thread_local static const pjs::ConstStr s_content_encoding("content-encoding");
 thread_local static const pjs::ConstStr s_gzip("gzip");
 thread_local static const pjs::ConstStr s_deflate("deflate");
 thread_local static const pjs::ConstStr s_inflate("inflate");
+thread_local static const pjs::ConstStr s_br("br");
+thread_local static const pjs::ConstStr s_zstd("zstd");
+thread_local static const pjs::ConstStr s_vary("vary");
 
 static Data::Producer s_dp("compressMessage()");
 
+//
+// Compress::Options
+//
+
+Compress::Options::Options(pjs::Object *options) {
+  Value(options, "level")
+    .get(level)
+    .check_nullable();
+  Value(options, "window")
+    .get(window)
+    .check_nullable();
+}
+
 //
 // Compress
 //
 
-Compress::Compress(const pjs::Value &algorithm)
+Compress::Compress(const pjs::Value &algorithm, const Options &options)
   : m_algorithm(algorithm)
+  , m_options(options)
 {
 }
 
 Compress::Compress(const Compress &r)
   : Filter(r)
   , m_algorithm(r.m_algorithm)
+  , m_options(r.m_options)
 {
 }
 
@@ -86,14 +106,13 @@ void Compress::process(Event *evt) {
     }
     auto out = [this](Data &data) { compressor_output(data); };
     auto str = algorithm.s();
-    if (str == s_deflate) {
-      m_compressor = Compressor::deflate(out);
-    } else if (str == s_gzip) {
-      m_compressor = Compressor::gzip(out);
-    } else {
+    Compressor::Algorithm alg;
+    if (!Compressor::algorithm(str->str(), alg)) {
       Filter::error("unknown compression algorithm: %s", str->c_str());
       return;
     }
+    Compressor::Params params(m_options.level, m_options.window);
+    m_compressor = Compressor::make(alg, out, params);
   }
 
   if (m_compressor) {
@@ -116,18 +135,35 @@ void Compress::compressor_output(Data &data) {
 }
 
 //
-// CompressHTTP
+// CompressHTTP::Options
 //
 
+CompressHTTP::Options::Options(pjs::Object *options)
+  : Compress::Options(options)
+{
+  Value(options, "acceptEncoding")
+    .get(accept_encoding)
+    .get(accept_encoding_f)
+    .check_nullable();
+}
+
+//
+// CompressHTTP
+//
 
-CompressHTTP::CompressHTTP(const pjs::Value &algorithm)
+CompressHTTP::CompressHTTP(const pjs::Value &algorithm, const Options &options)
   : m_algorithm(algorithm)
+  , m_options(options)
 {
+  if (algorithm.is_array() && !options.accept_encoding && !options.accept_encoding_f) {
+    throw std::runtime_error("acceptEncoding is required to negotiate from an array of algorithms");
+  }
 }
 
 CompressHTTP::CompressHTTP(const CompressHTTP &r)
   : Filter(r)
   , m_algorithm(r.m_algorithm)
+  , m_options(r.m_options)
 {
 }
 
@@ -157,19 +193,26 @@ void CompressHTTP::process(Event *evt) {
   if (auto ms = evt->as<MessageStart>()) {
     if (!m_is_message_started) {
       pjs::Ref<pjs::Str> algorithm;
+      bool is_negotiated = false;
       if (m_algorithm.is_function()) {
         pjs::Value arg(ms), ret;
         if (!Filter::callback(m_algorithm.f(), 1, &arg, ret)) return;
-        if (!ret.is_nullish()) {
+        if (ret.is_array()) {
+          if (!negotiate(ret.as<pjs::Array>(), algorithm)) return;
+          is_negotiated = true;
+        } else if (!ret.is_nullish()) {
           if (!ret.is_string()) {
-            Filter::error("callback did not return a string");
+            Filter::error("callback did not return a string or an array");
             return;
           }
           algorithm = ret.s();
         }
+      } else if (m_algorithm.is_array()) {
+        if (!negotiate(m_algorithm.as<pjs::Array>(), algorithm)) return;
+        is_negotiated = true;
       } else {
         if (!m_algorithm.is_string()) {
-          Filter::error("algorithm expects a string");
+          Filter::error("algorithm expects a string or an array");
           return;
         }
         algorithm = m_algorithm.s();
@@ -187,12 +230,27 @@ void CompressHTTP::process(Event *evt) {
           ms->head()->set(s_headers, headers);
         }
         auto out = [this](Data &data) { compressor_output(data); };
-        if (algorithm == s_gzip) {
-          m_compressor = Compressor::gzip(out);
-          headers->set(s_content_encoding, s_gzip.get());
-        } else if (algorithm == s_deflate) {
-          m_compressor = Compressor::deflate(out);
-          headers->set(s_content_encoding, s_deflate.get());
+        Compressor::Algorithm alg;
+        if (algorithm && Compressor::algorithm(algorithm->str(), alg)) {
+          Compressor::Params params(m_options.level, m_options.window);
+          m_compressor = Compressor::make(alg, out, params);
+          headers->set(s_content_encoding, pjs::Str::make(Compressor::name(alg)));
+        }
+        if (is_negotiated) {
+          pjs::Value vary;
+          headers->get(s_vary, vary);
+          if (vary.is_nullish()) {
+            headers->set(s_vary, pjs::Str::make("accept-encoding"));
+          } else {
+            auto *s = vary.to_string();
+            auto str = s->str();
+            s->release();
+            std::string lower(str);
+            for (auto &c : lower) c = std::tolower((unsigned char)c);
+            if (lower.find("accept-encoding") == std::string::npos) {
+              headers->set(s_vary, pjs::Str::make(str + ", accept-encoding"));
+            }
+          }
         }
       }
       m_is_message_started = true;
@@ -221,6 +279,69 @@ void CompressHTTP::process(Event *evt) {
   }
 }
 
+//
+// Picks the candidate with the highest q-value in Accept-Encoding,
+// preferring earlier candidates on ties. Leaves the algorithm empty
+// when none is acceptable.
+//
+
+bool CompressHTTP::negotiate(pjs::Array *candidates, pjs::Ref<pjs::Str> &algorithm) {
+  pjs::Ref<pjs::Str> accept_encoding;
+  if (!m_options.accept_encoding && !m_options.accept_encoding_f) {
+    Filter::error("acceptEncoding is required to negotiate from an array of algorithms");
+    return false;
+  }
+  if (auto *f = m_options.accept_encoding_f.get()) {
+    pjs::Value ret;
+    if (!Filter::callback(f, 0, nullptr, ret)) return false;
+    if (!ret.is_nullish()) {
+      auto *s = ret.to_string();
+      accept_encoding = s;
+      s->release();
+    }
+  } else {
+    accept_encoding = m_options.accept_encoding;
+  }
+
+  algorithm = nullptr;
+  if (!accept_encoding) return true;
+
+  std::map<std::string, double> qvalues;
+  const auto &str = accept_encoding->str();
+  size_t i = 0;
+  while (i < str.length()) {
+    auto j = str.find(',', i);
+    if (j == std::string::npos) j = str.length();
+    auto item = str.substr(i, j - i);
+    i = j + 1;
+    double q = 1;
+    auto k = item.find(';');
+    if (k != std::string::npos) {
+      auto p = item.find("q=", k);
+      if (p != std::string::npos) q = std::atof(item.c_str() + p + 2);
+      item = item.substr(0, k);
+    }
+    std::string name;
+    for (auto c : item) if (!std::isspace((unsigned char)c)) name += std::tolower((unsigned char)c);
+    if (!name.empty()) qvalues[name] = q;
+  }
+
+  double best = 0;
+  candidates->iterate_all(
+    [&](pjs::Value &v, int) {
+      if (!v.is_string()) return;
+      auto i = qvalues.find(v.s()->str());
+      if (i == qvalues.end()) i = qvalues.find("*");
+      if (i != qvalues.end() && i->second > best) {
+        best = i->second;
+        algorithm = v.s();
+      }
+    }
+  );
+
+  return true;
+}
+
 void CompressHTTP::compressor_output(Data &data) {
   Filter::output(Data::make(std::move(data)));
 }
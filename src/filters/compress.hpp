@@ -27,6 +27,7 @@
 #define COMPRESS_HPP
 
 #include "filter.hpp"
+#include "options.hpp"
 
 namespace pipy {
 
@@ -39,7 +40,14 @@ class Data;
 
 class Compress : public Filter {
 public:
-  Compress(const pjs::Value &algorithm);
+  struct Options : public pipy::Options {
+    int level = -1;
+    int window = 0;
+    Options() {}
+    Options(pjs::Object *options);
+  };
+
+  Compress(const pjs::Value &algorithm, const Options &options = Options());
 
 private:
   Compress(const Compress &r);
@@ -51,6 +59,7 @@ private:
   virtual void dump(Dump &d) override;
 
   pjs::Value m_algorithm;
+  Options m_options;
   Compressor* m_compressor = nullptr;
   bool m_is_started = false;
 
@@ -63,7 +72,14 @@ private:
 
 class CompressHTTP : public Filter {
 public:
-  CompressHTTP(const pjs::Value &algorithm);
+  struct Options : public Compress::Options {
+    pjs::Ref<pjs::Str> accept_encoding;
+    pjs::Ref<pjs::Function> accept_encoding_f;
+    Options() {}
+    Options(pjs::Object *options);
+  };
+
+  CompressHTTP(const pjs::Value &algorithm, const Options &options = Options());
 
 private:
   CompressHTTP(const CompressHTTP &r);
@@ -75,9 +91,12 @@ private:
   virtual void dump(Dump &d) override;
 
   pjs::Value m_algorithm;
+  Options m_options;
   Compressor* m_compressor = nullptr;
   bool m_is_message_started = false;
 
+  bool negotiate(pjs::Array *candidates, pjs::Ref<pjs::Str> &algorithm);
+
   void compressor_output(Data &data);
 };
 
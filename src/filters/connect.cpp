@@ -24,7 +24,10 @@
  */
 
 #include "connect.hpp"
+#include "context.hpp"
+#include "inbound.hpp"
 #include "outbound.hpp"
+#include "pipeline.hpp"
 #include "utils.hpp"
 
 namespace pipy {
@@ -197,9 +200,14 @@ void Connect::process(Event *evt) {
     }
 
     switch (protocol) {
-      case Outbound::Protocol::TCP:
-        m_outbound = OutboundTCP::make(Filter::output(), options);
+      case Outbound::Protocol::TCP: {
+        auto outbound = OutboundTCP::make(Filter::output(), options);
+#ifdef __linux__
+        if (is_relay()) outbound->splice(Filter::context()->inbound());
+#endif
+        m_outbound = outbound;
         break;
+      }
       case Outbound::Protocol::UDP:
         m_outbound = OutboundUDP::make(Filter::output(), options);
         break;
@@ -236,4 +244,20 @@ void Connect::process(Event *evt) {
   }
 }
 
+//
+// A connect() being the only filter in the pipeline of an inbound TCP
+// connection relays bytes without looking at them, so both sockets
+// can be spliced together in the kernel
+//
+
+bool Connect::is_relay() {
+  auto p = Filter::pipeline();
+  auto inbound = Filter::context()->inbound();
+  return (
+    p && inbound &&
+    inbound->pipeline() == p &&
+    p->layout()->filter_count() == 1
+  );
+}
+
 } // namespace pipy
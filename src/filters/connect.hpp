@@ -50,6 +50,8 @@ public:
   Connect(const pjs::Value &target, const Options &options);
   Connect(const pjs::Value &target, pjs::Function *options);
 
+  auto outbound() const -> Outbound* { return m_outbound; }
+
 private:
   Connect(const Connect &r);
   ~Connect();
@@ -59,6 +61,8 @@ private:
   virtual void process(Event *evt) override;
   virtual void dump(Dump &d) override;
 
+  bool is_relay();
+
   pjs::Value m_target;
   pjs::Ref<Outbound> m_outbound;
   pjs::Ref<pjs::Function> m_options_f;
@@ -36,6 +36,7 @@ thread_local static const pjs::ConstStr s_br("br");
 thread_local static const pjs::ConstStr s_deflate("deflate");
 thread_local static const pjs::ConstStr s_inflate("inflate");
 thread_local static const pjs::ConstStr s_brotli("brotli");
+thread_local static const pjs::ConstStr s_zstd("zstd");
 
 //
 // Decompress
@@ -91,6 +92,8 @@ void Decompress::process(Event *evt) {
       m_decompressor = Decompressor::gzip(out);
     } else if (str == s_brotli) {
       m_decompressor = Decompressor::brotli(out);
+    } else if (str == s_zstd) {
+      m_decompressor = Decompressor::zstd(out);
     } else {
       Filter::error("unknown compression algorithm: %s", str->c_str());
       return;
@@ -162,6 +165,7 @@ void DecompressHTTP::process(Event *evt) {
           if (str == s_gzip) m_decompressor = Decompressor::gzip(out);
           if (str == s_deflate) m_decompressor = Decompressor::inflate(out);
           else if (str == s_br) m_decompressor = Decompressor::brotli(out);
+          else if (str == s_zstd) m_decompressor = Decompressor::zstd(out);
           if (m_decompressor) head->headers->ht_delete(s_content_encoding);
         }
       }
@@ -34,9 +34,18 @@
 #include "utils.hpp"
 
 #include <cctype>
+#include <cstring>
 #include <queue>
 #include <limits>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#define PIPY_HTTP_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 namespace pipy {
 namespace http {
 
@@ -290,28 +299,6 @@ static auto read_str(Data::Reader &dr, char ending, const StrMap &strmap, char *
   }
 }
 
-static auto read_str_lower(Data::Reader &dr, char ending, const StrMap &strmap, char *buf, char *buf_lower) -> pjs::Str* {
-  size_t i = 0;
-  StrMap::Parser p(strmap);
-  pjs::Str *found = nullptr;
-  for (;;) {
-    auto c = dr.get();
-    if (c < 0) return nullptr;
-    if (c == ending) {
-      if (found && found != pjs::Str::empty) {
-        return found;
-      } else {
-        return i > 0 ? pjs::Str::make(buf_lower, i) : nullptr;
-      }
-    }
-    if (c == ' ' && !i) continue;
-    auto l = std::tolower(c);
-    found = p.parse(l);
-    buf_lower[i] = l;
-    buf[i++] = c;
-  }
-}
-
 static auto read_uint(Data::Reader &dr, char ending) -> int {
   int n = 0;
   for (;;) {
@@ -326,6 +313,128 @@ static auto read_uint(Data::Reader &dr, char ending) -> int {
   }
 }
 
+//
+// Head scanning
+//
+// Header blocks are indexed 64 bytes at a time into bitmasks of
+// line feeds and colons, using AVX2 or SSE2 where available.
+//
+
+static auto scan_delimiters_scalar(const char *p) -> uint64_t {
+  uint64_t mask = 0;
+  for (int i = 0; i < 64; i++) {
+    auto c = p[i];
+    if (c == '\n' || c == ':') mask |= uint64_t(1) << i;
+  }
+  return mask;
+}
+
+#ifdef PIPY_HTTP_SIMD_X86
+
+static auto scan_delimiters_sse2(const char *p) -> uint64_t {
+  const auto lf = _mm_set1_epi8('\n');
+  const auto colon = _mm_set1_epi8(':');
+  uint64_t mask = 0;
+  for (int i = 0; i < 4; i++) {
+    auto v = _mm_loadu_si128((const __m128i*)(p + i * 16));
+    auto m = _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, colon));
+    mask |= uint64_t(uint16_t(_mm_movemask_epi8(m))) << (i * 16);
+  }
+  return mask;
+}
+
+#ifdef __GNUC__
+
+__attribute__((target("avx2")))
+static auto scan_delimiters_avx2(const char *p) -> uint64_t {
+  const auto lf = _mm256_set1_epi8('\n');
+  const auto colon = _mm256_set1_epi8(':');
+  auto a = _mm256_loadu_si256((const __m256i*)p);
+  auto b = _mm256_loadu_si256((const __m256i*)(p + 32));
+  auto ma = _mm256_or_si256(_mm256_cmpeq_epi8(a, lf), _mm256_cmpeq_epi8(a, colon));
+  auto mb = _mm256_or_si256(_mm256_cmpeq_epi8(b, lf), _mm256_cmpeq_epi8(b, colon));
+  return uint64_t(uint32_t(_mm256_movemask_epi8(ma))) | (uint64_t(uint32_t(_mm256_movemask_epi8(mb))) << 32);
+}
+
+#endif // __GNUC__
+#endif // PIPY_HTTP_SIMD_X86
+
+static auto select_scan_delimiters() -> uint64_t(*)(const char*) {
+#ifdef PIPY_HTTP_SIMD_X86
+#ifdef __GNUC__
+  // Runs from a static initializer, possibly before libgcc has probed the CPU
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return scan_delimiters_avx2;
+#endif
+  return scan_delimiters_sse2;
+#else
+  return scan_delimiters_scalar;
+#endif
+}
+
+static uint64_t (*const s_scan_delimiters)(const char*) = select_scan_delimiters();
+
+static inline auto lowest_bit(uint64_t mask) -> int {
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanForward64(&i, mask);
+  return i;
+#else
+  return __builtin_ctzll(mask);
+#endif
+}
+
+// Calls f(i) for every '\n' or ':' in p[0..n) until f returns false
+template<class F>
+static bool scan_delimiters(const char *p, size_t n, const F &f) {
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    auto mask = s_scan_delimiters(p + i);
+    while (mask) {
+      if (!f(i + lowest_bit(mask))) return false;
+      mask &= mask - 1;
+    }
+  }
+  if (i < n) {
+    char tail[64];
+    std::memcpy(tail, p + i, n - i);
+    std::memset(tail + (n - i), 0, 64 - (n - i));
+    auto mask = scan_delimiters_scalar(tail);
+    while (mask) {
+      if (!f(i + lowest_bit(mask))) return false;
+      mask &= mask - 1;
+    }
+  }
+  return true;
+}
+
+// Lowercases n bytes from src into dst, returning true if any changed
+static bool to_lower(const char *src, char *dst, size_t n) {
+  size_t i = 0;
+  int changed = 0;
+#ifdef PIPY_HTTP_SIMD_X86
+  const auto a = _mm_set1_epi8('A' - 1);
+  const auto z = _mm_set1_epi8('Z' + 1);
+  const auto d = _mm_set1_epi8(0x20);
+  for (; i + 16 <= n; i += 16) {
+    auto v = _mm_loadu_si128((const __m128i*)(src + i));
+    auto m = _mm_and_si128(_mm_cmpgt_epi8(v, a), _mm_cmplt_epi8(v, z));
+    changed |= _mm_movemask_epi8(m);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi8(v, _mm_and_si128(m, d)));
+  }
+#endif
+  for (; i < n; i++) {
+    auto c = src[i];
+    if ('A' <= c && c <= 'Z') {
+      dst[i] = c + 0x20;
+      changed = 1;
+    } else {
+      dst[i] = c;
+    }
+  }
+  return changed;
+}
+
 //
 // Decoder
 //
@@ -333,6 +442,8 @@ static auto read_uint(Data::Reader &dr, char ending) -> int {
 void Decoder::reset() {
   m_state = HEAD;
   m_head_buffer.clear();
+  m_line_size = 0;
+  m_line_tail = 0;
   m_head = nullptr;
   m_method = nullptr;
   m_header_transfer_encoding = nullptr;
@@ -372,25 +483,50 @@ void Decoder::on_event(Event *evt) {
       data->shift(n, output);
       if (0 == (m_current_size -= n)) state = (state == BODY ? HEAD : CHUNK_TAIL);
 
-    // byte scan the head
+    // scan the head for line ends
+    } else if (state == HEAD || state == HEADER) {
+      int n = 0;
+      bool overflow = false;
+      for (const auto c : data->chunks()) {
+        auto p = std::get<0>(c);
+        auto l = std::get<1>(c);
+        int i = 0;
+        while (i < l) {
+          auto eol = (const char *)std::memchr(p + i, '\n', l - i);
+          auto k = eol ? int(eol - p) : l;
+          auto size = m_line_size + (k - i);
+          if (size >= m_max_header_size) { overflow = true; break; }
+          if (k > i) m_line_tail = p[k-1];
+          if (!eol) {
+            m_line_size = size;
+            i = l;
+            break;
+          }
+          i = k + 1;
+          m_line_size = 0;
+          if (state == HEAD) {
+            state = HEAD_EOL;
+            break;
+          } else if (size == 0 || (size == 1 && m_line_tail == '\r')) {
+            state = HEADER_EOL;
+            break;
+          }
+        }
+        n += i;
+        if (overflow || state == HEAD_EOL || state == HEADER_EOL) break;
+      }
+      if (overflow) {
+        Log::error("HTTP header size overflow");
+        error();
+        break;
+      }
+      data->shift(n, output);
+
+    // byte scan the rest
     } else {
       data->shift_to(
         [&](int c) -> bool {
           switch (state) {
-          case HEAD:
-            if (c == '\n') {
-              state = HEAD_EOL;
-              return true;
-            }
-            return false;
-
-          case HEADER:
-            if (c == '\n') {
-              state = HEADER_EOL;
-              return true;
-            }
-            return false;
-
           case CHUNK_HEAD:
             m_body_size++;
             if (c == '\n') {
@@ -452,12 +588,7 @@ void Decoder::on_event(Event *evt) {
     switch (m_state) {
       case HEAD:
       case HEADER:
-        if (m_head_buffer.size() + output.size() <= m_max_header_size) {
-          m_head_buffer.push(output);
-        } else {
-          Log::error("HTTP header size overflow");
-          error();
-        }
+        m_head_buffer.push(output);
         break;
       case BODY:
       case CHUNK_BODY:
@@ -511,7 +642,6 @@ void Decoder::on_event(Event *evt) {
           }
         }
         m_head->headers = pjs::Object::make();
-        m_head->headerNames = pjs::Object::make();
         m_header_transfer_encoding = nullptr;
         m_header_content_length = nullptr;
         m_header_connection = nullptr;
@@ -522,84 +652,45 @@ void Decoder::on_event(Event *evt) {
       }
       case HEADER_EOL: {
         auto len = m_head_buffer.size();
-        pjs::vl_array<char, DATA_CHUNK_SIZE> buf(len);
-        pjs::vl_array<char, DATA_CHUNK_SIZE> buf_lower(len);
         m_head_size += len;
-        if (len > 2) {
-          Data::Reader dr(m_head_buffer);
-          pjs::Ref<pjs::Str> key(read_str_lower(dr, ':', s_strmap_headers, buf, buf_lower));
-          pjs::Ref<pjs::Str> val(read_str(dr, '\r', s_strmap_header_values, buf_lower));
-          if (!key || !val) { error(); break; }
-          auto headers = m_head->headers.get();
-          if (key == s_set_cookie) {
-            pjs::Value old;
-            headers->get(key, old);
-            if (old.is_array()) {
-              old.as<pjs::Array>()->push(val.get());
-            } else if (old.is_string()) {
-              auto a = pjs::Array::make(2);
-              a->set(0, old.s());
-              a->set(1, val.get());
-              headers->set(key, a);
-            } else {
-              headers->set(key, val.get());
-            }
+        if (!parse_headers()) { error(); break; }
+        m_current_size = 0;
+        m_head_buffer.clear();
+
+        static const std::string s_chunked("chunked");
+
+        // Transfer-Encoding and Content-Length
+        if (
+          m_header_transfer_encoding &&
+          utils::starts_with(m_header_transfer_encoding->str(), s_chunked)
+        ) {
+          message_start();
+          if (m_method == s_HEAD) {
+            message_end();
+            state = HEAD;
           } else {
-            auto v = val.get();
-            if (key == s_transfer_encoding) m_header_transfer_encoding = v;
-            else if (key == s_content_length) m_header_content_length = v;
-            else if (key == s_connection) { m_header_connection = v; v = nullptr; }
-            else if (key == s_upgrade) m_header_upgrade = v;
-            if (v) headers->set(key, v);
+            state = CHUNK_HEAD;
           }
-          if (auto names = m_head->headerNames.get()) {
-            pjs::Ref<pjs::Str> name(pjs::Str::make(buf, key->size()));
-            if (name != key) {
-              names->set(key, name.get());
+        } else {
+          message_start();
+          if (m_header_content_length) {
+            m_current_size = std::atoi(m_header_content_length->c_str());
+          } else if (m_is_response && m_method != s_HEAD && m_method != s_CONNECT) {
+            auto status = m_head->as<ResponseHead>()->status;
+            if (status >= 200 && status != 204 && status != 304) {
+              m_current_size = std::numeric_limits<int>::max();
             }
           }
-          state = HEADER;
-          m_head_buffer.clear();
-
-        } else {
-          m_current_size = 0;
-          m_head_buffer.clear();
-
-          static const std::string s_chunked("chunked");
-
-          // Transfer-Encoding and Content-Length
-          if (
-            m_header_transfer_encoding &&
-            utils::starts_with(m_header_transfer_encoding->str(), s_chunked)
-          ) {
-            message_start();
+          if (m_current_size > 0) {
             if (m_method == s_HEAD) {
               message_end();
               state = HEAD;
             } else {
-              state = CHUNK_HEAD;
+              state = BODY;
             }
           } else {
-            message_start();
-            if (m_header_content_length) {
-              m_current_size = std::atoi(m_header_content_length->c_str());
-            } else if (m_is_response && m_method != s_HEAD && m_method != s_CONNECT) {
-              auto status = m_head->as<ResponseHead>()->status;
-              if (status >= 200 && status != 204 && status != 304) {
-                m_current_size = std::numeric_limits<int>::max();
-              }
-            }
-            if (m_current_size > 0) {
-              if (m_method == s_HEAD) {
-                message_end();
-                state = HEAD;
-              } else {
-                state = BODY;
-              }
-            } else {
-              message_end();
-              state = HEAD;
-            }
+            message_end();
+            state = HEAD;
           }
         }
         break;
@@ -628,6 +719,93 @@ void Decoder::on_event(Event *evt) {
   }
 }
 
+bool Decoder::parse_headers() {
+  auto len = m_head_buffer.size();
+  pjs::vl_array<char, DATA_CHUNK_SIZE> buf(len);
+  pjs::vl_array<char, DATA_CHUNK_SIZE> buf_lower(len);
+  const char *p = buf;
+  auto chunks = m_head_buffer.chunks();
+  auto first = chunks.begin();
+  if (first != chunks.end() && std::get<1>(*first) == len) {
+    p = std::get<0>(*first);
+  } else {
+    m_head_buffer.to_bytes((uint8_t *)buf.data());
+  }
+
+  auto headers = m_head->headers.get();
+  std::string raw_names;
+  size_t line = 0, colon = len;
+
+  auto ok = scan_delimiters(
+    p, len,
+    [&](size_t i) -> bool {
+      if (p[i] == ':') {
+        if (colon == len) colon = i;
+        return true;
+      }
+
+      // the empty line ending the head
+      if (i == line || (i == line + 1 && p[line] == '\r')) return false;
+      if (colon > i) return false;
+
+      auto name = line;
+      while (name < colon && p[name] == ' ') name++;
+      if (name == colon) return false;
+      auto name_len = colon - name;
+      auto lower = buf_lower.data() + name;
+      auto changed = to_lower(p + name, lower, name_len);
+
+      auto value = colon + 1;
+      while (value < i && p[value] == ' ') value++;
+      auto value_end = (const char *)std::memchr(p + value, '\r', i - value);
+      if (!value_end) return false;
+      auto value_len = value_end - (p + value);
+
+      pjs::Ref<pjs::Str> key(s_strmap_headers.find(lower, name_len));
+      if (!key) key = pjs::Str::make(lower, name_len);
+      pjs::Ref<pjs::Str> val(s_strmap_header_values.find(p + value, value_len));
+      if (!val) val = value_len > 0 ? pjs::Str::make(p + value, value_len) : pjs::Str::empty.get();
+
+      if (key == s_set_cookie) {
+        pjs::Value old;
+        headers->get(key, old);
+        if (old.is_array()) {
+          old.as<pjs::Array>()->push(val.get());
+        } else if (old.is_string()) {
+          auto a = pjs::Array::make(2);
+          a->set(0, old.s());
+          a->set(1, val.get());
+          headers->set(key, a);
+        } else {
+          headers->set(key, val.get());
+        }
+      } else {
+        auto v = val.get();
+        if (key == s_transfer_encoding) m_header_transfer_encoding = v;
+        else if (key == s_content_length) m_header_content_length = v;
+        else if (key == s_connection) { m_header_connection = v; v = nullptr; }
+        else if (key == s_upgrade) m_header_upgrade = v;
+        if (v) headers->set(key, v);
+      }
+
+      if (changed) {
+        raw_names.append(p + name, name_len);
+        raw_names += '\n';
+      }
+
+      line = i + 1;
+      colon = len;
+      return true;
+    }
+  );
+
+  // Stopping early is fine only at the empty line
+  if (ok || line + 2 < len) return false;
+  if (!raw_names.empty()) raw_names.pop_back();
+  m_head->header_names(std::move(raw_names));
+  return true;
+}
+
 void Decoder::message_start() {
   if (m_is_response) {
     m_method = nullptr;
@@ -843,7 +1021,7 @@ void Encoder::output_head() {
   }
 
   if (auto headers = m_head->headers.get()) {
-    auto names = m_head->headerNames.get();
+    size_t name_hint = 0;
     headers->iterate_all(
       [&](pjs::Str *k, pjs::Value &v) {
         if (k == s_keep_alive) return;
@@ -862,20 +1040,17 @@ void Encoder::output_head() {
         } else if (k == s_upgrade) {
           if (v.is_string()) m_header_upgrade = v.s();
         }
-        pjs::Ref<pjs::Str> name = k;
-        if (names) {
-          pjs::Value v;
-          if (names->get(k, v)) {
-            auto s = v.to_string();
-            name = s;
-            s->release();
-          }
+        size_t name_len = 0;
+        auto name = m_head->header_name(k, name_hint, name_len);
+        if (!name) {
+          name = k->c_str();
+          name_len = k->size();
         }
         if (k == s_set_cookie && v.is_array()) {
           v.as<pjs::Array>()->iterate_all(
             [&](pjs::Value &v, int) {
               auto s = v.to_string();
-              db.push(name->str());
+              db.push(name, name_len);
               db.push(": ");
               db.push(s->str());
               db.push("\r\n");
@@ -883,7 +1058,7 @@ void Encoder::output_head() {
             }
           );
         } else {
-          db.push(name->str());
+          db.push(name, name_len);
           db.push(": ");
           auto s = v.to_string();
           db.push(s->str());
@@ -105,6 +105,8 @@ private:
 
   State m_state = HEAD;
   Data m_head_buffer;
+  size_t m_line_size = 0;
+  char m_line_tail = 0;
   size_t m_max_header_size = DATA_CHUNK_SIZE;
   pjs::Ref<MessageHead> m_head;
   pjs::Ref<pjs::Str> m_method;
@@ -122,6 +124,7 @@ private:
 
   virtual void on_event(Event *evt) override;
 
+  bool parse_headers();
   void message_start();
   void message_end();
   void stream_end(StreamEnd *eos);
@@ -84,6 +84,15 @@ thread_local static const pjs::ConstStr s_te("te");
 thread_local static const pjs::ConstStr s_trailers("trailers");
 thread_local static const pjs::ConstStr s_content_length("content-length");
 thread_local static const pjs::ConstStr s_set_cookie("set-cookie");
+thread_local static const pjs::ConstStr s_cookie("cookie");
+thread_local static const pjs::ConstStr s_authorization("authorization");
+thread_local static const pjs::ConstStr s_proxy_authorization("proxy-authorization");
+thread_local static const pjs::ConstStr s_date("date");
+thread_local static const pjs::ConstStr s_etag("etag");
+thread_local static const pjs::ConstStr s_last_modified("last-modified");
+thread_local static const pjs::ConstStr s_location("location");
+thread_local static const pjs::ConstStr s_if_modified_since("if-modified-since");
+thread_local static const pjs::ConstStr s_if_none_match("if-none-match");
 
 static struct {
   const char *name;
@@ -152,272 +161,7 @@ static struct {
   { "www-authenticate"            , nullptr }, 
 };
 
-//
-// HPACK Huffman code table
-//
-
-static struct {
-  uint32_t code;
-  int bits;
-} s_hpack_huffman_table[] = {
-  { 0x00001ff8, 13 }, //     (  0)  |11111111|11000
-  { 0x007fffd8, 23 }, //     (  1)  |11111111|11111111|1011000
-  { 0x0fffffe2, 28 }, //     (  2)  |11111111|11111111|11111110|0010
-  { 0x0fffffe3, 28 }, //     (  3)  |11111111|11111111|11111110|0011
-  { 0x0fffffe4, 28 }, //     (  4)  |11111111|11111111|11111110|0100
-  { 0x0fffffe5, 28 }, //     (  5)  |11111111|11111111|11111110|0101
-  { 0x0fffffe6, 28 }, //     (  6)  |11111111|11111111|11111110|0110
-  { 0x0fffffe7, 28 }, //     (  7)  |11111111|11111111|11111110|0111
-  { 0x0fffffe8, 28 }, //     (  8)  |11111111|11111111|11111110|1000
-  { 0x00ffffea, 24 }, //     (  9)  |11111111|11111111|11101010
-  { 0x3ffffffc, 30 }, //     ( 10)  |11111111|11111111|11111111|111100
-  { 0x0fffffe9, 28 }, //     ( 11)  |11111111|11111111|11111110|1001
-  { 0x0fffffea, 28 }, //     ( 12)  |11111111|11111111|11111110|1010
-  { 0x3ffffffd, 30 }, //     ( 13)  |11111111|11111111|11111111|111101
-  { 0x0fffffeb, 28 }, //     ( 14)  |11111111|11111111|11111110|1011
-  { 0x0fffffec, 28 }, //     ( 15)  |11111111|11111111|11111110|1100
-  { 0x0fffffed, 28 }, //     ( 16)  |11111111|11111111|11111110|1101
-  { 0x0fffffee, 28 }, //     ( 17)  |11111111|11111111|11111110|1110
-  { 0x0fffffef, 28 }, //     ( 18)  |11111111|11111111|11111110|1111
-  { 0x0ffffff0, 28 }, //     ( 19)  |11111111|11111111|11111111|0000
-  { 0x0ffffff1, 28 }, //     ( 20)  |11111111|11111111|11111111|0001
-  { 0x0ffffff2, 28 }, //     ( 21)  |11111111|11111111|11111111|0010
-  { 0x3ffffffe, 30 }, //     ( 22)  |11111111|11111111|11111111|111110
-  { 0x0ffffff3, 28 }, //     ( 23)  |11111111|11111111|11111111|0011
-  { 0x0ffffff4, 28 }, //     ( 24)  |11111111|11111111|11111111|0100
-  { 0x0ffffff5, 28 }, //     ( 25)  |11111111|11111111|11111111|0101
-  { 0x0ffffff6, 28 }, //     ( 26)  |11111111|11111111|11111111|0110
-  { 0x0ffffff7, 28 }, //     ( 27)  |11111111|11111111|11111111|0111
-  { 0x0ffffff8, 28 }, //     ( 28)  |11111111|11111111|11111111|1000
-  { 0x0ffffff9, 28 }, //     ( 29)  |11111111|11111111|11111111|1001
-  { 0x0ffffffa, 28 }, //     ( 30)  |11111111|11111111|11111111|1010
-  { 0x0ffffffb, 28 }, //     ( 31)  |11111111|11111111|11111111|1011
-  { 0x00000014,  6 }, // ' ' ( 32)  |010100
-  { 0x000003f8, 10 }, // '!' ( 33)  |11111110|00
-  { 0x000003f9, 10 }, // '"' ( 34)  |11111110|01
-  { 0x00000ffa, 12 }, // '#' ( 35)  |11111111|1010
-  { 0x00001ff9, 13 }, // '$' ( 36)  |11111111|11001
-  { 0x00000015,  6 }, // '%' ( 37)  |010101
-  { 0x000000f8,  8 }, // '&' ( 38)  |11111000
-  { 0x000007fa, 11 }, // ''' ( 39)  |11111111|010
-  { 0x000003fa, 10 }, // '(' ( 40)  |11111110|10
-  { 0x000003fb, 10 }, // ')' ( 41)  |11111110|11
-  { 0x000000f9,  8 }, // '*' ( 42)  |11111001
-  { 0x000007fb, 11 }, // '+' ( 43)  |11111111|011
-  { 0x000000fa,  8 }, // ',' ( 44)  |11111010
-  { 0x00000016,  6 }, // '-' ( 45)  |010110
-  { 0x00000017,  6 }, // '.' ( 46)  |010111
-  { 0x00000018,  6 }, // '/' ( 47)  |011000
-  { 0x00000000,  5 }, // '0' ( 48)  |00000
-  { 0x00000001,  5 }, // '1' ( 49)  |00001
-  { 0x00000002,  5 }, // '2' ( 50)  |00010
-  { 0x00000019,  6 }, // '3' ( 51)  |011001
-  { 0x0000001a,  6 }, // '4' ( 52)  |011010
-  { 0x0000001b,  6 }, // '5' ( 53)  |011011
-  { 0x0000001c,  6 }, // '6' ( 54)  |011100
-  { 0x0000001d,  6 }, // '7' ( 55)  |011101
-  { 0x0000001e,  6 }, // '8' ( 56)  |011110
-  { 0x0000001f,  6 }, // '9' ( 57)  |011111
-  { 0x0000005c,  7 }, // ':' ( 58)  |1011100
-  { 0x000000fb,  8 }, // ';' ( 59)  |11111011
-  { 0x00007ffc, 15 }, // '<' ( 60)  |11111111|1111100
-  { 0x00000020,  6 }, // '=' ( 61)  |100000
-  { 0x00000ffb, 12 }, // '>' ( 62)  |11111111|1011
-  { 0x000003fc, 10 }, // '?' ( 63)  |11111111|00
-  { 0x00001ffa, 13 }, // '@' ( 64)  |11111111|11010
-  { 0x00000021,  6 }, // 'A' ( 65)  |100001
-  { 0x0000005d,  7 }, // 'B' ( 66)  |1011101
-  { 0x0000005e,  7 }, // 'C' ( 67)  |1011110
-  { 0x0000005f,  7 }, // 'D' ( 68)  |1011111
-  { 0x00000060,  7 }, // 'E' ( 69)  |1100000
-  { 0x00000061,  7 }, // 'F' ( 70)  |1100001
-  { 0x00000062,  7 }, // 'G' ( 71)  |1100010
-  { 0x00000063,  7 }, // 'H' ( 72)  |1100011
-  { 0x00000064,  7 }, // 'I' ( 73)  |1100100
-  { 0x00000065,  7 }, // 'J' ( 74)  |1100101
-  { 0x00000066,  7 }, // 'K' ( 75)  |1100110
-  { 0x00000067,  7 }, // 'L' ( 76)  |1100111
-  { 0x00000068,  7 }, // 'M' ( 77)  |1101000
-  { 0x00000069,  7 }, // 'N' ( 78)  |1101001
-  { 0x0000006a,  7 }, // 'O' ( 79)  |1101010
-  { 0x0000006b,  7 }, // 'P' ( 80)  |1101011
-  { 0x0000006c,  7 }, // 'Q' ( 81)  |1101100
-  { 0x0000006d,  7 }, // 'R' ( 82)  |1101101
-  { 0x0000006e,  7 }, // 'S' ( 83)  |1101110
-  { 0x0000006f,  7 }, // 'T' ( 84)  |1101111
-  { 0x00000070,  7 }, // 'U' ( 85)  |1110000
-  { 0x00000071,  7 }, // 'V' ( 86)  |1110001
-  { 0x00000072,  7 }, // 'W' ( 87)  |1110010
-  { 0x000000fc,  8 }, // 'X' ( 88)  |11111100
-  { 0x00000073,  7 }, // 'Y' ( 89)  |1110011
-  { 0x000000fd,  8 }, // 'Z' ( 90)  |11111101
-  { 0x00001ffb, 13 }, // '[' ( 91)  |11111111|11011
-  { 0x0007fff0, 19 }, // '\' ( 92)  |11111111|11111110|000
-  { 0x00001ffc, 13 }, // ']' ( 93)  |11111111|11100
-  { 0x00003ffc, 14 }, // '^' ( 94)  |11111111|111100
-  { 0x00000022,  6 }, // '_' ( 95)  |100010
-  { 0x00007ffd, 15 }, // '`' ( 96)  |11111111|1111101
-  { 0x00000003,  5 }, // 'a' ( 97)  |00011
-  { 0x00000023,  6 }, // 'b' ( 98)  |100011
-  { 0x00000004,  5 }, // 'c' ( 99)  |00100
-  { 0x00000024,  6 }, // 'd' (100)  |100100
-  { 0x00000005,  5 }, // 'e' (101)  |00101
-  { 0x00000025,  6 }, // 'f' (102)  |100101
-  { 0x00000026,  6 }, // 'g' (103)  |100110
-  { 0x00000027,  6 }, // 'h' (104)  |100111
-  { 0x00000006,  5 }, // 'i' (105)  |00110
-  { 0x00000074,  7 }, // 'j' (106)  |1110100
-  { 0x00000075,  7 }, // 'k' (107)  |1110101
-  { 0x00000028,  6 }, // 'l' (108)  |101000
-  { 0x00000029,  6 }, // 'm' (109)  |101001
-  { 0x0000002a,  6 }, // 'n' (110)  |101010
-  { 0x00000007,  5 }, // 'o' (111)  |00111
-  { 0x0000002b,  6 }, // 'p' (112)  |101011
-  { 0x00000076,  7 }, // 'q' (113)  |1110110
-  { 0x0000002c,  6 }, // 'r' (114)  |101100
-  { 0x00000008,  5 }, // 's' (115)  |01000
-  { 0x00000009,  5 }, // 't' (116)  |01001
-  { 0x0000002d,  6 }, // 'u' (117)  |101101
-  { 0x00000077,  7 }, // 'v' (118)  |1110111
-  { 0x00000078,  7 }, // 'w' (119)  |1111000
-  { 0x00000079,  7 }, // 'x' (120)  |1111001
-  { 0x0000007a,  7 }, // 'y' (121)  |1111010
-  { 0x0000007b,  7 }, // 'z' (122)  |1111011
-  { 0x00007ffe, 15 }, // '{' (123)  |11111111|1111110
-  { 0x000007fc, 11 }, // '|' (124)  |11111111|100
-  { 0x00003ffd, 14 }, // '}' (125)  |11111111|111101
-  { 0x00001ffd, 13 }, // '~' (126)  |11111111|11101
-  { 0x0ffffffc, 28 }, //     (127)  |11111111|11111111|11111111|1100
-  { 0x000fffe6, 20 }, //     (128)  |11111111|11111110|0110
-  { 0x003fffd2, 22 }, //     (129)  |11111111|11111111|010010
-  { 0x000fffe7, 20 }, //     (130)  |11111111|11111110|0111
-  { 0x000fffe8, 20 }, //     (131)  |11111111|11111110|1000
-  { 0x003fffd3, 22 }, //     (132)  |11111111|11111111|010011
-  { 0x003fffd4, 22 }, //     (133)  |11111111|11111111|010100
-  { 0x003fffd5, 22 }, //     (134)  |11111111|11111111|010101
-  { 0x007fffd9, 23 }, //     (135)  |11111111|11111111|1011001
-  { 0x003fffd6, 22 }, //     (136)  |11111111|11111111|010110
-  { 0x007fffda, 23 }, //     (137)  |11111111|11111111|1011010
-  { 0x007fffdb, 23 }, //     (138)  |11111111|11111111|1011011
-  { 0x007fffdc, 23 }, //     (139)  |11111111|11111111|1011100
-  { 0x007fffdd, 23 }, //     (140)  |11111111|11111111|1011101
-  { 0x007fffde, 23 }, //     (141)  |11111111|11111111|1011110
-  { 0x00ffffeb, 24 }, //     (142)  |11111111|11111111|11101011
-  { 0x007fffdf, 23 }, //     (143)  |11111111|11111111|1011111
-  { 0x00ffffec, 24 }, //     (144)  |11111111|11111111|11101100
-  { 0x00ffffed, 24 }, //     (145)  |11111111|11111111|11101101
-  { 0x003fffd7, 22 }, //     (146)  |11111111|11111111|010111
-  { 0x007fffe0, 23 }, //     (147)  |11111111|11111111|1100000
-  { 0x00ffffee, 24 }, //     (148)  |11111111|11111111|11101110
-  { 0x007fffe1, 23 }, //     (149)  |11111111|11111111|1100001
-  { 0x007fffe2, 23 }, //     (150)  |11111111|11111111|1100010
-  { 0x007fffe3, 23 }, //     (151)  |11111111|11111111|1100011
-  { 0x007fffe4, 23 }, //     (152)  |11111111|11111111|1100100
-  { 0x001fffdc, 21 }, //     (153)  |11111111|11111110|11100
-  { 0x003fffd8, 22 }, //     (154)  |11111111|11111111|011000
-  { 0x007fffe5, 23 }, //     (155)  |11111111|11111111|1100101
-  { 0x003fffd9, 22 }, //     (156)  |11111111|11111111|011001
-  { 0x007fffe6, 23 }, //     (157)  |11111111|11111111|1100110
-  { 0x007fffe7, 23 }, //     (158)  |11111111|11111111|1100111
-  { 0x00ffffef, 24 }, //     (159)  |11111111|11111111|11101111
-  { 0x003fffda, 22 }, //     (160)  |11111111|11111111|011010
-  { 0x001fffdd, 21 }, //     (161)  |11111111|11111110|11101
-  { 0x000fffe9, 20 }, //     (162)  |11111111|11111110|1001
-  { 0x003fffdb, 22 }, //     (163)  |11111111|11111111|011011
-  { 0x003fffdc, 22 }, //     (164)  |11111111|11111111|011100
-  { 0x007fffe8, 23 }, //     (165)  |11111111|11111111|1101000
-  { 0x007fffe9, 23 }, //     (166)  |11111111|11111111|1101001
-  { 0x001fffde, 21 }, //     (167)  |11111111|11111110|11110
-  { 0x007fffea, 23 }, //     (168)  |11111111|11111111|1101010
-  { 0x003fffdd, 22 }, //     (169)  |11111111|11111111|011101
-  { 0x003fffde, 22 }, //     (170)  |11111111|11111111|011110
-  { 0x00fffff0, 24 }, //     (171)  |11111111|11111111|11110000
-  { 0x001fffdf, 21 }, //     (172)  |11111111|11111110|11111
-  { 0x003fffdf, 22 }, //     (173)  |11111111|11111111|011111
-  { 0x007fffeb, 23 }, //     (174)  |11111111|11111111|1101011
-  { 0x007fffec, 23 }, //     (175)  |11111111|11111111|1101100
-  { 0x001fffe0, 21 }, //     (176)  |11111111|11111111|00000
-  { 0x001fffe1, 21 }, //     (177)  |11111111|11111111|00001
-  { 0x003fffe0, 22 }, //     (178)  |11111111|11111111|100000
-  { 0x001fffe2, 21 }, //     (179)  |11111111|11111111|00010
-  { 0x007fffed, 23 }, //     (180)  |11111111|11111111|1101101
-  { 0x003fffe1, 22 }, //     (181)  |11111111|11111111|100001
-  { 0x007fffee, 23 }, //     (182)  |11111111|11111111|1101110
-  { 0x007fffef, 23 }, //     (183)  |11111111|11111111|1101111
-  { 0x000fffea, 20 }, //     (184)  |11111111|11111110|1010
-  { 0x003fffe2, 22 }, //     (185)  |11111111|11111111|100010
-  { 0x003fffe3, 22 }, //     (186)  |11111111|11111111|100011
-  { 0x003fffe4, 22 }, //     (187)  |11111111|11111111|100100
-  { 0x007ffff0, 23 }, //     (188)  |11111111|11111111|1110000
-  { 0x003fffe5, 22 }, //     (189)  |11111111|11111111|100101
-  { 0x003fffe6, 22 }, //     (190)  |11111111|11111111|100110
-  { 0x007ffff1, 23 }, //     (191)  |11111111|11111111|1110001
-  { 0x03ffffe0, 26 }, //     (192)  |11111111|11111111|11111000|00
-  { 0x03ffffe1, 26 }, //     (193)  |11111111|11111111|11111000|01
-  { 0x000fffeb, 20 }, //     (194)  |11111111|11111110|1011
-  { 0x0007fff1, 19 }, //     (195)  |11111111|11111110|001
-  { 0x003fffe7, 22 }, //     (196)  |11111111|11111111|100111
-  { 0x007ffff2, 23 }, //     (197)  |11111111|11111111|1110010
-  { 0x003fffe8, 22 }, //     (198)  |11111111|11111111|101000
-  { 0x01ffffec, 25 }, //     (199)  |11111111|11111111|11110110|0
-  { 0x03ffffe2, 26 }, //     (200)  |11111111|11111111|11111000|10
-  { 0x03ffffe3, 26 }, //     (201)  |11111111|11111111|11111000|11
-  { 0x03ffffe4, 26 }, //     (202)  |11111111|11111111|11111001|00
-  { 0x07ffffde, 27 }, //     (203)  |11111111|11111111|11111011|110
-  { 0x07ffffdf, 27 }, //     (204)  |11111111|11111111|11111011|111
-  { 0x03ffffe5, 26 }, //     (205)  |11111111|11111111|11111001|01
-  { 0x00fffff1, 24 }, //     (206)  |11111111|11111111|11110001
-  { 0x01ffffed, 25 }, //     (207)  |11111111|11111111|11110110|1
-  { 0x0007fff2, 19 }, //     (208)  |11111111|11111110|010
-  { 0x001fffe3, 21 }, //     (209)  |11111111|11111111|00011
-  { 0x03ffffe6, 26 }, //     (210)  |11111111|11111111|11111001|10
-  { 0x07ffffe0, 27 }, //     (211)  |11111111|11111111|11111100|000
-  { 0x07ffffe1, 27 }, //     (212)  |11111111|11111111|11111100|001
-  { 0x03ffffe7, 26 }, //     (213)  |11111111|11111111|11111001|11
-  { 0x07ffffe2, 27 }, //     (214)  |11111111|11111111|11111100|010
-  { 0x00fffff2, 24 }, //     (215)  |11111111|11111111|11110010
-  { 0x001fffe4, 21 }, //     (216)  |11111111|11111111|00100
-  { 0x001fffe5, 21 }, //     (217)  |11111111|11111111|00101
-  { 0x03ffffe8, 26 }, //     (218)  |11111111|11111111|11111010|00
-  { 0x03ffffe9, 26 }, //     (219)  |11111111|11111111|11111010|01
-  { 0x0ffffffd, 28 }, //     (220)  |11111111|11111111|11111111|1101
-  { 0x07ffffe3, 27 }, //     (221)  |11111111|11111111|11111100|011
-  { 0x07ffffe4, 27 }, //     (222)  |11111111|11111111|11111100|100
-  { 0x07ffffe5, 27 }, //     (223)  |11111111|11111111|11111100|101
-  { 0x000fffec, 20 }, //     (224)  |11111111|11111110|1100
-  { 0x00fffff3, 24 }, //     (225)  |11111111|11111111|11110011
-  { 0x000fffed, 20 }, //     (226)  |11111111|11111110|1101
-  { 0x001fffe6, 21 }, //     (227)  |11111111|11111111|00110
-  { 0x003fffe9, 22 }, //     (228)  |11111111|11111111|101001
-  { 0x001fffe7, 21 }, //     (229)  |11111111|11111111|00111
-  { 0x001fffe8, 21 }, //     (230)  |11111111|11111111|01000
-  { 0x007ffff3, 23 }, //     (231)  |11111111|11111111|1110011
-  { 0x003fffea, 22 }, //     (232)  |11111111|11111111|101010
-  { 0x003fffeb, 22 }, //     (233)  |11111111|11111111|101011
-  { 0x01ffffee, 25 }, //     (234)  |11111111|11111111|11110111|0
-  { 0x01ffffef, 25 }, //     (235)  |11111111|11111111|11110111|1
-  { 0x00fffff4, 24 }, //     (236)  |11111111|11111111|11110100
-  { 0x00fffff5, 24 }, //     (237)  |11111111|11111111|11110101
-  { 0x03ffffea, 26 }, //     (238)  |11111111|11111111|11111010|10
-  { 0x007ffff4, 23 }, //     (239)  |11111111|11111111|1110100
-  { 0x03ffffeb, 26 }, //     (240)  |11111111|11111111|11111010|11
-  { 0x07ffffe6, 27 }, //     (241)  |11111111|11111111|11111100|110
-  { 0x03ffffec, 26 }, //     (242)  |11111111|11111111|11111011|00
-  { 0x03ffffed, 26 }, //     (243)  |11111111|11111111|11111011|01
-  { 0x07ffffe7, 27 }, //     (244)  |11111111|11111111|11111100|111
-  { 0x07ffffe8, 27 }, //     (245)  |11111111|11111111|11111101|000
-  { 0x07ffffe9, 27 }, //     (246)  |11111111|11111111|11111101|001
-  { 0x07ffffea, 27 }, //     (247)  |11111111|11111111|11111101|010
-  { 0x07ffffeb, 27 }, //     (248)  |11111111|11111111|11111101|011
-  { 0x0ffffffe, 28 }, //     (249)  |11111111|11111111|11111111|1110
-  { 0x07ffffec, 27 }, //     (250)  |11111111|11111111|11111101|100
-  { 0x07ffffed, 27 }, //     (251)  |11111111|11111111|11111101|101
-  { 0x07ffffee, 27 }, //     (252)  |11111111|11111111|11111101|110
-  { 0x07ffffef, 27 }, //     (253)  |11111111|11111111|11111101|111
-  { 0x07fffff0, 27 }, //     (254)  |11111111|11111111|11111110|000
-  { 0x03ffffee, 26 }, //     (255)  |11111111|11111111|11111011|10
-  { 0x3fffffff, 30 }, // EOS (256)  |11111111|11111111|11111111|111111
-};
+static const int s_hpack_static_table_size = sizeof(s_hpack_static_table) / sizeof(s_hpack_static_table[0]);
 
 //
 // Settings
@@ -674,41 +418,56 @@ void FrameEncoder::header(uint8_t *buf, int id, uint8_t type, uint8_t flags, siz
 //
 
 void DynamicTable::reset() {
-  for (auto i = m_tail + 1; i <= m_head; i++) {
-    auto entry = m_entries[i % MAX_ENTRY_COUNT];
-    delete entry;
-  }
-  m_size = 0;
+  evict(0);
+  m_capacity = Settings::DEFAULT_HEADER_TABLE_SIZE;
   m_head = 0;
-  m_tail = 0;
+}
+
+void DynamicTable::resize(size_t size) {
+  m_capacity = size;
+  evict(size);
 }
 
 auto DynamicTable::get(size_t i) const -> const TableEntry* {
-  auto n = m_head - m_tail;
-  if (i >= n) return nullptr;
-  return m_entries[(m_head - i) % MAX_ENTRY_COUNT];
+  if (i >= m_count) return nullptr;
+  return &m_entries[(m_head - 1 - i) & (m_entries.size() - 1)];
 }
 
 void DynamicTable::add(pjs::Str *name, pjs::Str *value) {
-  auto i = ++m_head;
-  if (i - m_tail >= MAX_ENTRY_COUNT) {
-    auto entry = m_entries[++m_tail % MAX_ENTRY_COUNT];
-    m_size -= 32 + entry->name->size() + entry->value->size();
-    delete entry;
+  auto size = entry_size(name, value);
+  if (size > m_capacity) {
+    evict(0);
+    return;
   }
-  auto entry = m_entries[i % MAX_ENTRY_COUNT] = new TableEntry;
-  entry->name = name;
-  entry->value = value;
-  m_size += 32 + name->size() + value->size();
-  evict();
+
+  evict(m_capacity - size);
+
+  // Every entry takes at least 32 bytes, so the ring stops
+  // growing once it can hold capacity / 32 entries
+  if (m_count == m_entries.size()) {
+    auto n = m_entries.size();
+    std::vector<TableEntry> entries(n ? n * 2 : 16);
+    auto mask = entries.size() - 1;
+    for (auto i = m_head - m_count; i != m_head; i++) {
+      entries[i & mask] = std::move(m_entries[i & (n - 1)]);
+    }
+    m_entries.swap(entries);
+  }
+
+  auto &entry = m_entries[m_head++ & (m_entries.size() - 1)];
+  entry.name = name;
+  entry.value = value;
+  m_size += size;
+  m_count++;
 }
 
-void DynamicTable::evict() {
-  while (m_size > m_capacity) {
-    auto i = ++m_tail;
-    auto entry = m_entries[i % MAX_ENTRY_COUNT];
-    m_size -= 32 + entry->name->size() + entry->value->size();
-    delete entry;
+void DynamicTable::evict(size_t size) {
+  while (m_size > size) {
+    auto &entry = m_entries[(m_head - m_count) & (m_entries.size() - 1)];
+    m_size -= entry_size(entry.name, entry.value);
+    entry.name = nullptr;
+    entry.value = nullptr;
+    m_count--;
   }
 }
 
@@ -718,7 +477,6 @@ void DynamicTable::evict() {
 
 thread_local
 const HeaderDecoder::StaticTable HeaderDecoder::s_static_table;
-const HeaderDecoder::HuffmanTree HeaderDecoder::s_huffman_tree;
 
 HeaderDecoder::HeaderDecoder(const Settings &settings)
   : m_settings(settings)
@@ -774,7 +532,7 @@ auto HeaderDecoder::decode(Data &data) -> ErrorCode {
         }
         case NAME_LENGTH: {
           if (read_int(c)) {
-            m_ptr = 0;
+            m_huffman.reset();
             m_state = NAME_STRING;
           }
           break;
@@ -799,7 +557,7 @@ auto HeaderDecoder::decode(Data &data) -> ErrorCode {
         }
         case VALUE_LENGTH: {
           if (read_int(c)) {
-            m_ptr = 0;
+            m_huffman.reset();
             m_state = VALUE_STRING;
           }
           break;
@@ -852,35 +610,25 @@ bool HeaderDecoder::read_int(uint8_t c) {
 
 bool HeaderDecoder::read_str(uint8_t c, bool lowercase_only) {
   if (m_prefix & 0x80) {
-    const auto &tree = s_huffman_tree.get();
-    int last_bit = 8;
-    for (int b = 7; b >= 0; b--) {
-      bool bit = (c >> b) & 1;
-      m_ptr = bit ? tree[m_ptr].right : tree[m_ptr].left;
-      auto &node = tree[m_ptr];
-      if (!node.left) {
-        auto ch = node.right;
-        if (ch == 256) {
-          error(); // EOS is considered an error
+    uint8_t sym[2];
+    auto n = m_huffman.decode(c, sym);
+    if (n < 0) {
+      error(); // EOS is considered an error
+      return false;
+    }
+    for (int i = 0; i < n; i++) {
+      auto ch = sym[i];
+      if (lowercase_only) {
+        if (std::tolower(ch) != ch) {
+          error(PROTOCOL_ERROR);
           return false;
         }
-        if (lowercase_only) {
-          if (std::tolower(ch) != ch) {
-            error(PROTOCOL_ERROR);
-            return false;
-          }
-        }
-        s_dp.push(&m_buffer, char(ch));
-        m_ptr = 0;
-        last_bit = b;
       }
+      s_dp.push(&m_buffer, char(ch));
     }
-    if (m_int == 1) {
-      uint8_t mask = uint8_t(1 << last_bit) - 1;
-      if (mask == 0xff || (c & mask) != mask) {
-        error();
-        return false;
-      }
+    if (m_int == 1 && !m_huffman.accepted()) {
+      error();
+      return false;
     }
   } else {
     if (lowercase_only) {
@@ -951,7 +699,7 @@ void HeaderDecoder::name_prefix(uint8_t prefix) {
     m_exp = 0;
     m_state = NAME_LENGTH;
   } else {
-    m_ptr = 0;
+    m_huffman.reset();
     m_state = NAME_STRING;
   }
 }
@@ -962,7 +710,7 @@ void HeaderDecoder::value_prefix(uint8_t prefix) {
     m_exp = 0;
     m_state = VALUE_LENGTH;
   } else {
-    m_ptr = 0;
+    m_huffman.reset();
     m_state = VALUE_STRING;
   }
 }
@@ -1095,34 +843,53 @@ HeaderDecoder::StaticTable::StaticTable() {
 }
 
 //
-// HeaderDecoder::HuffmanTree
+// HeaderEncoder
 //
 
-HeaderDecoder::HuffmanTree::HuffmanTree() {
-  int n = sizeof(s_hpack_huffman_table) / sizeof(s_hpack_huffman_table[0]);
-  m_tree.resize(1);
-  for (int i = 0; i < n; i++) {
-    auto &p = s_hpack_huffman_table[i];
-    int ptr = 0;
-    for (int b = p.bits - 1; b >= 0; b--) {
-      bool bit = (p.code >> b) & 1;
-      auto &node = m_tree[ptr];
-      ptr = bit ? node.right : node.left;
-      if (!ptr) {
-        ptr = m_tree.size();
-        (bit ? node.right : node.left) = ptr;
-        m_tree.emplace_back();
-      }
-    }
-    m_tree[ptr].right = i;
-  }
+thread_local HeaderEncoder::StaticTable HeaderEncoder::m_static_table;
+
+HeaderEncoder::HeaderEncoder() {
+  reset();
+}
+
+void HeaderEncoder::reset() {
+  m_dynamic_table.reset();
+  m_field_index.clear();
+  m_name_index.clear();
+  m_peer_table_size = Settings::DEFAULT_HEADER_TABLE_SIZE;
+  m_min_table_size = m_dynamic_table.capacity();
+  m_table_size_changed = false;
+  update_table_size();
+}
+
+void HeaderEncoder::set_max_table_size(size_t size) {
+  m_max_table_size = size;
+  update_table_size();
+}
+
+void HeaderEncoder::set_peer_table_size(size_t size) {
+  m_peer_table_size = size;
+  update_table_size();
 }
 
 //
-// HeaderEncoder
+// Header names are matched by their interned strings, so names that
+// come with capital letters are lowercased once up front, before any
+// lookup in the static and dynamic tables
 //
 
-thread_local HeaderEncoder::StaticTable HeaderEncoder::m_static_table;
+static auto lowercase_name(pjs::Str *k) -> pjs::Str* {
+  const auto &s = k->str();
+  for (size_t i = 0; i < s.length(); i++) {
+    auto ch = s[i];
+    if ('A' <= ch && ch <= 'Z') {
+      std::string lower(s);
+      for (auto &c : lower) c = std::tolower((unsigned char)c);
+      return pjs::Str::make(std::move(lower));
+    }
+  }
+  return k;
+}
 
 void HeaderEncoder::encode(bool is_response, bool is_tail, pjs::Object *head, Data &data) {
   Data::Builder db(data, &s_dp);
@@ -1167,6 +934,8 @@ void HeaderEncoder::encode(bool is_response, bool is_tail, pjs::Object *head, Da
       obj->iterate_all(
         [&](pjs::Str *k, pjs::Value &v) {
           if (k == pjs::Str::empty) return;
+          pjs::Ref<pjs::Str> name(lowercase_name(k));
+          k = name;
           if (k == s_host) {
             if (has_authority) return;
             k = s_colon_authority;
@@ -1197,18 +966,64 @@ void HeaderEncoder::encode(bool is_response, bool is_tail, pjs::Object *head, Da
   db.flush();
 }
 
+//
+// Values that change with nearly every message would only churn
+// the dynamic table, and short credentials are never indexed so
+// that they can't be guessed by probing the compression (RFC 7541
+// section 7.1.3)
+//
+
+static bool should_index(pjs::Str *k, pjs::Str *v) {
+  if (k == s_colon_path) return !std::strchr(v->c_str(), '?');
+  return (
+    k != s_content_length &&
+    k != s_set_cookie &&
+    k != s_date &&
+    k != s_etag &&
+    k != s_last_modified &&
+    k != s_location &&
+    k != s_if_modified_since &&
+    k != s_if_none_match
+  );
+}
+
+static bool is_sensitive(pjs::Str *k, pjs::Str *v) {
+  if (k == s_authorization || k == s_proxy_authorization) return true;
+  if (k == s_cookie) return v->size() < 20;
+  return false;
+}
+
 void HeaderEncoder::encode_header_field(Data::Builder &db, pjs::Str *k, pjs::Str *v) {
-  if (const auto *ent = m_static_table.find(k)) {
+  encode_table_size(db);
+
+  const auto *ent = m_static_table.find(k);
+  if (ent) {
     auto i = ent->values.find(v);
-    if (i == ent->values.end()) {
-      encode_int(db, 0x00, 4, ent->index);
-      encode_str(db, v, false);
-    } else {
+    if (i != ent->values.end()) {
       encode_int(db, 0x80, 1, i->second);
+      return;
     }
+  }
+
+  if (auto i = find_field(k, v)) {
+    encode_int(db, 0x80, 1, i);
+    return;
+  }
+
+  auto name_index = ent ? ent->index : find_name(k);
+  auto sensitive = is_sensitive(k, v);
+
+  if (
+    !sensitive && should_index(k, v) &&
+    DynamicTable::entry_size(k, v) <= m_dynamic_table.capacity() * 3 / 4
+  ) {
+    encode_int(db, 0x40, 2, name_index);
+    if (!name_index) encode_str(db, k, true);
+    encode_str(db, v, false);
+    index_field(k, v);
   } else {
-    encode_int(db, 0x00, 4, 0);
-    encode_str(db, k, true);
+    encode_int(db, sensitive ? 0x10 : 0x00, 4, name_index);
+    if (!name_index) encode_str(db, k, true);
     encode_str(db, v, false);
   }
 }
@@ -1220,19 +1035,25 @@ void HeaderEncoder::encode_int(Data::Builder &db, uint8_t prefix, int prefix_len
   } else {
     db.push(uint8_t(prefix | mask));
     n -= mask;
-    while (n) {
-      if (n >> 7) {
-        db.push(uint8_t(0x80 | (n & 0x7f)));
-      } else {
-        db.push(uint8_t(n & 0x7f));
-      }
+    while (n >> 7) {
+      db.push(uint8_t(0x80 | (n & 0x7f)));
       n >>= 7;
     }
+    db.push(uint8_t(n));
   }
 }
 
 void HeaderEncoder::encode_str(Data::Builder &db, pjs::Str *s, bool lowercase) {
-  encode_int(db, 0, 1, s->size());
+  auto len = s->size();
+  auto huffman_len = HuffmanEncoder::encoded_size(s->c_str(), len, lowercase);
+  if (huffman_len < len) {
+    pjs::vl_array<uint8_t, 1000> buf(huffman_len);
+    HuffmanEncoder::encode(s->c_str(), len, lowercase, buf.data());
+    encode_int(db, 0x80, 1, huffman_len);
+    db.push((const char *)buf.data(), huffman_len);
+    return;
+  }
+  encode_int(db, 0, 1, len);
   if (lowercase) {
     for (auto ch : s->str()) {
       db.push(char(std::tolower(ch)));
@@ -1242,6 +1063,62 @@ void HeaderEncoder::encode_str(Data::Builder &db, pjs::Str *s, bool lowercase) {
   }
 }
 
+void HeaderEncoder::encode_table_size(Data::Builder &db) {
+  if (m_table_size_changed) {
+    auto size = m_dynamic_table.capacity();
+    if (m_min_table_size < size) encode_int(db, 0x20, 3, m_min_table_size);
+    encode_int(db, 0x20, 3, size);
+    m_min_table_size = size;
+    m_table_size_changed = false;
+  }
+}
+
+void HeaderEncoder::update_table_size() {
+  auto size = std::min(m_max_table_size, m_peer_table_size);
+  if (size != m_dynamic_table.capacity()) {
+    m_dynamic_table.resize(size);
+    m_min_table_size = std::min(m_min_table_size, size);
+    m_table_size_changed = true;
+  }
+}
+
+void HeaderEncoder::index_field(pjs::Str *k, pjs::Str *v) {
+  m_dynamic_table.add(k, v);
+  auto seq = m_dynamic_table.inserted() - 1;
+  m_field_index[std::make_pair(k, v)] = seq;
+  m_name_index[k] = seq;
+
+  // Drop index entries left behind by evictions every now and then
+  auto limit = 2 * m_dynamic_table.count() + 64;
+  if (m_field_index.size() > limit || m_name_index.size() > limit) {
+    auto oldest = m_dynamic_table.inserted() - m_dynamic_table.count();
+    for (auto i = m_field_index.begin(); i != m_field_index.end(); ) {
+      if (i->second < oldest) i = m_field_index.erase(i); else i++;
+    }
+    for (auto i = m_name_index.begin(); i != m_name_index.end(); ) {
+      if (i->second < oldest) i = m_name_index.erase(i); else i++;
+    }
+  }
+}
+
+auto HeaderEncoder::find_field(pjs::Str *k, pjs::Str *v) -> int {
+  auto i = m_field_index.find(std::make_pair(k, v));
+  if (i == m_field_index.end()) return 0;
+  auto newest = m_dynamic_table.inserted() - 1;
+  auto age = newest - i->second;
+  if (age >= m_dynamic_table.count()) return 0;
+  return s_hpack_static_table_size + 1 + age;
+}
+
+auto HeaderEncoder::find_name(pjs::Str *k) -> int {
+  auto i = m_name_index.find(k);
+  if (i == m_name_index.end()) return 0;
+  auto newest = m_dynamic_table.inserted() - 1;
+  auto age = newest - i->second;
+  if (age >= m_dynamic_table.count()) return 0;
+  return s_hpack_static_table_size + 1 + age;
+}
+
 HeaderEncoder::StaticTable::StaticTable() {
   int n = sizeof(s_hpack_static_table) / sizeof(s_hpack_static_table[0]);
   for (int i = 0; i < n; i++) {
@@ -1276,6 +1153,9 @@ Endpoint::Options::Options(pjs::Object *options) {
   Value(options, "streamWindowSize")
     .get_binary_size(stream_window_size)
     .check_nullable();
+  Value(options, "headerTableSize")
+    .get_binary_size(header_table_size)
+    .check_nullable();
 }
 
 Endpoint::Endpoint(bool is_server_side, const Options &options)
@@ -1287,6 +1167,8 @@ Endpoint::Endpoint(bool is_server_side, const Options &options)
   init_metrics();
   m_settings.enable_push = false;
   m_settings.initial_window_size = options.stream_window_size;
+  m_settings.header_table_size = options.header_table_size;
+  m_header_encoder.set_max_table_size(options.header_table_size);
   m_recv_window_max = options.connection_window_size;
   m_recv_window_low = m_recv_window_max / 2;
 }
@@ -1301,6 +1183,7 @@ void Endpoint::reset() {
   m_streams.clear();
   m_streams_pending.clear();
   m_header_decoder.reset();
+  m_header_encoder.reset();
   m_peer_settings = Settings();
   m_output_buffer.clear();
   m_last_received_stream_id = 0;
@@ -1313,6 +1196,7 @@ void Endpoint::reset() {
 
 void Endpoint::init_settings(const uint8_t *data, size_t size) {
   m_peer_settings.decode(data, size);
+  m_header_encoder.set_peer_table_size(m_peer_settings.header_table_size);
 }
 
 void Endpoint::process_event(Event *evt) {
@@ -1443,6 +1327,7 @@ void Endpoint::on_deframe(Frame &frm) {
             auto err = m_peer_settings.decode(buf, len);
             if (err == NO_ERROR) {
               bool ok = true;
+              m_header_encoder.set_peer_table_size(m_peer_settings.header_table_size);
               if (m_peer_settings.initial_window_size != old_initial_window_size) {
                 auto delta = m_peer_settings.initial_window_size - old_initial_window_size;
                 ok = for_each_stream(
@@ -1837,9 +1722,9 @@ void Endpoint::StreamBase::encoder_input(Event *evt) {
           } else {
             if (m_is_tunnel_requested) return;
           }
-          if (auto tail = end->tail()) {
-            m_header_encoder.encode(m_is_server_side, true, tail, m_tail_buffer);
-          }
+          // Trailers are encoded only when sent, since the dynamic
+          // table must see header blocks in the order they go out
+          m_tail = end->tail();
         }
         if (m_state == OPEN) {
           m_state = HALF_CLOSED_LOCAL;
@@ -2137,6 +2022,23 @@ void Endpoint::StreamBase::write_header_block(Data &data) {
   }
 }
 
+void Endpoint::StreamBase::write_tail() {
+  Data buf;
+  pjs::Ref<pjs::Object> tail(m_tail);
+  m_tail = nullptr;
+  m_header_encoder.encode(m_is_server_side, true, tail, buf);
+  if (buf.empty()) {
+    Frame frm;
+    frm.stream_id = m_id;
+    frm.type = Frame::DATA;
+    frm.flags = Frame::BIT_END_STREAM;
+    m_end_stream_send = false;
+    frame(frm);
+  } else {
+    write_header_block(buf);
+  }
+}
+
 void Endpoint::StreamBase::stream_end(http::MessageTail *tail) {
   if (m_is_tunnel_confirmed) {
     decoder_output(StreamEnd::make());
@@ -2190,7 +2092,7 @@ void Endpoint::StreamBase::set_clearing(bool clearing) {
 }
 
 void Endpoint::StreamBase::pump() {
-  bool is_empty_end = (m_end_stream_send && m_send_buffer.empty() && m_tail_buffer.empty());
+  bool is_empty_end = (m_end_stream_send && m_send_buffer.empty() && !m_tail);
   int size = m_send_buffer.size();
   if (size > m_send_window) size = m_send_window;
   if (size > 0) size = deduct_send(size);
@@ -2203,7 +2105,7 @@ void Endpoint::StreamBase::pump() {
       frm.stream_id = m_id;
       frm.type = Frame::DATA;
       if (n > 0) m_send_buffer.shift(n, frm.payload);
-      if (m_end_stream_send && m_send_buffer.empty() && m_tail_buffer.empty()) {
+      if (m_end_stream_send && m_send_buffer.empty() && !m_tail) {
         frm.flags = Frame::BIT_END_STREAM;
         m_end_stream_send = false;
       } else {
@@ -2214,7 +2116,7 @@ void Endpoint::StreamBase::pump() {
     m_send_window -= size;
   }
   if (m_send_buffer.empty()) {
-    if (!m_tail_buffer.empty()) write_header_block(m_tail_buffer);
+    if (m_tail) write_tail();
     set_pending(false);
   } else {
     set_pending(true);
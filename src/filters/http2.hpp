@@ -36,8 +36,10 @@
 #include "deframer.hpp"
 #include "demux.hpp"
 #include "options.hpp"
+#include "huffman.hpp"
 
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 
@@ -174,7 +176,7 @@ private:
 // TableEntry
 //
 
-struct TableEntry : public pjs::Pooled<TableEntry> {
+struct TableEntry {
   pjs::Ref<pjs::Str> name;
   pjs::Ref<pjs::Str> value;
 };
@@ -182,27 +184,32 @@ struct TableEntry : public pjs::Pooled<TableEntry> {
 //
 // DynamicTable
 //
+// Entries live by value in a ring sized for the most entries that
+// can fit in the capacity, so adding one allocates nothing.
+//
 
 class DynamicTable {
 public:
-  ~DynamicTable() { reset(); }
-
   void reset();
   auto capacity() const -> size_t { return m_capacity; }
-  void resize(size_t size) { m_capacity = size; evict(); }
+  auto count() const -> size_t { return m_count; }
+  auto inserted() const -> size_t { return m_head; }
+  void resize(size_t size);
   auto get(size_t i) const -> const TableEntry*;
   void add(pjs::Str *name, pjs::Str *value);
 
-private:
-  enum { MAX_ENTRY_COUNT = 128 };
+  static auto entry_size(pjs::Str *name, pjs::Str *value) -> size_t {
+    return 32 + name->size() + value->size();
+  }
 
-  TableEntry* m_entries[MAX_ENTRY_COUNT];
+private:
+  std::vector<TableEntry> m_entries;
   size_t m_capacity = Settings::DEFAULT_HEADER_TABLE_SIZE;
   size_t m_size = 0;
   size_t m_head = 0;
-  size_t m_tail = 0;
+  size_t m_count = 0;
 
-  void evict();
+  void evict(size_t size);
 };
 
 //
@@ -239,14 +246,6 @@ private:
     VALUE_STRING,
   };
 
-  struct Huffman {
-    uint16_t left = 0;
-    union {
-      uint16_t right = 0;
-      uint16_t code;
-    };
-  };
-
   const Settings& m_settings;
   State m_state;
   ErrorCode m_error;
@@ -258,7 +257,7 @@ private:
   uint8_t m_prefix;
   uint8_t m_exp;
   uint32_t m_int;
-  uint16_t m_ptr;
+  HuffmanDecoder m_huffman;
   Data m_buffer;
   pjs::Ref<http::MessageHead> m_head;
   pjs::Ref<pjs::Str> m_name;
@@ -290,21 +289,8 @@ private:
     std::vector<TableEntry> m_table;
   };
 
-  //
-  // HeaderDecoder::HuffmanTree
-  //
-
-  class HuffmanTree {
-  public:
-    HuffmanTree();
-    auto get() const -> const std::vector<Huffman>& { return m_tree; }
-  private:
-    std::vector<Huffman> m_tree;
-  };
-
   thread_local
   static const StaticTable s_static_table;
-  static const HuffmanTree s_huffman_tree;
 };
 
 //
@@ -313,6 +299,12 @@ private:
 
 class HeaderEncoder {
 public:
+  HeaderEncoder();
+
+  void reset();
+  void set_max_table_size(size_t size);
+  void set_peer_table_size(size_t size);
+
   void encode(
     bool is_response,
     bool is_tail,
@@ -329,12 +321,23 @@ private:
 
   void encode_int(Data::Builder &db, uint8_t prefix, int prefix_len, uint32_t n);
   void encode_str(Data::Builder &db, pjs::Str *s, bool lowercase);
+  void encode_table_size(Data::Builder &db);
+  void update_table_size();
+  void index_field(pjs::Str *k, pjs::Str *v);
+  auto find_field(pjs::Str *k, pjs::Str *v) -> int;
+  auto find_name(pjs::Str *k) -> int;
 
   struct Entry {
     int index = 0;
     std::map<pjs::Ref<pjs::Str>, int> values;
   };
 
+  struct FieldHash {
+    size_t operator()(const std::pair<pjs::Str*, pjs::Str*> &f) const {
+      return std::hash<pjs::Str*>()(f.first) * 31 + std::hash<pjs::Str*>()(f.second);
+    }
+  };
+
   //
   // HeaderEncoder::StaticTable
   //
@@ -347,6 +350,16 @@ private:
     std::map<pjs::Ref<pjs::Str>, Entry> m_table;
   };
 
+  // Dynamic table entries are indexed by their insertion sequence
+  // numbers, which stay valid until the entries are evicted
+  DynamicTable m_dynamic_table;
+  std::unordered_map<std::pair<pjs::Str*, pjs::Str*>, size_t, FieldHash> m_field_index;
+  std::unordered_map<pjs::Str*, size_t> m_name_index;
+  size_t m_max_table_size = Settings::DEFAULT_HEADER_TABLE_SIZE;
+  size_t m_peer_table_size = Settings::DEFAULT_HEADER_TABLE_SIZE;
+  size_t m_min_table_size;
+  bool m_table_size_changed = false;
+
   thread_local static StaticTable m_static_table;
 };
 
@@ -363,6 +376,7 @@ public:
   struct Options : public pipy::Options {
     size_t connection_window_size = 0x100000;
     size_t stream_window_size = 0x100000;
+    size_t header_table_size = Settings::DEFAULT_HEADER_TABLE_SIZE;
     Options() {}
     Options(pjs::Object *options);
   };
@@ -486,6 +500,7 @@ protected:
     bool update_send_window(int delta);
     void update_connection_send_window();
     void write_header_block(Data &data);
+    void write_tail();
     void stream_end(http::MessageTail *tail);
 
     void frame(Frame &frm) { m_endpoint->frame(frm); }
@@ -517,7 +532,7 @@ protected:
     HeaderDecoder& m_header_decoder;
     HeaderEncoder& m_header_encoder;
     Data m_send_buffer;
-    Data m_tail_buffer;
+    pjs::Ref<pjs::Object> m_tail;
     int m_send_window = INITIAL_SEND_WINDOW_SIZE;
     int m_recv_window;
     int m_recv_window_max;
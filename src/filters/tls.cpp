@@ -24,19 +24,43 @@
  */
 
 #include "tls.hpp"
+#include "connect.hpp"
 #include "context.hpp"
+#include "inbound.hpp"
+#include "outbound.hpp"
 #include "module.hpp"
 #include "pipeline.hpp"
 #include "api/crypto.hpp"
 #include "log.hpp"
 
+#include <openssl/core_names.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/kdf.h>
+#include <openssl/rand.h>
+#include <openssl/x509v3.h>
+
+#ifdef __linux__
+#include <linux/tls.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 namespace pipy {
 namespace tls {
 
 thread_local static pjs::ConstStr STR_serverNames("serverNames");
 thread_local static pjs::ConstStr STR_protocolNames("protocolNames");
+thread_local static pjs::ConstStr STR_server("server");
+thread_local static pjs::ConstStr STR_client("client");
+thread_local static pjs::ConstStr STR_full("full");
+thread_local static pjs::ConstStr STR_resumed("resumed");
 static Data::Producer s_dp("TLS");
 
 static void throw_error() {
@@ -46,6 +70,262 @@ static void throw_error() {
   throw std::runtime_error(str);
 }
 
+//
+// SessionStore
+//
+// Process-wide LRU store of serialized sessions, shared by all
+// worker threads. Used as the server-side session cache keyed by
+// session ID and as the client-side session store keyed by
+// context and SNI.
+//
+
+class SessionStore {
+public:
+  SessionStore(size_t capacity) : m_capacity(capacity) {}
+
+  void reserve(size_t capacity) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (capacity > m_capacity) m_capacity = capacity;
+  }
+
+  void put(const std::string &key, SSL_SESSION *sess) {
+    auto len = i2d_SSL_SESSION(sess, nullptr);
+    if (len <= 0) return;
+    std::string der(len, 0);
+    auto *p = (unsigned char *)&der[0];
+    i2d_SSL_SESSION(sess, &p);
+    auto expiration = SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess);
+    auto single_use = (SSL_SESSION_get_protocol_version(sess) >= TLS1_3_VERSION);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_capacity) return;
+    auto i = m_map.find(key);
+    if (i != m_map.end()) {
+      m_lru.erase(i->second);
+      m_map.erase(i);
+    }
+    while (m_map.size() >= m_capacity) {
+      m_map.erase(m_lru.back().key);
+      m_lru.pop_back();
+    }
+    m_lru.push_front({ key, std::move(der), expiration, single_use });
+    m_map[key] = m_lru.begin();
+  }
+
+  auto get(const std::string &key) -> SSL_SESSION* {
+    std::string der;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto i = m_map.find(key);
+      if (i == m_map.end()) return nullptr;
+      auto e = i->second;
+      if (e->expiration <= std::time(nullptr)) {
+        m_lru.erase(e);
+        m_map.erase(i);
+        return nullptr;
+      }
+
+      // TLS 1.3 tickets are handed out only once (RFC 8446 C.4)
+      if (e->single_use) {
+        der = std::move(e->der);
+        m_lru.erase(e);
+        m_map.erase(i);
+      } else {
+        m_lru.splice(m_lru.begin(), m_lru, e);
+        der = e->der;
+      }
+    }
+    auto *p = (const unsigned char *)der.c_str();
+    return d2i_SSL_SESSION(nullptr, &p, der.length());
+  }
+
+private:
+  struct Entry {
+    std::string key;
+    std::string der;
+    time_t expiration;
+    bool single_use;
+  };
+
+  std::mutex m_mutex;
+  std::list<Entry> m_lru;
+  std::unordered_map<std::string, std::list<Entry>::iterator> m_map;
+  size_t m_capacity;
+};
+
+static SessionStore s_server_sessions(0);
+static SessionStore s_client_sessions(10000);
+
+static auto session_id_key(const unsigned char *id, unsigned int len) -> std::string {
+  return std::string((const char *)id, len);
+}
+
+//
+// Fingerprint
+//
+
+class Fingerprint {
+public:
+  Fingerprint() : m_ctx(EVP_MD_CTX_new()) {
+    EVP_DigestInit_ex(m_ctx, EVP_sha256(), nullptr);
+  }
+
+  ~Fingerprint() {
+    EVP_MD_CTX_free(m_ctx);
+  }
+
+  void update(const void *p, size_t n) {
+    uint32_t len = n;
+    EVP_DigestUpdate(m_ctx, &len, sizeof(len));
+    EVP_DigestUpdate(m_ctx, p, n);
+  }
+
+  void update(const std::string &s) {
+    update(s.c_str(), s.length());
+  }
+
+  void update(X509 *x) {
+    unsigned char *der = nullptr;
+    auto len = i2d_X509(x, &der);
+    if (len > 0) update(der, len);
+    OPENSSL_free(der);
+  }
+
+  template<class T>
+  void update_value(const T &v) {
+    update(&v, sizeof(v));
+  }
+
+  auto digest() -> std::string {
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int md_len = 0;
+    EVP_DigestFinal_ex(m_ctx, md, &md_len);
+    return std::string((const char *)md, md_len);
+  }
+
+private:
+  EVP_MD_CTX* m_ctx;
+};
+
+//
+// Digest of everything in a configuration that affects whether a
+// session established under it may be resumed under another
+//
+
+static auto config_digest(const Options &options, const std::string &extra) -> std::string {
+  Fingerprint fp;
+  int versions[2] = { int(options.minVersion.get()), int(options.maxVersion.get()) };
+  fp.update(versions, sizeof(versions));
+  if (options.ciphers) fp.update(options.ciphers->str());
+  for (const auto &cert : options.trusted) fp.update(cert->x509());
+  pjs::Value certificate(options.certificate);
+  if (options.certificate && !certificate.is_function()) {
+    pjs::Value cert;
+    certificate.o()->get("cert", cert);
+    if (cert.is<crypto::Certificate>()) {
+      fp.update(cert.as<crypto::Certificate>()->x509());
+    } else if (cert.is<crypto::CertificateChain>()) {
+      auto chain = cert.as<crypto::CertificateChain>();
+      for (int i = 0; i < chain->size(); i++) fp.update(chain->x509(i));
+    }
+  }
+  fp.update(extra);
+  return fp.digest();
+}
+
+//
+// Secret for ticket keys when none is configured, generated once
+// per process so that all worker threads derive the same keys
+//
+
+static auto default_ticket_secret() -> const std::string& {
+  static std::string secret = []() {
+    std::string s(32, 0);
+    RAND_bytes((unsigned char *)&s[0], s.length());
+    return s;
+  }();
+  return secret;
+}
+
+//
+// ContextCache
+//
+// Process-wide registry of TLSContexts by fingerprint. Entries are
+// weak so a context goes away with its last filter or session.
+// Contexts picked by a certificate callback are owned by the context
+// they derive from, so they go away with its filters on reload. They
+// are looked up on every handshake, so those go through a thread-local
+// LRU of weak references in front and only take a lock the first time
+// a thread sees them.
+//
+
+class ContextCache {
+public:
+  auto get(
+    const std::string &key,
+    const std::function<TLSContext*()> &make
+  ) -> std::shared_ptr<TLSContext> {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &entry = m_map[key];
+    if (auto ctx = entry.lock()) return ctx;
+    std::shared_ptr<TLSContext> ctx(make());
+    entry = ctx;
+    if (m_map.size() >= m_sweep_size) {
+      for (auto i = m_map.begin(); i != m_map.end(); ) {
+        if (i->second.expired()) i = m_map.erase(i); else i++;
+      }
+      m_sweep_size = std::max(size_t(100), m_map.size() * 2);
+    }
+    return ctx;
+  }
+
+private:
+  std::mutex m_mutex;
+  std::unordered_map<std::string, std::weak_ptr<TLSContext>> m_map;
+  size_t m_sweep_size = 100;
+};
+
+static ContextCache s_contexts;
+
+class ContextLRU {
+public:
+  ContextLRU(size_t capacity) : m_capacity(capacity) {}
+
+  auto get(const std::string &key) -> std::shared_ptr<TLSContext> {
+    auto i = m_map.find(key);
+    if (i == m_map.end()) return nullptr;
+    auto ctx = i->second->second.lock();
+    if (!ctx) {
+      m_lru.erase(i->second);
+      m_map.erase(i);
+      return nullptr;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, i->second);
+    return ctx;
+  }
+
+  void put(const std::string &key, const std::shared_ptr<TLSContext> &ctx) {
+    auto i = m_map.find(key);
+    if (i != m_map.end()) {
+      m_lru.erase(i->second);
+      m_map.erase(i);
+    }
+    while (!m_lru.empty() && (m_map.size() >= m_capacity || m_lru.back().second.expired())) {
+      m_map.erase(m_lru.back().first);
+      m_lru.pop_back();
+    }
+    m_lru.emplace_front(key, ctx);
+    m_map[key] = m_lru.begin();
+  }
+
+private:
+  typedef std::list<std::pair<std::string, std::weak_ptr<TLSContext>>> List;
+  List m_lru;
+  std::unordered_map<std::string, List::iterator> m_map;
+  size_t m_capacity;
+};
+
+thread_local static ContextLRU s_identity_contexts(4096);
+
 //
 // Options
 //
@@ -101,6 +381,10 @@ Options::Options(pjs::Object *options, const char *base_name) {
     .get(on_state_f)
     .check_nullable();
 
+  Value(options, "ktls", base_name)
+    .get(ktls)
+    .check_nullable();
+
 #if PIPY_USE_NTLS
   Value(options, "ntls", base_name)
     .get(ntls)
@@ -112,32 +396,111 @@ Options::Options(pjs::Object *options, const char *base_name) {
 // TLSContext
 //
 
-TLSContext::TLSContext(bool is_server, const Options &options) {
+auto TLSContext::get(const Config &config, const Identity *identity) -> std::shared_ptr<TLSContext> {
+  Fingerprint fp;
+  fp.update_value(config.is_server);
+  fp.update_value(config.ktls);
+#if PIPY_USE_NTLS
+  fp.update_value(config.ntls);
+#endif
+  fp.update_value(config.min_version);
+  fp.update_value(config.max_version);
+  fp.update(config.ciphers);
+  fp.update(config.dhparam);
+  fp.update_value(config.trusted.size());
+  for (auto *x : config.trusted) fp.update(x);
+  fp.update_value(config.client_alpn.size());
+  for (const auto &s : config.client_alpn) fp.update(s);
+  fp.update_value(config.server_alpn.size());
+  for (const auto &s : config.server_alpn) fp.update(s);
+  fp.update_value(config.alpn_select);
+  fp.update(config.session_id_context);
+  fp.update_value(config.session_ticket);
+  fp.update(config.session_ticket_secret);
+  fp.update_value(config.session_ticket_rotation);
+  fp.update_value(config.server_session_cache);
+  fp.update_value(config.client_session_cache);
+
+  auto base_key = fp.digest();
+  auto key = base_key;
+  if (identity) key += identity->fingerprint;
+
+  return s_contexts.get(key, [&]() {
+    auto ctx = new TLSContext(config, identity);
+    ctx->m_key = base_key;
+    return ctx;
+  });
+}
+
+TLSContext::TLSContext(const Config &config, const Identity *identity, const TLSContext *base)
+  : m_config(config)
+{
+  m_config.trusted.clear();
+
 #if PIPY_USE_NTLS
-  if(options.ntls) {
-    m_ctx = SSL_CTX_new(is_server ? NTLS_server_method() : NTLS_client_method());
+  if(config.ntls) {
+    m_ctx = SSL_CTX_new(config.is_server ? NTLS_server_method() : NTLS_client_method());
   } else {
-    m_ctx = SSL_CTX_new(is_server ? TLS_server_method() : TLS_client_method());
+    m_ctx = SSL_CTX_new(config.is_server ? TLS_server_method() : TLS_client_method());
   }
 #else
-  m_ctx = SSL_CTX_new(is_server ? TLS_server_method() : TLS_client_method());
+  m_ctx = SSL_CTX_new(config.is_server ? TLS_server_method() : TLS_client_method());
 #endif
 
   if (!m_ctx) throw_error();
 #if PIPY_USE_NTLS
-  if (options.ntls) {
+  if (config.ntls) {
     SSL_CTX_enable_ntls(m_ctx);
+  } else {
+    set_protocol_versions(config.min_version, config.max_version);
   }
+#else
+  set_protocol_versions(config.min_version, config.max_version);
 #endif
-  m_verify_store = X509_STORE_new();
-  if (!m_verify_store) throw_error();
 
-  SSL_CTX_set0_verify_cert_store(m_ctx, m_verify_store);
+  if (base) {
+    m_verify_store = base->m_verify_store;
+    m_verify = base->m_verify;
+    SSL_CTX_set1_verify_cert_store(m_ctx, m_verify_store);
+  } else {
+    m_verify_store = X509_STORE_new();
+    if (!m_verify_store) throw_error();
+    SSL_CTX_set0_verify_cert_store(m_ctx, m_verify_store);
+    for (auto *x : config.trusted) X509_STORE_add_cert(m_verify_store, x);
+    m_verify = !config.trusted.empty();
+  }
+
+  if (m_verify) {
+    SSL_CTX_set_verify(m_ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, on_verify);
+  }
+
   SSL_CTX_set_tlsext_servername_callback(m_ctx, on_server_name);
 
-  if (options.alpn && is_server) {
+  if (config.alpn_select && config.is_server) {
     SSL_CTX_set_alpn_select_cb(m_ctx, on_select_alpn, this);
   }
+
+#if defined(__linux__) && !PIPY_USE_NTLS
+  if (config.ktls) {
+    m_ktls = true;
+    SSL_CTX_set_options(m_ctx, SSL_OP_NO_RENEGOTIATION);
+  }
+#endif
+
+  if (!config.ciphers.empty()) set_ciphers(config.ciphers);
+  if (!config.dhparam.empty()) set_dhparam(config.dhparam);
+  if (!config.client_alpn.empty()) set_client_alpn(config.client_alpn);
+
+  set_session_id_context(config.session_id_context);
+
+  if (config.is_server) {
+    set_session_tickets(config.session_ticket, config.session_ticket_secret, config.session_ticket_rotation);
+    set_server_session_cache(config.server_session_cache);
+  } else {
+    set_client_session_cache(config.client_session_cache);
+  }
+
+  if (identity) set_identity(*identity);
 }
 
 TLSContext::~TLSContext() {
@@ -145,6 +508,75 @@ TLSContext::~TLSContext() {
   if (m_ctx) SSL_CTX_free(m_ctx);
 }
 
+//
+// Same configuration with a certificate from a callback, so that
+// only the certificate varies between contexts switched to on SNI
+//
+
+auto TLSContext::with_identity(const Identity &identity) -> std::shared_ptr<TLSContext> {
+  static const size_t max_identities = 4096;
+  auto key = m_key + identity.fingerprint;
+  if (auto ctx = s_identity_contexts.get(key)) return ctx;
+  std::shared_ptr<TLSContext> ctx;
+  {
+    std::lock_guard<std::mutex> lock(m_identities_mutex);
+    auto i = m_identities.find(identity.fingerprint);
+    if (i != m_identities.end()) {
+      ctx = i->second;
+    } else {
+      ctx = s_contexts.get(key, [&]() {
+        auto ctx = new TLSContext(m_config, &identity, this);
+        ctx->m_key = m_key;
+        return ctx;
+      });
+      if (m_identities.size() >= max_identities) m_identities.clear();
+      m_identities[identity.fingerprint] = ctx;
+    }
+  }
+  s_identity_contexts.put(key, ctx);
+  return ctx;
+}
+
+//
+// Certificate digests are cached inside X509 objects after their
+// extensions are parsed, so the fingerprint is cheap to take on
+// every handshake
+//
+
+auto TLSContext::Identity::load(pjs::Object *certificate) -> const char* {
+  pjs::Value c, k;
+  certificate->get("cert", c);
+  certificate->get("key", k);
+
+  if (!k.is<crypto::PrivateKey>()) {
+    return "certificate.key requires a PrivateKey object";
+  }
+
+  key = k.as<crypto::PrivateKey>()->pkey();
+  chain.clear();
+
+  if (c.is<crypto::Certificate>()) {
+    chain.push_back(c.as<crypto::Certificate>()->x509());
+  } else if (c.is<crypto::CertificateChain>()) {
+    auto *cc = c.as<crypto::CertificateChain>();
+    if (cc->size() < 1) return "empty certificate chain";
+    for (int i = 0; i < cc->size(); i++) chain.push_back(cc->x509(i));
+  } else {
+    return "certificate.cert requires a Certificate or a CertificateChain object";
+  }
+
+  fingerprint.clear();
+  for (auto *x : chain) {
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    X509_get_extension_flags(x);
+    X509_digest(x, EVP_sha1(), md, &len);
+    fingerprint.append((const char *)md, len);
+  }
+
+  return nullptr;
+}
+
 void TLSContext::set_protocol_versions(ProtocolVersion min, ProtocolVersion max) {
   auto f = [](ProtocolVersion v) {
     switch (v) {
@@ -175,11 +607,6 @@ void TLSContext::set_dhparam(const std::string &data) {
   }
 }
 
-void TLSContext::add_certificate(crypto::Certificate *cert) {
-  X509_STORE_add_cert(m_verify_store, cert->x509());
-  SSL_CTX_set_verify(m_ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, on_verify);
-}
-
 void TLSContext::set_client_alpn(const std::vector<std::string> &protocols) {
   std::string proto_list;
   for (const auto &s : protocols) {
@@ -193,8 +620,102 @@ void TLSContext::set_client_alpn(const std::vector<std::string> &protocols) {
   SSL_CTX_set_alpn_protos(m_ctx, (const unsigned char *)proto_list.c_str(), proto_list.size());
 }
 
-void TLSContext::set_server_alpn(const std::set<pjs::Ref<pjs::Str>> &protocols) {
-  m_server_alpn = protocols;
+void TLSContext::set_session_id_context(const std::string &id) {
+  SSL_CTX_set_session_id_context(
+    m_ctx, (const unsigned char *)id.c_str(),
+    std::min(id.length(), size_t(SSL_MAX_SID_CTX_LENGTH))
+  );
+}
+
+void TLSContext::set_session_tickets(bool enabled, const std::string &secret, double rotation) {
+  if (!enabled) {
+    SSL_CTX_set_options(m_ctx, SSL_OP_NO_TICKET);
+    return;
+  }
+  m_config.session_ticket_secret = secret.empty() ? default_ticket_secret() : secret;
+  m_config.session_ticket_rotation = rotation > 0 ? rotation : 3600;
+  m_ticket_epoch = -1;
+  SSL_CTX_set_app_data(m_ctx, this);
+  SSL_CTX_set_tlsext_ticket_key_evp_cb(m_ctx, on_ticket_key);
+
+  // A ticket stays decryptable for the current and the previous epoch
+  SSL_CTX_set_timeout(m_ctx, long(m_config.session_ticket_rotation));
+}
+
+void TLSContext::set_server_session_cache(size_t size) {
+  if (size > 0) {
+    s_server_sessions.reserve(size);
+    SSL_CTX_set_session_cache_mode(m_ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(m_ctx, on_new_session);
+    SSL_CTX_sess_set_get_cb(m_ctx, on_get_session);
+  } else {
+    SSL_CTX_set_session_cache_mode(m_ctx, SSL_SESS_CACHE_OFF);
+  }
+}
+
+void TLSContext::set_client_session_cache(bool enabled) {
+  if (enabled) {
+    SSL_CTX_set_session_cache_mode(m_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(m_ctx, on_new_session);
+  } else {
+    SSL_CTX_set_session_cache_mode(m_ctx, SSL_SESS_CACHE_OFF);
+  }
+}
+
+void TLSContext::set_identity(const Identity &identity) {
+  if (
+    SSL_CTX_use_certificate(m_ctx, identity.chain[0]) != 1 ||
+    SSL_CTX_use_PrivateKey(m_ctx, identity.key) != 1
+  ) throw_error();
+  for (size_t i = 1; i < identity.chain.size(); i++) {
+    if (SSL_CTX_add1_chain_cert(m_ctx, identity.chain[i]) != 1) throw_error();
+  }
+  m_has_identity = true;
+}
+
+//
+// Ticket keys are derived from the secret and the rotation epoch,
+// so every thread (and every instance sharing the same secret)
+// arrives at the same keys without any coordination
+//
+
+void TLSContext::update_ticket_keys() {
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+
+  auto epoch = int64_t(std::floor(now / m_config.session_ticket_rotation));
+  if (epoch == m_ticket_epoch) return;
+
+  auto derive = [this](int64_t epoch, TicketKey &key) {
+    auto hmac = [&](const char *label, unsigned char *out, size_t size) {
+      unsigned char input[32];
+      auto n = std::strlen(label);
+      std::memcpy(input, label, n);
+      for (int i = 0; i < 8; i++) input[n + i] = epoch >> ((7 - i) * 8);
+      unsigned char md[EVP_MAX_MD_SIZE];
+      unsigned int md_len = 0;
+      HMAC(
+        EVP_sha256(),
+        m_config.session_ticket_secret.c_str(),
+        m_config.session_ticket_secret.length(),
+        input, n + 8, md, &md_len
+      );
+      std::memcpy(out, md, size);
+    };
+    hmac("pipy tls name", key.name, sizeof(key.name));
+    hmac("pipy tls hmac", key.hmac_key, sizeof(key.hmac_key));
+    hmac("pipy tls aes", key.aes_key, sizeof(key.aes_key));
+  };
+
+  if (epoch == m_ticket_epoch + 1) {
+    m_ticket_keys[1] = m_ticket_keys[0];
+  } else {
+    derive(epoch - 1, m_ticket_keys[1]);
+  }
+
+  derive(epoch, m_ticket_keys[0]);
+  m_ticket_epoch = epoch;
 }
 
 auto TLSContext::on_verify(int preverify_ok, X509_STORE_CTX *ctx) -> int {
@@ -226,9 +747,8 @@ auto TLSContext::on_select_alpn(
   for (size_t i = 0; i < n; i++) {
     auto str = (const char *)names[i] + 1;
     auto len = *names[i];
-    auto s = pjs::Str::make(str, len);
-    name_array->set(i, s);
-    if (static_cast<TLSContext*>(arg)->m_server_alpn.count(s)) {
+    name_array->set(i, pjs::Str::make(str, len));
+    if (static_cast<TLSContext*>(arg)->m_config.server_alpn.count(std::string(str, len))) {
       *out = (const unsigned char *)str;
       *outlen = len;
       return SSL_TLSEXT_ERR_OK;
@@ -244,6 +764,83 @@ auto TLSContext::on_select_alpn(
   }
 }
 
+auto TLSContext::on_ticket_key(
+  SSL *ssl,
+  unsigned char *key_name,
+  unsigned char *iv,
+  EVP_CIPHER_CTX *cipher_ctx,
+  EVP_MAC_CTX *mac_ctx,
+  int enc
+) -> int {
+  auto *thiz = static_cast<TLSContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+
+  // Contexts are shared across threads, so take a copy of the key
+  TicketKey k;
+  const TicketKey *key = nullptr;
+  int ret = 1;
+
+  {
+    std::lock_guard<std::mutex> lock(thiz->m_ticket_mutex);
+    thiz->update_ticket_keys();
+    if (enc) {
+      k = thiz->m_ticket_keys[0];
+      key = &k;
+    } else {
+      for (int i = 0; i < 2; i++) {
+        if (!std::memcmp(key_name, thiz->m_ticket_keys[i].name, sizeof(k.name))) {
+          k = thiz->m_ticket_keys[i];
+          key = &k;
+          if (i > 0) ret = 2; // accepted but renewed under the current key
+          break;
+        }
+      }
+    }
+  }
+
+  if (!key) return 0;
+
+  if (enc) {
+    if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) <= 0) return -1;
+    std::memcpy(key_name, key->name, sizeof(key->name));
+  }
+
+  OSSL_PARAM params[] = {
+    OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, (void *)key->hmac_key, sizeof(key->hmac_key)),
+    OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA256", 0),
+    OSSL_PARAM_construct_end(),
+  };
+
+  if (!EVP_MAC_CTX_set_params(mac_ctx, params)) return -1;
+
+  if (enc) {
+    if (!EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key->aes_key, iv)) return -1;
+  } else {
+    if (!EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key->aes_key, iv)) return -1;
+  }
+
+  return ret;
+}
+
+auto TLSContext::on_new_session(SSL *ssl, SSL_SESSION *sess) -> int {
+  if (SSL_is_server(ssl)) {
+    // Stateless TLSv1.3 tickets carry everything in the ticket itself
+    if (SSL_version(ssl) == TLS1_3_VERSION && !(SSL_get_options(ssl) & SSL_OP_NO_TICKET)) return 0;
+    unsigned int len = 0;
+    auto id = SSL_SESSION_get_id(sess, &len);
+    s_server_sessions.put(session_id_key(id, len), sess);
+  } else if (auto session = TLSSession::get(ssl)) {
+    if (!session->m_session_key.empty() && SSL_SESSION_is_resumable(sess)) {
+      s_client_sessions.put(session->m_session_key, sess);
+    }
+  }
+  return 0;
+}
+
+auto TLSContext::on_get_session(SSL *ssl, const unsigned char *id, int len, int *copy) -> SSL_SESSION* {
+  *copy = 0;
+  return s_server_sessions.get(session_id_key(id, len));
+}
+
 //
 // TLSSession
 //
@@ -263,6 +860,7 @@ auto TLSContext::on_select_alpn(
 //
 
 int TLSSession::s_user_data_index = 0;
+thread_local pjs::Ref<stats::Counter> TLSSession::s_metric_handshakes;
 
 void TLSSession::init() {
   SSL_load_error_strings();
@@ -276,8 +874,22 @@ auto TLSSession::get(SSL *ssl) -> TLSSession* {
   return reinterpret_cast<TLSSession*>(ptr);
 }
 
+void TLSSession::init_metrics() {
+  if (!s_metric_handshakes) {
+    pjs::Ref<pjs::Array> label_names = pjs::Array::make();
+    label_names->length(2);
+    label_names->set(0, "side");
+    label_names->set(1, "type");
+
+    s_metric_handshakes = stats::Counter::make(
+      pjs::Str::make("pipy_tls_handshake_count"),
+      label_names
+    );
+  }
+}
+
 TLSSession::TLSSession(
-  TLSContext *ctx,
+  const std::shared_ptr<TLSContext> &ctx,
   Filter *filter,
   bool is_server,
 #if PIPY_USE_NTLS
@@ -290,6 +902,7 @@ TLSSession::TLSSession(
   pjs::Function *on_state
 )
   : m_filter(filter)
+  , m_context(ctx)
   , m_certificate(certificate)
   , m_alpn(alpn)
   , m_handshake(handshake)
@@ -300,9 +913,16 @@ TLSSession::TLSSession(
   , m_is_ntls(is_ntls)
 #endif
 {
+  init_metrics();
+
+  m_ktls = ctx->ktls();
   m_ssl = SSL_new(ctx->ctx());
   SSL_set_ex_data(m_ssl, s_user_data_index, this);
 
+  if (!is_server && ctx->client_session_cache()) {
+    m_session_key = ctx->session_id_context();
+  }
+
   m_rbio = BIO_new(BIO_s_mem());
   m_wbio = BIO_new(BIO_s_mem());
 
@@ -327,6 +947,20 @@ TLSSession::~TLSSession() {
 
 void TLSSession::start_handshake(const char *name) {
   if (name) SSL_set_tlsext_host_name(m_ssl, name);
+
+  // Client sessions are only reused for the same server name
+  if (!m_session_key.empty()) {
+    if (name && *name) {
+      m_session_key += name;
+      if (auto sess = s_client_sessions.get(m_session_key)) {
+        SSL_set_session(m_ssl, sess);
+        SSL_SESSION_free(sess);
+      }
+    } else {
+      m_session_key.clear();
+    }
+  }
+
   handshake_step();
 }
 
@@ -460,6 +1094,7 @@ void TLSSession::set_error() {
 
 void TLSSession::use_certificate(pjs::Str *sni) {
   pjs::Value certificate(m_certificate);
+  if (!certificate.is_function() && m_context->has_identity()) return;
   if (certificate.is_function()) {
     Context &ctx = *m_pipeline->context();
     pjs::Value arg;
@@ -475,17 +1110,17 @@ void TLSSession::use_certificate(pjs::Str *sni) {
     return;
   }
 
-  pjs::Value cert, key;
-  certificate.o()->get("cert", cert);
-  certificate.o()->get("key", key);
-
-  if (!key.is<crypto::PrivateKey>()) {
-    m_filter->error("certificate.key requires a PrivateKey object");
-    return;
-  }
-
 #if PIPY_USE_NTLS
   if (m_is_ntls) {
+    pjs::Value cert, key;
+    certificate.o()->get("cert", cert);
+    certificate.o()->get("key", key);
+
+    if (!key.is<crypto::PrivateKey>()) {
+      m_filter->error("certificate.key requires a PrivateKey object");
+      return;
+    }
+
     pjs::Value cert_enc, cert_sign, key_enc, key_sign;
     certificate.o()->get("certSign", cert_sign);
     certificate.o()->get("certEnc", cert_enc);
@@ -527,25 +1162,42 @@ void TLSSession::use_certificate(pjs::Str *sni) {
     if (!cert_enc.is_nullish()) {
       if (SSL_use_enc_certificate(m_ssl,cert_enc.as<crypto::Certificate>()->x509()) == 0) throw_error();
     }
+
+    SSL_use_PrivateKey(m_ssl, key.as<crypto::PrivateKey>()->pkey());
+
+    if (cert.is<crypto::Certificate>()) {
+      SSL_use_certificate(m_ssl, cert.as<crypto::Certificate>()->x509());
+    } else if (cert.is<crypto::CertificateChain>()) {
+      auto chain = cert.as<crypto::CertificateChain>();
+      if (chain->size() < 1) {
+        m_filter->error("empty certificate chain");
+      } else {
+        SSL_use_certificate(m_ssl, chain->x509(0));
+        for (int i = 1; i < chain->size(); i++) {
+          SSL_add1_chain_cert(m_ssl, chain->x509(i));
+        }
+      }
+    } else {
+      m_filter->error("certificate.cert requires a Certificate or a CertificateChain object");
+    }
+    return;
   }
 #endif
 
-  SSL_use_PrivateKey(m_ssl, key.as<crypto::PrivateKey>()->pkey());
+  TLSContext::Identity identity;
+  if (auto err = identity.load(certificate.o())) {
+    m_filter->error(err);
+    return;
+  }
 
-  if (cert.is<crypto::Certificate>()) {
-    SSL_use_certificate(m_ssl, cert.as<crypto::Certificate>()->x509());
-  } else if (cert.is<crypto::CertificateChain>()) {
-    auto chain = cert.as<crypto::CertificateChain>();
-    if (chain->size() < 1) {
-      m_filter->error("empty certificate chain");
-    } else {
-      SSL_use_certificate(m_ssl, chain->x509(0));
-      for (int i = 1; i < chain->size(); i++) {
-        SSL_add1_chain_cert(m_ssl, chain->x509(i));
-      }
+  try {
+    auto ctx = m_context->with_identity(identity);
+    if (ctx != m_identity_context) {
+      SSL_set_SSL_CTX(m_ssl, ctx->ctx());
+      m_identity_context = ctx;
     }
-  } else {
-    m_filter->error("certificate.cert requires a Certificate or a CertificateChain object");
+  } catch (std::runtime_error &err) {
+    m_filter->error("%s", err.what());
   }
 }
 
@@ -557,6 +1209,7 @@ bool TLSSession::handshake_step() {
     if (ret == 1) {
       handshake_done();
       pump_send();
+      if (m_ktls) start_ktls();
       pump_write();
       return true;
     }
@@ -583,6 +1236,12 @@ bool TLSSession::handshake_step() {
 }
 
 void TLSSession::handshake_done() {
+  pjs::Str *labels[2];
+  labels[0] = m_is_server ? STR_server : STR_client;
+  labels[1] = SSL_session_reused(m_ssl) ? STR_resumed : STR_full;
+  s_metric_handshakes->with_labels(labels, 2)->increase();
+  s_metric_handshakes->increase();
+
   if (m_handshake) {
     Context &ctx = *m_pipeline->context();
     auto info = HandshakeInfo::make();
@@ -601,6 +1260,156 @@ void TLSSession::handshake_done() {
   }
 }
 
+//
+// Kernel TLS
+//
+// After the handshake, the keys for the sending direction can be
+// handed over to the kernel if the filter sits right on a TCP
+// socket. From then on, data goes out to the socket in plaintext
+// and gets encrypted by the kernel. Receiving still goes through
+// OpenSSL, as do ciphers the kernel doesn't support.
+//
+
+#ifdef __linux__
+
+template<class T>
+static auto fill_ktls_gcm(
+  T &info, int version, int cipher_type,
+  const unsigned char *key, const unsigned char *salt,
+  const unsigned char *iv, const unsigned char *seq
+) -> size_t {
+  info.info.version = version;
+  info.info.cipher_type = cipher_type;
+  std::memcpy(info.key, key, sizeof(info.key));
+  std::memcpy(info.salt, salt, sizeof(info.salt));
+  std::memcpy(info.iv, iv, sizeof(info.iv));
+  std::memcpy(info.rec_seq, seq, sizeof(info.rec_seq));
+  return sizeof(info);
+}
+
+static bool tls1_prf(
+  const EVP_MD *md, const unsigned char *secret, size_t secret_len,
+  const char *label, const unsigned char *seed1, const unsigned char *seed2,
+  size_t seed_len, unsigned char *out, size_t len
+) {
+  auto kdf = EVP_KDF_fetch(nullptr, "TLS1-PRF", nullptr);
+  if (!kdf) return false;
+  auto ctx = EVP_KDF_CTX_new(kdf);
+  EVP_KDF_free(kdf);
+  if (!ctx) return false;
+  OSSL_PARAM params[] = {
+    OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, (char *)EVP_MD_get0_name(md), 0),
+    OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SECRET, (void *)secret, secret_len),
+    OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SEED, (void *)label, std::strlen(label)),
+    OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SEED, (void *)seed1, seed_len),
+    OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SEED, (void *)seed2, seed_len),
+    OSSL_PARAM_construct_end(),
+  };
+  auto ok = EVP_KDF_derive(ctx, out, len, params) > 0;
+  EVP_KDF_CTX_free(ctx);
+  return ok;
+}
+
+#endif // __linux__
+
+void TLSSession::start_ktls() {
+#ifdef __linux__
+
+  // TLSv1.3 is left to OpenSSL since it may write post-handshake records
+  // such as KeyUpdate at any time, which the kernel can't take over
+  if (SSL_version(m_ssl) != TLS1_2_VERSION) return;
+
+  auto socket = ktls_socket();
+  if (!socket || !socket->ktls_attach()) return;
+
+  auto cipher = SSL_get_current_cipher(m_ssl);
+  auto md = SSL_CIPHER_get_handshake_digest(cipher);
+  if (!md) return;
+
+  size_t key_len = 0, iv_len = 0;
+  switch (SSL_CIPHER_get_cipher_nid(cipher)) {
+    case NID_aes_128_gcm: key_len = 16; iv_len = 4; break;
+    case NID_aes_256_gcm: key_len = 32; iv_len = 4; break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case NID_chacha20_poly1305: key_len = 32; iv_len = 12; break;
+#endif
+    default: return;
+  }
+
+  unsigned char key[32], iv[12], seq[8] = { 0 };
+  unsigned char master[SSL_MAX_MASTER_KEY_LENGTH];
+  unsigned char client_random[SSL3_RANDOM_SIZE];
+  unsigned char server_random[SSL3_RANDOM_SIZE];
+  unsigned char block[2 * (32 + 12)];
+  auto master_len = SSL_SESSION_get_master_key(SSL_get_session(m_ssl), master, sizeof(master));
+  SSL_get_client_random(m_ssl, client_random, sizeof(client_random));
+  SSL_get_server_random(m_ssl, server_random, sizeof(server_random));
+  if (!tls1_prf(
+    md, master, master_len, "key expansion",
+    server_random, client_random, SSL3_RANDOM_SIZE,
+    block, 2 * (key_len + iv_len)
+  )) return;
+  std::memcpy(key, block + (m_is_server ? key_len : 0), key_len);
+  std::memcpy(iv, block + 2 * key_len + (m_is_server ? iv_len : 0), iv_len);
+  OPENSSL_cleanse(master, sizeof(master));
+  OPENSSL_cleanse(block, sizeof(block));
+
+  // Our own Finished was the first record under these keys
+  seq[7] = 1;
+
+  SocketTCP::KTLSCryptoInfo info;
+  std::memset(&info, 0, sizeof(info));
+
+  size_t info_size = 0;
+  auto tls_version = TLS_1_2_VERSION;
+  auto explicit_iv = seq;
+
+  switch (SSL_CIPHER_get_cipher_nid(cipher)) {
+    case NID_aes_128_gcm:
+      info_size = fill_ktls_gcm(info.aes_gcm_128, tls_version, TLS_CIPHER_AES_GCM_128, key, iv, explicit_iv, seq);
+      break;
+    case NID_aes_256_gcm:
+      info_size = fill_ktls_gcm(info.aes_gcm_256, tls_version, TLS_CIPHER_AES_GCM_256, key, iv, explicit_iv, seq);
+      break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case NID_chacha20_poly1305:
+      info.chacha20_poly1305.info.version = tls_version;
+      info.chacha20_poly1305.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+      std::memcpy(info.chacha20_poly1305.key, key, key_len);
+      std::memcpy(info.chacha20_poly1305.iv, iv, iv_len);
+      std::memcpy(info.chacha20_poly1305.rec_seq, seq, sizeof(seq));
+      info_size = sizeof(info.chacha20_poly1305);
+      break;
+#endif
+  }
+
+  OPENSSL_cleanse(key, sizeof(key));
+  m_ktls_tx = socket->ktls_send(info, info_size);
+  OPENSSL_cleanse(&info, sizeof(info));
+#endif // __linux__
+}
+
+//
+// The socket is only reachable when nothing sits between us and it:
+// acceptTLS being the last filter in the pipeline of an inbound TCP
+// connection, or connectTLS having a single connect() sub-pipeline
+//
+
+auto TLSSession::ktls_socket() -> SocketTCP* {
+  if (m_is_server) {
+    auto p = m_filter->pipeline();
+    auto inbound = m_filter->context()->inbound();
+    if (p && inbound && inbound->pipeline() == p && !m_filter->next()) {
+      return inbound->get_socket_tcp();
+    }
+  } else if (m_pipeline->layout()->filter_count() == 1) {
+    if (auto connect = dynamic_cast<Connect*>(m_pipeline->head())) {
+      return dynamic_cast<OutboundTCP*>(connect->outbound());
+    }
+  }
+  return nullptr;
+}
+
 auto TLSSession::pump_send() -> int {
   int size = 0;
   for (;;) {
@@ -610,6 +1419,13 @@ auto TLSSession::pump_send() -> int {
     auto ptr = std::get<0>(*chunk);
     auto len = std::get<1>(*chunk);
     if (BIO_read_ex(m_wbio, ptr, len, &n)) {
+      if (m_ktls_tx) {
+        // Only alerts can come up after a TLSv1.2 handshake with renegotiation
+        // off, under keys the kernel doesn't share. A fatal one fails the next
+        // read anyway, so they are left out rather than corrupting the stream.
+        Log::debug(Log::SOCKET, "[tls] kTLS: dropped %d bytes of outgoing alert after offload", int(n));
+        continue;
+      }
       data.pop(data.size() - n);
       if (m_is_server) {
         output(Data::make(data));
@@ -672,6 +1488,16 @@ void TLSSession::pump_read() {
 }
 
 void TLSSession::pump_write() {
+  if (m_ktls_tx) {
+    if (!m_buffer_write.empty()) {
+      if (m_is_server) {
+        output(Data::make(std::move(m_buffer_write)));
+      } else {
+        forward(Data::make(std::move(m_buffer_write)));
+      }
+    }
+    return;
+  }
   while (!m_buffer_write.empty()) {
     int size = 0;
     for (const auto c : m_buffer_write.chunks()) {
@@ -714,6 +1540,25 @@ void TLSSession::close() {
   set_state(State::closed);
 }
 
+//
+// A static certificate goes right into the shared context, while
+// those from a callback get contexts of their own on demand
+//
+
+static auto get_context(
+  const TLSContext::Config &config,
+  const Options &options
+) -> std::shared_ptr<TLSContext> {
+  pjs::Value certificate(options.certificate);
+#if PIPY_USE_NTLS
+  if (options.ntls) return TLSContext::get(config);
+#endif
+  if (!options.certificate || certificate.is_function()) return TLSContext::get(config);
+  TLSContext::Identity identity;
+  if (auto err = identity.load(options.certificate)) throw std::runtime_error(err);
+  return TLSContext::get(config, &identity);
+}
+
 //
 // Client::Options
 //
@@ -751,6 +1596,10 @@ Client::Options::Options(pjs::Object *options, const char *base_name)
     .get(sni)
     .get(sni_f)
     .check_nullable();
+
+  Value(options, "sessionReuse", base_name)
+    .get(session_reuse)
+    .check_nullable();
 }
 
 //
@@ -758,34 +1607,34 @@ Client::Options::Options(pjs::Object *options, const char *base_name)
 //
 
 Client::Client(const Options &options)
-  : m_tls_context(std::make_shared<TLSContext>(false, options))
-  , m_options(std::make_shared<Options>(options))
+  : m_options(std::make_shared<Options>(options))
 {
+  TLSContext::Config config;
+  config.is_server = false;
+  config.ktls = options.ktls;
 #if PIPY_USE_NTLS
-  if (!options.ntls) {
-    m_tls_context->set_protocol_versions(
-      options.minVersion,
-      options.maxVersion
-    );
-  }
-#else
-  m_tls_context->set_protocol_versions(
-    options.minVersion,
-    options.maxVersion
-  );
+  config.ntls = options.ntls;
 #endif
-
-  if (options.ciphers) {
-    m_tls_context->set_ciphers(options.ciphers->str());
+  config.min_version = options.minVersion;
+  config.max_version = options.maxVersion;
+  if (options.ciphers) config.ciphers = options.ciphers->str();
+  for (const auto &cert : options.trusted) config.trusted.push_back(cert->x509());
+  config.client_alpn = options.alpn_list;
+
+  // Sessions can't be shared safely when the client certificate is chosen dynamically,
+  // and a resumed session would skip the onVerify callback altogether
+  if (
+    options.session_reuse &&
+    !options.on_verify_f &&
+    !pjs::Value(options.certificate).is_function()
+  ) {
+    std::string alpn;
+    for (const auto &s : options.alpn_list) alpn += s + '\n';
+    config.session_id_context = config_digest(options, alpn);
+    config.client_session_cache = true;
   }
 
-  for (const auto &cert : options.trusted) {
-    m_tls_context->add_certificate(cert);
-  }
-
-  if (options.alpn_list.size() > 0) {
-    m_tls_context->set_client_alpn(options.alpn_list);
-  }
+  m_tls_context = get_context(config, options);
 }
 
 Client::Client(const Client &r)
@@ -822,7 +1671,7 @@ void Client::process(Event *evt) {
 
   if (!m_session) {
     m_session = TLSSession::make(
-      m_tls_context.get(),
+      m_tls_context,
       this,
       false,
 #if PIPY_USE_NTLS
@@ -881,6 +1730,23 @@ Server::Options::Options(pjs::Object *options)
       }
     );
   }
+
+  Value(options, "sessionTicket")
+    .get(session_ticket)
+    .check_nullable();
+
+  Value(options, "sessionTicketKey")
+    .get(session_ticket_key)
+    .get(session_ticket_key_s)
+    .check_nullable();
+
+  Value(options, "sessionTicketRotation")
+    .get_seconds(session_ticket_rotation)
+    .check_nullable();
+
+  Value(options, "sessionCache")
+    .get(session_cache)
+    .check_nullable();
 }
 
 //
@@ -888,38 +1754,36 @@ Server::Options::Options(pjs::Object *options)
 //
 
 Server::Server(const Options &options)
-  : m_tls_context(std::make_shared<TLSContext>(true, options))
-  , m_options(std::make_shared<Options>(options))
+  : m_options(std::make_shared<Options>(options))
 {
+  TLSContext::Config config;
+  config.is_server = true;
+  config.ktls = options.ktls;
 #if PIPY_USE_NTLS
-  if (!options.ntls) {
-    m_tls_context->set_protocol_versions(
-      options.minVersion,
-      options.maxVersion
-    );
-  }
-#else
-  m_tls_context->set_protocol_versions(
-    options.minVersion,
-    options.maxVersion
-  );
+  config.ntls = options.ntls;
 #endif
-
-  if (options.ciphers) {
-    m_tls_context->set_ciphers(options.ciphers->str());
-  }
-
+  config.min_version = options.minVersion;
+  config.max_version = options.maxVersion;
+  if (options.ciphers) config.ciphers = options.ciphers->str();
   if (options.dhparam_s) {
-    m_tls_context->set_dhparam(options.dhparam_s->str());
+    config.dhparam = options.dhparam_s->str();
   } else if (options.dhparam) {
-    m_tls_context->set_dhparam(options.dhparam->to_string());
+    config.dhparam = options.dhparam->to_string();
   }
-
-  for (const auto &cert : options.trusted) {
-    m_tls_context->add_certificate(cert);
+  for (const auto &cert : options.trusted) config.trusted.push_back(cert->x509());
+  for (const auto &s : options.alpn_set) config.server_alpn.insert(s->str());
+  config.alpn_select = options.alpn;
+  config.session_id_context = config_digest(options, options.on_verify_f ? "verify" : "");
+  config.session_ticket = options.session_ticket;
+  if (options.session_ticket_key_s) {
+    config.session_ticket_secret = options.session_ticket_key_s->str();
+  } else if (options.session_ticket_key) {
+    config.session_ticket_secret = options.session_ticket_key->to_string();
   }
+  config.session_ticket_rotation = options.session_ticket_rotation;
+  config.server_session_cache = options.session_cache;
 
-  m_tls_context->set_server_alpn(options.alpn_set);
+  m_tls_context = get_context(config, options);
 }
 
 Server::Server(const Server &r)
@@ -949,7 +1813,7 @@ void Server::reset() {
 void Server::process(Event *evt) {
   if (!m_session) {
     m_session = TLSSession::make(
-      m_tls_context.get(),
+      m_tls_context,
       this,
       true,
 #if PIPY_USE_NTLS
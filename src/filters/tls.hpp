@@ -29,17 +29,23 @@
 #include "filter.hpp"
 #include "data.hpp"
 #include "api/crypto.hpp"
+#include "api/stats.hpp"
 #include "options.hpp"
 
 #include <openssl/bio.h>
 #include <openssl/ssl.h>
 
+#include <map>
 #include <vector>
 #include <string>
 #include <set>
+#include <memory>
+#include <mutex>
 
 namespace pipy {
 
+class SocketTCP;
+
 namespace tls {
 
 class TLSFilter;
@@ -69,6 +75,7 @@ struct Options : public pipy::Options {
   pjs::Ref<pjs::Function> on_verify_f;
   pjs::Ref<pjs::Function> on_state_f;
   bool alpn = false;
+  bool ktls = false;
 #if PIPY_USE_NTLS
   bool ntls = false;
 #endif
@@ -80,25 +87,99 @@ struct Options : public pipy::Options {
 //
 // TLSContext
 //
+// Contexts are shared by every filter and worker thread configured
+// the same way. Use TLSContext::get() to obtain one.
+//
 
 class TLSContext {
 public:
-  TLSContext(bool is_server, const Options &options);
+
+  //
+  // TLSContext::Config
+  //
+
+  struct Config {
+    bool is_server = false;
+    bool ktls = false;
+#if PIPY_USE_NTLS
+    bool ntls = false;
+#endif
+    ProtocolVersion min_version = ProtocolVersion::TLS1_2;
+    ProtocolVersion max_version = ProtocolVersion::TLS1_3;
+    std::string ciphers;
+    std::string dhparam;
+    std::vector<X509*> trusted; // only borrowed while building
+    std::vector<std::string> client_alpn;
+    std::set<std::string> server_alpn;
+    bool alpn_select = false;
+    std::string session_id_context;
+    bool session_ticket = false;
+    std::string session_ticket_secret;
+    double session_ticket_rotation = 0;
+    size_t server_session_cache = 0;
+    bool client_session_cache = false;
+  };
+
+  //
+  // TLSContext::Identity
+  //
+
+  struct Identity {
+    EVP_PKEY* key = nullptr;
+    std::vector<X509*> chain;
+    std::string fingerprint;
+
+    auto load(pjs::Object *certificate) -> const char*;
+  };
+
+  static auto get(const Config &config, const Identity *identity = nullptr) -> std::shared_ptr<TLSContext>;
+
+  TLSContext(const Config &config, const Identity *identity, const TLSContext *base = nullptr);
   ~TLSContext();
 
   auto ctx() const -> SSL_CTX* { return m_ctx; }
-  void set_protocol_versions(ProtocolVersion min, ProtocolVersion max);
-  void set_ciphers(const std::string &ciphers);
-  void set_dhparam(const std::string &data);
-  void add_certificate(crypto::Certificate *cert);
-  void set_client_alpn(const std::vector<std::string> &protocols);
-  void set_server_alpn(const std::set<pjs::Ref<pjs::Str>> &protocols);
+  auto with_identity(const Identity &identity) -> std::shared_ptr<TLSContext>;
+  auto session_id_context() const -> const std::string& { return m_config.session_id_context; }
+  bool client_session_cache() const { return m_config.client_session_cache; }
+  bool ktls() const { return m_ktls; }
+  bool has_identity() const { return m_has_identity; }
 
 private:
+
+  //
+  // TLSContext::TicketKey
+  //
+
+  struct TicketKey {
+    unsigned char name[16];
+    unsigned char hmac_key[32];
+    unsigned char aes_key[32];
+  };
+
+  Config m_config;
+  std::string m_key;
   SSL_CTX* m_ctx;
   DH* m_dhparam = nullptr;
   X509_STORE* m_verify_store;
-  std::set<pjs::Ref<pjs::Str>> m_server_alpn;
+  std::mutex m_ticket_mutex;
+  int64_t m_ticket_epoch = -1;
+  TicketKey m_ticket_keys[2]; // current and previous epochs
+  std::mutex m_identities_mutex;
+  std::map<std::string, std::shared_ptr<TLSContext>> m_identities;
+  bool m_verify = false;
+  bool m_has_identity = false;
+  bool m_ktls = false;
+
+  void set_protocol_versions(ProtocolVersion min, ProtocolVersion max);
+  void set_ciphers(const std::string &ciphers);
+  void set_dhparam(const std::string &data);
+  void set_client_alpn(const std::vector<std::string> &protocols);
+  void set_session_id_context(const std::string &id);
+  void set_session_tickets(bool enabled, const std::string &secret, double rotation);
+  void set_server_session_cache(size_t size);
+  void set_client_session_cache(bool enabled);
+  void set_identity(const Identity &identity);
+  void update_ticket_keys();
 
   static auto on_verify(int preverify_ok, X509_STORE_CTX *ctx) -> int;
   static auto on_server_name(SSL *ssl, int*, void*) -> int;
@@ -110,6 +191,18 @@ private:
     unsigned int inlen,
     void *arg
   ) -> int;
+
+  static auto on_ticket_key(
+    SSL *ssl,
+    unsigned char *key_name,
+    unsigned char *iv,
+    EVP_CIPHER_CTX *cipher_ctx,
+    EVP_MAC_CTX *mac_ctx,
+    int enc
+  ) -> int;
+
+  static auto on_new_session(SSL *ssl, SSL_SESSION *sess) -> int;
+  static auto on_get_session(SSL *ssl, const unsigned char *id, int len, int *copy) -> SSL_SESSION*;
 };
 
 //
@@ -154,7 +247,7 @@ public:
 
 private:
   TLSSession(
-    TLSContext *ctx,
+    const std::shared_ptr<TLSContext> &ctx,
     Filter *filter,
     bool is_server,
 #if PIPY_USE_NTLS
@@ -170,6 +263,8 @@ private:
   ~TLSSession();
 
   Filter* m_filter;
+  std::shared_ptr<TLSContext> m_context;
+  std::shared_ptr<TLSContext> m_identity_context;
   SSL* m_ssl;
   BIO* m_rbio;
   BIO* m_wbio;
@@ -187,12 +282,15 @@ private:
   pjs::Ref<pjs::Str> m_protocol;
   pjs::Ref<pjs::Str> m_hostname;
   pjs::Ref<crypto::Certificate> m_peer;
+  std::string m_session_key;
   bool m_is_server;
 #if PIPY_USE_NTLS
   bool m_is_ntls;
 #endif
   bool m_closed_input = false;
   bool m_closed_output = false;
+  bool m_ktls = false;
+  bool m_ktls_tx = false;
 
   virtual void on_input(Event *evt) override;
   virtual void on_reply(Event *evt) override;
@@ -207,6 +305,8 @@ private:
   void use_certificate(pjs::Str *sni);
   bool handshake_step();
   void handshake_done();
+  void start_ktls();
+  auto ktls_socket() -> SocketTCP*;
   auto pump_send() -> int;
   auto pump_receive() -> int;
   void pump_read();
@@ -215,6 +315,10 @@ private:
 
   static int s_user_data_index;
 
+  thread_local static pjs::Ref<stats::Counter> s_metric_handshakes;
+
+  static void init_metrics();
+
   friend class pjs::ObjectTemplate<TLSSession>;
   friend class TLSContext;
 };
@@ -229,6 +333,7 @@ public:
     std::vector<std::string> alpn_list;
     pjs::Ref<pjs::Str> sni;
     pjs::Ref<pjs::Function> sni_f;
+    bool session_reuse = true;
 
     Options() {}
     Options(pjs::Object *options, const char *base_name = nullptr);
@@ -261,6 +366,11 @@ public:
     pjs::Ref<Data> dhparam;
     pjs::Ref<pjs::Function> alpn_f;
     std::set<pjs::Ref<pjs::Str>> alpn_set;
+    bool session_ticket = true;
+    pjs::Ref<pjs::Str> session_ticket_key_s;
+    pjs::Ref<Data> session_ticket_key;
+    double session_ticket_rotation = 3600;
+    size_t session_cache = 20480;
 
     Options() {}
     Options(pjs::Object *options);
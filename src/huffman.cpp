@@ -0,0 +1,419 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "huffman.hpp"
+
+#include <cctype>
+#include <vector>
+
+namespace pipy {
+namespace http2 {
+
+//
+// HPACK Huffman code table
+//
+
+static struct {
+  uint32_t code;
+  int bits;
+} s_hpack_huffman_table[] = {
+  { 0x00001ff8, 13 }, //     (  0)  |11111111|11000
+  { 0x007fffd8, 23 }, //     (  1)  |11111111|11111111|1011000
+  { 0x0fffffe2, 28 }, //     (  2)  |11111111|11111111|11111110|0010
+  { 0x0fffffe3, 28 }, //     (  3)  |11111111|11111111|11111110|0011
+  { 0x0fffffe4, 28 }, //     (  4)  |11111111|11111111|11111110|0100
+  { 0x0fffffe5, 28 }, //     (  5)  |11111111|11111111|11111110|0101
+  { 0x0fffffe6, 28 }, //     (  6)  |11111111|11111111|11111110|0110
+  { 0x0fffffe7, 28 }, //     (  7)  |11111111|11111111|11111110|0111
+  { 0x0fffffe8, 28 }, //     (  8)  |11111111|11111111|11111110|1000
+  { 0x00ffffea, 24 }, //     (  9)  |11111111|11111111|11101010
+  { 0x3ffffffc, 30 }, //     ( 10)  |11111111|11111111|11111111|111100
+  { 0x0fffffe9, 28 }, //     ( 11)  |11111111|11111111|11111110|1001
+  { 0x0fffffea, 28 }, //     ( 12)  |11111111|11111111|11111110|1010
+  { 0x3ffffffd, 30 }, //     ( 13)  |11111111|11111111|11111111|111101
+  { 0x0fffffeb, 28 }, //     ( 14)  |11111111|11111111|11111110|1011
+  { 0x0fffffec, 28 }, //     ( 15)  |11111111|11111111|11111110|1100
+  { 0x0fffffed, 28 }, //     ( 16)  |11111111|11111111|11111110|1101
+  { 0x0fffffee, 28 }, //     ( 17)  |11111111|11111111|11111110|1110
+  { 0x0fffffef, 28 }, //     ( 18)  |11111111|11111111|11111110|1111
+  { 0x0ffffff0, 28 }, //     ( 19)  |11111111|11111111|11111111|0000
+  { 0x0ffffff1, 28 }, //     ( 20)  |11111111|11111111|11111111|0001
+  { 0x0ffffff2, 28 }, //     ( 21)  |11111111|11111111|11111111|0010
+  { 0x3ffffffe, 30 }, //     ( 22)  |11111111|11111111|11111111|111110
+  { 0x0ffffff3, 28 }, //     ( 23)  |11111111|11111111|11111111|0011
+  { 0x0ffffff4, 28 }, //     ( 24)  |11111111|11111111|11111111|0100
+  { 0x0ffffff5, 28 }, //     ( 25)  |11111111|11111111|11111111|0101
+  { 0x0ffffff6, 28 }, //     ( 26)  |11111111|11111111|11111111|0110
+  { 0x0ffffff7, 28 }, //     ( 27)  |11111111|11111111|11111111|0111
+  { 0x0ffffff8, 28 }, //     ( 28)  |11111111|11111111|11111111|1000
+  { 0x0ffffff9, 28 }, //     ( 29)  |11111111|11111111|11111111|1001
+  { 0x0ffffffa, 28 }, //     ( 30)  |11111111|11111111|11111111|1010
+  { 0x0ffffffb, 28 }, //     ( 31)  |11111111|11111111|11111111|1011
+  { 0x00000014,  6 }, // ' ' ( 32)  |010100
+  { 0x000003f8, 10 }, // '!' ( 33)  |11111110|00
+  { 0x000003f9, 10 }, // '"' ( 34)  |11111110|01
+  { 0x00000ffa, 12 }, // '#' ( 35)  |11111111|1010
+  { 0x00001ff9, 13 }, // '$' ( 36)  |11111111|11001
+  { 0x00000015,  6 }, // '%' ( 37)  |010101
+  { 0x000000f8,  8 }, // '&' ( 38)  |11111000
+  { 0x000007fa, 11 }, // ''' ( 39)  |11111111|010
+  { 0x000003fa, 10 }, // '(' ( 40)  |11111110|10
+  { 0x000003fb, 10 }, // ')' ( 41)  |11111110|11
+  { 0x000000f9,  8 }, // '*' ( 42)  |11111001
+  { 0x000007fb, 11 }, // '+' ( 43)  |11111111|011
+  { 0x000000fa,  8 }, // ',' ( 44)  |11111010
+  { 0x00000016,  6 }, // '-' ( 45)  |010110
+  { 0x00000017,  6 }, // '.' ( 46)  |010111
+  { 0x00000018,  6 }, // '/' ( 47)  |011000
+  { 0x00000000,  5 }, // '0' ( 48)  |00000
+  { 0x00000001,  5 }, // '1' ( 49)  |00001
+  { 0x00000002,  5 }, // '2' ( 50)  |00010
+  { 0x00000019,  6 }, // '3' ( 51)  |011001
+  { 0x0000001a,  6 }, // '4' ( 52)  |011010
+  { 0x0000001b,  6 }, // '5' ( 53)  |011011
+  { 0x0000001c,  6 }, // '6' ( 54)  |011100
+  { 0x0000001d,  6 }, // '7' ( 55)  |011101
+  { 0x0000001e,  6 }, // '8' ( 56)  |011110
+  { 0x0000001f,  6 }, // '9' ( 57)  |011111
+  { 0x0000005c,  7 }, // ':' ( 58)  |1011100
+  { 0x000000fb,  8 }, // ';' ( 59)  |11111011
+  { 0x00007ffc, 15 }, // '<' ( 60)  |11111111|1111100
+  { 0x00000020,  6 }, // '=' ( 61)  |100000
+  { 0x00000ffb, 12 }, // '>' ( 62)  |11111111|1011
+  { 0x000003fc, 10 }, // '?' ( 63)  |11111111|00
+  { 0x00001ffa, 13 }, // '@' ( 64)  |11111111|11010
+  { 0x00000021,  6 }, // 'A' ( 65)  |100001
+  { 0x0000005d,  7 }, // 'B' ( 66)  |1011101
+  { 0x0000005e,  7 }, // 'C' ( 67)  |1011110
+  { 0x0000005f,  7 }, // 'D' ( 68)  |1011111
+  { 0x00000060,  7 }, // 'E' ( 69)  |1100000
+  { 0x00000061,  7 }, // 'F' ( 70)  |1100001
+  { 0x00000062,  7 }, // 'G' ( 71)  |1100010
+  { 0x00000063,  7 }, // 'H' ( 72)  |1100011
+  { 0x00000064,  7 }, // 'I' ( 73)  |1100100
+  { 0x00000065,  7 }, // 'J' ( 74)  |1100101
+  { 0x00000066,  7 }, // 'K' ( 75)  |1100110
+  { 0x00000067,  7 }, // 'L' ( 76)  |1100111
+  { 0x00000068,  7 }, // 'M' ( 77)  |1101000
+  { 0x00000069,  7 }, // 'N' ( 78)  |1101001
+  { 0x0000006a,  7 }, // 'O' ( 79)  |1101010
+  { 0x0000006b,  7 }, // 'P' ( 80)  |1101011
+  { 0x0000006c,  7 }, // 'Q' ( 81)  |1101100
+  { 0x0000006d,  7 }, // 'R' ( 82)  |1101101
+  { 0x0000006e,  7 }, // 'S' ( 83)  |1101110
+  { 0x0000006f,  7 }, // 'T' ( 84)  |1101111
+  { 0x00000070,  7 }, // 'U' ( 85)  |1110000
+  { 0x00000071,  7 }, // 'V' ( 86)  |1110001
+  { 0x00000072,  7 }, // 'W' ( 87)  |1110010
+  { 0x000000fc,  8 }, // 'X' ( 88)  |11111100
+  { 0x00000073,  7 }, // 'Y' ( 89)  |1110011
+  { 0x000000fd,  8 }, // 'Z' ( 90)  |11111101
+  { 0x00001ffb, 13 }, // '[' ( 91)  |11111111|11011
+  { 0x0007fff0, 19 }, // '\' ( 92)  |11111111|11111110|000
+  { 0x00001ffc, 13 }, // ']' ( 93)  |11111111|11100
+  { 0x00003ffc, 14 }, // '^' ( 94)  |11111111|111100
+  { 0x00000022,  6 }, // '_' ( 95)  |100010
+  { 0x00007ffd, 15 }, // '`' ( 96)  |11111111|1111101
+  { 0x00000003,  5 }, // 'a' ( 97)  |00011
+  { 0x00000023,  6 }, // 'b' ( 98)  |100011
+  { 0x00000004,  5 }, // 'c' ( 99)  |00100
+  { 0x00000024,  6 }, // 'd' (100)  |100100
+  { 0x00000005,  5 }, // 'e' (101)  |00101
+  { 0x00000025,  6 }, // 'f' (102)  |100101
+  { 0x00000026,  6 }, // 'g' (103)  |100110
+  { 0x00000027,  6 }, // 'h' (104)  |100111
+  { 0x00000006,  5 }, // 'i' (105)  |00110
+  { 0x00000074,  7 }, // 'j' (106)  |1110100
+  { 0x00000075,  7 }, // 'k' (107)  |1110101
+  { 0x00000028,  6 }, // 'l' (108)  |101000
+  { 0x00000029,  6 }, // 'm' (109)  |101001
+  { 0x0000002a,  6 }, // 'n' (110)  |101010
+  { 0x00000007,  5 }, // 'o' (111)  |00111
+  { 0x0000002b,  6 }, // 'p' (112)  |101011
+  { 0x00000076,  7 }, // 'q' (113)  |1110110
+  { 0x0000002c,  6 }, // 'r' (114)  |101100
+  { 0x00000008,  5 }, // 's' (115)  |01000
+  { 0x00000009,  5 }, // 't' (116)  |01001
+  { 0x0000002d,  6 }, // 'u' (117)  |101101
+  { 0x00000077,  7 }, // 'v' (118)  |1110111
+  { 0x00000078,  7 }, // 'w' (119)  |1111000
+  { 0x00000079,  7 }, // 'x' (120)  |1111001
+  { 0x0000007a,  7 }, // 'y' (121)  |1111010
+  { 0x0000007b,  7 }, // 'z' (122)  |1111011
+  { 0x00007ffe, 15 }, // '{' (123)  |11111111|1111110
+  { 0x000007fc, 11 }, // '|' (124)  |11111111|100
+  { 0x00003ffd, 14 }, // '}' (125)  |11111111|111101
+  { 0x00001ffd, 13 }, // '~' (126)  |11111111|11101
+  { 0x0ffffffc, 28 }, //     (127)  |11111111|11111111|11111111|1100
+  { 0x000fffe6, 20 }, //     (128)  |11111111|11111110|0110
+  { 0x003fffd2, 22 }, //     (129)  |11111111|11111111|010010
+  { 0x000fffe7, 20 }, //     (130)  |11111111|11111110|0111
+  { 0x000fffe8, 20 }, //     (131)  |11111111|11111110|1000
+  { 0x003fffd3, 22 }, //     (132)  |11111111|11111111|010011
+  { 0x003fffd4, 22 }, //     (133)  |11111111|11111111|010100
+  { 0x003fffd5, 22 }, //     (134)  |11111111|11111111|010101
+  { 0x007fffd9, 23 }, //     (135)  |11111111|11111111|1011001
+  { 0x003fffd6, 22 }, //     (136)  |11111111|11111111|010110
+  { 0x007fffda, 23 }, //     (137)  |11111111|11111111|1011010
+  { 0x007fffdb, 23 }, //     (138)  |11111111|11111111|1011011
+  { 0x007fffdc, 23 }, //     (139)  |11111111|11111111|1011100
+  { 0x007fffdd, 23 }, //     (140)  |11111111|11111111|1011101
+  { 0x007fffde, 23 }, //     (141)  |11111111|11111111|1011110
+  { 0x00ffffeb, 24 }, //     (142)  |11111111|11111111|11101011
+  { 0x007fffdf, 23 }, //     (143)  |11111111|11111111|1011111
+  { 0x00ffffec, 24 }, //     (144)  |11111111|11111111|11101100
+  { 0x00ffffed, 24 }, //     (145)  |11111111|11111111|11101101
+  { 0x003fffd7, 22 }, //     (146)  |11111111|11111111|010111
+  { 0x007fffe0, 23 }, //     (147)  |11111111|11111111|1100000
+  { 0x00ffffee, 24 }, //     (148)  |11111111|11111111|11101110
+  { 0x007fffe1, 23 }, //     (149)  |11111111|11111111|1100001
+  { 0x007fffe2, 23 }, //     (150)  |11111111|11111111|1100010
+  { 0x007fffe3, 23 }, //     (151)  |11111111|11111111|1100011
+  { 0x007fffe4, 23 }, //     (152)  |11111111|11111111|1100100
+  { 0x001fffdc, 21 }, //     (153)  |11111111|11111110|11100
+  { 0x003fffd8, 22 }, //     (154)  |11111111|11111111|011000
+  { 0x007fffe5, 23 }, //     (155)  |11111111|11111111|1100101
+  { 0x003fffd9, 22 }, //     (156)  |11111111|11111111|011001
+  { 0x007fffe6, 23 }, //     (157)  |11111111|11111111|1100110
+  { 0x007fffe7, 23 }, //     (158)  |11111111|11111111|1100111
+  { 0x00ffffef, 24 }, //     (159)  |11111111|11111111|11101111
+  { 0x003fffda, 22 }, //     (160)  |11111111|11111111|011010
+  { 0x001fffdd, 21 }, //     (161)  |11111111|11111110|11101
+  { 0x000fffe9, 20 }, //     (162)  |11111111|11111110|1001
+  { 0x003fffdb, 22 }, //     (163)  |11111111|11111111|011011
+  { 0x003fffdc, 22 }, //     (164)  |11111111|11111111|011100
+  { 0x007fffe8, 23 }, //     (165)  |11111111|11111111|1101000
+  { 0x007fffe9, 23 }, //     (166)  |11111111|11111111|1101001
+  { 0x001fffde, 21 }, //     (167)  |11111111|11111110|11110
+  { 0x007fffea, 23 }, //     (168)  |11111111|11111111|1101010
+  { 0x003fffdd, 22 }, //     (169)  |11111111|11111111|011101
+  { 0x003fffde, 22 }, //     (170)  |11111111|11111111|011110
+  { 0x00fffff0, 24 }, //     (171)  |11111111|11111111|11110000
+  { 0x001fffdf, 21 }, //     (172)  |11111111|11111110|11111
+  { 0x003fffdf, 22 }, //     (173)  |11111111|11111111|011111
+  { 0x007fffeb, 23 }, //     (174)  |11111111|11111111|1101011
+  { 0x007fffec, 23 }, //     (175)  |11111111|11111111|1101100
+  { 0x001fffe0, 21 }, //     (176)  |11111111|11111111|00000
+  { 0x001fffe1, 21 }, //     (177)  |11111111|11111111|00001
+  { 0x003fffe0, 22 }, //     (178)  |11111111|11111111|100000
+  { 0x001fffe2, 21 }, //     (179)  |11111111|11111111|00010
+  { 0x007fffed, 23 }, //     (180)  |11111111|11111111|1101101
+  { 0x003fffe1, 22 }, //     (181)  |11111111|11111111|100001
+  { 0x007fffee, 23 }, //     (182)  |11111111|11111111|1101110
+  { 0x007fffef, 23 }, //     (183)  |11111111|11111111|1101111
+  { 0x000fffea, 20 }, //     (184)  |11111111|11111110|1010
+  { 0x003fffe2, 22 }, //     (185)  |11111111|11111111|100010
+  { 0x003fffe3, 22 }, //     (186)  |11111111|11111111|100011
+  { 0x003fffe4, 22 }, //     (187)  |11111111|11111111|100100
+  { 0x007ffff0, 23 }, //     (188)  |11111111|11111111|1110000
+  { 0x003fffe5, 22 }, //     (189)  |11111111|11111111|100101
+  { 0x003fffe6, 22 }, //     (190)  |11111111|11111111|100110
+  { 0x007ffff1, 23 }, //     (191)  |11111111|11111111|1110001
+  { 0x03ffffe0, 26 }, //     (192)  |11111111|11111111|11111000|00
+  { 0x03ffffe1, 26 }, //     (193)  |11111111|11111111|11111000|01
+  { 0x000fffeb, 20 }, //     (194)  |11111111|11111110|1011
+  { 0x0007fff1, 19 }, //     (195)  |11111111|11111110|001
+  { 0x003fffe7, 22 }, //     (196)  |11111111|11111111|100111
+  { 0x007ffff2, 23 }, //     (197)  |11111111|11111111|1110010
+  { 0x003fffe8, 22 }, //     (198)  |11111111|11111111|101000
+  { 0x01ffffec, 25 }, //     (199)  |11111111|11111111|11110110|0
+  { 0x03ffffe2, 26 }, //     (200)  |11111111|11111111|11111000|10
+  { 0x03ffffe3, 26 }, //     (201)  |11111111|11111111|11111000|11
+  { 0x03ffffe4, 26 }, //     (202)  |11111111|11111111|11111001|00
+  { 0x07ffffde, 27 }, //     (203)  |11111111|11111111|11111011|110
+  { 0x07ffffdf, 27 }, //     (204)  |11111111|11111111|11111011|111
+  { 0x03ffffe5, 26 }, //     (205)  |11111111|11111111|11111001|01
+  { 0x00fffff1, 24 }, //     (206)  |11111111|11111111|11110001
+  { 0x01ffffed, 25 }, //     (207)  |11111111|11111111|11110110|1
+  { 0x0007fff2, 19 }, //     (208)  |11111111|11111110|010
+  { 0x001fffe3, 21 }, //     (209)  |11111111|11111111|00011
+  { 0x03ffffe6, 26 }, //     (210)  |11111111|11111111|11111001|10
+  { 0x07ffffe0, 27 }, //     (211)  |11111111|11111111|11111100|000
+  { 0x07ffffe1, 27 }, //     (212)  |11111111|11111111|11111100|001
+  { 0x03ffffe7, 26 }, //     (213)  |11111111|11111111|11111001|11
+  { 0x07ffffe2, 27 }, //     (214)  |11111111|11111111|11111100|010
+  { 0x00fffff2, 24 }, //     (215)  |11111111|11111111|11110010
+  { 0x001fffe4, 21 }, //     (216)  |11111111|11111111|00100
+  { 0x001fffe5, 21 }, //     (217)  |11111111|11111111|00101
+  { 0x03ffffe8, 26 }, //     (218)  |11111111|11111111|11111010|00
+  { 0x03ffffe9, 26 }, //     (219)  |11111111|11111111|11111010|01
+  { 0x0ffffffd, 28 }, //     (220)  |11111111|11111111|11111111|1101
+  { 0x07ffffe3, 27 }, //     (221)  |11111111|11111111|11111100|011
+  { 0x07ffffe4, 27 }, //     (222)  |11111111|11111111|11111100|100
+  { 0x07ffffe5, 27 }, //     (223)  |11111111|11111111|11111100|101
+  { 0x000fffec, 20 }, //     (224)  |11111111|11111110|1100
+  { 0x00fffff3, 24 }, //     (225)  |11111111|11111111|11110011
+  { 0x000fffed, 20 }, //     (226)  |11111111|11111110|1101
+  { 0x001fffe6, 21 }, //     (227)  |11111111|11111111|00110
+  { 0x003fffe9, 22 }, //     (228)  |11111111|11111111|101001
+  { 0x001fffe7, 21 }, //     (229)  |11111111|11111111|00111
+  { 0x001fffe8, 21 }, //     (230)  |11111111|11111111|01000
+  { 0x007ffff3, 23 }, //     (231)  |11111111|11111111|1110011
+  { 0x003fffea, 22 }, //     (232)  |11111111|11111111|101010
+  { 0x003fffeb, 22 }, //     (233)  |11111111|11111111|101011
+  { 0x01ffffee, 25 }, //     (234)  |11111111|11111111|11110111|0
+  { 0x01ffffef, 25 }, //     (235)  |11111111|11111111|11110111|1
+  { 0x00fffff4, 24 }, //     (236)  |11111111|11111111|11110100
+  { 0x00fffff5, 24 }, //     (237)  |11111111|11111111|11110101
+  { 0x03ffffea, 26 }, //     (238)  |11111111|11111111|11111010|10
+  { 0x007ffff4, 23 }, //     (239)  |11111111|11111111|1110100
+  { 0x03ffffeb, 26 }, //     (240)  |11111111|11111111|11111010|11
+  { 0x07ffffe6, 27 }, //     (241)  |11111111|11111111|11111100|110
+  { 0x03ffffec, 26 }, //     (242)  |11111111|11111111|11111011|00
+  { 0x03ffffed, 26 }, //     (243)  |11111111|11111111|11111011|01
+  { 0x07ffffe7, 27 }, //     (244)  |11111111|11111111|11111100|111
+  { 0x07ffffe8, 27 }, //     (245)  |11111111|11111111|11111101|000
+  { 0x07ffffe9, 27 }, //     (246)  |11111111|11111111|11111101|001
+  { 0x07ffffea, 27 }, //     (247)  |11111111|11111111|11111101|010
+  { 0x07ffffeb, 27 }, //     (248)  |11111111|11111111|11111101|011
+  { 0x0ffffffe, 28 }, //     (249)  |11111111|11111111|11111111|1110
+  { 0x07ffffec, 27 }, //     (250)  |11111111|11111111|11111101|100
+  { 0x07ffffed, 27 }, //     (251)  |11111111|11111111|11111101|101
+  { 0x07ffffee, 27 }, //     (252)  |11111111|11111111|11111101|110
+  { 0x07ffffef, 27 }, //     (253)  |11111111|11111111|11111101|111
+  { 0x07fffff0, 27 }, //     (254)  |11111111|11111111|11111110|000
+  { 0x03ffffee, 26 }, //     (255)  |11111111|11111111|11111011|10
+  { 0x3fffffff, 30 }, // EOS (256)  |11111111|11111111|11111111|111111
+};
+
+//
+// HuffmanDecoder
+//
+
+const HuffmanDecoder::Table HuffmanDecoder::s_table;
+
+HuffmanDecoder::Table::Table() {
+  struct Node {
+    int child[2];
+    int symbol;
+  };
+
+  // Build the code tree
+  std::vector<Node> tree(1, Node{ { 0, 0 }, -1 });
+  for (int i = 0; i < 257; i++) {
+    auto &p = s_hpack_huffman_table[i];
+    int ptr = 0;
+    for (int b = p.bits - 1; b >= 0; b--) {
+      int bit = (p.code >> b) & 1;
+      int next = tree[ptr].child[bit];
+      if (!next) {
+        next = tree.size();
+        tree[ptr].child[bit] = next;
+        tree.push_back(Node{ { 0, 0 }, -1 });
+      }
+      ptr = next;
+    }
+    tree[ptr].symbol = i;
+  }
+
+  // Number the internal nodes as states, root being state 0
+  std::vector<int> states(tree.size(), -1);
+  std::vector<int> nodes;
+  for (int i = 0; i < int(tree.size()); i++) {
+    if (tree[i].symbol < 0) {
+      states[i] = nodes.size();
+      nodes.push_back(i);
+    }
+  }
+
+  // Padding is valid when it is a prefix of EOS shorter than 8 bits
+  std::vector<bool> padding(tree.size(), false);
+  for (int i = 0, d = 0; d < 8 && tree[i].symbol < 0; i = tree[i].child[1], d++) {
+    padding[i] = true;
+  }
+
+  for (int s = 0; s < 256; s++) {
+    for (int c = 0; c < 256; c++) {
+      auto &e = entries[s][c];
+      int ptr = nodes[s];
+      int count = 0;
+      e.state = 0;
+      e.flags = 0;
+      e.sym[0] = e.sym[1] = 0;
+      for (int b = 7; b >= 0; b--) {
+        ptr = tree[ptr].child[(c >> b) & 1];
+        auto sym = tree[ptr].symbol;
+        if (sym == 256) {
+          e.flags = FAIL;
+          break;
+        } else if (sym >= 0) {
+          e.sym[count++] = sym;
+          ptr = 0;
+        }
+      }
+      if (!e.flags) {
+        e.state = states[ptr];
+        e.flags = count | (padding[ptr] ? ACCEPT : 0);
+      }
+    }
+  }
+}
+
+//
+// HuffmanEncoder
+//
+
+auto HuffmanEncoder::encoded_size(const char *str, size_t len, bool lowercase) -> size_t {
+  size_t bits = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = str[i];
+    if (lowercase) c = std::tolower(c);
+    bits += s_hpack_huffman_table[c].bits;
+  }
+  return (bits + 7) >> 3;
+}
+
+void HuffmanEncoder::encode(const char *str, size_t len, bool lowercase, uint8_t *out) {
+  uint64_t acc = 0;
+  int bits = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = str[i];
+    if (lowercase) c = std::tolower(c);
+    const auto &p = s_hpack_huffman_table[c];
+    acc = (acc << p.bits) | p.code;
+    bits += p.bits;
+    if (bits >= 32) {
+      bits -= 32;
+      auto w = uint32_t(acc >> bits);
+      out[0] = w >> 24;
+      out[1] = w >> 16;
+      out[2] = w >> 8;
+      out[3] = w >> 0;
+      out += 4;
+    }
+  }
+  if (bits > 0) {
+    int pad = (8 - (bits & 7)) & 7;
+    acc = (acc << pad) | ((1u << pad) - 1); // padded with the MSBs of EOS
+    bits += pad;
+    while (bits > 0) {
+      bits -= 8;
+      *out++ = uint8_t(acc >> bits);
+    }
+  }
+}
+
+} // namespace http2
+} // namespace pipy
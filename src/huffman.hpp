@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HUFFMAN_HPP
+#define HUFFMAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pipy {
+namespace http2 {
+
+//
+// HuffmanDecoder
+//
+// Decodes HPACK Huffman strings (RFC 7541 Appendix B) one octet at a
+// time. Each internal node of the code tree is a state, and a
+// precomputed table maps a state and an input octet to the next state
+// along with the (at most two) symbols completed on the way.
+//
+
+class HuffmanDecoder {
+public:
+  void reset() {
+    m_state = 0;
+    m_accepted = true;
+  }
+
+  // Returns the number of symbols written to out, or -1 on EOS
+  auto decode(uint8_t c, uint8_t out[2]) -> int {
+    const auto &e = s_table.entries[m_state][c];
+    if (e.flags & FAIL) return -1;
+    m_state = e.state;
+    m_accepted = (e.flags & ACCEPT);
+    out[0] = e.sym[0];
+    out[1] = e.sym[1];
+    return e.flags & COUNT;
+  }
+
+  // Whether input so far ends at a symbol boundary or in valid padding
+  bool accepted() const { return m_accepted; }
+
+private:
+  enum {
+    COUNT  = 0x03,
+    FAIL   = 0x04,
+    ACCEPT = 0x08,
+  };
+
+  struct Entry {
+    uint8_t state;
+    uint8_t flags;
+    uint8_t sym[2];
+  };
+
+  struct Table {
+    Table();
+    Entry entries[256][256];
+  };
+
+  uint8_t m_state = 0;
+  bool m_accepted = true;
+
+  static const Table s_table;
+};
+
+//
+// HuffmanEncoder
+//
+
+class HuffmanEncoder {
+public:
+  static auto encoded_size(const char *str, size_t len, bool lowercase) -> size_t;
+  static void encode(const char *str, size_t len, bool lowercase, uint8_t *out);
+};
+
+} // namespace http2
+} // namespace pipy
+
+#endif // HUFFMAN_HPP
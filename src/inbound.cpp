@@ -34,6 +34,7 @@
 #include <linux/netfilter_ipv4.h>
 #include <linux/ip.h>
 #include <linux/udp.h>
+#include <unistd.h>
 #endif // __linux__
 
 namespace pipy {
@@ -248,35 +249,95 @@ InboundTCP::~InboundTCP() {
   if (m_socket) {
     m_socket->discard();
   }
+#ifdef PIPY_USE_IO_URING
+  delete m_uring_accept;
+#endif
   collect();
 }
 
 void InboundTCP::accept(asio::ip::tcp::acceptor &acceptor) {
+#ifdef PIPY_USE_IO_URING
+  if (auto ring = IOUring::current()) {
+    auto a = new URingAccept(this, ring, acceptor);
+    if (ring->accept(a, acceptor.native_handle(), (sockaddr*)&a->addr, &a->addrlen)) {
+      m_uring_accept = a;
+      retain();
+      return;
+    }
+    delete a;
+  }
+#endif
+
   acceptor.async_accept(
     socket(), m_peer,
     [this](const std::error_code &ec) {
-      InputContext ic(this);
-
-      if (ec == asio::error::operation_aborted) {
-        dangle();
-      } else if (!m_canceled) {
-        if (ec) {
-          log_error("error accepting connection", ec);
-          dangle();
-
-        } else if (m_listener && m_listener->pipeline_layout()) {
-          log_debug("connection accepted");
-          start();
-        }
-      }
-
-      release();
+      on_accept(ec);
     }
   );
 
   retain();
 }
 
+void InboundTCP::cancel() {
+  m_canceled = true;
+#ifdef PIPY_USE_IO_URING
+  if (auto a = m_uring_accept) {
+    a->ring->cancel(a);
+  }
+#endif
+}
+
+void InboundTCP::on_accept(const std::error_code &ec) {
+  InputContext ic(this);
+
+  if (ec == asio::error::operation_aborted) {
+    dangle();
+  } else if (!m_canceled) {
+    if (ec) {
+      log_error("error accepting connection", ec);
+      dangle();
+
+    } else if (m_listener && m_listener->pipeline_layout()) {
+      log_debug("connection accepted");
+      start();
+    }
+  }
+
+  release();
+}
+
+#ifdef PIPY_USE_IO_URING
+
+void InboundTCP::on_uring_accept(int res) {
+  std::unique_ptr<URingAccept> a(m_uring_accept);
+  m_uring_accept = nullptr;
+
+  if (res == -EAGAIN && !m_canceled) {
+    accept(*a->acceptor);
+    release();
+    return;
+  }
+
+  std::error_code ec;
+  if (res >= 0) {
+    socket().assign(a->protocol, res, ec);
+    if (ec) {
+      ::close(res);
+    } else {
+      std::memcpy(m_peer.data(), &a->addr, std::min<size_t>(a->addrlen, sizeof(a->addr)));
+      m_peer.resize(a->addrlen);
+    }
+  } else if (res == -EINTR) {
+    ec = asio::error::operation_aborted;
+  } else {
+    ec = std::error_code(-res, asio::error::get_system_category());
+  }
+
+  on_accept(ec);
+}
+
+#endif // PIPY_USE_IO_URING
+
 auto InboundTCP::get_socket() -> Socket* {
   if (!m_socket) {
     m_socket = Socket::make(SocketTCP::socket().native_handle());
@@ -69,8 +69,10 @@ public:
   auto ori_dst_address() -> pjs::Str*;
   auto ori_dst_port() -> int { address(); return m_ori_dst_port; }
   bool is_receiving() const { return m_receiving_state == RECEIVING; }
+  auto pipeline() const -> Pipeline* { return m_pipeline; }
 
   virtual auto get_socket() -> Socket* = 0;
+  virtual auto get_socket_tcp() -> SocketTCP* = 0;
   virtual auto get_buffered() const -> size_t = 0;
   virtual auto get_traffic_in() ->size_t = 0;
   virtual auto get_traffic_out() ->size_t = 0;
@@ -138,7 +140,7 @@ class InboundTCP :
 {
 public:
   void accept(asio::ip::tcp::acceptor &acceptor);
-  void cancel() { m_canceled = true; }
+  void cancel();
 
 private:
   InboundTCP(Listener *listener, const Inbound::Options &options);
@@ -148,7 +150,36 @@ private:
   asio::ip::tcp::endpoint m_peer;
   bool m_canceled = false;
 
+  void on_accept(const std::error_code &ec);
+
+#ifdef PIPY_USE_IO_URING
+
+  //
+  // InboundTCP::URingAccept
+  //
+
+  struct URingAccept : public IOUring::Request, public pjs::Pooled<URingAccept> {
+    URingAccept(InboundTCP *s, IOUring *r, asio::ip::tcp::acceptor &a)
+      : self(s), ring(r), acceptor(&a), protocol(a.local_endpoint().protocol()) {}
+
+    InboundTCP* self;
+    IOUring* ring;
+    asio::ip::tcp::acceptor* acceptor;
+    asio::ip::tcp protocol;
+    sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+
+    virtual void on_complete(int res, unsigned flags) override { self->on_uring_accept(res); }
+  };
+
+  URingAccept* m_uring_accept = nullptr;
+
+  void on_uring_accept(int res);
+
+#endif // PIPY_USE_IO_URING
+
   virtual auto get_socket() -> Socket* override;
+  virtual auto get_socket_tcp() -> SocketTCP* override { return this; }
   virtual auto get_buffered() const -> size_t override { return SocketTCP::buffered(); }
   virtual auto get_traffic_in() -> size_t override;
   virtual auto get_traffic_out() -> size_t override;
@@ -197,6 +228,7 @@ class InboundUDP :
   ~InboundUDP();
 
   virtual auto get_socket() -> Socket* override;
+  virtual auto get_socket_tcp() -> SocketTCP* override { return nullptr; }
   virtual auto get_buffered() const -> size_t override;
   virtual auto get_traffic_in() -> size_t override;
   virtual auto get_traffic_out() -> size_t override;
@@ -0,0 +1,453 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "io-uring.hpp"
+
+#ifdef PIPY_USE_IO_URING
+
+#include "log.hpp"
+
+#include <algorithm>
+#include <memory>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace pipy {
+
+static const unsigned URING_ENTRIES = 1024;
+static const unsigned URING_BUFFER_COUNT = 256;
+static const unsigned URING_BUFFER_GROUP = 1;
+
+static int io_uring_setup(unsigned entries, io_uring_params *p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+//
+// IOUring
+//
+
+bool IOUring::s_enabled = false;
+Data::Producer IOUring::s_dp("io_uring");
+
+void IOUring::set_enabled(bool enabled) {
+  s_enabled = enabled;
+}
+
+auto IOUring::current() -> IOUring* {
+  thread_local static std::unique_ptr<IOUring> s_ring;
+  thread_local static bool s_initialized = false;
+  if (!s_initialized) {
+    s_initialized = true;
+    if (s_enabled) {
+      auto ring = new IOUring();
+      if (ring->init()) {
+        s_ring.reset(ring);
+      } else {
+        delete ring;
+        Log::warn("[io_uring] io_uring is not available, falling back to the default socket backend");
+      }
+    }
+  }
+  return s_ring.get();
+}
+
+IOUring::IOUring()
+  : m_event_stream(Net::context())
+{
+  memset(&m_params, 0, sizeof(m_params));
+}
+
+IOUring::~IOUring() {
+  close();
+}
+
+bool IOUring::init() {
+  m_params.flags = IORING_SETUP_CQSIZE;
+  m_params.cq_entries = URING_ENTRIES * 4;
+
+  m_fd = io_uring_setup(URING_ENTRIES, &m_params);
+  if (m_fd < 0) return false;
+
+  auto &p = m_params;
+  if (!(p.features & IORING_FEAT_FAST_POLL) || !(p.features & IORING_FEAT_NODROP)) {
+    close();
+    return false;
+  }
+
+  auto probe_size = sizeof(io_uring_probe) + sizeof(io_uring_probe_op) * 256;
+  std::unique_ptr<char[]> probe_buf(new char[probe_size]);
+  auto probe = (io_uring_probe*)probe_buf.get();
+  memset(probe, 0, probe_size);
+  if (io_uring_register(m_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+    close();
+    return false;
+  }
+
+  auto supported = [&](int op) {
+    return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  };
+
+  if (
+    !supported(IORING_OP_ACCEPT) ||
+    !supported(IORING_OP_RECV) ||
+    !supported(IORING_OP_SENDMSG) ||
+    !supported(IORING_OP_ASYNC_CANCEL)
+  ) {
+    close();
+    return false;
+  }
+
+  m_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  m_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+  }
+
+  m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+  if (m_sq_ring == MAP_FAILED) {
+    m_sq_ring = nullptr;
+    close();
+    return false;
+  }
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    m_cq_ring = m_sq_ring;
+  } else {
+    m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    if (m_cq_ring == MAP_FAILED) {
+      m_cq_ring = nullptr;
+      close();
+      return false;
+    }
+  }
+
+  m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+  auto sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    close();
+    return false;
+  }
+
+  auto sq = (char *)m_sq_ring;
+  auto cq = (char *)m_cq_ring;
+  m_sqes = (io_uring_sqe*)sqes;
+  m_sq_head = (unsigned*)(sq + p.sq_off.head);
+  m_sq_tail = (unsigned*)(sq + p.sq_off.tail);
+  m_sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+  m_sq_flags = (unsigned*)(sq + p.sq_off.flags);
+  m_sq_array = (unsigned*)(sq + p.sq_off.array);
+  m_cq_head = (unsigned*)(cq + p.cq_off.head);
+  m_cq_tail = (unsigned*)(cq + p.cq_off.tail);
+  m_cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+  m_cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+
+  for (unsigned i = 0; i < p.sq_entries; i++) m_sq_array[i] = i;
+  m_sq_local_tail = m_sq_submitted = *m_sq_tail;
+
+  m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_event_fd < 0) {
+    close();
+    return false;
+  }
+
+  if (io_uring_register(m_fd, IORING_REGISTER_EVENTFD, &m_event_fd, 1) < 0) {
+    ::close(m_event_fd);
+    m_event_fd = -1;
+    close();
+    return false;
+  }
+
+  m_event_stream.assign(m_event_fd);
+
+  if (supported(IORING_OP_PROVIDE_BUFFERS)) {
+    m_buffers.resize(URING_BUFFER_COUNT);
+    for (unsigned i = 0; i < URING_BUFFER_COUNT; i++) provide_buffer(i);
+    m_buffers_provided = true;
+  }
+
+  submit();
+
+  Log::debug(
+    Log::SOCKET, "[io_uring] ring created with %d entries, %d provided buffers",
+    p.sq_entries, int(m_buffers.size())
+  );
+
+  return true;
+}
+
+void IOUring::close() {
+  if (m_event_fd >= 0) {
+    std::error_code ec;
+    m_event_stream.close(ec);
+    m_event_fd = -1;
+  }
+  if (m_sqes) munmap(m_sqes, m_sqes_size);
+  if (m_cq_ring && m_cq_ring != m_sq_ring) munmap(m_cq_ring, m_cq_ring_size);
+  if (m_sq_ring) munmap(m_sq_ring, m_sq_ring_size);
+  if (m_fd >= 0) ::close(m_fd);
+  m_sqes = nullptr;
+  m_sq_ring = nullptr;
+  m_cq_ring = nullptr;
+  m_fd = -1;
+}
+
+bool IOUring::accept(Request *req, int fd, sockaddr *addr, socklen_t *addrlen) {
+  auto sqe = get_sqe();
+  if (!sqe) return false;
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)addr;
+  sqe->addr2 = (uint64_t)addrlen;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = (uint64_t)req;
+  track(req);
+  return true;
+}
+
+bool IOUring::recv(Request *req, int fd, void *buf, size_t len) {
+  auto sqe = get_sqe();
+  if (!sqe) return false;
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)buf;
+  sqe->len = len;
+  sqe->user_data = (uint64_t)req;
+  track(req);
+  return true;
+}
+
+bool IOUring::recv(Request *req, int fd) {
+  if (!m_buffers_provided) return false;
+  auto sqe = get_sqe();
+  if (!sqe) return false;
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->len = RECEIVE_BUFFER_SIZE;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BUFFER_GROUP;
+  sqe->user_data = (uint64_t)req;
+  track(req);
+  return true;
+}
+
+bool IOUring::sendmsg(Request *req, int fd, const msghdr *msg) {
+  auto sqe = get_sqe();
+  if (!sqe) return false;
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)msg;
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = (uint64_t)req;
+  track(req);
+  return true;
+}
+
+void IOUring::cancel(Request *req) {
+  if (!req->m_pending) return;
+  if (auto sqe = get_sqe()) {
+    prep_cancel(sqe, req);
+  } else {
+    m_deferred_cancels.push_back(req);
+    schedule_submit();
+  }
+}
+
+void IOUring::take_buffer(unsigned flags, Data &out) {
+  if (!(flags & IORING_CQE_F_BUFFER)) return;
+  auto bid = flags >> IORING_CQE_BUFFER_SHIFT;
+  if (bid >= m_buffers.size()) return;
+  out.push(std::move(m_buffers[bid]));
+  provide_buffer(bid);
+}
+
+auto IOUring::get_sqe() -> io_uring_sqe* {
+  auto sqe = next_sqe();
+  if (!sqe) {
+    submit();
+    sqe = next_sqe();
+    if (!sqe) return nullptr;
+  }
+  schedule_submit();
+  return sqe;
+}
+
+auto IOUring::next_sqe() -> io_uring_sqe* {
+  auto head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+  if (m_sq_local_tail - head >= m_params.sq_entries) return nullptr;
+  auto sqe = &m_sqes[m_sq_local_tail & *m_sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  m_sq_local_tail++;
+  return sqe;
+}
+
+void IOUring::provide_buffer(int bid) {
+  auto &buf = m_buffers[bid];
+  if (buf.empty()) buf.push(Data(RECEIVE_BUFFER_SIZE, &s_dp));
+  if (auto sqe = get_sqe()) {
+    prep_provide_buffer(sqe, bid);
+  } else {
+    m_deferred_buffers.push_back(bid);
+    schedule_submit();
+  }
+}
+
+void IOUring::prep_cancel(io_uring_sqe *sqe, Request *req) {
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = (uint64_t)req;
+  sqe->user_data = 0;
+}
+
+void IOUring::prep_provide_buffer(io_uring_sqe *sqe, int bid) {
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = 1;
+  sqe->addr = (uint64_t)std::get<0>(*m_buffers[bid].chunks().begin());
+  sqe->len = RECEIVE_BUFFER_SIZE;
+  sqe->off = bid;
+  sqe->buf_group = URING_BUFFER_GROUP;
+  sqe->user_data = 0;
+}
+
+void IOUring::flush_deferred() {
+  auto added = false;
+  while (!m_deferred_buffers.empty()) {
+    auto sqe = next_sqe();
+    if (!sqe) break;
+    prep_provide_buffer(sqe, m_deferred_buffers.back());
+    m_deferred_buffers.pop_back();
+    added = true;
+  }
+  while (!m_deferred_cancels.empty()) {
+    auto sqe = next_sqe();
+    if (!sqe) break;
+    prep_cancel(sqe, m_deferred_cancels.back());
+    m_deferred_cancels.pop_back();
+    added = true;
+  }
+  if (added) schedule_submit();
+}
+
+void IOUring::schedule_submit() {
+  if (!m_submit_scheduled) {
+    m_submit_scheduled = true;
+    asio::post(Net::context(), SubmitHandler(this));
+  }
+}
+
+void IOUring::submit() {
+  flush_deferred();
+  auto n = m_sq_local_tail - m_sq_submitted;
+  if (!n) return;
+  __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+  while (n > 0) {
+    auto ret = io_uring_enter(m_fd, n, 0, 0);
+    if (ret >= 0) {
+      m_sq_submitted += ret;
+      n -= ret;
+      if (!ret) break;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN || errno == EBUSY) {
+      schedule_submit();
+      break;
+    } else {
+      Log::error("[io_uring] io_uring_enter failed with errno = %d", errno);
+      break;
+    }
+  }
+  if (!m_deferred_buffers.empty() || !m_deferred_cancels.empty()) {
+    flush_deferred();
+  }
+}
+
+void IOUring::reap() {
+  uint64_t count;
+  while (::read(m_event_fd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+
+  auto head = *m_cq_head;
+  for (;;) {
+    auto tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+#ifdef IORING_SQ_CQ_OVERFLOW
+      if (__atomic_load_n(m_sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW) {
+        io_uring_enter(m_fd, 0, 0, IORING_ENTER_GETEVENTS);
+        continue;
+      }
+#endif
+      break;
+    }
+    auto cqe = &m_cqes[head & *m_cq_mask];
+    auto req = (Request*)cqe->user_data;
+    auto res = cqe->res;
+    auto flags = cqe->flags;
+    __atomic_store_n(m_cq_head, ++head, __ATOMIC_RELEASE);
+    if (req) {
+      req->m_pending = false;
+      m_requests--;
+      if (!m_deferred_cancels.empty()) {
+        auto &v = m_deferred_cancels;
+        v.erase(std::remove(v.begin(), v.end(), req), v.end());
+      }
+      req->on_complete(res, flags);
+    }
+  }
+
+  // Only keep the eventfd watched while there are requests in flight
+  // so that an idle ring never holds the event loop from exiting
+  if (m_requests > 0 && !m_waiting) wait();
+}
+
+void IOUring::track(Request *req) {
+  req->m_pending = true;
+  m_requests++;
+  if (!m_waiting) wait();
+}
+
+void IOUring::wait() {
+  m_waiting = true;
+  m_event_stream.async_wait(
+    asio::posix::stream_descriptor::wait_read,
+    WaitHandler(this)
+  );
+}
+
+} // namespace pipy
+
+#endif // PIPY_USE_IO_URING
@@ -0,0 +1,153 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef IO_URING_HPP
+#define IO_URING_HPP
+
+#include "net.hpp"
+#include "data.hpp"
+
+#ifdef PIPY_USE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <vector>
+
+namespace pipy {
+
+//
+// IOUring
+//
+
+class IOUring {
+public:
+
+  //
+  // IOUring::Request
+  //
+
+  class Request {
+  public:
+    bool pending() const { return m_pending; }
+
+  private:
+    virtual void on_complete(int res, unsigned flags) = 0;
+
+    bool m_pending = false;
+
+    friend class IOUring;
+  };
+
+  static void set_enabled(bool enabled);
+  static auto current() -> IOUring*;
+
+  ~IOUring();
+
+  bool accept(Request *req, int fd, sockaddr *addr, socklen_t *addrlen);
+  bool recv(Request *req, int fd, void *buf, size_t len);
+  bool recv(Request *req, int fd);
+  bool sendmsg(Request *req, int fd, const msghdr *msg);
+  void cancel(Request *req);
+  void take_buffer(unsigned flags, Data &out);
+
+private:
+  IOUring();
+
+  bool init();
+  void close();
+  auto get_sqe() -> io_uring_sqe*;
+  auto next_sqe() -> io_uring_sqe*;
+  void provide_buffer(int bid);
+  void prep_cancel(io_uring_sqe *sqe, Request *req);
+  void prep_provide_buffer(io_uring_sqe *sqe, int bid);
+  void flush_deferred();
+  void schedule_submit();
+  void submit();
+  void reap();
+  void track(Request *req);
+  void wait();
+
+  int m_fd = -1;
+  int m_event_fd = -1;
+  bool m_submit_scheduled = false;
+  bool m_waiting = false;
+  size_t m_requests = 0;
+
+  io_uring_params m_params;
+  void* m_sq_ring = nullptr;
+  void* m_cq_ring = nullptr;
+  size_t m_sq_ring_size = 0;
+  size_t m_cq_ring_size = 0;
+  io_uring_sqe* m_sqes = nullptr;
+  size_t m_sqes_size = 0;
+
+  unsigned* m_sq_head;
+  unsigned* m_sq_tail;
+  unsigned* m_sq_mask;
+  unsigned* m_sq_flags;
+  unsigned* m_sq_array;
+  unsigned* m_cq_head;
+  unsigned* m_cq_tail;
+  unsigned* m_cq_mask;
+  io_uring_cqe* m_cqes;
+  unsigned m_sq_local_tail = 0;
+  unsigned m_sq_submitted = 0;
+
+  std::vector<Data> m_buffers;
+  bool m_buffers_provided = false;
+
+  // Cancels and buffer returns that found the submission queue full,
+  // retried after the next submit instead of being dropped
+  std::vector<Request*> m_deferred_cancels;
+  std::vector<int> m_deferred_buffers;
+
+  asio::posix::stream_descriptor m_event_stream;
+
+  struct WaitHandler : public SelfHandler<IOUring> {
+    using SelfHandler::SelfHandler;
+    WaitHandler(const WaitHandler &r) : SelfHandler(r) {}
+    void operator()(const std::error_code &ec) {
+      self->m_waiting = false;
+      if (ec != asio::error::operation_aborted) self->reap();
+    }
+  };
+
+  struct SubmitHandler : public SelfHandler<IOUring> {
+    using SelfHandler::SelfHandler;
+    SubmitHandler(const SubmitHandler &r) : SelfHandler(r) {}
+    void operator()() { self->m_submit_scheduled = false; self->submit(); }
+  };
+
+  static bool s_enabled;
+  static Data::Producer s_dp;
+};
+
+} // namespace pipy
+
+#endif // PIPY_USE_IO_URING
+
+#endif // IO_URING_HPP
@@ -0,0 +1,282 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ip-table.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <deque>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace pipy {
+
+static inline auto popcount(uint64_t x) -> int {
+#ifdef _MSC_VER
+  return (int)__popcnt64(x);
+#else
+  return __builtin_popcountll(x);
+#endif
+}
+
+// Takes the next "width" bits starting from bit "off" of a 128-bit key
+static inline auto bits_at(uint64_t hi, uint64_t lo, int off, int width) -> uint32_t {
+  uint64_t top = (
+    off == 0 ? hi :
+    off < 64 ? (hi << off) | (lo >> (64 - off)) :
+    off < 128 ? lo << (off - 64) : 0
+  );
+  return top >> (64 - width);
+}
+
+//
+// IPPrefixTable::Prefix
+//
+
+bool IPPrefixTable::Prefix::parse(const std::string &cidr, Prefix &prefix) {
+  auto p = cidr.find('/');
+  auto addr = cidr.substr(0, p);
+
+  uint8_t ipv4[4];
+  uint16_t ipv6[8];
+  int max_length;
+
+  if (utils::get_ip_v4(addr, ipv4)) {
+    prefix.hi = (
+      ((uint64_t)ipv4[0] << 56) |
+      ((uint64_t)ipv4[1] << 48) |
+      ((uint64_t)ipv4[2] << 40) |
+      ((uint64_t)ipv4[3] << 32)
+    );
+    prefix.lo = 0;
+    prefix.is_v6 = false;
+    max_length = 32;
+  } else if (utils::get_ip_v6(addr, ipv6)) {
+    prefix.hi = prefix.lo = 0;
+    for (int i = 0; i < 4; i++) prefix.hi = (prefix.hi << 16) | ipv6[i];
+    for (int i = 4; i < 8; i++) prefix.lo = (prefix.lo << 16) | ipv6[i];
+    prefix.is_v6 = true;
+    max_length = 128;
+  } else {
+    return false;
+  }
+
+  if (p == std::string::npos) {
+    prefix.length = max_length;
+  } else {
+    auto n = 0;
+    if (p + 1 == cidr.length()) return false;
+    for (auto i = p + 1; i < cidr.length(); i++) {
+      auto c = cidr[i];
+      if (c < '0' || '9' < c) return false;
+      n = n * 10 + (c - '0');
+      if (n > max_length) return false;
+    }
+    prefix.length = n;
+  }
+
+  auto len = prefix.length;
+  if (len < 64) {
+    prefix.hi &= len > 0 ? ~0ull << (64 - len) : 0;
+    prefix.lo = 0;
+  } else if (len < 128) {
+    prefix.lo &= len > 64 ? ~0ull << (128 - len) : 0;
+  }
+
+  return true;
+}
+
+//
+// IPPrefixTable::Builder
+//
+
+namespace {
+
+struct BuildNode {
+  std::vector<int> leaves;
+  std::vector<BuildNode*> children;
+
+  BuildNode(int width, int id)
+    : leaves(1 << width, id)
+    , children(1 << width, nullptr) {}
+
+  ~BuildNode() {
+    for (auto *c : children) delete c;
+  }
+};
+
+} // anonymous namespace
+
+void IPPrefixTable::Builder::add(const Prefix &prefix, int id) {
+  Entry e;
+  e.prefix = prefix;
+  e.id = id;
+  m_entries.push_back(e);
+}
+
+auto IPPrefixTable::Builder::build() -> IPPrefixTable* {
+
+  // Shorter prefixes go first so that longer ones overwrite them, which
+  // also guarantees no leaf is ever set where a child node already is
+  std::stable_sort(
+    m_entries.begin(), m_entries.end(),
+    [](const Entry &a, const Entry &b) {
+      return a.prefix.length < b.prefix.length;
+    }
+  );
+
+  auto insert = [](BuildNode *root, const Prefix &prefix, int id) {
+    auto node = root;
+    auto off = 0;
+    auto width = DIRECT_BITS;
+    for (;;) {
+      auto i = bits_at(prefix.hi, prefix.lo, off, width);
+      auto rest = prefix.length - off;
+      if (rest <= width) {
+        auto n = 1u << (width - rest);
+        auto first = i & ~(n - 1);
+        for (auto k = first; k < first + n; k++) node->leaves[k] = id;
+        return;
+      }
+      auto &child = node->children[i];
+      if (!child) child = new BuildNode(STRIDE_BITS, node->leaves[i]);
+      node = child;
+      off += width;
+      width = STRIDE_BITS;
+    }
+  };
+
+  // Nodes are laid out breadth-first so that children of
+  // the same node are contiguous and indexed by popcount
+  auto compile = [](BuildNode *root, Trie &trie) {
+    std::deque<std::pair<BuildNode*, uint32_t>> queue;
+    trie.direct.resize(1 << DIRECT_BITS);
+    for (size_t i = 0; i < trie.direct.size(); i++) {
+      if (auto *c = root->children[i]) {
+        uint32_t index = trie.nodes.size();
+        trie.nodes.emplace_back();
+        trie.direct[i] = NODE_BIT | index;
+        queue.push_back(std::make_pair(c, index));
+      } else {
+        trie.direct[i] = root->leaves[i] + 1;
+      }
+    }
+    while (!queue.empty()) {
+      auto *b = queue.front().first;
+      auto index = queue.front().second;
+      queue.pop_front();
+      Node node;
+      node.vector = 0;
+      node.leafvec = 0;
+      node.base0 = trie.leaves.size();
+      node.base1 = trie.nodes.size();
+      auto has_last = false;
+      uint32_t last = 0;
+      for (int i = 0; i < (1 << STRIDE_BITS); i++) {
+        auto bit = 1ull << i;
+        if (auto *c = b->children[i]) {
+          node.vector |= bit;
+          queue.push_back(std::make_pair(c, (uint32_t)trie.nodes.size()));
+          trie.nodes.emplace_back();
+        } else {
+          uint32_t v = b->leaves[i] + 1;
+          if (!has_last || v != last) {
+            node.leafvec |= bit;
+            trie.leaves.push_back(v);
+            last = v;
+            has_last = true;
+          }
+        }
+      }
+      trie.nodes[index] = node;
+    }
+  };
+
+  BuildNode *root_v4 = nullptr;
+  BuildNode *root_v6 = nullptr;
+
+  for (const auto &e : m_entries) {
+    auto &root = e.prefix.is_v6 ? root_v6 : root_v4;
+    if (!root) root = new BuildNode(DIRECT_BITS, -1);
+    insert(root, e.prefix, e.id);
+  }
+
+  auto table = new IPPrefixTable;
+  if (root_v4) compile(root_v4, table->m_v4);
+  if (root_v6) compile(root_v6, table->m_v6);
+  delete root_v4;
+  delete root_v6;
+  return table;
+}
+
+//
+// IPPrefixTable
+//
+
+auto IPPrefixTable::find(const std::string &addr) const -> int {
+  uint8_t ipv4[4];
+  uint16_t ipv6[8];
+  if (utils::get_ip_v4(addr, ipv4)) return find_v4(ipv4);
+  if (utils::get_ip_v6(addr, ipv6)) return find_v6(ipv6);
+  return -1;
+}
+
+auto IPPrefixTable::find_v4(const uint8_t addr[4]) const -> int {
+  auto hi = (
+    ((uint64_t)addr[0] << 56) |
+    ((uint64_t)addr[1] << 48) |
+    ((uint64_t)addr[2] << 40) |
+    ((uint64_t)addr[3] << 32)
+  );
+  return lookup(m_v4, hi, 0);
+}
+
+auto IPPrefixTable::find_v6(const uint16_t addr[8]) const -> int {
+  uint64_t hi = 0, lo = 0;
+  for (int i = 0; i < 4; i++) hi = (hi << 16) | addr[i];
+  for (int i = 4; i < 8; i++) lo = (lo << 16) | addr[i];
+  return lookup(m_v6, hi, lo);
+}
+
+auto IPPrefixTable::lookup(const Trie &trie, uint64_t hi, uint64_t lo) -> int {
+  if (trie.direct.empty()) return -1;
+  auto e = trie.direct[bits_at(hi, lo, 0, DIRECT_BITS)];
+  auto off = DIRECT_BITS;
+  while (e & NODE_BIT) {
+    const auto &node = trie.nodes[e & ~NODE_BIT];
+    auto bit = 1ull << bits_at(hi, lo, off, STRIDE_BITS);
+    auto mask = (bit << 1) - 1;
+    if (!(node.vector & bit)) {
+      return (int)trie.leaves[node.base0 + popcount(node.leafvec & mask) - 1] - 1;
+    }
+    e = NODE_BIT | (node.base1 + popcount(node.vector & mask) - 1);
+    off += STRIDE_BITS;
+  }
+  return (int)e - 1;
+}
+
+} // namespace pipy
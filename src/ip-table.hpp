@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef IP_TABLE_HPP
+#define IP_TABLE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pipy {
+
+//
+// IPPrefixTable
+//
+// Immutable longest-prefix-match table of IPv4 and IPv6 address blocks,
+// compiled into a Poptrie: the top 16 bits of an address index a flat
+// array directly, the rest is walked 6 bits at a time through 64-ary
+// nodes whose children and leaves are located by popcount over per-node
+// bitmaps. Once built, a table can be shared read-only by all threads.
+//
+
+class IPPrefixTable {
+public:
+
+  //
+  // IPPrefixTable::Prefix
+  //
+
+  struct Prefix {
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+    int length = 0;
+    bool is_v6 = false;
+
+    // Accepts "addr/len" or a single address
+    static bool parse(const std::string &cidr, Prefix &prefix);
+  };
+
+  //
+  // IPPrefixTable::Builder
+  //
+
+  class Builder {
+  public:
+    void add(const Prefix &prefix, int id);
+    auto build() -> IPPrefixTable*;
+
+  private:
+    struct Entry {
+      Prefix prefix;
+      int id;
+    };
+
+    std::vector<Entry> m_entries;
+  };
+
+  auto find(const std::string &addr) const -> int;
+  auto find_v4(const uint8_t addr[4]) const -> int;
+  auto find_v6(const uint16_t addr[8]) const -> int;
+  auto size() const -> size_t { return m_v4.nodes.size() + m_v6.nodes.size(); }
+
+private:
+  static const int DIRECT_BITS = 16;
+  static const int STRIDE_BITS = 6;
+  static const uint32_t NODE_BIT = 0x80000000;
+
+  struct Node {
+    uint64_t vector;  // slots pointing to child nodes
+    uint64_t leafvec; // slots starting a run of identical leaves
+    uint32_t base0;   // first leaf
+    uint32_t base1;   // first child node
+  };
+
+  // Direct entries and leaves hold route IDs plus 1, or 0 for no route.
+  // Direct entries with NODE_BIT set point to a node instead.
+  struct Trie {
+    std::vector<uint32_t> direct;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> leaves;
+  };
+
+  Trie m_v4;
+  Trie m_v6;
+
+  static auto lookup(const Trie &trie, uint64_t hi, uint64_t lo) -> int;
+};
+
+} // namespace pipy
+
+#endif // IP_TABLE_HPP
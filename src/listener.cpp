@@ -29,6 +29,14 @@
 #include "worker-thread.hpp"
 #include "log.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
+
 namespace pipy {
 
 //
@@ -138,11 +146,16 @@ Listener::Options::Options(pjs::Object *options) {
 
 thread_local std::set<Listener*> Listener::s_listeners;
 bool Listener::s_reuse_port = false;
+Listener::ReusePortSteering Listener::s_reuse_port_steering = Listener::ReusePortSteering::NONE;
 
 void Listener::set_reuse_port(bool reuse) {
   s_reuse_port = reuse;
 }
 
+void Listener::set_reuse_port_steering(ReusePortSteering steering) {
+  s_reuse_port_steering = steering;
+}
+
 void Listener::commit_all() {
   for (auto l : s_listeners) {
     l->commit();
@@ -427,6 +440,90 @@ void Listener::set_sock_opts(int sock) {
   }
 }
 
+//
+// Each worker thread has its own socket in the reuseport group of a port.
+// The kernel reorders sockets in a group whenever one leaves, so the
+// steering never relies on the index of a socket in its group:
+//
+//   - cpu: each socket is marked with SO_INCOMING_CPU as the CPU its
+//     thread is pinned to, and the kernel prefers it for connections
+//     received on that CPU (effective with reuseport since Linux 6.2).
+//
+//   - queue: a classic BPF program maps the RX queue number modulo the
+//     group size to a socket, so connections from the same queue always
+//     land on the same thread. The program is re-attached with the new
+//     group size every time a worker socket joins or leaves the group.
+//
+// Only TCP ports opened by worker threads are steered. Admin ports and
+// UDP ports are left to the default kernel load balancing.
+//
+
+void Listener::set_steering(int sock) {
+#ifdef __linux__
+  if (!s_reuse_port || s_reuse_port_steering == ReusePortSteering::NONE) return;
+  if (m_port->protocol() != Port::Protocol::TCP) return;
+
+  auto *wt = WorkerThread::current();
+  if (!wt) return;
+
+  auto &wm = WorkerManager::get();
+  if (wm.concurrency() <= 1) return;
+
+  char desc[200];
+  describe(desc, sizeof(desc));
+
+  if (s_reuse_port_steering == ReusePortSteering::CPU) {
+#ifdef SO_INCOMING_CPU
+    const auto &cpus = wm.cpu_affinity();
+    if (cpus.empty()) return;
+    int cpu = cpus[wt->index() % cpus.size()];
+    if (setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu))) {
+      Log::warn("[listener] Cannot set incoming CPU for %s: %s", desc, std::strerror(errno));
+    }
+#endif
+  } else {
+    std::lock_guard<std::mutex> lock(m_port->m_steering_mutex);
+    auto &socks = m_port->m_steering_socks;
+    socks.push_back(sock);
+    attach_steering_program(sock, socks.size());
+  }
+#endif
+}
+
+void Listener::clear_steering(int sock) {
+#ifdef __linux__
+  if (s_reuse_port_steering != ReusePortSteering::QUEUE) return;
+  std::lock_guard<std::mutex> lock(m_port->m_steering_mutex);
+  auto &socks = m_port->m_steering_socks;
+  auto i = std::find(socks.begin(), socks.end(), sock);
+  if (i == socks.end()) return;
+  socks.erase(i);
+  if (!socks.empty()) {
+    attach_steering_program(socks.front(), socks.size());
+  }
+#endif
+}
+
+void Listener::attach_steering_program(int sock, int n) {
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+  sock_filter code[] = {
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, uint32_t(SKF_AD_OFF + SKF_AD_QUEUE)),
+    BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, uint32_t(n)),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+
+  sock_fprog prog;
+  prog.len = sizeof(code) / sizeof(code[0]);
+  prog.filter = code;
+
+  if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog))) {
+    char desc[200];
+    describe(desc, sizeof(desc));
+    Log::warn("[listener] Cannot attach reuseport steering program to %s: %s", desc, std::strerror(errno));
+  }
+#endif
+}
+
 auto Listener::find(Port::Protocol protocol, const std::string &ip, int port) -> Listener* {
   for (auto *l : s_listeners) {
     if (l->protocol() == protocol && l->ip() == ip && l->port() == port) {
@@ -458,6 +555,7 @@ void Listener::AcceptorTCP::start(const asio::ip::tcp::endpoint &endpoint) {
 
   m_acceptor.bind(endpoint);
   m_acceptor.listen(asio::socket_base::max_connections);
+  m_listener->set_steering(m_acceptor.native_handle());
 }
 
 void Listener::AcceptorTCP::accept() {
@@ -475,8 +573,12 @@ void Listener::AcceptorTCP::cancel() {
 }
 
 void Listener::AcceptorTCP::stop() {
+  if (m_acceptor.is_open()) {
+    m_listener->clear_steering(m_acceptor.native_handle());
+  }
   m_acceptor.close();
   if (m_accepting) {
+    m_accepting->cancel();
     m_accepting->dangle();
     m_accepting = nullptr;
   }
@@ -37,6 +37,7 @@
 #include <string>
 #include <set>
 #include <map>
+#include <vector>
 
 namespace pipy {
 
@@ -86,6 +87,8 @@ private:
   std::atomic<int> m_num_connections;
   std::set<Listener*> m_listeners;
   std::mutex m_listeners_mutex;
+  std::vector<int> m_steering_socks;
+  std::mutex m_steering_mutex;
 
   static std::list<pjs::Ref<Port>> s_port_list;
   static std::mutex s_port_list_mutex;
@@ -108,7 +111,14 @@ public:
     Options(pjs::Object *options);
   };
 
+  enum class ReusePortSteering {
+    NONE,
+    CPU,
+    QUEUE,
+  };
+
   static void set_reuse_port(bool reuse);
+  static void set_reuse_port_steering(ReusePortSteering steering);
 
   static auto get(Port::Protocol protocol, const std::string &ip, int port) -> Listener* {
     if (auto *l = find(protocol, ip, port)) return l;
@@ -228,6 +238,9 @@ private:
   void print_state(const char *msg);
   void describe(char *buf, size_t len);
   void set_sock_opts(int sock);
+  void set_steering(int sock);
+  void clear_steering(int sock);
+  void attach_steering_program(int sock, int n);
 
   Net& m_net;
   Options m_options;
@@ -247,6 +260,7 @@ private:
 
   thread_local static std::set<Listener*> s_listeners;
   static bool s_reuse_port;
+  static ReusePortSteering s_reuse_port_steering;
 
   static auto find(Port::Protocol protocol, const std::string &ip, int port) -> Listener*;
 
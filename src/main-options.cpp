@@ -66,6 +66,7 @@ void MainOptions::show_help() {
   std::cout << "  --, -args, --args                    Indicate the end of Pipy options and the start of script arguments" << std::endl;
   std::cout << "  --pipy-options                       Indicate the beginning of Pipy options while processing script arguments" << std::endl;
   std::cout << "  --threads=<number>                   Number of worker threads (1, 2, ... max)" << std::endl;
+  std::cout << "  --cpu-affinity=<cpus|auto>           Pin worker threads to the listed CPUs in order, e.g. 0-3,8" << std::endl;
   std::cout << "  --log-file=<filename>                Set the pathname of the log file" << std::endl;
   std::cout << "  --log-level=<debug|info|warn|error>  Set the level of log output" << std::endl;
   std::cout << "  --log-history-limit=<size>           Set size limit of log history in bytes" << std::endl;
@@ -80,6 +81,11 @@ void MainOptions::show_help() {
   std::cout << "  --instance-uuid=<uuid>               Specify a UUID for this worker process" << std::endl;
   std::cout << "  --instance-name=<name>               Specify a name for this worker process" << std::endl;
   std::cout << "  --reuse-port                         Enable kernel load balancing for all listening ports" << std::endl;
+  std::cout << "  --reuse-port-steering=<cpu|queue>    Steer connections to the thread on the receiving CPU or RX queue" << std::endl;
+  std::cout << "  --io-uring                           Use io_uring for TCP sockets when supported by the kernel" << std::endl;
+  std::cout << "  --pjs-vm=<bytecode|ast>              Run scripts as compiled bytecode (default) or by walking syntax trees" << std::endl;
+  std::cout << "  --resolv-conf=<filename>             Read nameservers from the specified file instead of /etc/resolv.conf" << std::endl;
+  std::cout << "  --hosts-file=<filename>              Read static host names from the specified file instead of /etc/hosts" << std::endl;
   std::cout << "  --admin-port=<[[ip]:]port>           Enable administration service on the specified port" << std::endl;
   std::cout << "  --admin-port-off                     Do not start administration service at startup" << std::endl;
   std::cout << "  --admin-gui=<dirname>                Specify the location of administration GUI front-end files" << std::endl;
@@ -190,6 +196,23 @@ void MainOptions::parse(const std::list<std::string> &args) {
             throw std::runtime_error(msg + std::to_string(max_threads));
           }
         }
+      } else if (k == "--cpu-affinity") {
+        cpu_affinity.clear();
+        if (v == "auto") {
+          for (int i = 0; i < int(max_threads); i++) cpu_affinity.push_back(i);
+        } else {
+          for (const auto &s : utils::split(v, ',')) {
+            char *end;
+            auto first = std::strtol(s.c_str(), &end, 10);
+            auto last = first;
+            if (end != s.c_str() && *end == '-') last = std::strtol(end + 1, &end, 10);
+            if (s.empty() || *end || first < 0 || last < first) {
+              throw std::runtime_error("invalid --cpu-affinity");
+            }
+            for (auto i = first; i <= last; i++) cpu_affinity.push_back(i);
+          }
+        }
+        if (cpu_affinity.empty()) throw std::runtime_error("invalid --cpu-affinity");
       } else if (k == "--log-file") {
         log_file = v;
       } else if (k == "--log-level") {
@@ -259,6 +282,23 @@ void MainOptions::parse(const std::list<std::string> &args) {
         instance_name = v;
       } else if (k == "--reuse-port") {
         reuse_port = true;
+      } else if (k == "--reuse-port-steering") {
+        if (v != "cpu" && v != "queue") {
+          throw std::runtime_error("--reuse-port-steering expects 'cpu' or 'queue'");
+        }
+        reuse_port_steering = v;
+        reuse_port = true;
+      } else if (k == "--io-uring") {
+        io_uring = true;
+      } else if (k == "--pjs-vm") {
+        if (v != "bytecode" && v != "ast") {
+          throw std::runtime_error("--pjs-vm expects 'bytecode' or 'ast'");
+        }
+        pjs_vm = v;
+      } else if (k == "--resolv-conf") {
+        resolv_conf = v;
+      } else if (k == "--hosts-file") {
+        hosts_file = v;
       } else if (k == "--admin-port-off") {
         admin_port_off = true;
       } else if (k == "--admin-port") {
@@ -287,6 +327,10 @@ void MainOptions::parse(const std::list<std::string> &args) {
     }
   }
 
+  if (reuse_port_steering == "cpu" && cpu_affinity.empty()) {
+    for (int i = 0; i < int(max_threads); i++) cpu_affinity.push_back(i);
+  }
+
   if (eval && filename.empty()) {
     throw std::runtime_error("missing script to evaluate");
   }
@@ -337,6 +381,14 @@ auto MainOptions::to_string() -> std::string {
   std::string str;
 
   if (threads > 1) list.push_back("--threads=" + std::to_string(threads));
+  if (!cpu_affinity.empty()) {
+    std::string cpus;
+    for (auto cpu : cpu_affinity) {
+      if (!cpus.empty()) cpus += ',';
+      cpus += std::to_string(cpu);
+    }
+    list.push_back("--cpu-affinity=" + cpus);
+  }
   if (!log_file.empty()) list.push_back("--log-file=" + log_file);
   switch (log_level) {
     case Log::DEBUG: {
@@ -380,6 +432,11 @@ auto MainOptions::to_string() -> std::string {
   if (!instance_uuid.empty()) list.push_back("--instance-uuid" + instance_uuid);
   if (!instance_name.empty()) list.push_back("--instance-name" + instance_name);
   if (reuse_port) list.push_back("--reuse-port");
+  if (!reuse_port_steering.empty()) list.push_back("--reuse-port-steering=" + reuse_port_steering);
+  if (io_uring) list.push_back("--io-uring");
+  if (!pjs_vm.empty()) list.push_back("--pjs-vm=" + pjs_vm);
+  if (!resolv_conf.empty()) list.push_back("--resolv-conf=" + resolv_conf);
+  if (!hosts_file.empty()) list.push_back("--hosts-file=" + hosts_file);
   if (admin_port_off) list.push_back("--admin-port-off");
   if (!admin_port.empty()) list.push_back("--admin-port=" + admin_port);
   if (!admin_gui.empty()) list.push_back("--admin-gui=" + admin_gui);
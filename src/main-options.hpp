@@ -56,7 +56,10 @@ public:
   bool        no_metrics = false;
   bool        force_start = false;
   bool        reuse_port = false;
+  bool        io_uring = false;
   int         threads = 1;
+  std::vector<int> cpu_affinity;
+  std::string reuse_port_steering;
   std::string log_file;
   Log::Level  log_level = Log::INFO;
   Log::Output log_local = Log::OUTPUT_STDERR;
@@ -72,6 +75,9 @@ public:
   std::string instance_uuid;
   std::string instance_name;
   std::string openssl_engine;
+  std::string pjs_vm;
+  std::string resolv_conf;
+  std::string hosts_file;
 
   pjs::Ref<crypto::Certificate>               admin_tls_cert;
   pjs::Ref<crypto::PrivateKey>                admin_tls_key;
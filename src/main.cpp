@@ -36,10 +36,13 @@
 #include "fs.hpp"
 #include "filters/tls.hpp"
 #include "input.hpp"
+#include "io-uring.hpp"
 #include "listener.hpp"
 #include "main-options.hpp"
 #include "net.hpp"
 #include "os-platform.hpp"
+#include "pjs/bytecode.hpp"
+#include "resolver.hpp"
 #include "status.hpp"
 #include "timer.hpp"
 #include "utils.hpp"
@@ -420,6 +423,19 @@ int pipy_main(int argc, char *argv[]) {
     Log::init();
     logging::Logger::set_history_size(opts.log_history_limit);
     Listener::set_reuse_port(opts.reuse_port);
+    if (opts.reuse_port_steering == "cpu") {
+      Listener::set_reuse_port_steering(Listener::ReusePortSteering::CPU);
+    } else if (opts.reuse_port_steering == "queue") {
+      Listener::set_reuse_port_steering(Listener::ReusePortSteering::QUEUE);
+    }
+    WorkerManager::get().cpu_affinity(opts.cpu_affinity);
+#ifdef PIPY_USE_IO_URING
+    IOUring::set_enabled(opts.io_uring);
+#else
+    if (opts.io_uring) Log::warn("[io_uring] io_uring is not supported in this build");
+#endif
+    pjs::Bytecode::set_enabled(opts.pjs_vm != "ast");
+    Resolver::set_config_files(opts.resolv_conf, opts.hosts_file);
     pjs::Math::init();
     crypto::Crypto::init(opts.openssl_engine);
     tls::TLSSession::init();
@@ -24,11 +24,13 @@
  */
 
 #include "outbound.hpp"
+#include "inbound.hpp"
 #include "constants.hpp"
 #include "pipeline.hpp"
 #include "utils.hpp"
 #include "log.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 #ifdef __linux__
@@ -53,6 +55,9 @@ thread_local pjs::Ref<stats::Histogram> Outbound::s_metric_conn_time;
 static const std::string s_localhost("localhost");
 static const std::string s_localhost_ip("127.0.0.1");
 
+// Connection Attempt Delay from RFC 8305
+static const double CONNECTION_ATTEMPT_DELAY = 0.25;
+
 Outbound::Outbound(EventTarget::Input *input, const Options &options)
   : m_options(options)
   , m_input(input)
@@ -257,7 +262,6 @@ void Outbound::init_metrics() {
 OutboundTCP::OutboundTCP(EventTarget::Input *output, const Outbound::Options &options)
   : pjs::ObjectTemplate<OutboundTCP, Outbound>(output, options)
   , SocketTCP(false, Outbound::m_options)
-  , m_resolver(Net::context())
 {
 }
 
@@ -311,13 +315,24 @@ void OutboundTCP::send(Event *evt) {
   SocketTCP::output(evt);
 }
 
+#ifdef __linux__
+
+void OutboundTCP::splice(Inbound *inbound) {
+  if (auto s = inbound->get_socket_tcp()) {
+    SocketTCP::splice(s);
+  }
+}
+
+#endif // __linux__
+
 void OutboundTCP::close() {
   asio::error_code ec;
   switch (state()) {
     case Outbound::State::resolving:
     case Outbound::State::connecting:
-      m_resolver.cancel();
+      m_resolve_request.cancel();
       m_connect_timer.cancel();
+      cancel_attempts();
       SocketTCP::socket().cancel(ec);
       break;
     case Outbound::State::connected:
@@ -376,45 +391,113 @@ void OutboundTCP::resolve() {
   }
 
   state(Outbound::State::resolving);
+  log_debug("resolving hostname...");
 
   const auto &host = (m_host == s_localhost ? s_localhost_ip : m_host);
 
-  m_resolver.async_resolve(
-    tcp::resolver::query(host, std::to_string(m_port)),
-    [this](
-      const std::error_code &ec,
-      tcp::resolver::results_type results
-    ) {
+  // Cached answers come back before resolve() returns
+  retain();
+  m_resolve_request.resolve(
+    host,
+    [this](const Resolver::Addresses &addresses, const char *error) {
       InputContext ic;
 
-      if (ec && options().connect_timeout > 0) {
-        m_connect_timer.cancel();
+      if (error) {
+        if (options().connect_timeout > 0) {
+          m_connect_timer.cancel();
+        }
+        if (Log::is_enabled(Log::OUTBOUND)) {
+          char desc[1000];
+          describe(desc, sizeof(desc));
+          Log::debug(Log::OUTBOUND, "%s cannot resolve hostname: %s", desc, error);
+        }
+        connect_error(StreamEnd::CANNOT_RESOLVE);
+
+      } else if (state() == Outbound::State::resolving) {
+        connect(addresses);
+      } else if (state() == Outbound::State::connecting) {
+        add_targets(addresses);
       }
+    },
+    [this](const Resolver::Addresses &addresses) {
+      InputContext ic;
+      if (state() == Outbound::State::resolving && !SocketTCP::socket().is_open()) {
+        connect(addresses);
+      }
+    }
+  );
+  release();
+}
 
-      if (ec != asio::error::operation_aborted) {
-        if (ec) {
-          if (Log::is_enabled(Log::OUTBOUND)) {
-            char desc[1000];
-            describe(desc, sizeof(desc));
-            Log::debug(Log::OUTBOUND, "%s cannot resolve hostname: %s", desc, ec.message().c_str());
-          }
-          connect_error(StreamEnd::CANNOT_RESOLVE);
+//
+// Connects to the resolved addresses in the Happy Eyeballs way (RFC 8305):
+// a new attempt starts whenever the previous one fails or has not
+// succeeded within the attempt delay, and the first to connect wins.
+//
 
-        } else if (state() == Outbound::State::resolving) {
-          auto &result = *results;
-          const auto &target = result.endpoint();
-          m_remote_addr = target.address().to_string();
-          m_remote_addr_str = nullptr;
-          connect(target);
-        }
+void OutboundTCP::connect(const Resolver::Addresses &addresses) {
+  m_targets.clear();
+  m_next_target = 0;
+  for (const auto &addr : addresses) {
+    m_targets.push_back(tcp::endpoint(addr, m_port));
+  }
+
+  if (m_targets.empty()) {
+    if (options().connect_timeout > 0) {
+      m_connect_timer.cancel();
+    }
+    connect_error(StreamEnd::CANNOT_RESOLVE);
+    return;
+  }
+
+  // A socket already bound to a local address can only try one target
+  auto &s = SocketTCP::socket();
+  if (s.is_open()) {
+    asio::error_code ec;
+    auto is_v6 = s.local_endpoint(ec).address().is_v6();
+    auto target = m_targets.front();
+    for (const auto &t : m_targets) {
+      if (t.address().is_v6() == is_v6) {
+        target = t;
+        break;
       }
+    }
+    m_remote_addr = target.address().to_string();
+    m_remote_addr_str = nullptr;
+    connect(target);
+    return;
+  }
 
-      release();
+  state(Outbound::State::connecting);
+  connect_next();
+}
+
+//
+// Takes in the full answer after connecting has started with the
+// addresses of one family only
+//
+
+void OutboundTCP::add_targets(const Resolver::Addresses &addresses) {
+  auto has_next = (m_next_target < m_targets.size());
+  for (const auto &addr : addresses) {
+    tcp::endpoint ep(addr, m_port);
+    if (std::find(m_targets.begin(), m_targets.end(), ep) == m_targets.end()) {
+      m_targets.push_back(ep);
     }
-  );
+  }
 
-  log_debug("resolving hostname...");
-  retain();
+  if (m_next_target >= m_targets.size()) {
+    if (m_attempts.empty()) {
+      if (options().connect_timeout > 0) {
+        m_connect_timer.cancel();
+      }
+      connect_error(StreamEnd::CONNECTION_REFUSED);
+    }
+  } else if (m_attempts.empty()) {
+    connect_next();
+  } else if (!has_next) {
+    schedule_next();
+  }
 }
 
 void OutboundTCP::connect(const asio::ip::tcp::endpoint &target) {
@@ -445,48 +528,146 @@ void OutboundTCP::connect(const asio::ip::tcp::endpoint &target) {
           connect_error(StreamEnd::CONNECTION_REFUSED);
 
         } else if (state() == Outbound::State::connecting) {
-          const auto &ep = socket().local_endpoint();
-          m_local_addr = ep.address().to_string();
-          m_local_port = ep.port();
-          m_local_addr_str = nullptr;
+          connected();
+        }
+      }
 
-          auto conn_time = utils::now() - m_start_time;
-          m_connection_time += conn_time;
-          m_metric_conn_time->observe(conn_time);
-          s_metric_conn_time->observe(conn_time);
+      release();
+    }
+  );
 
-          if (Log::is_enabled(Log::OUTBOUND)) {
-            char desc[200];
-            describe(desc, sizeof(desc));
-            Log::debug(Log::OUTBOUND, "%s connected in %g ms", desc, conn_time);
-          }
+  retain();
+}
 
-          state(Outbound::State::connected);
-          retain();
-          SocketTCP::open();
-        }
-      }
+void OutboundTCP::connect_next() {
+  pjs::Ref<Attempt> attempt(new Attempt(m_targets[m_next_target++]));
+  m_attempts.push_back(attempt);
+
+  m_remote_addr = attempt->target.address().to_string();
+  m_remote_addr_str = nullptr;
+
+  if (Log::is_enabled(Log::OUTBOUND)) {
+    char desc[200];
+    describe(desc, sizeof(desc));
+    Log::debug(Log::OUTBOUND, "%s connecting...", desc);
+  }
 
+  attempt->socket.async_connect(
+    attempt->target,
+    [=](const std::error_code &ec) {
+      connect_attempt(attempt, ec);
       release();
     }
   );
 
   retain();
+  schedule_next();
+}
+
+void OutboundTCP::schedule_next() {
+  if (m_next_target < m_targets.size()) {
+    m_attempt_timer.schedule(
+      CONNECTION_ATTEMPT_DELAY,
+      [this]() {
+        if (state() == Outbound::State::connecting && m_next_target < m_targets.size()) {
+          connect_next();
+        }
+      }
+    );
+  }
+}
+
+void OutboundTCP::connect_attempt(Attempt *attempt, const std::error_code &ec) {
+  InputContext ic;
+
+  if (ec == asio::error::operation_aborted) return;
+  if (state() != Outbound::State::connecting) return;
+
+  auto i = std::find_if(
+    m_attempts.begin(), m_attempts.end(),
+    [=](const pjs::Ref<Attempt> &a) { return a.get() == attempt; }
+  );
+  if (i == m_attempts.end()) return;
+  pjs::Ref<Attempt> ref(attempt);
+  m_attempts.erase(i);
+
+  if (ec) {
+    if (Log::is_enabled(Log::OUTBOUND)) {
+      char desc[200];
+      describe(desc, sizeof(desc));
+      auto addr = attempt->target.address().to_string();
+      Log::debug(Log::OUTBOUND, "%s cannot connect to %s: %s", desc, addr.c_str(), ec.message().c_str());
+    }
+    if (m_next_target < m_targets.size()) {
+      m_attempt_timer.cancel();
+      connect_next();
+    } else if (m_attempts.empty() && !m_resolve_request.pending()) {
+      if (options().connect_timeout > 0) {
+        m_connect_timer.cancel();
+      }
+      connect_error(StreamEnd::CONNECTION_REFUSED);
+    }
+    return;
+  }
+
+  m_resolve_request.cancel();
+  cancel_attempts();
+
+  if (options().connect_timeout > 0) {
+    m_connect_timer.cancel();
+  }
+
+  m_remote_addr = attempt->target.address().to_string();
+  m_remote_addr_str = nullptr;
+  SocketTCP::socket() = std::move(attempt->socket);
+  connected();
 }
 
 void OutboundTCP::connect_error(StreamEnd::Error err) {
+  m_resolve_request.cancel();
+  cancel_attempts();
   if (options().retry_count >= 0 && m_retries >= options().retry_count) {
     error(err);
   } else {
     m_retries++;
     std::error_code ec;
     socket().close(ec);
-    m_resolver.cancel();
     state(Outbound::State::idle);
     start(options().retry_delay);
   }
 }
 
+void OutboundTCP::connected() {
+  const auto &ep = socket().local_endpoint();
+  m_local_addr = ep.address().to_string();
+  m_local_port = ep.port();
+  m_local_addr_str = nullptr;
+
+  auto conn_time = utils::now() - m_start_time;
+  m_connection_time += conn_time;
+  m_metric_conn_time->observe(conn_time);
+  s_metric_conn_time->observe(conn_time);
+
+  if (Log::is_enabled(Log::OUTBOUND)) {
+    char desc[200];
+    describe(desc, sizeof(desc));
+    Log::debug(Log::OUTBOUND, "%s connected in %g ms", desc, conn_time);
+  }
+
+  state(Outbound::State::connected);
+  retain();
+  SocketTCP::open();
+}
+
+void OutboundTCP::cancel_attempts() {
+  m_attempt_timer.cancel();
+  for (const auto &a : m_attempts) {
+    std::error_code ec;
+    a->socket.close(ec);
+  }
+  m_attempts.clear();
+}
+
 auto OutboundTCP::wrap_socket() -> Socket* {
   return Socket::make(SocketTCP::socket().native_handle());
 }
@@ -32,6 +32,7 @@
 #include "input.hpp"
 #include "timer.hpp"
 #include "list.hpp"
+#include "resolver.hpp"
 #include "api/ip.hpp"
 #include "api/stats.hpp"
 
@@ -40,6 +41,7 @@
 namespace pipy {
 
 class Data;
+class Inbound;
 
 //
 // Outbound
@@ -176,6 +178,10 @@ class OutboundTCP :
 public:
   auto buffered() const -> size_t { return SocketTCP::buffered(); }
 
+#ifdef __linux__
+  void splice(Inbound *inbound);
+#endif
+
   virtual void bind(const std::string &address) override;
   virtual void connect(const std::string &address) override;
   virtual void connect(IP *ip, int port) override;
@@ -186,14 +192,44 @@ private:
   OutboundTCP(EventTarget::Input *output, const Outbound::Options &options);
   ~OutboundTCP();
 
-  asio::ip::tcp::resolver m_resolver;
+  //
+  // OutboundTCP::Attempt
+  //
+  // One of the connections raced to the resolved addresses
+  //
+
+  class Attempt :
+    public pjs::RefCount<Attempt>,
+    public pjs::Pooled<Attempt>
+  {
+  public:
+    Attempt(const asio::ip::tcp::endpoint &ep)
+      : socket(Net::context())
+      , target(ep) {}
+
+    asio::ip::tcp::socket socket;
+    asio::ip::tcp::endpoint target;
+  };
+
+  Resolver::Request m_resolve_request;
+  std::vector<asio::ip::tcp::endpoint> m_targets;
+  std::vector<pjs::Ref<Attempt>> m_attempts;
+  size_t m_next_target = 0;
   Timer m_connect_timer;
   Timer m_retry_timer;
+  Timer m_attempt_timer;
 
   void start(double delay);
   void resolve();
+  void connect(const Resolver::Addresses &addresses);
   void connect(const asio::ip::tcp::endpoint &target);
+  void connect_next();
+  void schedule_next();
+  void add_targets(const Resolver::Addresses &addresses);
+  void connect_attempt(Attempt *attempt, const std::error_code &ec);
   void connect_error(StreamEnd::Error err);
+  void connected();
+  void cancel_attempts();
 
   virtual auto wrap_socket() -> Socket* override;
   virtual auto get_buffered() const -> size_t override { return SocketTCP::buffered(); }
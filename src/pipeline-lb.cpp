@@ -27,12 +27,15 @@
 #include "module.hpp"
 #include "input.hpp"
 
+#include <map>
+
 namespace pipy {
 
 PipelineLoadBalancer::~PipelineLoadBalancer() {
-  for (const auto &m : m_modules) {
-    for (const auto &p : m.second.pipelines) {
-      auto t = p.second.targets;
+  for (auto &b : m_table) {
+    auto p = b.load(std::memory_order_relaxed);
+    while (p) {
+      auto t = p->targets.load(std::memory_order_relaxed);
       while (t) {
         auto pl = t->layout.release();
         t->net->post(
@@ -43,6 +46,8 @@ PipelineLoadBalancer::~PipelineLoadBalancer() {
         auto target = t; t = t->next;
         delete target;
       }
+      auto info = p; p = p->next;
+      delete info;
     }
   }
 }
@@ -50,52 +55,89 @@ PipelineLoadBalancer::~PipelineLoadBalancer() {
 void PipelineLoadBalancer::add_target(PipelineLayout *layout) {
   std::lock_guard<std::mutex> lock(m_mutex);
   auto *m = static_cast<Module*>(layout->module());
-  auto &p = m_modules[m->filename()->str()].pipelines[layout->name()->str()];
-  auto *t = new Target;
-  t->net = &Net::current();
-  t->layout = layout;
-  t->next = p.targets;
-  p.targets = t;
+  const auto &module = m->filename()->str();
+  const auto &name = layout->name()->str();
+  auto h = hash(module, name);
+  auto p = find(module, name, h);
+  if (!p) {
+    auto &b = m_table[h % TABLE_SIZE];
+    p = new PipelineInfo(module, name);
+    p->next = b.load(std::memory_order_relaxed);
+    b.store(p, std::memory_order_release);
+  }
+  p->add(&Net::current(), layout);
 }
 
 auto PipelineLoadBalancer::allocate(const std::string &module, const std::string &name, EventTarget::Input *output) -> AsyncWrapper* {
-  std::lock_guard<std::mutex> lock(m_mutex);
-  auto i = m_modules.find(module); if (i == m_modules.end()) return nullptr;
-  auto j = i->second.pipelines.find(name); if (j == i->second.pipelines.end()) return nullptr;
-  auto t = j->second.current;
-  if (!t) t = j->second.targets;
-  if (!t) return nullptr;
-  j->second.current = t->next;
+  auto p = find(module, name, hash(module, name)); if (!p) return nullptr;
+  auto t = p->next_target(); if (!t) return nullptr;
   return new AsyncWrapper(t->net, t->layout, output);
 }
 
+auto PipelineLoadBalancer::hash(const std::string &module, const std::string &name) -> size_t {
+  std::hash<std::string> h;
+  return h(module) * 31 + h(name);
+}
+
+auto PipelineLoadBalancer::find(const std::string &module, const std::string &name, size_t h) -> PipelineInfo* {
+  auto p = m_table[h % TABLE_SIZE].load(std::memory_order_acquire);
+  while (p) {
+    if (p->name == name && p->module == module) return p;
+    p = p->next;
+  }
+  return nullptr;
+}
+
+//
+// PipelineLoadBalancer::PipelineInfo
+//
+
+void PipelineLoadBalancer::PipelineInfo::add(Net *net, PipelineLayout *layout) {
+  auto *t = new Target;
+  t->net = net;
+  t->layout = layout;
+  t->next = targets.load(std::memory_order_relaxed);
+  targets.store(t, std::memory_order_release);
+  target_count.fetch_add(1, std::memory_order_release);
+}
+
+auto PipelineLoadBalancer::PipelineInfo::next_target() -> Target* {
+  auto n = target_count.load(std::memory_order_acquire);
+  if (!n) return nullptr;
+  auto i = cursor.fetch_add(1, std::memory_order_relaxed) % n;
+  auto t = targets.load(std::memory_order_acquire);
+  while (i-- > 0) t = t->next;
+  return t;
+}
+
 //
 // PipelineLoadBalancer::AsyncWrapper
 //
 
 PipelineLoadBalancer::AsyncWrapper::AsyncWrapper(Net *net, PipelineLayout *layout, EventTarget::Input *output)
-  : m_input_net(net)
+  : m_input_channel(Channel::get(net))
   , m_output_net(&Net::current())
   , m_pipeline_layout(layout)
   , m_output(output)
 {
   retain();
-  m_input_net->io_context().post(OpenHandler(this));
+  m_input_channel->send(this, Channel::Op::OPEN);
 }
 
 void PipelineLoadBalancer::AsyncWrapper::input(Event *evt) {
   retain();
-  m_input_net->io_context().post(InputHandler(this, SharedEvent::make(evt)));
+  m_input_channel->send(this, Channel::Op::INPUT, SharedEvent::make(evt));
 }
 
 void PipelineLoadBalancer::AsyncWrapper::close() {
   m_output = nullptr;
-  m_input_net->io_context().post(CloseHandler(this));
+  m_input_channel->send(this, Channel::Op::CLOSE);
 }
 
 void PipelineLoadBalancer::AsyncWrapper::on_event(Event *evt) {
   retain();
-  m_output_net->io_context().post(OutputHandler(this, SharedEvent::make(evt)));
+  if (!m_output_channel) m_output_channel = Channel::get(m_output_net);
+  m_output_channel->send(this, Channel::Op::OUTPUT, SharedEvent::make(evt));
 }
 
 void PipelineLoadBalancer::AsyncWrapper::on_open() {
@@ -109,6 +151,7 @@ void PipelineLoadBalancer::AsyncWrapper::on_open() {
 void PipelineLoadBalancer::AsyncWrapper::on_close() {
   m_pipeline = nullptr;
   m_pipeline_layout = nullptr;
+  m_output_channel = nullptr;
   EventTarget::close();
   release();
 }
@@ -139,4 +182,48 @@ void PipelineLoadBalancer::AsyncWrapper::on_output(SharedEvent *se) {
   release();
 }
 
+//
+// PipelineLoadBalancer::Channel
+//
+
+auto PipelineLoadBalancer::Channel::get(Net *net) -> Channel* {
+  thread_local static std::map<Net*, pjs::Ref<Channel>> s_channels;
+  auto &c = s_channels[net];
+  if (!c) c = new Channel(net);
+  return c;
+}
+
+void PipelineLoadBalancer::Channel::send(AsyncWrapper *aw, Op op, SharedEvent *se) {
+  if (se) se->retain();
+  m_queue.push({ aw, se, op });
+  schedule();
+}
+
+void PipelineLoadBalancer::Channel::schedule() {
+  if (!m_scheduled.exchange(true, std::memory_order_acq_rel)) {
+    retain();
+    m_net->io_context().post(DrainHandler(this));
+  }
+}
+
+void PipelineLoadBalancer::Channel::drain() {
+  m_scheduled.exchange(false, std::memory_order_acq_rel);
+
+  Message msg;
+  int n = 0;
+  while (n < MAX_BATCH && m_queue.pop(msg)) {
+    switch (msg.op) {
+      case Op::OPEN: msg.aw->on_open(); break;
+      case Op::CLOSE: msg.aw->on_close(); break;
+      case Op::INPUT: msg.aw->on_input(msg.se); break;
+      case Op::OUTPUT: msg.aw->on_output(msg.se); break;
+    }
+    if (msg.se) msg.se->release();
+    n++;
+  }
+
+  if (n == MAX_BATCH) schedule();
+  release();
+}
+
 } // namespace pipy
@@ -29,9 +29,11 @@
 #include "event.hpp"
 #include "net.hpp"
 #include "pipeline.hpp"
+#include "spsc-queue.hpp"
 
+#include <atomic>
 #include <mutex>
-#include <map>
+#include <string>
 
 namespace pipy {
 
@@ -49,6 +51,8 @@ public:
   // AsyncWrapper
   //
 
+  class Channel;
+
   class AsyncWrapper :
     public pjs::Pooled<AsyncWrapper>,
     public pjs::RefCountMT<AsyncWrapper>,
@@ -60,34 +64,6 @@ public:
   private:
     AsyncWrapper(Net *net, PipelineLayout *layout, EventTarget::Input *output);
 
-    struct OpenHandler : SelfHandlerMT<AsyncWrapper> {
-      using SelfHandlerMT::SelfHandlerMT;
-      OpenHandler(const OpenHandler &r) : SelfHandlerMT(r) {}
-      void operator()() { self->on_open(); }
-    };
-
-    struct CloseHandler : SelfHandlerMT<AsyncWrapper> {
-      using SelfHandlerMT::SelfHandlerMT;
-      CloseHandler(const CloseHandler &r) : SelfHandlerMT(r) {}
-      void operator()() { self->on_close(); }
-    };
-
-    struct InputHandler : SelfDataHandlerMT<AsyncWrapper, SharedEvent> {
-      using SelfDataHandlerMT::SelfDataHandlerMT;
-      InputHandler(AsyncWrapper *s, SharedEvent *d) : SelfDataHandlerMT(s, d) { d->retain(); }
-      InputHandler(const InputHandler &r) : SelfDataHandlerMT(r) { r.data->retain(); }
-      ~InputHandler() { data->release(); }
-      void operator()() { self->on_input(data); }
-    };
-
-    struct OutputHandler : SelfDataHandlerMT<AsyncWrapper, SharedEvent> {
-      using SelfDataHandlerMT::SelfDataHandlerMT;
-      OutputHandler(AsyncWrapper *s, SharedEvent *d) : SelfDataHandlerMT(s, d) { d->retain(); }
-      OutputHandler(const OutputHandler &r) : SelfDataHandlerMT(r) { r.data->retain(); }
-      ~OutputHandler() { data->release(); }
-      void operator()() { self->on_output(data); }
-    };
-
     virtual void on_event(Event *evt) override;
 
     void on_open();
@@ -95,8 +71,9 @@ public:
     void on_input(SharedEvent *se);
     void on_output(SharedEvent *se);
 
-    Net* m_input_net;
+    pjs::Ref<Channel> m_input_channel;
     Net* m_output_net;
+    pjs::Ref<Channel> m_output_channel;
     pjs::Ref<PipelineLayout> m_pipeline_layout;
     pjs::Ref<Pipeline> m_pipeline;
     pjs::Ref<EventTarget::Input> m_output;
@@ -105,6 +82,49 @@ public:
     friend class PipelineLoadBalancer;
   };
 
+  //
+  // PipelineLoadBalancer::Channel
+  //
+  // Carries events from the current thread to another one. Events are
+  // queued on a lock-free ring and drained in batches by a single
+  // handler on the receiving side, instead of one post per event.
+  //
+
+  class Channel : public pjs::RefCountMT<Channel> {
+  public:
+    static auto get(Net *net) -> Channel*;
+
+    enum class Op { OPEN, CLOSE, INPUT, OUTPUT };
+
+    void send(AsyncWrapper *aw, Op op, SharedEvent *se = nullptr);
+
+  private:
+    Channel(Net *net) : m_net(net), m_scheduled(false) {}
+
+    enum { MAX_BATCH = 1024 };
+
+    struct Message {
+      AsyncWrapper* aw;
+      SharedEvent* se;
+      Op op;
+    };
+
+    struct DrainHandler : SelfHandlerMT<Channel> {
+      using SelfHandlerMT::SelfHandlerMT;
+      DrainHandler(const DrainHandler &r) : SelfHandlerMT(r) {}
+      void operator()() { self->drain(); }
+    };
+
+    Net* m_net;
+    SPSCQueue<Message> m_queue;
+    std::atomic<bool> m_scheduled;
+
+    void schedule();
+    void drain();
+
+    friend class pjs::RefCountMT<Channel>;
+  };
+
   void add_target(PipelineLayout *target);
   auto allocate(const std::string &module, const std::string &name, EventTarget::Input *output) -> AsyncWrapper*;
 
@@ -126,24 +146,31 @@ private:
   // PipelineLoadBalancer::PipelineInfo
   //
 
+  // Entries and targets are only ever added, under m_mutex, and
+  // published with release stores so that allocate() can look them
+  // up from any thread without taking the lock.
+
   struct PipelineInfo {
-    Target* targets = nullptr;
-    Target* current = nullptr;
+    std::string module;
+    std::string name;
+    PipelineInfo* next = nullptr;
+    std::atomic<Target*> targets;
+    std::atomic<size_t> target_count;
+    std::atomic<size_t> cursor;
+    PipelineInfo(const std::string &m, const std::string &n)
+      : module(m), name(n), targets(nullptr), target_count(0), cursor(0) {}
     void add(Net *net, PipelineLayout *layout);
-    auto next() -> Net*;
+    auto next_target() -> Target*;
   };
 
-  //
-  // PipelineLoadBalancer::ModuleInfo
-  //
-
-  struct ModuleInfo {
-    std::map<std::string, PipelineInfo> pipelines;
-  };
+  enum { TABLE_SIZE = 256 };
 
-  std::map<std::string, ModuleInfo> m_modules;
+  std::atomic<PipelineInfo*> m_table[TABLE_SIZE] = {};
   std::mutex m_mutex;
 
+  static auto hash(const std::string &module, const std::string &name) -> size_t;
+  auto find(const std::string &module, const std::string &name, size_t h) -> PipelineInfo*;
+
   friend class pjs::RefCountMT<PipelineLoadBalancer>;
 };
 
@@ -194,6 +194,10 @@ Pipeline::~Pipeline() {
   }
 }
 
+auto Pipeline::head() const -> Filter* {
+  return m_filters.head();
+}
+
 void Pipeline::start(const pjs::Value &args) {
   if (args.is_empty()) {
     start();
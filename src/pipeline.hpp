@@ -106,6 +106,7 @@ public:
   auto name_or_label() const -> pjs::Str*;
   auto allocated() const -> size_t { return m_allocated; }
   auto active() const -> size_t { return m_pipelines.size(); }
+  auto filter_count() const -> size_t { return m_filters.size(); }
   void on_start_location(pjs::Context::Location &loc) { m_on_start_location = loc; }
   void on_start(pjs::Object *e) { m_on_start = e; }
   void on_end(pjs::Function *f) { m_on_end = f; }
@@ -184,6 +185,7 @@ public:
 
   auto layout() const -> PipelineLayout* { return m_layout; }
   auto context() const -> Context* { return m_context; }
+  auto head() const -> Filter*;
   auto chain() const -> PipelineLayout::Chain* { return m_chain; }
   void chain(Input *input) { EventProxy::chain(input); }
   void chain(PipelineLayout::Chain *chain, const pjs::Value &args = pjs::Value::undefined) { m_chain = chain; m_chain_args = args; }
@@ -0,0 +1,370 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bytecode.hpp"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PJS_BYTECODE_COMPUTED_GOTO
+#endif
+
+namespace pjs {
+
+static const char* s_opcode_names[] = {
+  "eval", "const", "local", "get", "function", "call",
+  "jump", "jump-if-false", "jump-if-true", "jump-if-defined",
+  "pos", "neg", "bit-not", "bool-not",
+  "add", "sub", "mul", "div", "rem", "pow",
+  "shl", "shr", "usr", "bit-and", "bit-or", "bit-xor",
+  "eql", "neq", "same", "diff", "gt", "ge", "lt", "le",
+  "return",
+};
+
+static_assert(
+  sizeof(s_opcode_names) / sizeof(s_opcode_names[0]) == Bytecode::OPCODE_COUNT,
+  "opcode name table out of sync"
+);
+
+static bool throw_error(Context &ctx, Expr *node, const std::string &msg) {
+  ctx.error(msg);
+  ctx.backtrace(node->source(), node->line(), node->column());
+  return false;
+}
+
+//
+// Bytecode
+//
+
+bool Bytecode::s_enabled = true;
+
+void Bytecode::compile(std::unique_ptr<Expr> &expr) {
+  if (!s_enabled || !expr) return;
+  if (dynamic_cast<Bytecode*>(expr.get())) return;
+  auto code = new Bytecode(expr.release());
+  if (code->build()) {
+    expr.reset(code);
+  } else {
+    expr.reset(code->m_source.release());
+    delete code;
+  }
+}
+
+Bytecode::Bytecode(Expr *source)
+  : m_source(source)
+{
+  locate(source->source(), source->line(), source->column());
+}
+
+bool Bytecode::build() {
+  m_code.clear();
+  m_constants.clear();
+  m_sites.clear();
+  m_registers = m_top = 1;
+  m_native = 0;
+  m_overflow = false;
+  m_source->compile(*this, 0);
+  emit(RETURN, 0);
+
+  // Out of encodable registers, constants or jump range:
+  // run the whole tree as a single instruction instead
+  if (m_overflow) {
+    m_code.clear();
+    m_constants.clear();
+    m_sites.clear();
+    m_registers = m_top = 1;
+    m_native = 0;
+    m_overflow = false;
+    fallback(m_source.get(), 0);
+    emit(RETURN, 0);
+    return false;
+  }
+
+  // Not worth it for a lone literal or variable
+  return m_native > 2;
+}
+
+auto Bytecode::alloc() -> int {
+  auto reg = m_top++;
+  if (m_top > m_registers) m_registers = m_top;
+  if (m_top > 0x100) m_overflow = true;
+  return reg;
+}
+
+void Bytecode::emit(Opcode op, int a, int b, int c, int d) {
+  if (a > 0xff || b > 0xffff || c > 0xffff || d > 0xffff || m_code.size() >= 0xffff) {
+    m_overflow = true;
+    return;
+  }
+  Instruction ins;
+  ins.op = op;
+  ins.a = a;
+  ins.b = b;
+  ins.c = c;
+  ins.d = d;
+  m_code.push_back(ins);
+  if (op != EVAL) m_native++;
+}
+
+void Bytecode::load(int reg, const Value &v) {
+  emit(CONST, reg, m_constants.size());
+  m_constants.push_back(v);
+}
+
+void Bytecode::unary(Opcode op, Expr *x, int reg) {
+  auto t = alloc();
+  x->compile(*this, t);
+  emit(op, reg, t);
+  free(t);
+}
+
+void Bytecode::binary(Opcode op, Expr *a, Expr *b, int reg) {
+  auto ta = alloc();
+  auto tb = alloc();
+  a->compile(*this, ta);
+  b->compile(*this, tb);
+  emit(op, reg, ta, tb);
+  free(ta);
+}
+
+void Bytecode::fallback(Expr *node, int reg) {
+  emit(EVAL, reg, site(node));
+}
+
+auto Bytecode::site(Expr *node, PropertyCache *cache, Module *module) -> int {
+  Site s;
+  s.node = node;
+  s.cache = cache;
+  s.module = module;
+  m_sites.push_back(s);
+  return m_sites.size() - 1;
+}
+
+auto Bytecode::jump(Opcode op, int reg) -> int {
+  emit(op, reg);
+  return m_code.size() - 1;
+}
+
+void Bytecode::land(int jump) {
+  if (m_overflow) return;
+  m_code[jump].b = m_code.size();
+}
+
+bool Bytecode::eval(Context &ctx, Value &result) {
+  vl_array<Value, 16> r(m_registers);
+  if (!run(ctx, r)) return false;
+  result = std::move(r[0]);
+  return true;
+}
+
+void Bytecode::resolve(Module *module, Context &ctx, int l, LegacyImports *imports) {
+  m_source->resolve(module, ctx, l, imports);
+  build();
+}
+
+auto Bytecode::reduce(Reducer &r) -> Reducer::Value* {
+  return m_source->reduce(r);
+}
+
+void Bytecode::dump(std::ostream &out, const std::string &indent) {
+  out << indent << "bytecode" << std::endl;
+  for (size_t i = 0; i < m_code.size(); i++) {
+    const auto &ins = m_code[i];
+    out << indent << "  " << i << ' ' << s_opcode_names[ins.op];
+    out << ' ' << int(ins.a) << ' ' << ins.b << ' ' << ins.c << ' ' << ins.d << std::endl;
+  }
+}
+
+//
+// The interpreter loop. Dispatches with computed gotos where the
+// compiler supports them and falls back to a plain switch otherwise.
+//
+
+#ifdef PJS_BYTECODE_COMPUTED_GOTO
+#define VM_CASE(op) case op: L_##op
+#define VM_DISPATCH() goto *labels[pc->op]
+#else
+#define VM_CASE(op) case op
+#define VM_DISPATCH() goto dispatch
+#endif
+
+#define VM_NEXT() { pc++; VM_DISPATCH(); }
+#define VM_JUMP(target) { pc = code + (target); VM_DISPATCH(); }
+
+#define VM_UNARY(op, expr_class) \
+  VM_CASE(op): expr::expr_class::operate(r[pc->b], r[pc->a]); VM_NEXT();
+
+#define VM_BINARY(op, expr_class) \
+  VM_CASE(op): expr::expr_class::operate(r[pc->b], r[pc->c], r[pc->a]); VM_NEXT();
+
+#define VM_ARITHMETIC(op, expr_class, operator) \
+  VM_CASE(op): { \
+    auto &a = r[pc->b]; \
+    auto &b = r[pc->c]; \
+    if (a.is_number() && b.is_number()) { \
+      r[pc->a].set(a.n() operator b.n()); \
+    } else { \
+      expr::expr_class::operate(a, b, r[pc->a]); \
+    } \
+  } VM_NEXT();
+
+bool Bytecode::run(Context &ctx, Value *r) {
+  const auto *code = m_code.data();
+  const auto *pc = code;
+
+#ifdef PJS_BYTECODE_COMPUTED_GOTO
+  static const void* labels[] = {
+    &&L_EVAL, &&L_CONST, &&L_LOCAL, &&L_GET, &&L_FUNCTION, &&L_CALL,
+    &&L_JUMP, &&L_JUMP_IF_FALSE, &&L_JUMP_IF_TRUE, &&L_JUMP_IF_DEFINED,
+    &&L_POS, &&L_NEG, &&L_BIT_NOT, &&L_BOOL_NOT,
+    &&L_ADD, &&L_SUB, &&L_MUL, &&L_DIV, &&L_REM, &&L_POW,
+    &&L_SHL, &&L_SHR, &&L_USR, &&L_BIT_AND, &&L_BIT_OR, &&L_BIT_XOR,
+    &&L_EQL, &&L_NEQ, &&L_SAME, &&L_DIFF, &&L_GT, &&L_GE, &&L_LT, &&L_LE,
+    &&L_RETURN,
+  };
+  static_assert(sizeof(labels) / sizeof(labels[0]) == OPCODE_COUNT, "dispatch table out of sync");
+  VM_DISPATCH();
+#else
+dispatch:
+#endif
+
+  switch (pc->op) {
+
+    VM_CASE(EVAL): {
+      if (!m_sites[pc->b].node->eval(ctx, r[pc->a])) return false;
+    } VM_NEXT();
+
+    VM_CASE(CONST): {
+      r[pc->a] = m_constants[pc->b];
+    } VM_NEXT();
+
+    VM_CASE(LOCAL): {
+      auto *scope = ctx.scope();
+      for (int i = pc->c; i > 0; i--) scope = scope->parent();
+      r[pc->a] = scope->value(pc->b);
+    } VM_NEXT();
+
+    VM_CASE(GET): {
+      auto &obj = r[pc->b];
+      auto &key = r[pc->c];
+      auto &site = m_sites[pc->d];
+      if (obj.is_undefined()) return throw_error(ctx, site.node, "cannot read property of undefined");
+      if (obj.is_null()) return throw_error(ctx, site.node, "cannot read property of null");
+      if (obj.is_object() && key.is_string() && !obj.o()->type()->has_seti()) {
+        site.cache->get(obj.o(), key.s(), r[pc->a]);
+        VM_NEXT();
+      }
+      auto o = obj.to_object();
+      auto c = o->type();
+      if (c->has_seti()) {
+        auto i = key.to_number();
+        if (std::isfinite(i)) {
+          c->geti(o, i, r[pc->a]);
+          o->release();
+          VM_NEXT();
+        }
+      }
+      auto k = key.to_string();
+      site.cache->get(o, k, r[pc->a]);
+      k->release();
+      o->release();
+    } VM_NEXT();
+
+    VM_CASE(FUNCTION): {
+      if (!r[pc->a].is_function()) return throw_error(ctx, m_sites[pc->b].node, "not a function");
+    } VM_NEXT();
+
+    VM_CASE(CALL): {
+      auto &site = m_sites[pc->d];
+      auto *node = site.node;
+      ctx.trace(site.module, node->line(), node->column());
+      (*r[pc->b].as<Function>())(ctx, pc->c, r + pc->b + 1, r[pc->a]);
+      if (!ctx.ok()) {
+        ctx.backtrace(node->source(), node->line(), node->column());
+        return false;
+      }
+    } VM_NEXT();
+
+    VM_CASE(JUMP): VM_JUMP(pc->b);
+
+    VM_CASE(JUMP_IF_FALSE): {
+      if (!r[pc->a].to_boolean()) VM_JUMP(pc->b);
+    } VM_NEXT();
+
+    VM_CASE(JUMP_IF_TRUE): {
+      if (r[pc->a].to_boolean()) VM_JUMP(pc->b);
+    } VM_NEXT();
+
+    VM_CASE(JUMP_IF_DEFINED): {
+      auto &v = r[pc->a];
+      if (!v.is_undefined() && !v.is_null()) VM_JUMP(pc->b);
+    } VM_NEXT();
+
+    VM_UNARY(POS, Plus)
+
+    VM_CASE(NEG): {
+      auto &x = r[pc->b];
+      if (x.is_number()) {
+        r[pc->a].set(-x.n());
+      } else {
+        expr::Negation::operate(x, r[pc->a]);
+      }
+    } VM_NEXT();
+
+    VM_UNARY(BIT_NOT, BitwiseNot)
+
+    VM_CASE(BOOL_NOT): {
+      r[pc->a].set(!r[pc->b].to_boolean());
+    } VM_NEXT();
+
+    VM_ARITHMETIC(ADD, Addition, +)
+    VM_ARITHMETIC(SUB, Subtraction, -)
+    VM_ARITHMETIC(MUL, Multiplication, *)
+    VM_ARITHMETIC(DIV, Division, /)
+    VM_BINARY(REM, Remainder)
+    VM_BINARY(POW, Exponentiation)
+    VM_BINARY(SHL, ShiftLeft)
+    VM_BINARY(SHR, ShiftRight)
+    VM_BINARY(USR, UnsignedShiftRight)
+    VM_BINARY(BIT_AND, BitwiseAnd)
+    VM_BINARY(BIT_OR, BitwiseOr)
+    VM_BINARY(BIT_XOR, BitwiseXor)
+    VM_BINARY(EQL, Equality)
+    VM_BINARY(NEQ, Inequality)
+    VM_BINARY(SAME, Identity)
+    VM_BINARY(DIFF, Nonidentity)
+    VM_ARITHMETIC(GT, GreaterThan, >)
+    VM_ARITHMETIC(GE, GreaterThanOrEqual, >=)
+    VM_ARITHMETIC(LT, LessThan, <)
+    VM_ARITHMETIC(LE, LessThanOrEqual, <=)
+
+    VM_CASE(RETURN):
+      return true;
+
+    default: break;
+  }
+
+  return false;
+}
+
+} // namespace pjs
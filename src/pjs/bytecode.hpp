@@ -0,0 +1,130 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PJS_BYTECODE_HPP
+#define PJS_BYTECODE_HPP
+
+#include "expr.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace pjs {
+
+//
+// Bytecode
+//
+// An expression tree lowered to a flat sequence of register-machine
+// instructions. Nodes without a native lowering are kept as EVAL
+// instructions that call back into the tree, so semantics and error
+// backtraces are the same as with plain tree walking.
+//
+
+class Bytecode : public Expr {
+public:
+  enum Opcode : uint8_t {
+    EVAL,             // r[a] = sites[b].node->eval()
+    CONST,            // r[a] = constants[b]
+    LOCAL,            // r[a] = scope(c)->value(b)
+    GET,              // r[a] = r[b][r[c]]
+    FUNCTION,         // throw unless r[a] is a function
+    CALL,             // r[a] = r[b](r[b+1] ... r[b+c])
+    JUMP,             // goto b
+    JUMP_IF_FALSE,    // if (!r[a]) goto b
+    JUMP_IF_TRUE,     // if (r[a]) goto b
+    JUMP_IF_DEFINED,  // if (r[a] != null && r[a] != undefined) goto b
+    POS, NEG, BIT_NOT, BOOL_NOT,
+    ADD, SUB, MUL, DIV, REM, POW,
+    SHL, SHR, USR, BIT_AND, BIT_OR, BIT_XOR,
+    EQL, NEQ, SAME, DIFF, GT, GE, LT, LE,
+    RETURN,
+    OPCODE_COUNT,
+  };
+
+  struct Instruction {
+    uint8_t op;
+    uint8_t a;
+    uint16_t b;
+    uint16_t c;
+    uint16_t d;
+  };
+
+  static bool enabled() { return s_enabled; }
+  static void set_enabled(bool b) { s_enabled = b; }
+
+  //
+  // Replaces an expression with its bytecode when enabled and worthwhile
+  //
+
+  static void compile(std::unique_ptr<Expr> &expr);
+
+  //
+  // Code generation, called back from Expr::compile()
+  //
+
+  auto alloc() -> int;
+  void free(int reg) { m_top = reg; }
+  void emit(Opcode op, int a, int b = 0, int c = 0, int d = 0);
+  void load(int reg, const Value &v);
+  void unary(Opcode op, Expr *x, int reg);
+  void binary(Opcode op, Expr *a, Expr *b, int reg);
+  void fallback(Expr *node, int reg);
+  auto site(Expr *node, PropertyCache *cache = nullptr, Module *module = nullptr) -> int;
+  auto jump(Opcode op, int reg = 0) -> int;
+  void land(int jump);
+
+  virtual bool eval(Context &ctx, Value &result) override;
+  virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
+  virtual auto reduce(Reducer &r) -> Reducer::Value* override;
+  virtual void dump(std::ostream &out, const std::string &indent) override;
+
+private:
+  Bytecode(Expr *source);
+
+  struct Site {
+    Expr* node;
+    PropertyCache* cache;
+    Module* module;
+  };
+
+  std::unique_ptr<Expr> m_source;
+  std::vector<Instruction> m_code;
+  std::vector<Value> m_constants;
+  std::vector<Site> m_sites;
+  int m_registers = 0;
+  int m_top = 0;
+  int m_native = 0;
+  bool m_overflow = false;
+
+  bool build();
+  bool run(Context &ctx, Value *r);
+
+  static bool s_enabled;
+};
+
+} // namespace pjs
+
+#endif // PJS_BYTECODE_HPP
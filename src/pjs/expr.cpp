@@ -26,6 +26,7 @@
 #include "expr.hpp"
 #include "stmt.hpp"
 #include "module.hpp"
+#include "bytecode.hpp"
 
 namespace pjs {
 
@@ -54,6 +55,10 @@ Expr::~Expr()
 {
 }
 
+void Expr::compile(Bytecode &code, int reg) {
+  code.fallback(this, reg);
+}
+
 namespace expr {
 
 //
@@ -102,6 +107,12 @@ bool Compound::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void Compound::compile(Bytecode &code, int reg) {
+  for (const auto &p : m_exprs) {
+    p->compile(code, reg);
+  }
+}
+
 auto Compound::reduce(Reducer &r) -> Reducer::Value* {
   size_t n = m_exprs.size();
   vl_array<Reducer::Value*> v(n);
@@ -135,17 +146,31 @@ void Compound::dump(std::ostream &out, const std::string &indent) {
 // Concatenation
 //
 
+// Appends a value to a string under construction without interning
+// intermediate pieces such as number-to-string conversions.
+static void append_string(std::string &str, const Value &v) {
+  if (v.is_string()) {
+    str += v.s()->str();
+  } else if (v.is_number() && std::isfinite(v.n())) {
+    char buf[100];
+    auto len = Number::to_string(buf, sizeof(buf), v.n());
+    str.append(buf, len);
+  } else {
+    auto s = v.to_string();
+    str += s->str();
+    s->release();
+  }
+}
+
 bool Concatenation::eval(Context &ctx, Value &result) {
   std::string str;
   for (const auto &p : m_exprs) {
     if (!p->eval(ctx, result)) {
       return false;
     }
-    auto s = result.to_string();
-    str += s->str();
-    s->release();
+    append_string(str, result);
   }
-  result.set(str);
+  result.set(std::move(str));
   return true;
 }
 
@@ -178,6 +203,10 @@ bool Undefined::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void Undefined::compile(Bytecode &code, int reg) {
+  code.load(reg, Value::undefined);
+}
+
 auto Undefined::reduce(Reducer &r) -> Reducer::Value* {
   return r.undefined();
 }
@@ -195,6 +224,10 @@ bool Null::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void Null::compile(Bytecode &code, int reg) {
+  code.load(reg, Value::null);
+}
+
 auto Null::reduce(Reducer &r) -> Reducer::Value* {
   return r.null();
 }
@@ -212,6 +245,10 @@ bool BooleanLiteral::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void BooleanLiteral::compile(Bytecode &code, int reg) {
+  code.load(reg, m_b);
+}
+
 auto BooleanLiteral::reduce(Reducer &r) -> Reducer::Value* {
   return r.boolean(m_b);
 }
@@ -229,6 +266,10 @@ bool NumberLiteral::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void NumberLiteral::compile(Bytecode &code, int reg) {
+  code.load(reg, m_n);
+}
+
 auto NumberLiteral::reduce(Reducer &r) -> Reducer::Value* {
   return r.number(m_n);
 }
@@ -246,6 +287,10 @@ bool StringLiteral::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void StringLiteral::compile(Bytecode &code, int reg) {
+  code.load(reg, m_s.get());
+}
+
 auto StringLiteral::reduce(Reducer &r) -> Reducer::Value* {
   return r.string(m_s->str());
 }
@@ -715,6 +760,10 @@ bool LocalVariable::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void LocalVariable::compile(Bytecode &code, int reg) {
+  code.emit(Bytecode::LOCAL, reg, m_i, m_level);
+}
+
 bool LocalVariable::assign(Context &ctx, Value &value) {
   auto *scope = ctx.scope();
   for (int i = 0; i < m_level; i++) scope = scope->parent();
@@ -784,6 +833,14 @@ bool Identifier::eval(Context &ctx, Value &result) {
   return m_resolved->eval(ctx, result);
 }
 
+void Identifier::compile(Bytecode &code, int reg) {
+  if (m_resolved) {
+    m_resolved->compile(code, reg);
+  } else {
+    Expr::compile(code, reg);
+  }
+}
+
 bool Identifier::assign(Context &ctx, Value &value) {
   if (!m_resolved) resolve(ctx);
   if (!m_resolved) return error(ctx, "unresolved identifier");
@@ -880,6 +937,10 @@ bool Property::eval(Context &ctx, Value &result) {
   if (!m_key->eval(ctx, key)) return false;
   if (obj.is_undefined()) return error(ctx, "cannot read property of undefined");
   if (obj.is_null()) return error(ctx, "cannot read property of null");
+  if (obj.is_object() && key.is_string() && !obj.o()->type()->has_seti()) {
+    m_cache.get(obj.o(), key.s(), result);
+    return true;
+  }
   auto o = obj.to_object();
   auto c = o->type();
   if (c->has_seti()) {
@@ -897,6 +958,15 @@ bool Property::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void Property::compile(Bytecode &code, int reg) {
+  auto obj = code.alloc();
+  auto key = code.alloc();
+  m_obj->compile(code, obj);
+  m_key->compile(code, key);
+  code.emit(Bytecode::GET, reg, obj, key, code.site(this, &m_cache));
+  code.free(obj);
+}
+
 bool Property::assign(Context &ctx, Value &value) {
   Value obj, key;
   if (!m_obj->eval(ctx, obj)) return false;
@@ -977,6 +1047,10 @@ bool OptionalProperty::eval(Context &ctx, Value &result) {
     result = Value::undefined;
     return true;
   }
+  if (obj.is_object() && key.is_string() && !obj.o()->type()->has_seti()) {
+    m_cache.get(obj.o(), key.s(), result);
+    return true;
+  }
   auto o = obj.to_object();
   auto c = o->type();
   if (c->has_seti()) {
@@ -1071,6 +1145,19 @@ bool Invocation::eval(Context &ctx, Value &result) {
   return false;
 }
 
+void Invocation::compile(Bytecode &code, int reg) {
+  auto argc = m_argv.size();
+  auto site = code.site(this, nullptr, m_module);
+  auto f = code.alloc();
+  m_func->compile(code, f);
+  code.emit(Bytecode::FUNCTION, f, site);
+  for (size_t i = 0; i < argc; i++) {
+    m_argv[i]->compile(code, code.alloc());
+  }
+  code.emit(Bytecode::CALL, reg, f, argc, site);
+  code.free(f);
+}
+
 bool Invocation::declare(Module *module, Scope &scope, Error &error) {
   if (!m_func->declare(module, scope, error)) return false;
   for (const auto &p : m_argv) {
@@ -1153,10 +1240,18 @@ void OptionalInvocation::dump(std::ostream &out, const std::string &indent) {
 bool Plus::eval(Context &ctx, Value &result) {
   Value x;
   if (!m_x->eval(ctx, x)) return false;
-  result.set(x.to_number());
+  operate(x, result);
   return true;
 }
 
+void Plus::operate(Value &x, Value &result) {
+  result.set(x.to_number());
+}
+
+void Plus::compile(Bytecode &code, int reg) {
+  code.unary(Bytecode::POS, m_x.get(), reg);
+}
+
 bool Plus::declare(Module *module, Scope &scope, Error &error) {
   return m_x->declare(module, scope, error);
 }
@@ -1177,12 +1272,20 @@ void Plus::dump(std::ostream &out, const std::string &indent) {
 bool Negation::eval(Context &ctx, Value &result) {
   Value x;
   if (!m_x->eval(ctx, x)) return false;
+  operate(x, result);
+  return true;
+}
+
+void Negation::operate(Value &x, Value &result) {
   if (x.is<Int>()) {
     result.set(x.as<Int>()->neg());
-    return true;
+    return;
   }
   result.set(-x.to_number());
-  return true;
+}
+
+void Negation::compile(Bytecode &code, int reg) {
+  code.unary(Bytecode::NEG, m_x.get(), reg);
 }
 
 bool Negation::declare(Module *module, Scope &scope, Error &error) {
@@ -1206,13 +1309,17 @@ bool Addition::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void Addition::operate(Value &a, Value &b, Value &result) {
   if (a.is_string() || b.is_string()) {
-    auto sa = a.to_string();
-    auto sb = b.to_string();
-    result.set(sa->str() + sb->str());
-    sa->release();
-    sb->release();
-    return true;
+    std::string str;
+    append_string(str, a);
+    append_string(str, b);
+    result.set(std::move(str));
+    return;
   }
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
@@ -1220,12 +1327,15 @@ bool Addition::eval(Context &ctx, Value &result) {
     result.set(ia->add(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(na + nb);
-  return true;
+}
+
+void Addition::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::ADD, m_a.get(), m_b.get(), reg);
 }
 
 bool Addition::declare(Module *module, Scope &scope, Error &error) {
@@ -1253,18 +1363,26 @@ bool Subtraction::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void Subtraction::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->sub(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(na - nb);
-  return true;
+}
+
+void Subtraction::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::SUB, m_a.get(), m_b.get(), reg);
 }
 
 bool Subtraction::declare(Module *module, Scope &scope, Error &error) {
@@ -1292,18 +1410,26 @@ bool Multiplication::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void Multiplication::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->mul(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(na * nb);
-  return true;
+}
+
+void Multiplication::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::MUL, m_a.get(), m_b.get(), reg);
 }
 
 bool Multiplication::declare(Module *module, Scope &scope, Error &error) {
@@ -1331,18 +1457,26 @@ bool Division::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void Division::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->div(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(na / nb);
-  return true;
+}
+
+void Division::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::DIV, m_a.get(), m_b.get(), reg);
 }
 
 bool Division::declare(Module *module, Scope &scope, Error &error) {
@@ -1370,18 +1504,26 @@ bool Remainder::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void Remainder::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->mod(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(std::fmod(na, nb));
-  return true;
+}
+
+void Remainder::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::REM, m_a.get(), m_b.get(), reg);
 }
 
 bool Remainder::declare(Module *module, Scope &scope, Error &error) {
@@ -1409,10 +1551,18 @@ bool Exponentiation::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void Exponentiation::operate(Value &a, Value &b, Value &result) {
   auto na = a.to_number();
   auto nb = b.to_number();
   result.set(std::pow(na, nb));
-  return true;
+}
+
+void Exponentiation::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::POW, m_a.get(), m_b.get(), reg);
 }
 
 bool Exponentiation::declare(Module *module, Scope &scope, Error &error) {
@@ -1440,14 +1590,22 @@ bool ShiftLeft::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void ShiftLeft::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>()) {
     result.set(a.as<Int>()->shl(b.to_int32()));
-    return true;
+    return;
   }
   int32_t na = a.to_int32();
   int32_t nb = b.to_int32();
   result.set(na << nb);
-  return true;
+}
+
+void ShiftLeft::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::SHL, m_a.get(), m_b.get(), reg);
 }
 
 bool ShiftLeft::declare(Module *module, Scope &scope, Error &error) {
@@ -1475,14 +1633,22 @@ bool ShiftRight::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void ShiftRight::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>()) {
     result.set(a.as<Int>()->shr(b.to_int32()));
-    return true;
+    return;
   }
   int32_t na = a.to_int32();
   int32_t nb = b.to_int32();
   result.set(na >> nb);
-  return true;
+}
+
+void ShiftRight::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::SHR, m_a.get(), m_b.get(), reg);
 }
 
 bool ShiftRight::declare(Module *module, Scope &scope, Error &error) {
@@ -1510,14 +1676,22 @@ bool UnsignedShiftRight::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void UnsignedShiftRight::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>()) {
     result.set(a.as<Int>()->bitwise_shr(b.to_int32()));
-    return true;
+    return;
   }
   int32_t na = a.to_int32();
   int32_t nb = b.to_int32();
   result.set((uint32_t)na >> nb);
-  return true;
+}
+
+void UnsignedShiftRight::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::USR, m_a.get(), m_b.get(), reg);
 }
 
 bool UnsignedShiftRight::declare(Module *module, Scope &scope, Error &error) {
@@ -1544,12 +1718,20 @@ void UnsignedShiftRight::dump(std::ostream &out, const std::string &indent) {
 bool BitwiseNot::eval(Context &ctx, Value &result) {
   Value x;
   if (!m_x->eval(ctx, x)) return false;
+  operate(x, result);
+  return true;
+}
+
+void BitwiseNot::operate(Value &x, Value &result) {
   if (x.is<Int>()) {
     result.set(x.as<Int>()->bitwise_not());
-    return true;
+    return;
   }
   result.set(~x.to_int32());
-  return true;
+}
+
+void BitwiseNot::compile(Bytecode &code, int reg) {
+  code.unary(Bytecode::BIT_NOT, m_x.get(), reg);
 }
 
 bool BitwiseNot::declare(Module *module, Scope &scope, Error &error) {
@@ -1573,18 +1755,26 @@ bool BitwiseAnd::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void BitwiseAnd::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->bitwise_and(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   int32_t na = a.to_int32();
   int32_t nb = b.to_int32();
   result.set(na & nb);
-  return true;
+}
+
+void BitwiseAnd::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::BIT_AND, m_a.get(), m_b.get(), reg);
 }
 
 bool BitwiseAnd::declare(Module *module, Scope &scope, Error &error) {
@@ -1612,18 +1802,26 @@ bool BitwiseOr::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void BitwiseOr::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->bitwise_or(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   int32_t na = a.to_int32();
   int32_t nb = b.to_int32();
   result.set(na | nb);
-  return true;
+}
+
+void BitwiseOr::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::BIT_OR, m_a.get(), m_b.get(), reg);
 }
 
 bool BitwiseOr::declare(Module *module, Scope &scope, Error &error) {
@@ -1651,18 +1849,26 @@ bool BitwiseXor::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void BitwiseXor::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->bitwise_xor(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   int32_t na = a.to_int32();
   int32_t nb = b.to_int32();
   result.set(na ^ nb);
-  return true;
+}
+
+void BitwiseXor::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::BIT_XOR, m_a.get(), m_b.get(), reg);
 }
 
 bool BitwiseXor::declare(Module *module, Scope &scope, Error &error) {
@@ -1693,6 +1899,10 @@ bool LogicalNot::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void LogicalNot::compile(Bytecode &code, int reg) {
+  code.unary(Bytecode::BOOL_NOT, m_x.get(), reg);
+}
+
 bool LogicalNot::declare(Module *module, Scope &scope, Error &error) {
   return m_x->declare(module, scope, error);
 }
@@ -1717,6 +1927,13 @@ bool LogicalAnd::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void LogicalAnd::compile(Bytecode &code, int reg) {
+  m_a->compile(code, reg);
+  auto skip = code.jump(Bytecode::JUMP_IF_FALSE, reg);
+  m_b->compile(code, reg);
+  code.land(skip);
+}
+
 bool LogicalAnd::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1745,6 +1962,13 @@ bool LogicalOr::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void LogicalOr::compile(Bytecode &code, int reg) {
+  m_a->compile(code, reg);
+  auto skip = code.jump(Bytecode::JUMP_IF_TRUE, reg);
+  m_b->compile(code, reg);
+  code.land(skip);
+}
+
 bool LogicalOr::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1773,6 +1997,13 @@ bool NullishCoalescing::eval(Context &ctx, Value &result) {
   return true;
 }
 
+void NullishCoalescing::compile(Bytecode &code, int reg) {
+  m_a->compile(code, reg);
+  auto skip = code.jump(Bytecode::JUMP_IF_DEFINED, reg);
+  m_b->compile(code, reg);
+  code.land(skip);
+}
+
 bool NullishCoalescing::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1798,16 +2029,24 @@ bool Equality::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void Equality::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(ia->eql(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   result.set(Value::is_equal(a, b));
-  return true;
+}
+
+void Equality::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::EQL, m_a.get(), m_b.get(), reg);
 }
 
 bool Equality::declare(Module *module, Scope &scope, Error &error) {
@@ -1835,16 +2074,24 @@ bool Inequality::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void Inequality::operate(Value &a, Value &b, Value &result) {
   if (a.is<Int>() || b.is<Int>()) {
     auto ia = a.to_int();
     auto ib = b.to_int();
     result.set(!ia->eql(ib));
     ia->release();
     ib->release();
-    return true;
+    return;
   }
   result.set(!Value::is_equal(a, b));
-  return true;
+}
+
+void Inequality::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::NEQ, m_a.get(), m_b.get(), reg);
 }
 
 bool Inequality::declare(Module *module, Scope &scope, Error &error) {
@@ -1872,10 +2119,18 @@ bool Identity::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
-  result.set(Value::is_identical(a, b));
+  operate(a, b, result);
   return true;
 }
 
+void Identity::operate(Value &a, Value &b, Value &result) {
+  result.set(Value::is_identical(a, b));
+}
+
+void Identity::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::SAME, m_a.get(), m_b.get(), reg);
+}
+
 bool Identity::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1901,10 +2156,18 @@ bool Nonidentity::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
-  result.set(!Value::is_identical(a, b));
+  operate(a, b, result);
   return true;
 }
 
+void Nonidentity::operate(Value &a, Value &b, Value &result) {
+  result.set(!Value::is_identical(a, b));
+}
+
+void Nonidentity::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::DIFF, m_a.get(), m_b.get(), reg);
+}
+
 bool Nonidentity::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -1930,6 +2193,11 @@ bool GreaterThan::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void GreaterThan::operate(Value &a, Value &b, Value &result) {
   if (a.is_undefined() || b.is_undefined()) {
     result.set(false);
   } else if (a.is_string() && b.is_string()) {
@@ -1945,7 +2213,10 @@ bool GreaterThan::eval(Context &ctx, Value &result) {
     auto nb = b.to_number();
     result.set(na > nb);
   }
-  return true;
+}
+
+void GreaterThan::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::GT, m_a.get(), m_b.get(), reg);
 }
 
 bool GreaterThan::declare(Module *module, Scope &scope, Error &error) {
@@ -1973,6 +2244,11 @@ bool GreaterThanOrEqual::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void GreaterThanOrEqual::operate(Value &a, Value &b, Value &result) {
   if (a.is_undefined() || b.is_undefined()) {
     result.set(false);
   } else if (a.is_string() && b.is_string()) {
@@ -1988,7 +2264,10 @@ bool GreaterThanOrEqual::eval(Context &ctx, Value &result) {
     auto nb = b.to_number();
     result.set(na >= nb);
   }
-  return true;
+}
+
+void GreaterThanOrEqual::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::GE, m_a.get(), m_b.get(), reg);
 }
 
 bool GreaterThanOrEqual::declare(Module *module, Scope &scope, Error &error) {
@@ -2016,6 +2295,11 @@ bool LessThan::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void LessThan::operate(Value &a, Value &b, Value &result) {
   if (a.is_undefined() || b.is_undefined()) {
     result.set(false);
   } else if (a.is_string() && b.is_string()) {
@@ -2031,7 +2315,10 @@ bool LessThan::eval(Context &ctx, Value &result) {
     auto nb = b.to_number();
     result.set(na < nb);
   }
-  return true;
+}
+
+void LessThan::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::LT, m_a.get(), m_b.get(), reg);
 }
 
 bool LessThan::declare(Module *module, Scope &scope, Error &error) {
@@ -2059,6 +2346,11 @@ bool LessThanOrEqual::eval(Context &ctx, Value &result) {
   Value a, b;
   if (!m_a->eval(ctx, a)) return false;
   if (!m_b->eval(ctx, b)) return false;
+  operate(a, b, result);
+  return true;
+}
+
+void LessThanOrEqual::operate(Value &a, Value &b, Value &result) {
   if (a.is_undefined() || b.is_undefined()) {
     result.set(false);
   } else if (a.is_string() && b.is_string()) {
@@ -2074,7 +2366,10 @@ bool LessThanOrEqual::eval(Context &ctx, Value &result) {
     auto nb = b.to_number();
     result.set(na <= nb);
   }
-  return true;
+}
+
+void LessThanOrEqual::compile(Bytecode &code, int reg) {
+  code.binary(Bytecode::LE, m_a.get(), m_b.get(), reg);
 }
 
 bool LessThanOrEqual::declare(Module *module, Scope &scope, Error &error) {
@@ -2929,6 +3224,18 @@ bool Conditional::eval(Context &ctx, Value &result) {
   }
 }
 
+void Conditional::compile(Bytecode &code, int reg) {
+  auto cond = code.alloc();
+  m_a->compile(code, cond);
+  auto skip_b = code.jump(Bytecode::JUMP_IF_FALSE, cond);
+  code.free(cond);
+  m_b->compile(code, reg);
+  auto skip_c = code.jump(Bytecode::JUMP);
+  code.land(skip_b);
+  m_c->compile(code, reg);
+  code.land(skip_c);
+}
+
 bool Conditional::declare(Module *module, Scope &scope, Error &error) {
   if (!m_a->declare(module, scope, error)) return false;
   if (!m_b->declare(module, scope, error)) return false;
@@ -40,6 +40,7 @@
 namespace pjs {
 
 class Stmt;
+class Bytecode;
 
 //
 // Expression base
@@ -161,6 +162,7 @@ public:
   virtual bool eval(Context &ctx, Value &result) = 0;
   virtual bool assign(Context &ctx, Value &value) { return error(ctx, "cannot assign to a right-value"); }
   virtual bool clear(Context &ctx, Value &result) { return error(ctx, "cannot delete a value"); }
+  virtual void compile(Bytecode &code, int reg);
   virtual auto reduce(Reducer &r) -> Reducer::Value* { return r.undefined(); }
   virtual auto reduce_lval(Reducer &r, Reducer::Value *rval) -> Reducer::Value* { return r.undefined(); }
   virtual void dump(std::ostream &out, const std::string &indent = "") = 0;
@@ -219,6 +221,7 @@ public:
   virtual bool is_argument_list() const override;
   virtual bool is_comma_ended() const override { return m_is_comma_ended; }
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
@@ -254,6 +257,7 @@ private:
 class Undefined : public Expr {
 public:
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 };
@@ -265,6 +269,7 @@ public:
 class Null : public Expr {
 public:
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 };
@@ -278,6 +283,7 @@ public:
   BooleanLiteral(bool b) : m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
@@ -294,6 +300,7 @@ public:
   NumberLiteral(double n) : m_n(n) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
@@ -312,6 +319,7 @@ public:
   auto s() const -> Str* { return m_s; }
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
 
@@ -498,6 +506,7 @@ public:
 
   virtual bool is_left_value() const override;
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool assign(Context &ctx, Value &value) override;
   virtual bool clear(Context &ctx, Value &result) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -542,6 +551,7 @@ public:
   virtual void unpack(std::vector<Ref<Str>> &vars) const override;
   virtual bool unpack(Context &ctx, Value &arg, int &var) override;
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool assign(Context &ctx, Value &value) override;
   virtual bool clear(Context &ctx, Value &result) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
@@ -573,6 +583,7 @@ public:
 
   virtual bool is_left_value() const override;
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool assign(Context &ctx, Value &value) override;
   virtual bool clear(Context &ctx, Value &result) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
@@ -633,6 +644,7 @@ public:
   Invocation(Expr *func, std::vector<std::unique_ptr<Expr>> &&argv) : m_func(func), m_argv(std::move(argv)) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual auto reduce(Reducer &r) -> Reducer::Value* override;
@@ -671,6 +683,8 @@ public:
   Plus(Expr *x) : m_x(x) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &x, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -688,6 +702,8 @@ public:
   Negation(Expr *x) : m_x(x) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &x, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -705,6 +721,8 @@ public:
   Addition(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -723,6 +741,8 @@ public:
   Subtraction(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -741,6 +761,8 @@ public:
   Multiplication(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -759,6 +781,8 @@ public:
   Division(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -777,6 +801,8 @@ public:
   Remainder(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -795,6 +821,8 @@ public:
   Exponentiation(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -813,6 +841,8 @@ public:
   ShiftLeft(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -831,6 +861,8 @@ public:
   ShiftRight(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -849,6 +881,8 @@ public:
   UnsignedShiftRight(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -867,6 +901,8 @@ public:
   BitwiseNot(Expr *x) : m_x(x) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &x, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -884,6 +920,8 @@ public:
   BitwiseAnd(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -902,6 +940,8 @@ public:
   BitwiseOr(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -920,6 +960,8 @@ public:
   BitwiseXor(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -938,6 +980,7 @@ public:
   LogicalNot(Expr *x) : m_x(x) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -955,6 +998,7 @@ public:
   LogicalAnd(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -973,6 +1017,7 @@ public:
   LogicalOr(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -991,6 +1036,7 @@ public:
   NullishCoalescing(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1009,6 +1055,8 @@ public:
   Equality(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1027,6 +1075,8 @@ public:
   Inequality(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1045,6 +1095,8 @@ public:
   Identity(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1063,6 +1115,8 @@ public:
   Nonidentity(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1081,6 +1135,8 @@ public:
   GreaterThan(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1099,6 +1155,8 @@ public:
   GreaterThanOrEqual(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1117,6 +1175,8 @@ public:
   LessThan(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1135,6 +1195,8 @@ public:
   LessThanOrEqual(Expr *a, Expr *b) : m_a(a), m_b(b) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  static void operate(Value &a, Value &b, Value &result);
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
@@ -1596,6 +1658,7 @@ public:
   Conditional(Expr *a, Expr *b, Expr *c) : m_a(a), m_b(b), m_c(c) {}
 
   virtual bool eval(Context &ctx, Value &result) override;
+  virtual void compile(Bytecode &code, int reg) override;
   virtual bool declare(Module *module, Scope &scope, Error &error) override;
   virtual void resolve(Module *module, Context &ctx, int l, LegacyImports *imports) override;
   virtual void dump(std::ostream &out, const std::string &indent) override;
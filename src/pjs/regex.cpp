@@ -0,0 +1,1294 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "regex.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace pjs {
+
+static const int MAX_PROGRAM_SIZE = 100000;
+static const int MAX_REPEAT = 1000;
+static const int MAX_DFA_STATES = 2000;
+static const int MAX_LOOP_DEPTH = 4;
+static const size_t MAX_BACKTRACK_STATES = 256 * 1024;
+static const size_t MAX_THREAD_STATE = 16 * 1024 * 1024;
+static const uint32_t MAX_CODE_POINT = 0x10ffff;
+
+//
+// Matching context at a position
+//
+
+enum {
+  AT_START  = 1 << 0,
+  PREV_WORD = 1 << 1,
+  PREV_LINE = 1 << 2,
+  AT_END    = 1 << 3,
+  NEXT_WORD = 1 << 4,
+  NEXT_LINE = 1 << 5,
+};
+
+static bool is_word(int c) {
+  return (
+    ('0' <= c && c <= '9') ||
+    ('a' <= c && c <= 'z') ||
+    ('A' <= c && c <= 'Z') ||
+    (c == '_')
+  );
+}
+
+static bool is_line_terminator(int c) {
+  return c == '\n' || c == '\r' || c == 0x2028 || c == 0x2029;
+}
+
+static int prev_context(int c) {
+  if (c < 0) return AT_START;
+  if (is_word(c)) return PREV_WORD;
+  if (is_line_terminator(c)) return PREV_LINE;
+  return 0;
+}
+
+static int next_context(int c) {
+  if (c < 0) return AT_END;
+  if (is_word(c)) return NEXT_WORD;
+  if (is_line_terminator(c)) return NEXT_LINE;
+  return 0;
+}
+
+//
+// UTF-8
+//
+// Bytes that don't start a well-formed sequence decode to themselves,
+// one at a time, so any input can be matched.
+//
+
+static int utf8_length(uint8_t b) {
+  if (b < 0xc0) return 1;
+  if (b < 0xe0) return 2;
+  if (b < 0xf0) return 3;
+  if (b < 0xf8) return 4;
+  return 1;
+}
+
+static int utf8_decode(const char *str, size_t len, uint32_t &c) {
+  auto *p = (const uint8_t *)str;
+  auto b = p[0];
+  auto n = utf8_length(b);
+  if (n == 1 || size_t(n) > len) { c = b; return 1; }
+  uint32_t code = b & (0x7f >> n);
+  for (int i = 1; i < n; i++) {
+    if ((p[i] & 0xc0) != 0x80) { c = b; return 1; }
+    code = (code << 6) | (p[i] & 0x3f);
+  }
+  c = code;
+  return n;
+}
+
+static int utf8_decode_back(const char *str, size_t pos) {
+  auto i = pos - 1;
+  while (i > 0 && pos - i < 4 && (str[i] & 0xc0) == 0x80) i--;
+  uint32_t c;
+  if (i + utf8_decode(str + i, pos - i, c) == pos) return c;
+  return (uint8_t)str[pos - 1];
+}
+
+//
+// Regex::Node
+//
+
+struct Regex::Node {
+  enum Type { EMPTY, CHAR, CAT, ALT, GROUP, REPEAT, ASSERT };
+
+  Type type;
+  int value = 0;
+  int min = 0, max = 0;
+  bool greedy = true;
+  std::vector<std::unique_ptr<Node>> children;
+
+  Node(Type t, int v = 0) : type(t), value(v) {}
+
+  auto add(Node *child) -> Node* {
+    children.push_back(std::unique_ptr<Node>(child));
+    return this;
+  }
+
+  bool nullable() const {
+    switch (type) {
+      case CHAR: return false;
+      case CAT: for (const auto &p : children) if (!p->nullable()) return false; return true;
+      case ALT: for (const auto &p : children) if (p->nullable()) return true; return false;
+      case GROUP: return children[0]->nullable();
+      case REPEAT: return min == 0 || children[0]->nullable();
+      default: return true;
+    }
+  }
+
+  void groups(int &first, int &last) const {
+    if (type == GROUP && value > 0) {
+      if (first < 0) first = value;
+      last = value;
+    }
+    for (const auto &p : children) p->groups(first, last);
+  }
+};
+
+//
+// Regex::Parser
+//
+// Recursive descent over the ECMAScript pattern syntax. Backreferences
+// and lookaround need backtracking and are rejected.
+//
+
+class Regex::Parser {
+public:
+  Parser(Regex *regex, const std::string &source)
+    : m_regex(regex)
+    , m_source(source) {}
+
+  auto parse() -> Node* {
+    std::unique_ptr<Node> node(disjunction());
+    if (!eof()) error("unmatched ')'");
+    return node.release();
+  }
+
+private:
+  typedef std::vector<Range> Class;
+
+  Regex* m_regex;
+  const std::string& m_source;
+  size_t m_ptr = 0;
+
+  bool eof() const { return m_ptr >= m_source.length(); }
+  auto peek() const -> int { return eof() ? -1 : (uint8_t)m_source[m_ptr]; }
+  auto peek(int i) const -> int { return m_ptr + i >= m_source.length() ? -1 : (uint8_t)m_source[m_ptr + i]; }
+
+  auto get() -> uint32_t {
+    uint32_t c;
+    m_ptr += utf8_decode(m_source.c_str() + m_ptr, m_source.length() - m_ptr, c);
+    return c;
+  }
+
+  bool accept(char c) {
+    if (peek() != c) return false;
+    m_ptr++;
+    return true;
+  }
+
+  void error(const char *msg) {
+    throw std::runtime_error(
+      std::string("invalid regular expression /") + m_source + "/: " + msg
+    );
+  }
+
+  auto disjunction() -> Node* {
+    std::unique_ptr<Node> node(alternative());
+    if (peek() != '|') return node.release();
+    std::unique_ptr<Node> alt(new Node(Node::ALT));
+    alt->add(node.release());
+    while (accept('|')) alt->add(alternative());
+    return alt.release();
+  }
+
+  auto alternative() -> Node* {
+    std::unique_ptr<Node> cat(new Node(Node::CAT));
+    while (!eof() && peek() != '|' && peek() != ')') {
+      cat->add(term());
+    }
+    return cat.release();
+  }
+
+  auto term() -> Node* {
+    bool multiline = m_regex->m_flags & MULTILINE;
+    if (accept('^')) return new Node(Node::ASSERT, multiline ? BEGIN_LINE : BEGIN_TEXT);
+    if (accept('$')) return new Node(Node::ASSERT, multiline ? END_LINE : END_TEXT);
+    if (peek() == '\\' && peek(1) == 'b') { m_ptr += 2; return new Node(Node::ASSERT, WORD_BOUNDARY); }
+    if (peek() == '\\' && peek(1) == 'B') { m_ptr += 2; return new Node(Node::ASSERT, NOT_WORD_BOUNDARY); }
+    if (peek() == '(' && peek(1) == '?') {
+      auto c = peek(2);
+      if (c == '=' || c == '!' || (c == '<' && (peek(3) == '=' || peek(3) == '!'))) {
+        error("lookaround assertions are not supported");
+      }
+    }
+    return quantifier(atom());
+  }
+
+  auto atom() -> Node* {
+    switch (peek()) {
+      case '.': {
+        m_ptr++;
+        Class cls;
+        if (m_regex->m_flags & DOTALL) {
+          add_range(cls, 0, MAX_CODE_POINT);
+        } else {
+          add_range(cls, '\n', '\n');
+          add_range(cls, '\r', '\r');
+          add_range(cls, 0x2028, 0x2029);
+          negate(cls);
+        }
+        return char_node(cls);
+      }
+      case '(': {
+        m_ptr++;
+        int group = -1;
+        if (accept('?')) {
+          if (accept('<')) {
+            while (!eof() && peek() != '>') m_ptr++;
+            if (!accept('>')) error("invalid group name");
+            group = ++m_regex->m_group_count;
+          } else if (!accept(':')) {
+            error("invalid group");
+          }
+        } else {
+          group = ++m_regex->m_group_count;
+        }
+        std::unique_ptr<Node> node(new Node(Node::GROUP, group));
+        node->add(disjunction());
+        if (!accept(')')) error("unterminated group");
+        return node.release();
+      }
+      case '[': {
+        m_ptr++;
+        auto cls = char_class();
+        return char_node(cls);
+      }
+      case '\\': {
+        m_ptr++;
+        Class cls;
+        escape(cls, false);
+        return char_node(cls);
+      }
+      case ')': error("unmatched ')'"); break;
+      case '*': case '+': case '?': error("nothing to repeat"); break;
+      case '{': {
+        int min, max;
+        auto ptr = m_ptr;
+        if (counts(min, max)) error("nothing to repeat");
+        m_ptr = ptr + 1;
+        return literal('{');
+      }
+    }
+    return literal(get());
+  }
+
+  auto quantifier(Node *node) -> Node* {
+    std::unique_ptr<Node> atom(node);
+    int min, max;
+    switch (peek()) {
+      case '*': m_ptr++; min = 0; max = -1; break;
+      case '+': m_ptr++; min = 1; max = -1; break;
+      case '?': m_ptr++; min = 0; max = 1; break;
+      case '{': {
+        auto ptr = m_ptr;
+        if (!counts(min, max)) { m_ptr = ptr; return atom.release(); }
+        if (max >= 0 && max < min) error("numbers out of order in {} quantifier");
+        if (min > MAX_REPEAT || max > MAX_REPEAT) error("repetition count too large");
+        break;
+      }
+      default: return atom.release();
+    }
+    if (atom->type == Node::ASSERT) error("nothing to repeat");
+    std::unique_ptr<Node> repeat(new Node(Node::REPEAT));
+    repeat->min = min;
+    repeat->max = max;
+    repeat->greedy = !accept('?');
+    repeat->add(atom.release());
+    switch (peek()) {
+      case '*': case '+': case '?': error("nothing to repeat"); break;
+    }
+    return repeat.release();
+  }
+
+  bool counts(int &min, int &max) {
+    if (!accept('{')) return false;
+    if (!number(min)) return false;
+    if (accept(',')) {
+      if (peek() == '}') max = -1;
+      else if (!number(max)) return false;
+    } else {
+      max = min;
+    }
+    return accept('}');
+  }
+
+  bool number(int &n) {
+    if (peek() < '0' || peek() > '9') return false;
+    n = 0;
+    while ('0' <= peek() && peek() <= '9') {
+      if (n <= MAX_REPEAT) n = n * 10 + (get() - '0'); else m_ptr++;
+    }
+    return true;
+  }
+
+  auto char_class() -> Class {
+    Class cls;
+    bool negated = accept('^');
+    for (;;) {
+      if (eof()) error("unterminated character class");
+      if (accept(']')) break;
+      uint32_t lo, hi;
+      if (!class_atom(cls, lo)) continue;
+      if (peek() == '-' && peek(1) != ']' && peek(1) >= 0) {
+        m_ptr++;
+        if (!class_atom(cls, hi)) {
+          error("invalid character class range");
+        }
+        if (hi < lo) error("range out of order in character class");
+        add_range(cls, lo, hi);
+      } else {
+        add_range(cls, lo, lo);
+      }
+    }
+    if (m_regex->m_flags & ICASE) fold_case(cls);
+    if (negated) negate(cls);
+    return cls;
+  }
+
+  // Returns false if the atom is a class escape like \d which
+  // has already been added to the class
+  bool class_atom(Class &cls, uint32_t &c) {
+    if (!accept('\\')) {
+      c = get();
+      return true;
+    }
+    Class sub;
+    if (!escape(sub, true)) {
+      for (const auto &r : sub) add_range(cls, r.lo, r.hi);
+      return false;
+    }
+    c = sub[0].lo;
+    return true;
+  }
+
+  // Returns true if the escape is a single character
+  bool escape(Class &cls, bool in_class) {
+    if (eof()) error("\\ at end of pattern");
+    auto c = get();
+    switch (c) {
+      case 'd': case 'D':
+        add_range(cls, '0', '9');
+        if (c == 'D') negate(cls);
+        return false;
+      case 'w': case 'W':
+        add_range(cls, '0', '9');
+        add_range(cls, 'A', 'Z');
+        add_range(cls, '_', '_');
+        add_range(cls, 'a', 'z');
+        if (c == 'W') negate(cls);
+        return false;
+      case 's': case 'S':
+        add_range(cls, '\t', '\r');
+        add_range(cls, ' ', ' ');
+        add_range(cls, 0xa0, 0xa0);
+        add_range(cls, 0x1680, 0x1680);
+        add_range(cls, 0x2000, 0x200a);
+        add_range(cls, 0x2028, 0x2029);
+        add_range(cls, 0x202f, 0x202f);
+        add_range(cls, 0x205f, 0x205f);
+        add_range(cls, 0x3000, 0x3000);
+        add_range(cls, 0xfeff, 0xfeff);
+        if (c == 'S') negate(cls);
+        return false;
+      case 'b': c = in_class ? '\b' : 'b'; break;
+      case 'f': c = '\f'; break;
+      case 'n': c = '\n'; break;
+      case 'r': c = '\r'; break;
+      case 't': c = '\t'; break;
+      case 'v': c = '\v'; break;
+      case '0':
+        if ('0' <= peek() && peek() <= '9') error("octal escapes are not supported");
+        c = 0;
+        break;
+      case 'c':
+        if (('a' <= peek() && peek() <= 'z') || ('A' <= peek() && peek() <= 'Z')) {
+          c = get() % 32;
+        } else {
+          m_ptr--;
+          c = '\\';
+        }
+        break;
+      case 'x': c = hex(2); break;
+      case 'u':
+        if (accept('{')) {
+          c = 0;
+          do {
+            c = (c << 4) | hex(1);
+            if (c > MAX_CODE_POINT) error("invalid Unicode escape");
+          } while (peek() != '}' && !eof());
+          if (!accept('}')) error("invalid Unicode escape");
+        } else {
+          c = hex(4);
+        }
+        break;
+      case 'k': error("backreferences are not supported"); break;
+      case 'p': case 'P': error("Unicode property escapes are not supported"); break;
+      default:
+        if ('1' <= c && c <= '9') error("backreferences are not supported");
+        break;
+    }
+    add_range(cls, c, c);
+    return true;
+  }
+
+  auto hex(int n) -> uint32_t {
+    uint32_t c = 0;
+    for (int i = 0; i < n; i++) {
+      auto h = peek();
+      if ('0' <= h && h <= '9') c = (c << 4) | (h - '0');
+      else if ('a' <= h && h <= 'f') c = (c << 4) | (h - 'a' + 10);
+      else if ('A' <= h && h <= 'F') c = (c << 4) | (h - 'A' + 10);
+      else error("invalid hexadecimal escape");
+      m_ptr++;
+    }
+    return c;
+  }
+
+  auto literal(uint32_t c) -> Node* {
+    Class cls;
+    add_range(cls, c, c);
+    if (m_regex->m_flags & ICASE) fold_case(cls);
+    return char_node(cls);
+  }
+
+  auto char_node(Class &cls) -> Node* {
+    normalize(cls);
+    auto &classes = m_regex->m_classes;
+    for (size_t i = 0; i < classes.size(); i++) {
+      auto &c = classes[i];
+      if (c.size() == cls.size() && std::equal(
+        c.begin(), c.end(), cls.begin(),
+        [](const Range &a, const Range &b) { return a.lo == b.lo && a.hi == b.hi; }
+      )) return new Node(Node::CHAR, i);
+    }
+    classes.push_back(cls);
+    return new Node(Node::CHAR, classes.size() - 1);
+  }
+
+  static void add_range(Class &cls, uint32_t lo, uint32_t hi) {
+    Range r;
+    r.lo = lo;
+    r.hi = hi;
+    cls.push_back(r);
+  }
+
+  static void normalize(Class &cls) {
+    std::sort(
+      cls.begin(), cls.end(),
+      [](const Range &a, const Range &b) { return a.lo < b.lo; }
+    );
+    size_t n = 0;
+    for (size_t i = 0; i < cls.size(); i++) {
+      if (n > 0 && cls[i].lo <= cls[n-1].hi + 1) {
+        cls[n-1].hi = std::max(cls[n-1].hi, cls[i].hi);
+      } else {
+        cls[n++] = cls[i];
+      }
+    }
+    cls.resize(n);
+  }
+
+  static void negate(Class &cls) {
+    normalize(cls);
+    Class out;
+    uint32_t next = 0;
+    for (const auto &r : cls) {
+      if (r.lo > next) add_range(out, next, r.lo - 1);
+      next = r.hi + 1;
+    }
+    if (next <= MAX_CODE_POINT) add_range(out, next, MAX_CODE_POINT);
+    cls.swap(out);
+  }
+
+  // ASCII only, the same as std::regex::icase under the "C" locale
+  static void fold_case(Class &cls) {
+    auto n = cls.size();
+    for (size_t i = 0; i < n; i++) {
+      auto lo = cls[i].lo, hi = cls[i].hi;
+      auto a = std::max(lo, uint32_t('a')), b = std::min(hi, uint32_t('z'));
+      if (a <= b) add_range(cls, a - 32, b - 32);
+      a = std::max(lo, uint32_t('A')), b = std::min(hi, uint32_t('Z'));
+      if (a <= b) add_range(cls, a + 32, b + 32);
+    }
+  }
+};
+
+//
+// Regex
+//
+
+auto Regex::get(const std::string &pattern, int flags) -> std::shared_ptr<Regex> {
+  thread_local static std::map<std::string, std::weak_ptr<Regex>> s_cache;
+
+  auto key = pattern;
+  key += '/';
+  key += char('0' + flags);
+
+  auto &slot = s_cache[key];
+  if (auto regex = slot.lock()) return regex;
+
+  std::shared_ptr<Regex> regex;
+  try {
+    regex = std::make_shared<Regex>(pattern, flags);
+  } catch (std::runtime_error &) {
+    s_cache.erase(key);
+    throw;
+  }
+
+  slot = regex;
+
+  for (auto i = s_cache.begin(); i != s_cache.end(); ) {
+    if (i->second.expired()) i = s_cache.erase(i); else i++;
+  }
+
+  return regex;
+}
+
+Regex::Regex(const std::string &pattern, int flags)
+  : m_flags(flags)
+{
+  std::unique_ptr<Node> root(Parser(this, pattern).parse());
+  m_slot_count = 2 * (m_group_count + 1);
+  m_program.push_back({ SAVE, 0, 0 });
+  compile(root.get());
+  m_program.push_back({ SAVE, 1, 0 });
+  m_program.push_back({ MATCH, 0, 0 });
+  m_anchored = (m_program[1].op == ASSERT && m_program[1].x == BEGIN_TEXT);
+  build_loops();
+  build_symbols();
+
+  // Each thread in a Pike VM thread list keeps its own captures, so
+  // the worst case has every instruction in every loop state holding
+  // a full set of slots
+  auto keys = m_program.size() << m_loop_depth;
+  if (keys * (m_slot_count + 2) > MAX_THREAD_STATE) {
+    throw std::runtime_error("regular expression too large");
+  }
+
+  m_dfa_match = new DFAState;
+  m_dfa_dead = new DFAState;
+}
+
+Regex::~Regex() {
+  dfa_clear();
+  delete m_dfa_match;
+  delete m_dfa_dead;
+}
+
+void Regex::compile(Node *node) {
+  if (m_program.size() > size_t(MAX_PROGRAM_SIZE)) {
+    throw std::runtime_error("regular expression too large");
+  }
+
+  switch (node->type) {
+    case Node::EMPTY:
+      break;
+    case Node::CHAR:
+      m_program.push_back({ CHAR, node->value, 0 });
+      break;
+    case Node::CAT:
+      for (const auto &p : node->children) compile(p.get());
+      break;
+    case Node::ALT: {
+      std::vector<int> jumps;
+      auto n = node->children.size();
+      for (size_t i = 0; i < n; i++) {
+        if (i + 1 < n) {
+          auto split = m_program.size();
+          m_program.push_back({ SPLIT, int(split + 1), 0 });
+          compile(node->children[i].get());
+          jumps.push_back(m_program.size());
+          m_program.push_back({ JUMP, 0, 0 });
+          m_program[split].y = m_program.size();
+        } else {
+          compile(node->children[i].get());
+        }
+      }
+      for (auto i : jumps) m_program[i].x = m_program.size();
+      break;
+    }
+    case Node::GROUP:
+      if (node->value > 0) m_program.push_back({ SAVE, node->value * 2, 0 });
+      compile(node->children[0].get());
+      if (node->value > 0) m_program.push_back({ SAVE, node->value * 2 + 1, 0 });
+      break;
+    case Node::REPEAT: {
+      auto check = node->children[0]->nullable();
+      for (int i = 0; i < node->min; i++) compile_iteration(node, false);
+      if (node->max < 0) {
+        int loop = m_program.size();
+        m_program.push_back({ SPLIT, loop + 1, 0 });
+        compile_iteration(node, check);
+        m_program.push_back({ JUMP, loop, 0 });
+        int exit = m_program.size();
+        if (node->greedy) {
+          m_program[loop].y = exit;
+        } else {
+          m_program[loop].x = exit;
+          m_program[loop].y = loop + 1;
+        }
+      } else if (node->max > node->min) {
+        std::vector<int> splits;
+        for (int i = node->min; i < node->max; i++) {
+          splits.push_back(m_program.size());
+          m_program.push_back({ SPLIT, int(m_program.size() + 1), 0 });
+          compile_iteration(node, check);
+        }
+        int exit = m_program.size();
+        for (auto i : splits) {
+          auto &inst = m_program[i];
+          if (node->greedy) {
+            inst.y = exit;
+          } else {
+            inst.y = inst.x;
+            inst.x = exit;
+          }
+        }
+      }
+      break;
+    }
+    case Node::ASSERT:
+      m_program.push_back({ ASSERT, node->value, 0 });
+      break;
+  }
+}
+
+//
+// As in JavaScript, captures inside a quantified group are cleared
+// at the start of every iteration, and an optional iteration that
+// matches nothing fails.
+//
+
+void Regex::compile_iteration(Node *node, bool check) {
+  auto *child = node->children[0].get();
+  int first = -1, last = -1;
+  child->groups(first, last);
+  int slot = m_slot_count;
+  if (check) {
+    m_slot_count++;
+    m_program.push_back({ SAVE, slot, 0 });
+  }
+  if (first > 0) m_program.push_back({ RESET, first * 2, last * 2 + 2 });
+  compile(child);
+  if (check) m_program.push_back({ CHECK, slot, 0 });
+}
+
+void Regex::build_loops() {
+  std::vector<int> starts(m_slot_count, -1);
+  std::vector<std::pair<int, int>> loops;
+  for (size_t pc = 0; pc < m_program.size(); pc++) {
+    const auto &inst = m_program[pc];
+    if (inst.op == SAVE && inst.x >= 2 * (m_group_count + 1)) {
+      starts[inst.x] = pc;
+    } else if (inst.op == CHECK) {
+      loops.push_back(std::make_pair(starts[inst.x], int(pc)));
+    }
+  }
+
+  if (loops.empty()) return;
+
+  // Innermost loops first
+  std::sort(
+    loops.begin(), loops.end(),
+    [](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+      return a.second - a.first < b.second - b.first;
+    }
+  );
+
+  m_loop_slots.resize(m_program.size());
+  for (const auto &l : loops) {
+    auto slot = m_program[l.second].x;
+    for (int pc = l.first + 1; pc <= l.second; pc++) {
+      auto &slots = m_loop_slots[pc];
+      if (slots.size() < size_t(MAX_LOOP_DEPTH)) {
+        slots.push_back(slot);
+        m_loop_depth = std::max(m_loop_depth, int(slots.size()));
+      }
+    }
+  }
+}
+
+void Regex::build_symbols() {
+  m_bounds.clear();
+  for (const auto &cls : m_classes) {
+    for (const auto &r : cls) {
+      m_bounds.push_back(r.lo);
+      m_bounds.push_back(r.hi + 1);
+    }
+  }
+
+  // Boundaries between characters that make a difference to assertions
+  static const uint32_t context_bounds[] = {
+    '\n', '\n' + 1, '\r', '\r' + 1,
+    '0', '9' + 1, 'A', 'Z' + 1, '_', '_' + 1, 'a', 'z' + 1,
+    0x2028, 0x2029 + 1,
+  };
+
+  for (auto b : context_bounds) m_bounds.push_back(b);
+
+  std::sort(m_bounds.begin(), m_bounds.end());
+  m_bounds.erase(std::unique(m_bounds.begin(), m_bounds.end()), m_bounds.end());
+  m_bounds.erase(std::remove(m_bounds.begin(), m_bounds.end(), 0), m_bounds.end());
+
+  m_symbol_count = m_bounds.size() + 1;
+  m_symbol_reps.resize(m_symbol_count);
+  m_symbol_reps[0] = 0;
+  for (size_t i = 0; i < m_bounds.size(); i++) m_symbol_reps[i+1] = m_bounds[i];
+
+  for (int c = 0; c < 128; c++) {
+    m_ascii_symbols[c] = std::upper_bound(m_bounds.begin(), m_bounds.end(), c) - m_bounds.begin();
+  }
+
+  m_marks.assign(m_program.size(), 0);
+  m_captures.resize(m_slot_count);
+}
+
+// Only long inputs get to the Pike VM, so its thread lists are left
+// empty until then. Captures grow with the number of threads.
+void Regex::init_threads() {
+  auto keys = m_program.size() << m_loop_depth;
+  for (auto &t : m_threads) {
+    t.sparse.resize(keys);
+    t.dense.resize(keys);
+  }
+}
+
+auto Regex::symbol_of(uint32_t c) const -> int {
+  if (c < 128) return m_ascii_symbols[c];
+  return std::upper_bound(m_bounds.begin(), m_bounds.end(), c) - m_bounds.begin();
+}
+
+bool Regex::in_class(int i, uint32_t c) const {
+  const auto &cls = m_classes[i];
+  size_t a = 0, b = cls.size();
+  while (a < b) {
+    auto m = (a + b) / 2;
+    if (c < cls[m].lo) b = m;
+    else if (c > cls[m].hi) a = m + 1;
+    else return true;
+  }
+  return false;
+}
+
+bool Regex::check(int assertion, int context) const {
+  switch (assertion) {
+    case BEGIN_TEXT: return context & AT_START;
+    case END_TEXT: return context & AT_END;
+    case BEGIN_LINE: return context & (AT_START | PREV_LINE);
+    case END_LINE: return context & (AT_END | NEXT_LINE);
+    case WORD_BOUNDARY: return bool(context & PREV_WORD) != bool(context & NEXT_WORD);
+    case NOT_WORD_BOUNDARY: return bool(context & PREV_WORD) == bool(context & NEXT_WORD);
+  }
+  return false;
+}
+
+//
+// The lazy DFA
+//
+// A DFA state is the set of NFA instructions that are waiting for
+// the next code point: CHAR and MATCH, as well as ASSERT since that
+// can't be decided until the next code point is known. The context
+// of the previous code point is kept in the state key too.
+//
+// States are built on demand and cached. Once the cache is full it
+// is thrown away and built up again, so memory is bounded while
+// each code point still takes no more than one pass over the NFA.
+//
+
+bool Regex::test(const char *str, size_t len) {
+  auto s = dfa_start();
+  size_t i = 0;
+  while (s != m_dfa_match && s != m_dfa_dead) {
+    if (i >= len) {
+      s = dfa_next(s, m_symbol_count);
+      break;
+    }
+    uint32_t c = (uint8_t)str[i];
+    if (c < 0x80) i++; else i += utf8_decode(str + i, len - i, c);
+    s = dfa_next(s, symbol_of(c));
+  }
+  return s == m_dfa_match;
+}
+
+auto Regex::dfa_start() -> DFAState* {
+  if (!m_dfa_start) {
+    std::vector<int> key;
+    key.push_back(AT_START);
+    next_mark();
+    dfa_closure(0, key);
+    std::sort(key.begin() + 1, key.end());
+    m_dfa_start = dfa_state(key);
+  }
+  return m_dfa_start;
+}
+
+auto Regex::dfa_next(DFAState *s, int symbol) -> DFAState* {
+  if (auto next = s->next[symbol]) return next;
+
+  auto at_end = (symbol == m_symbol_count);
+  auto c = at_end ? -1 : int(m_symbol_reps[symbol]);
+  auto context = s->key[0] | next_context(c);
+
+  // Settle pending assertions now that the next code point is known
+  std::vector<int> chars;
+  m_stack.clear();
+  next_mark();
+  for (size_t i = 1; i < s->key.size(); i++) m_stack.push_back(s->key[i]);
+  while (!m_stack.empty()) {
+    auto pc = m_stack.back();
+    m_stack.pop_back();
+    if (m_marks[pc] == m_mark) continue;
+    m_marks[pc] = m_mark;
+    const auto &inst = m_program[pc];
+    switch (inst.op) {
+      case CHAR: chars.push_back(pc); break;
+      case SPLIT: m_stack.push_back(inst.y); m_stack.push_back(inst.x); break;
+      case JUMP: m_stack.push_back(inst.x); break;
+      case SAVE: case RESET: case CHECK: m_stack.push_back(pc + 1); break;
+      case ASSERT: if (check(inst.x, context)) m_stack.push_back(pc + 1); break;
+      case MATCH: return s->next[symbol] = m_dfa_match;
+    }
+  }
+
+  if (at_end) return s->next[symbol] = m_dfa_dead;
+
+  std::vector<int> key;
+  key.push_back(prev_context(c));
+  next_mark();
+  for (auto pc : chars) {
+    if (in_class(m_program[pc].x, c)) {
+      dfa_closure(pc + 1, key);
+    }
+  }
+  if (!m_anchored) dfa_closure(0, key);
+  std::sort(key.begin() + 1, key.end());
+
+  auto generation = m_dfa_generation;
+  auto next = dfa_state(key);
+  if (generation == m_dfa_generation) s->next[symbol] = next;
+  return next;
+}
+
+auto Regex::dfa_state(const std::vector<int> &key) -> DFAState* {
+  if (key.size() == 1) return m_dfa_dead;
+  for (size_t i = 1; i < key.size(); i++) {
+    if (m_program[key[i]].op == MATCH) return m_dfa_match;
+  }
+
+  auto i = m_dfa_states.find(key);
+  if (i != m_dfa_states.end()) return i->second;
+
+  if (m_dfa_states.size() >= size_t(MAX_DFA_STATES)) dfa_clear();
+
+  auto *s = new DFAState;
+  s->key = key;
+  s->next.resize(m_symbol_count + 1);
+  m_dfa_states[key] = s;
+  return s;
+}
+
+void Regex::dfa_clear() {
+  for (const auto &p : m_dfa_states) delete p.second;
+  m_dfa_states.clear();
+  m_dfa_start = nullptr;
+  m_dfa_generation++;
+}
+
+void Regex::next_mark() {
+  if (++m_mark == 0) {
+    std::fill(m_marks.begin(), m_marks.end(), 0);
+    m_mark = 1;
+  }
+}
+
+void Regex::dfa_closure(int pc, std::vector<int> &list) {
+  m_stack.clear();
+  m_stack.push_back(pc);
+  while (!m_stack.empty()) {
+    pc = m_stack.back();
+    m_stack.pop_back();
+    if (m_marks[pc] == m_mark) continue;
+    m_marks[pc] = m_mark;
+    const auto &inst = m_program[pc];
+    switch (inst.op) {
+      case SPLIT: m_stack.push_back(inst.y); m_stack.push_back(inst.x); break;
+      case JUMP: m_stack.push_back(inst.x); break;
+      case SAVE: case RESET: case CHECK: m_stack.push_back(pc + 1); break;
+      default: list.push_back(pc); break;
+    }
+  }
+}
+
+//
+// Regex::Scanner
+//
+
+Regex::Scanner::Scanner(Regex *regex)
+  : m_regex(regex)
+  , m_state(regex->dfa_start())
+  , m_generation(regex->m_dfa_generation)
+{
+  m_matched = (m_state == regex->m_dfa_match);
+  save();
+}
+
+bool Regex::Scanner::feed(const char *data, size_t size) {
+  if (m_matched || m_state == m_regex->m_dfa_dead) return m_matched;
+  restore();
+
+  auto *p = (const uint8_t *)data;
+  auto *e = p + size;
+  while (p < e) {
+    auto b = *p;
+    if (m_pending_size > 0) {
+      if ((b & 0xc0) == 0x80) {
+        m_pending[m_pending_size++] = b;
+        p++;
+        if (m_pending_size == utf8_length(m_pending[0])) {
+          uint32_t c;
+          utf8_decode(m_pending, m_pending_size, c);
+          m_pending_size = 0;
+          step(c);
+        }
+      } else {
+        for (int i = 0; i < m_pending_size; i++) step((uint8_t)m_pending[i]);
+        m_pending_size = 0;
+      }
+    } else if (b < 0x80) {
+      step(b);
+      p++;
+    } else {
+      if (utf8_length(b) > 1) m_pending[m_pending_size++] = b; else step(b);
+      p++;
+    }
+    if (m_matched || m_state == m_regex->m_dfa_dead) break;
+  }
+
+  save();
+  return m_matched;
+}
+
+bool Regex::Scanner::end() {
+  if (m_matched || m_state == m_regex->m_dfa_dead) return m_matched;
+  restore();
+  for (int i = 0; i < m_pending_size; i++) step((uint8_t)m_pending[i]);
+  m_pending_size = 0;
+  if (!m_matched && m_state != m_regex->m_dfa_dead) {
+    m_state = m_regex->dfa_next(m_state, m_regex->m_symbol_count);
+    m_matched = (m_state == m_regex->m_dfa_match);
+  }
+  save();
+  return m_matched;
+}
+
+void Regex::Scanner::step(uint32_t c) {
+  if (m_matched || m_state == m_regex->m_dfa_dead) return;
+  m_state = m_regex->dfa_next(m_state, m_regex->symbol_of(c));
+  m_matched = (m_state == m_regex->m_dfa_match);
+}
+
+void Regex::Scanner::save() {
+  if (m_state != m_regex->m_dfa_match && m_state != m_regex->m_dfa_dead) {
+    m_key = m_state->key;
+  }
+  m_generation = m_regex->m_dfa_generation;
+}
+
+void Regex::Scanner::restore() {
+  if (m_generation != m_regex->m_dfa_generation) {
+    m_state = m_regex->dfa_state(m_key);
+    m_generation = m_regex->m_dfa_generation;
+  }
+}
+
+//
+// The Pike VM
+//
+// All threads advance over the input in lock step. Threads are kept
+// in priority order and at most one thread is kept per instruction,
+// so the first thread reaching MATCH wins the way the first successful
+// path would in a backtracking matcher.
+//
+
+bool Regex::exec(const char *str, size_t len, size_t start, int *captures) {
+  if (start > len) return false;
+
+  auto states = (m_program.size() << m_loop_depth) * (len - start + 1);
+  if (states <= MAX_BACKTRACK_STATES) {
+    return backtrack(str, len, start, captures);
+  }
+
+  if (start == 0 && !test(str, len)) return false;
+  if (m_threads[0].sparse.empty()) init_threads();
+
+  auto n = m_captures.size();
+  auto *clist = &m_threads[0];
+  auto *nlist = &m_threads[1];
+  clist->size = 0;
+
+  bool matched = false;
+  size_t pos = start;
+  int prev = (pos > 0 ? utf8_decode_back(str, pos) : -1);
+  int cur = -1, cur_len = 0;
+  if (pos < len) {
+    uint32_t c;
+    cur_len = utf8_decode(str + pos, len - pos, c);
+    cur = c;
+  }
+
+  auto context = prev_context(prev) | next_context(cur);
+
+  for (;;) {
+    if (!matched && (!m_anchored || pos == 0)) {
+      std::fill(m_captures.begin(), m_captures.end(), -1);
+      add_thread(*clist, 0, m_captures.data(), pos, context);
+    }
+
+    if (clist->size == 0) break;
+
+    auto next_pos = pos + cur_len;
+    int next = -1, next_len = 0;
+    if (cur >= 0 && next_pos < len) {
+      uint32_t c;
+      next_len = utf8_decode(str + next_pos, len - next_pos, c);
+      next = c;
+    }
+
+    auto next_ctx = prev_context(cur) | next_context(next);
+
+    nlist->size = 0;
+    for (int i = 0; i < clist->size; i++) {
+      auto pc = clist->dense[i] >> m_loop_depth;
+      const auto &inst = m_program[pc];
+      if (inst.op == CHAR) {
+        if (cur >= 0 && in_class(inst.x, cur)) {
+          auto *caps = clist->captures.data() + i * n;
+          std::copy(caps, caps + n, m_captures.begin());
+          add_thread(*nlist, pc + 1, m_captures.data(), next_pos, next_ctx);
+        }
+      } else if (inst.op == MATCH) {
+        auto *caps = clist->captures.data() + i * n;
+        std::copy(caps, caps + 2 * (m_group_count + 1), captures);
+        matched = true;
+        break;
+      }
+    }
+
+    if (cur < 0) break;
+
+    std::swap(clist, nlist);
+    pos = next_pos;
+    cur = next;
+    cur_len = next_len;
+    context = next_ctx;
+  }
+
+  return matched;
+}
+
+//
+// The bounded backtracker
+//
+// Short inputs are matched depth-first in priority order, which is
+// cheaper than running all threads in lock step. A bitmap remembers
+// every state that has been tried, so no state is visited twice and
+// the running time stays linear.
+//
+
+bool Regex::backtrack(const char *str, size_t len, size_t start, int *captures) {
+  auto width = len - start + 1;
+  auto states = (m_program.size() << m_loop_depth) * width;
+  m_visited.assign((states + 31) / 32, 0);
+
+  auto *caps = m_captures.data();
+  auto &stack = m_stack;
+
+  size_t p = start;
+  for (;;) {
+    std::fill(m_captures.begin(), m_captures.end(), -1);
+    stack.clear();
+    stack.push_back(0);
+    stack.push_back(p);
+
+    while (!stack.empty()) {
+      int pos = stack.back(); stack.pop_back();
+      int pc = stack.back(); stack.pop_back();
+
+      // Restore a capture slot after returning from a SAVE
+      if (pc < 0) {
+        caps[-1 - pc] = pos;
+        continue;
+      }
+
+      for (;;) {
+        auto key = pc;
+        if (m_loop_depth > 0) {
+          const auto &slots = m_loop_slots[pc];
+          key <<= m_loop_depth;
+          for (size_t i = 0; i < slots.size(); i++) {
+            if (caps[slots[i]] == pos) key |= (1 << i);
+          }
+        }
+
+        auto bit = key * width + (pos - start);
+        auto &word = m_visited[bit >> 5];
+        auto mask = 1u << (bit & 31);
+        if (word & mask) break;
+        word |= mask;
+
+        const auto &inst = m_program[pc];
+        bool fail = false;
+        switch (inst.op) {
+          case CHAR:
+            if (size_t(pos) < len) {
+              uint32_t c;
+              auto n = utf8_decode(str + pos, len - pos, c);
+              if (in_class(inst.x, c)) {
+                pos += n;
+                pc++;
+                break;
+              }
+            }
+            fail = true;
+            break;
+          case SPLIT:
+            stack.push_back(inst.y);
+            stack.push_back(pos);
+            pc = inst.x;
+            break;
+          case JUMP:
+            pc = inst.x;
+            break;
+          case SAVE:
+            stack.push_back(-1 - inst.x);
+            stack.push_back(caps[inst.x]);
+            caps[inst.x] = pos;
+            pc++;
+            break;
+          case RESET:
+            for (int j = inst.x; j < inst.y; j++) {
+              stack.push_back(-1 - j);
+              stack.push_back(caps[j]);
+              caps[j] = -1;
+            }
+            pc++;
+            break;
+          case CHECK:
+            if (caps[inst.x] == pos) fail = true; else pc++;
+            break;
+          case ASSERT: {
+            int prev = -1, next = -1;
+            if (pos > 0) prev = utf8_decode_back(str, pos);
+            if (size_t(pos) < len) {
+              uint32_t c;
+              utf8_decode(str + pos, len - pos, c);
+              next = c;
+            }
+            if (check(inst.x, prev_context(prev) | next_context(next))) pc++; else fail = true;
+            break;
+          }
+          case MATCH:
+            std::copy(caps, caps + 2 * (m_group_count + 1), captures);
+            return true;
+        }
+        if (fail) break;
+      }
+    }
+
+    if (m_anchored || p >= len) break;
+    uint32_t c;
+    p += utf8_decode(str + p, len - p, c);
+  }
+
+  return false;
+}
+
+void Regex::add_thread(Threads &list, int pc, int *captures, int pos, int context) {
+  auto &stack = m_stack;
+  stack.clear();
+  stack.push_back(pc);
+  stack.push_back(0);
+
+  while (!stack.empty()) {
+    auto value = stack.back(); stack.pop_back();
+    pc = stack.back(); stack.pop_back();
+
+    // Restore a capture slot after returning from a SAVE
+    if (pc < 0) {
+      captures[-1 - pc] = value;
+      continue;
+    }
+
+    for (;;) {
+      auto key = pc;
+      if (m_loop_depth > 0) {
+        const auto &slots = m_loop_slots[pc];
+        key <<= m_loop_depth;
+        for (size_t i = 0; i < slots.size(); i++) {
+          if (captures[slots[i]] == pos) key |= (1 << i);
+        }
+      }
+
+      auto i = list.sparse[key];
+      if (i < list.size && list.dense[i] == key) break;
+      i = list.size++;
+      list.sparse[key] = i;
+      list.dense[i] = key;
+
+      const auto &inst = m_program[pc];
+      if (inst.op == JUMP) {
+        pc = inst.x;
+      } else if (inst.op == SPLIT) {
+        stack.push_back(inst.y);
+        stack.push_back(0);
+        pc = inst.x;
+      } else if (inst.op == SAVE) {
+        stack.push_back(-1 - inst.x);
+        stack.push_back(captures[inst.x]);
+        captures[inst.x] = pos;
+        pc++;
+      } else if (inst.op == RESET) {
+        for (int j = inst.x; j < inst.y; j++) {
+          stack.push_back(-1 - j);
+          stack.push_back(captures[j]);
+          captures[j] = -1;
+        }
+        pc++;
+      } else if (inst.op == CHECK) {
+        if (captures[inst.x] == pos) break;
+        pc++;
+      } else if (inst.op == ASSERT) {
+        if (!check(inst.x, context)) break;
+        pc++;
+      } else {
+        auto n = m_captures.size();
+        if (list.captures.size() < (i + 1) * n) list.captures.resize((i + 1) * n);
+        std::copy(captures, captures + n, list.captures.data() + i * n);
+        break;
+      }
+    }
+  }
+}
+
+} // namespace pjs
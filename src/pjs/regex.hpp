@@ -0,0 +1,209 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PJS_REGEX_HPP
+#define PJS_REGEX_HPP
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pjs {
+
+//
+// Regex
+//
+// A regular expression compiled to a Thompson NFA. Matching never
+// backtracks, so it runs in time linear to the input size:
+//
+//   - test() runs a lazily built DFA over the input, no captures needed
+//   - exec() finds captures with the same leftmost-first priority as
+//     JavaScript would, by a backtracker that never tries the same
+//     state twice on short inputs, or by a Pike VM on longer ones
+//
+// Both operate on UTF-8 bytes directly. Inputs that come in chunks
+// can be fed to a Scanner without being joined first.
+//
+// The DFA cache is mutable and not thread-safe, so compiled patterns
+// are shared per thread only. See Regex::get().
+//
+
+class Regex {
+public:
+  enum Flags {
+    ICASE     = 1 << 0,
+    MULTILINE = 1 << 1,
+    DOTALL    = 1 << 2,
+  };
+
+  static auto get(const std::string &pattern, int flags) -> std::shared_ptr<Regex>;
+
+  Regex(const std::string &pattern, int flags);
+  ~Regex();
+
+  auto flags() const -> int { return m_flags; }
+  auto group_count() const -> int { return m_group_count; }
+
+  class Scanner;
+
+  bool test(const char *str, size_t len);
+
+  // Searches from byte offset 'start' and fills in 2 * (group_count() + 1)
+  // byte offsets of the match and its groups, -1 for unmatched groups
+  bool exec(const char *str, size_t len, size_t start, int *captures);
+
+private:
+  enum Op : uint8_t {
+    CHAR,     // consume a code point in classes[x]
+    SPLIT,    // fork to x (preferred) and y
+    JUMP,     // goto x
+    SAVE,     // captures[x] = current position
+    RESET,    // captures[x] ... captures[y-1] = -1
+    CHECK,    // continue only if captures[x] != current position
+    ASSERT,   // continue only if assertion x holds
+    MATCH,
+  };
+
+  enum Assertion {
+    BEGIN_TEXT,
+    END_TEXT,
+    BEGIN_LINE,
+    END_LINE,
+    WORD_BOUNDARY,
+    NOT_WORD_BOUNDARY,
+  };
+
+  struct Inst {
+    Op op;
+    int x, y;
+  };
+
+  struct Range {
+    uint32_t lo, hi;
+  };
+
+  struct DFAState {
+    std::vector<int> key; // context bits followed by instruction indices
+    std::vector<DFAState*> next;
+  };
+
+  class Parser;
+  struct Node;
+
+  int m_flags;
+  int m_group_count = 0;
+  int m_slot_count = 0;
+  bool m_anchored = false;
+  std::vector<Inst> m_program;
+  std::vector<std::vector<Range>> m_classes;
+
+  // Code points are partitioned into intervals, within which every
+  // code point behaves the same to the whole program
+  std::vector<uint32_t> m_bounds;
+  std::vector<uint32_t> m_symbol_reps;
+  uint16_t m_ascii_symbols[128];
+  int m_symbol_count = 0;
+
+  // Lazy DFA
+  std::map<std::vector<int>, DFAState*> m_dfa_states;
+  DFAState* m_dfa_start = nullptr;
+  DFAState* m_dfa_match = nullptr;
+  DFAState* m_dfa_dead = nullptr;
+  int m_dfa_generation = 0;
+
+  // Pike VM, with thread lists allocated on first use
+  struct Threads {
+    std::vector<int> sparse;
+    std::vector<int> dense;
+    std::vector<int> captures;
+    int size = 0;
+  };
+
+  // Whether a thread has gone through an empty loop iteration makes a
+  // difference to its future, so it is part of the thread's identity
+  std::vector<std::vector<int>> m_loop_slots;
+  int m_loop_depth = 0;
+
+  Threads m_threads[2];
+  std::vector<uint32_t> m_visited;
+  std::vector<int> m_captures;
+  std::vector<int> m_stack;
+  std::vector<int> m_marks;
+  int m_mark = 0;
+
+  void compile(Node *node);
+  void compile_iteration(Node *node, bool check);
+  void build_loops();
+  void build_symbols();
+  void init_threads();
+
+  auto symbol_of(uint32_t c) const -> int;
+  bool in_class(int i, uint32_t c) const;
+  bool check(int assertion, int context) const;
+
+  bool backtrack(const char *str, size_t len, size_t start, int *captures);
+  void add_thread(Threads &list, int pc, int *captures, int pos, int context);
+
+  auto dfa_start() -> DFAState*;
+  auto dfa_next(DFAState *s, int symbol) -> DFAState*;
+  auto dfa_state(const std::vector<int> &key) -> DFAState*;
+  void dfa_clear();
+  void dfa_closure(int pc, std::vector<int> &list);
+  void next_mark();
+};
+
+//
+// Regex::Scanner
+//
+// Runs the DFA over input that arrives in pieces.
+//
+
+class Regex::Scanner {
+public:
+  Scanner(Regex *regex);
+
+  bool feed(const char *data, size_t size);
+  bool end();
+  bool matched() const { return m_matched; }
+
+private:
+  Regex* m_regex;
+  DFAState* m_state;
+  std::vector<int> m_key;
+  int m_generation;
+  char m_pending[4];
+  int m_pending_size = 0;
+  bool m_matched = false;
+
+  void step(uint32_t c);
+  void save();
+  void restore();
+};
+
+} // namespace pjs
+
+#endif // PJS_REGEX_HPP
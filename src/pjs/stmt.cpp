@@ -25,6 +25,7 @@
 
 #include "stmt.hpp"
 #include "module.hpp"
+#include "bytecode.hpp"
 
 #include <algorithm>
 
@@ -133,6 +134,7 @@ bool Evaluate::declare(Module *module, Tree::Scope &scope, Error &error) {
 
 void Evaluate::resolve(Module *module, Context &ctx, int l, Tree::LegacyImports *imports) {
   m_expr->resolve(module, ctx, l, imports);
+  Bytecode::compile(m_expr);
 }
 
 void Evaluate::execute(Context &ctx, Result &result) {
@@ -181,6 +183,7 @@ void Var::resolve(Module *module, Context &ctx, int l, Tree::LegacyImports *impo
   if (m_expr) {
     m_identifier->resolve(module, ctx, l, imports);
     m_expr->resolve(module, ctx, l, imports);
+    Bytecode::compile(m_expr);
   }
 }
 
@@ -308,6 +311,7 @@ void If::resolve(Module *module, Context &ctx, int l, Tree::LegacyImports *impor
   m_cond->resolve(module, ctx, l, imports);
   m_then->resolve(module, ctx, l, imports);
   if (m_else) m_else->resolve(module, ctx, l, imports);
+  Bytecode::compile(m_cond);
 }
 
 void If::execute(Context &ctx, Result &result) {
@@ -461,7 +465,10 @@ bool Return::declare(Module *module, Tree::Scope &scope, Error &error) {
 }
 
 void Return::resolve(Module *module, Context &ctx, int l, Tree::LegacyImports *imports) {
-  if (m_expr) m_expr->resolve(module, ctx, l, imports);
+  if (m_expr) {
+    m_expr->resolve(module, ctx, l, imports);
+    Bytecode::compile(m_expr);
+  }
 }
 
 void Return::execute(Context &ctx, Result &result) {
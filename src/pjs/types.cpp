@@ -29,6 +29,7 @@
 #include <cstdio>
 #include <cstring>
 #include <cmath>
+#include <climits>
 
 namespace pjs {
 
@@ -200,6 +201,27 @@ auto Str::local_map() -> LocalMap& {
   return s_local_map;
 }
 
+auto Str::hash(const char *str, size_t len) -> size_t {
+  static const uint64_t k = 0x9e3779b97f4a7c15ull;
+  auto mix = [](uint64_t h, uint64_t v) -> uint64_t {
+    h ^= v * k;
+    h = (h << 27) | (h >> 37);
+    return h * 0xff51afd7ed558ccdull;
+  };
+  uint64_t h = len * k;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t v; std::memcpy(&v, str + i, 8);
+    h = mix(h, v);
+  }
+  if (i < len) {
+    uint64_t v = 0; std::memcpy(&v, str + i, len - i);
+    h = mix(h, v);
+  }
+  h ^= h >> 29;
+  return size_t(h);
+}
+
 auto Str::make(const uint32_t *codes, size_t len) -> Str* {
   if (len > s_max_size) len = s_max_size;
   auto buf_size = len * 4;
@@ -272,7 +294,10 @@ auto Str::substring(int start, int end) -> std::string {
 // Str::CharData
 //
 
-Str::CharData::CharData(std::string &&str) : m_str(std::move(str)) {
+Str::CharData::CharData(std::string &&str, size_t hash, bool hashed)
+  : m_str(std::move(str))
+  , m_hash(hashed ? hash : Str::hash(m_str.c_str(), m_str.length()))
+{
   int n = 0, p = 0, i = 0;
   Utf8Decoder decoder(
     [&](int cp) {
@@ -1580,7 +1605,7 @@ template<> void ClassDef<String>::init() {
   method("match", [](Context &ctx, Object *obj, Value &ret) {
     RegExp *pattern;
     if (!ctx.arguments(1, &pattern)) return;
-    ret.set(pattern->exec(obj->as<String>()->str()));
+    ret.set(obj->as<String>()->match(pattern));
   });
 
   method("padEnd", [](Context &ctx, Object *obj, Value &ret) {
@@ -1836,16 +1861,85 @@ auto String::replace(Str *pattern, Str *replacement, bool all) -> Str* {
 auto String::replace(RegExp *pattern, Str *replacement) -> Str* {
   auto &s = m_s->str();
   auto &fmt = replacement->str();
-  auto &re = pattern->regex();
-  return Str::make(std::regex_replace(s, re, fmt));
+  auto re = pattern->regex();
+  auto n = re->group_count() + 1;
+  vl_array<int, 20> captures(n * 2);
+  std::string result;
+  size_t i = 0, p = 0;
+  while (p <= s.length() && re->exec(s.c_str(), s.length(), p, captures)) {
+    size_t a = captures[0], b = captures[1];
+    result.append(s, i, a - i);
+    for (size_t j = 0; j < fmt.length(); j++) {
+      auto c = fmt[j];
+      if (c != '$' || j + 1 >= fmt.length()) {
+        result += c;
+        continue;
+      }
+      auto d = fmt[j+1];
+      switch (d) {
+        case '$' : result += '$'; j++; continue;
+        case '&' : result.append(s, a, b - a); j++; continue;
+        case '`' : result.append(s, 0, a); j++; continue;
+        case '\'': result.append(s, b, std::string::npos); j++; continue;
+      }
+      if ('0' <= d && d <= '9') {
+        int k = d - '0', l = 1;
+        if (j + 2 < fmt.length() && '0' <= fmt[j+2] && fmt[j+2] <= '9') {
+          int kk = k * 10 + (fmt[j+2] - '0');
+          if (kk > 0 && kk < n) { k = kk; l = 2; }
+        }
+        if (k > 0 && k < n) {
+          if (captures[k*2] >= 0) result.append(s, captures[k*2], captures[k*2+1] - captures[k*2]);
+          j += l;
+          continue;
+        }
+      }
+      result += c;
+    }
+    i = b;
+    if (!pattern->global()) break;
+    if (a == b) {
+      if (b >= s.length()) break;
+      p = b + 1;
+      while (p < s.length() && (s[p] & 0xc0) == 0x80) p++;
+    } else {
+      p = b;
+    }
+  }
+  if (pattern->global()) pattern->last_index(0);
+  result.append(s, i, std::string::npos);
+  return Str::make(result);
+}
+
+auto String::match(RegExp *pattern) -> Array* {
+  if (!pattern->global()) return pattern->exec(m_s);
+  auto &s = m_s->str();
+  auto re = pattern->regex();
+  vl_array<int, 20> captures((re->group_count() + 1) * 2);
+  Array *result = nullptr;
+  size_t p = 0;
+  while (p <= s.length() && re->exec(s.c_str(), s.length(), p, captures)) {
+    size_t a = captures[0], b = captures[1];
+    if (!result) result = Array::make();
+    result->push(Str::make(s.c_str() + a, b - a));
+    if (a == b) {
+      if (b >= s.length()) break;
+      p = b + 1;
+      while (p < s.length() && (s[p] & 0xc0) == 0x80) p++;
+    } else {
+      p = b;
+    }
+  }
+  pattern->last_index(0);
+  return result;
 }
 
 auto String::search(RegExp *pattern) -> int {
-  std::smatch sm;
-  std::regex_search(m_s->str(), sm, pattern->regex());
-  if (sm.empty()) return -1;
-  auto p = sm.position(0);
-  return m_s->pos_to_chr(p);
+  auto &s = m_s->str();
+  auto re = pattern->regex();
+  vl_array<int, 20> captures((re->group_count() + 1) * 2);
+  if (!re->exec(s.c_str(), s.length(), 0, captures)) return -1;
+  return m_s->pos_to_chr(captures[0]);
 }
 
 auto String::slice(int start) -> Str* {
@@ -3401,7 +3495,14 @@ template<> void ClassDef<RegExp>::init() {
   accessor("source",      [](Object *obj, Value &ret) { ret.set(obj->as<RegExp>()->source()); });
   accessor("global",      [](Object *obj, Value &ret) { ret.set(obj->as<RegExp>()->global()); });
   accessor("ignoreCase",  [](Object *obj, Value &ret) { ret.set(obj->as<RegExp>()->ignore_case()); });
-  accessor("lastIndex",   [](Object *obj, Value &ret) { ret.set(obj->as<RegExp>()->last_index()); });
+  accessor("multiline",   [](Object *obj, Value &ret) { ret.set(obj->as<RegExp>()->multiline()); });
+  accessor("dotAll",      [](Object *obj, Value &ret) { ret.set(obj->as<RegExp>()->dot_all()); });
+  accessor("lastIndex",   [](Object *obj, Value &ret) { ret.set(obj->as<RegExp>()->last_index()); },
+                          [](Object *obj, const Value &val) {
+                            // ToLength: negatives and NaN become 0
+                            auto n = val.to_number();
+                            obj->as<RegExp>()->last_index(n > 0 ? int(std::min(n, double(INT_MAX))) : 0);
+                          });
 }
 
 template<> void ClassDef<Constructor<RegExp>>::init() {
@@ -3411,51 +3512,72 @@ template<> void ClassDef<Constructor<RegExp>>::init() {
 
 RegExp::RegExp(Str *pattern)
   : m_source(pattern)
-  , m_regex(pattern->str(), chars_to_flags(nullptr, m_global))
+  , m_regex(Regex::get(pattern->str(), chars_to_flags(nullptr, m_global)))
 {
 }
 
 RegExp::RegExp(Str *pattern, Str *flags)
   : m_source(pattern)
-  , m_regex(pattern->str(), chars_to_flags(flags, m_global))
+  , m_regex(Regex::get(pattern->str(), chars_to_flags(flags, m_global)))
 {
 }
 
 auto RegExp::exec(Str *str) -> Array* {
-  std::smatch sm;
-  auto &match = m_global ? m_match : sm;
+  auto &s = str->str();
+  auto n = m_regex->group_count() + 1;
+  vl_array<int, 20> captures(n * 2);
 
-  std::regex_search(str->str(), match, m_regex);
-  if (match.empty()) return nullptr;
+  size_t start = 0;
+  if (m_global) {
+    if (m_last_index > str->length()) {
+      m_last_index = 0;
+      return nullptr;
+    }
+    start = str->chr_to_pos(m_last_index);
+  }
 
-  auto result = Array::make(match.size());
-  for (size_t i = 0; i < match.size(); i++) {
-    auto &sm = match[i];
-    result->set(i, Str::make(sm.str()));
+  if (!m_regex->exec(s.c_str(), s.length(), start, captures)) {
+    if (m_global) m_last_index = 0;
+    return nullptr;
+  }
+
+  auto result = Array::make(n);
+  for (int i = 0; i < n; i++) {
+    auto a = captures[i*2];
+    auto b = captures[i*2+1];
+    if (a >= 0) {
+      result->set(i, Str::make(s.c_str() + a, b - a));
+    } else {
+      result->set(i, Value::undefined);
+    }
   }
 
   if (m_global) {
-    auto p = match[0].second - str->str().begin();
-    m_last_index = str->pos_to_chr(p);
+    m_last_index = str->pos_to_chr(captures[1]);
   }
 
   return result;
 }
 
 bool RegExp::test(Str *str) {
-  std::smatch match;
-  std::regex_search(str->str(), match, m_regex);
-  return !match.empty();
+  if (m_global) {
+    Ref<Array> result(exec(str));
+    return result;
+  }
+  auto &s = str->str();
+  return m_regex->test(s.c_str(), s.length());
 }
 
-auto RegExp::chars_to_flags(Str *chars, bool &global) -> std::regex::flag_type {
-  std::regex::flag_type flags = std::regex::ECMAScript | std::regex::optimize;
+auto RegExp::chars_to_flags(Str *chars, bool &global) -> int {
+  int flags = 0;
   global = false;
 
   if (chars) {
     for (auto c : chars->str()) {
       switch (c) {
-        case 'i': flags |= std::regex::icase; break;
+        case 'i': flags |= Regex::ICASE; break;
+        case 'm': flags |= Regex::MULTILINE; break;
+        case 's': flags |= Regex::DOTALL; break;
         case 'g': global = true; break;
         default: throw std::runtime_error(std::string("invalid RegExp flags: ") + chars->str());
       }
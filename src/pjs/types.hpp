@@ -26,6 +26,8 @@
 #ifndef PJS_TYPES_HPP
 #define PJS_TYPES_HPP
 
+#include "regex.hpp"
+
 #include <algorithm>
 #include <atomic>
 #include <cassert>
@@ -36,7 +38,6 @@
 #include <list>
 #include <map>
 #include <memory>
-#include <regex>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -779,6 +780,7 @@ public:
     auto c_str() const -> const char * { return m_str.c_str(); }
     auto size() const -> size_t { return m_str.length(); }
     auto length() const -> int { return m_length; }
+    auto hash() const -> size_t { return m_hash; }
 
     auto pos_to_chr(int i) const -> int;
     auto chr_to_pos(int i) const -> int;
@@ -787,10 +789,13 @@ public:
   private:
     enum { CHUNK_SIZE = 32 };
 
-    CharData(std::string &&str);
+    CharData(std::string &&str) : CharData(std::move(str), 0, false) {}
+    CharData(std::string &&str, size_t hash) : CharData(std::move(str), hash, true) {}
+    CharData(std::string &&str, size_t hash, bool hashed);
     ~CharData() {}
 
     const std::string m_str;
+    size_t m_hash;
     int m_length;
     std::vector<uint32_t> m_chunks;
 
@@ -803,25 +808,21 @@ public:
   }
 
   static auto make(const std::string &str) -> Str* {
-    if (str.length() > s_max_size) {
-      auto sub = str.substr(0, s_max_size);
-      if (auto s = local_map().get(sub)) return s;
-      return new Str(std::move(sub));
-    } else {
-      if (auto s = local_map().get(str)) return s;
-      return new Str(str);
-    }
+    return make(str.c_str(), str.length());
   }
 
   static auto make(std::string &&str) -> Str* {
     if (str.length() > s_max_size) str.resize(s_max_size);
-    if (auto s = local_map().get(str)) return s;
-    return new Str(std::move(str));
+    auto h = hash(str.c_str(), str.length());
+    if (auto s = local_map().get(str.c_str(), str.length(), h)) return s;
+    return new Str(new CharData(std::move(str), h));
   }
 
   static auto make(const char *str, size_t len) -> Str* {
-    std::string s(str, std::min(s_max_size, len));
-    return make(std::move(s));
+    if (len > s_max_size) len = s_max_size;
+    auto h = hash(str, len);
+    if (auto s = local_map().get(str, len, h)) return s;
+    return new Str(new CharData(std::string(str, len), h));
   }
 
   static auto make(const char *str) -> Str* {
@@ -829,7 +830,7 @@ public:
   }
 
   static auto make(CharData *data) -> Str* {
-    if (auto s = local_map().get(data->str())) return s;
+    if (auto s = local_map().get(data->c_str(), data->size(), data->hash())) return s;
     return new Str(data);
   }
 
@@ -859,6 +860,10 @@ private:
   //
   // Str::LocalMap
   //
+  // Keys point into the character data of the interned strings
+  // and carry their precomputed hashes, so a lookup hashes the
+  // input only once and never copies it.
+  //
 
   class LocalMap {
   public:
@@ -866,25 +871,42 @@ private:
       m_destructed = true;
     }
 
-    auto get(const std::string &k) -> Str* {
+    auto get(const char *ptr, size_t len, size_t hash) -> Str* {
       if (m_destructed) return nullptr;
-      auto i = m_hash.find(k);
+      auto i = m_hash.find(Key{ ptr, len, hash });
       if (i == m_hash.end()) return nullptr;
       return i->second;
     }
 
-    void set(const std::string &k, Str *s) {
+    void set(CharData *data, Str *s) {
       if (m_destructed) return;
-      m_hash[k] = s;
+      m_hash[Key{ data->c_str(), data->size(), data->hash() }] = s;
     }
 
-    void erase(const std::string &k) {
+    void erase(CharData *data) {
       if (m_destructed) return;
-      m_hash.erase(k);
+      m_hash.erase(Key{ data->c_str(), data->size(), data->hash() });
     }
 
   private:
-    std::unordered_map<std::string, Str*> m_hash;
+    struct Key {
+      const char *ptr;
+      size_t len;
+      size_t hash;
+
+      bool operator==(const Key &k) const {
+        return (
+          hash == k.hash && len == k.len &&
+          (ptr == k.ptr || !std::memcmp(ptr, k.ptr, len))
+        );
+      }
+    };
+
+    struct KeyHash {
+      size_t operator()(const Key &k) const { return k.hash; }
+    };
+
+    std::unordered_map<Key, Str*, KeyHash> m_hash;
     bool m_destructed = false;
   };
 
@@ -900,7 +922,7 @@ private:
     , m_thread_id(std::this_thread::get_id())
 #endif
   {
-    local_map().set(char_data->str(), this);
+    local_map().set(char_data, this);
   }
 
   Str(const std::string &str) : Str(new CharData(std::string(str))) {}
@@ -908,12 +930,13 @@ private:
 
   ~Str() {
     assert_same_thread(*this);
-    local_map().erase(m_char_data->str());
+    local_map().erase(m_char_data);
   }
 
   static size_t s_max_size;
 
   static auto local_map() -> LocalMap&;
+  static auto hash(const char *str, size_t len) -> size_t;
 
   static void assert_same_thread(const Str &str) {
 #ifdef PIPY_ASSERT_SAME_THREAD
@@ -3226,69 +3249,111 @@ public:
   }
 
   bool has(Object *obj, Str *key) {
-    auto i = find(obj->type(), key);
-    if (i >= 0) return true;
+    if (lookup(obj->type(), key)->kind != Entry::HASH) return true;
     else return obj->ht_has(key);
   }
 
   bool del(Object *obj, Str *key) {
-    auto i = find(obj->type(), key);
-    if (i >= 0) return false;
+    if (lookup(obj->type(), key)->kind != Entry::HASH) return false;
     obj->ht_delete(key);
     return true;
   }
 
   void get(Object *obj, Str *key, Value &val) {
-    auto type = obj->type();
-    auto i = find(type, key);
-    if (i >= 0) {
-      auto f = type->field(i);
-      if (f->is_accessor()) {
-        static_cast<Accessor*>(f)->get(obj, val);
+    auto e = lookup(obj->type(), key);
+    switch (e->kind) {
+      case Entry::VARIABLE:
+        val = obj->data()->at(e->slot);
         return;
-      }
-      if (f->is_method()) {
-        auto v = Function::make(static_cast<Method*>(f), obj);
-        val.set(v);
+      case Entry::ACCESSOR:
+        static_cast<Accessor*>(e->field)->get(obj, val);
+        return;
+      case Entry::METHOD:
+        val.set(Function::make(static_cast<Method*>(e->field), obj));
+        return;
+      default:
+        obj->ht_get(key, val);
         return;
-      }
-      val = obj->data()->at(static_cast<Variable*>(f)->index());
-      return;
     }
-    obj->ht_get(key, val);
   }
 
   void set(Object *obj, Str *key, const Value &val) {
-    auto type = obj->type();
-    auto i = find(type, key);
-    if (i >= 0) {
-      auto f = type->field(i);
-      if (f->is_accessor()) {
-        static_cast<Accessor*>(f)->set(obj, val);
-        return;
-      }
-      if (f->is_variable() && f->is_writable()) {
-        obj->data()->at(static_cast<Variable*>(f)->index()) = val;
+    auto e = lookup(obj->type(), key);
+    switch (e->kind) {
+      case Entry::ACCESSOR:
+        static_cast<Accessor*>(e->field)->set(obj, val);
         return;
-      }
+      case Entry::VARIABLE:
+        if (e->field->is_writable()) {
+          obj->data()->at(e->slot) = val;
+          return;
+        }
+        break;
+      default: break;
     }
     obj->ht_set(key, val);
   }
 
 private:
+
+  //
+  // Polymorphic inline cache: one entry per class seen at this site,
+  // holding the resolved field so that a hit costs a pointer compare.
+  // Class layouts never change after construction and entries keep
+  // their class alive, so an entry stays valid until it's recycled.
+  //
+
+  enum { MAX_SHAPES = 4 };
+
+  struct Entry {
+    enum Kind { HASH, VARIABLE, ACCESSOR, METHOD };
+    Ref<Class> type;
+    Field* field = nullptr;
+    Kind kind = HASH;
+    int slot = -1;
+  };
+
   Ref<Str> m_const_key;
   Ref<Str> m_key;
-  Ref<Class> m_class;
-  int m_index = -1;
+  Entry m_entries[MAX_SHAPES];
+  int m_size = 0;
+  int m_next = 0;
 
-  int find(Class *type, Str *key) {
-    auto i = m_index;
-    if (type != m_class || key != m_key) {
-      m_class = type;
+  auto lookup(Class *type, Str *key) -> Entry* {
+    if (key != m_key) {
       m_key = key;
-      m_index = (i = type->find_field(key));
+      m_size = 0;
+      m_next = 0;
+    }
+    for (int i = 0; i < m_size; i++) {
+      auto e = &m_entries[i];
+      if (e->type.get() == type) return e;
+    }
+    Entry *e;
+    if (m_size < MAX_SHAPES) {
+      e = &m_entries[m_size++];
+    } else {
+      e = &m_entries[m_next];
+      m_next = (m_next + 1) % MAX_SHAPES;
+    }
+    e->type = type;
+    e->field = nullptr;
+    e->kind = Entry::HASH;
+    e->slot = -1;
+    auto i = type->find_field(key);
+    if (i >= 0) {
+      auto f = type->field(i);
+      e->field = f;
+      switch (f->type()) {
+        case Field::Variable:
+          e->kind = Entry::VARIABLE;
+          e->slot = static_cast<Variable*>(f)->index();
+          break;
+        case Field::Accessor: e->kind = Entry::ACCESSOR; break;
+        case Field::Method: e->kind = Entry::METHOD; break;
+      }
     }
-    return i;
+    return e;
   }
 };
 
@@ -3522,6 +3587,7 @@ public:
   auto repeat(int count) -> Str*;
   auto replace(Str *pattern, Str *replacement, bool all = false) -> Str*;
   auto replace(RegExp *pattern, Str *replacement) -> Str*;
+  auto match(RegExp *pattern) -> Array*;
   auto search(RegExp *pattern) -> int;
   auto slice(int start) -> Str*;
   auto slice(int start, int end) -> Str*;
@@ -3751,12 +3817,15 @@ public:
 
 class RegExp : public ObjectTemplate<RegExp> {
 public:
-  auto regex() const -> const std::regex& { return m_regex; }
+  auto regex() const -> Regex* { return m_regex.get(); }
 
   auto source() const -> Str* { return m_source; }
   bool global() const { return m_global; }
-  bool ignore_case() const { return m_regex.flags() & std::regex::icase; }
+  bool ignore_case() const { return m_regex->flags() & Regex::ICASE; }
+  bool multiline() const { return m_regex->flags() & Regex::MULTILINE; }
+  bool dot_all() const { return m_regex->flags() & Regex::DOTALL; }
   auto last_index() const -> int { return m_last_index; }
+  void last_index(int i) { m_last_index = i; }
 
   auto exec(Str *str) -> Array*;
   bool test(Str *str);
@@ -3766,12 +3835,11 @@ private:
   RegExp(Str *pattern, Str *flags);
 
   Ref<Str> m_source;
-  std::regex m_regex;
-  std::smatch m_match;
+  std::shared_ptr<Regex> m_regex;
   bool m_global;
   int m_last_index = 0;
 
-  static auto chars_to_flags(Str *chars, bool &global) -> std::regex::flag_type;
+  static auto chars_to_flags(Str *chars, bool &global) -> int;
 
   friend class ObjectTemplate<RegExp>;
 };
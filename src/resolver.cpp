@@ -0,0 +1,1004 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "resolver.hpp"
+#include "api/dns.hpp"
+#include "data.hpp"
+#include "fs.hpp"
+#include "timer.hpp"
+#include "utils.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+namespace pipy {
+
+using tcp = asio::ip::tcp;
+using udp = asio::ip::udp;
+
+static const int DNS_PORT = 53;
+static const int MAX_NAMESERVERS = 3;
+static const int MAX_UDP_SIZE = 512;
+static const int TYPE_A = 1;
+static const int TYPE_AAAA = 28;
+static const int RCODE_NOERROR = 0;
+static const int RCODE_NXDOMAIN = 3;
+static const size_t MAX_CACHE_SIZE = 10000;
+static const double MAX_TTL = 24 * 60 * 60;
+static const double MAX_NEGATIVE_TTL = 60 * 60;
+static const double DEFAULT_NEGATIVE_TTL = 30;
+static const double CONFIG_CHECK_INTERVAL = 5;
+static const double RESOLUTION_DELAY = 0.05;
+
+static std::string s_resolv_conf_path("/etc/resolv.conf");
+static std::string s_hosts_path("/etc/hosts");
+
+static Data::Producer s_dp("DNS Resolver");
+
+thread_local static pjs::ConstStr s_id("id");
+thread_local static pjs::ConstStr s_qr("qr");
+thread_local static pjs::ConstStr s_tc("tc");
+thread_local static pjs::ConstStr s_rd("rd");
+thread_local static pjs::ConstStr s_rcode("rcode");
+thread_local static pjs::ConstStr s_question("question");
+thread_local static pjs::ConstStr s_answer("answer");
+thread_local static pjs::ConstStr s_authority("authority");
+thread_local static pjs::ConstStr s_name("name");
+thread_local static pjs::ConstStr s_type("type");
+thread_local static pjs::ConstStr s_ttl("ttl");
+thread_local static pjs::ConstStr s_rdata("rdata");
+thread_local static pjs::ConstStr s_minimum("minimum");
+thread_local static pjs::ConstStr s_A("A");
+thread_local static pjs::ConstStr s_AAAA("AAAA");
+thread_local static pjs::ConstStr s_SOA("SOA");
+
+static auto normalize_name(const std::string &name) -> std::string {
+  auto s = name;
+  if (!s.empty() && s.back() == '.') s.pop_back();
+  std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+  return s;
+}
+
+//
+// Config
+//
+
+struct Config {
+  std::vector<udp::endpoint> nameservers;
+  std::vector<std::string> search;
+  std::map<std::string, Resolver::Addresses> hosts;
+  int ndots = 1;
+  double timeout = 5;
+  int attempts = 2;
+  bool query_v4 = true;
+  bool query_v6 = true;
+  double resolv_conf_time = 0;
+  double hosts_time = 0;
+};
+
+static auto split_words(const std::string &line) -> std::vector<std::string> {
+  std::vector<std::string> words;
+  std::istringstream ss(line);
+  std::string w;
+  while (ss >> w) words.push_back(w);
+  return words;
+}
+
+// Takes an address with an optional port as in "127.0.0.1:5353" or
+// "[::1]:5353". Ports are not in resolv.conf(5) but come in handy
+// for pointing the resolver to a test server.
+static bool parse_nameserver(const std::string &str, udp::endpoint &ep) {
+  auto host = str;
+  int port = DNS_PORT;
+  auto p = str.rfind(':');
+  if (!str.empty() && str[0] == '[') {
+    auto q = str.find(']');
+    if (q == std::string::npos) return false;
+    host = str.substr(1, q - 1);
+    if (q + 1 < str.length()) {
+      if (str[q + 1] != ':') return false;
+      port = std::atoi(str.c_str() + q + 2);
+    }
+  } else if (p != std::string::npos && str.find(':') == p) {
+    host = str.substr(0, p);
+    port = std::atoi(str.c_str() + p + 1);
+  }
+  if (port <= 0 || port > 65535) return false;
+  asio::error_code ec;
+  auto addr = asio::ip::make_address(host, ec);
+  if (ec) return false;
+  ep = udp::endpoint(addr, port);
+  return true;
+}
+
+// Tells if there is a route to an address, like AI_ADDRCONFIG does.
+// Connecting a UDP socket sends nothing.
+static bool has_route(const char *addr) {
+  asio::io_context ctx;
+  udp::socket s(ctx);
+  asio::error_code ec;
+  s.connect(udp::endpoint(asio::ip::make_address(addr), DNS_PORT), ec);
+  return !ec;
+}
+
+static auto load_config() -> Config* {
+  auto *config = new Config;
+  config->resolv_conf_time = fs::get_file_time(s_resolv_conf_path);
+  config->hosts_time = fs::get_file_time(s_hosts_path);
+
+  std::ifstream rc(s_resolv_conf_path);
+  if (rc.is_open()) {
+    std::string line;
+    while (std::getline(rc, line)) {
+      auto p = line.find_first_of("#;");
+      if (p != std::string::npos) line.erase(p);
+      auto words = split_words(line);
+      if (words.size() < 2) continue;
+      const auto &key = words[0];
+      if (key == "nameserver") {
+        udp::endpoint ep;
+        if (parse_nameserver(words[1], ep) && config->nameservers.size() < MAX_NAMESERVERS) {
+          config->nameservers.push_back(ep);
+        }
+      } else if (key == "search" || key == "domain") {
+        config->search.clear();
+        for (size_t i = 1; i < words.size(); i++) {
+          config->search.push_back(normalize_name(words[i]));
+        }
+      } else if (key == "options") {
+        for (size_t i = 1; i < words.size(); i++) {
+          const auto &opt = words[i];
+          auto p = opt.find(':');
+          if (p == std::string::npos) continue;
+          auto name = opt.substr(0, p);
+          auto n = std::atoi(opt.c_str() + p + 1);
+          if (name == "ndots") config->ndots = std::min(n, 15);
+          else if (name == "timeout" && n > 0) config->timeout = std::min(n, 30);
+          else if (name == "attempts" && n > 0) config->attempts = std::min(n, 5);
+        }
+      }
+    }
+    if (config->nameservers.empty()) {
+      config->nameservers.push_back(udp::endpoint(asio::ip::make_address("127.0.0.1"), DNS_PORT));
+    }
+  }
+
+  std::ifstream hosts(s_hosts_path);
+  if (hosts.is_open()) {
+    std::string line;
+    while (std::getline(hosts, line)) {
+      auto p = line.find('#');
+      if (p != std::string::npos) line.erase(p);
+      auto words = split_words(line);
+      if (words.size() < 2) continue;
+      asio::error_code ec;
+      auto addr = asio::ip::make_address(words[0], ec);
+      if (ec) continue;
+      for (size_t i = 1; i < words.size(); i++) {
+        auto &list = config->hosts[normalize_name(words[i])];
+        if (std::find(list.begin(), list.end(), addr) == list.end()) {
+          list.push_back(addr);
+        }
+      }
+    }
+  }
+
+  // Without a route in either family, keep asking for both
+  auto v4 = has_route("198.51.100.1");
+  auto v6 = has_route("2001:db8::1");
+  if (v4 || v6) {
+    config->query_v4 = v4;
+    config->query_v6 = v6;
+  }
+
+  return config;
+}
+
+//
+// Reloaded when resolv.conf or /etc/hosts changes. Each thread looks
+// at the file times at most once every CONFIG_CHECK_INTERVAL seconds.
+// Queries keep the config they started with.
+//
+
+static auto current_config() -> std::shared_ptr<const Config> {
+  static auto *current = new std::shared_ptr<const Config>;
+  static auto *mutex = new std::mutex;
+  thread_local static std::shared_ptr<const Config> local;
+  thread_local static double check_time = 0;
+
+  auto now = utils::now();
+  if (local && now < check_time + CONFIG_CHECK_INTERVAL * 1000) return local;
+  check_time = now;
+
+  auto resolv_conf_time = fs::get_file_time(s_resolv_conf_path);
+  auto hosts_time = fs::get_file_time(s_hosts_path);
+
+  std::lock_guard<std::mutex> lock(*mutex);
+  auto &config = *current;
+  if (!config || config->resolv_conf_time != resolv_conf_time || config->hosts_time != hosts_time) {
+    config.reset(load_config());
+  }
+  local = config;
+  return local;
+}
+
+// Orders addresses as RFC 8305 suggests: alternating families, IPv6 first
+static void interleave(const Resolver::Addresses &addresses, Resolver::Addresses &sorted) {
+  Resolver::Addresses v4, v6;
+  for (const auto &a : addresses) {
+    (a.is_v6() ? v6 : v4).push_back(a);
+  }
+  sorted.clear();
+  for (size_t i = 0; i < v4.size() || i < v6.size(); i++) {
+    if (i < v6.size()) sorted.push_back(v6[i]);
+    if (i < v4.size()) sorted.push_back(v4[i]);
+  }
+}
+
+//
+// Cache
+//
+// Shared by all threads. Negative answers are entries with no addresses.
+//
+
+class Cache {
+public:
+  static bool get(const std::string &name, Resolver::Addresses &addresses) {
+    auto &c = cache();
+    std::lock_guard<std::mutex> lock(mutex());
+    auto i = c.find(name);
+    if (i == c.end()) return false;
+    if (i->second.expiration <= utils::now()) {
+      c.erase(i);
+      return false;
+    }
+    addresses = i->second.addresses;
+    return true;
+  }
+
+  static void set(const std::string &name, const Resolver::Addresses &addresses, double ttl) {
+    if (ttl <= 0) return;
+    auto &c = cache();
+    auto now = utils::now();
+    std::lock_guard<std::mutex> lock(mutex());
+    if (c.size() >= MAX_CACHE_SIZE && !c.count(name)) {
+      for (auto i = c.begin(); i != c.end(); ) {
+        if (i->second.expiration <= now) i = c.erase(i); else i++;
+      }
+      if (c.size() >= MAX_CACHE_SIZE) c.erase(c.begin());
+    }
+    auto &e = c[name];
+    e.addresses = addresses;
+    e.expiration = now + ttl * 1000;
+  }
+
+private:
+  struct Entry {
+    Resolver::Addresses addresses;
+    double expiration;
+  };
+
+  static auto cache() -> std::unordered_map<std::string, Entry>& {
+    static auto *c = new std::unordered_map<std::string, Entry>;
+    return *c;
+  }
+
+  static auto mutex() -> std::mutex& {
+    static auto *m = new std::mutex;
+    return *m;
+  }
+};
+
+//
+// Resolver::Question
+//
+// One question of type A or AAAA, sent to each nameserver in turn
+// until an answer comes back or all attempts are used up.
+//
+
+class Resolver::Question {
+public:
+  enum class Result {
+    PENDING,
+    FOUND,
+    NO_RECORDS,
+    NONEXISTENT,
+    FAILED,
+    SKIPPED,
+  };
+
+  Question(Query *query, int type)
+    : m_query(query)
+    , m_type(type)
+    , m_udp(Net::context())
+    , m_tcp(Net::context()) {}
+
+  auto result() const -> Result { return m_result; }
+  auto addresses() const -> const Addresses& { return m_addresses; }
+  auto ttl() const -> double { return m_ttl; }
+
+  void reset() { m_result = Result::PENDING; }
+  void start(const std::string &name);
+  void skip() { m_result = Result::SKIPPED; }
+  void cancel();
+
+private:
+  Query* m_query;
+  int m_type;
+  std::string m_name;
+  udp::socket m_udp;
+  tcp::socket m_tcp;
+  udp::endpoint m_server;
+  udp::endpoint m_from;
+  Timer m_timer;
+  int m_tries = 0;
+  uint16_t m_id = 0;
+  uint8_t m_length_out[2];
+  uint8_t m_length_in[2];
+  std::vector<uint8_t> m_packet;
+  std::vector<uint8_t> m_buffer;
+  Result m_result = Result::PENDING;
+  Addresses m_addresses;
+  double m_ttl = 0;
+
+  bool current(int tries) const { return tries == m_tries && m_result == Result::PENDING; }
+  void send();
+  void retry();
+  void send_tcp();
+  void receive_udp();
+  void receive_tcp();
+  bool receive(size_t size, bool is_tcp);
+  void finish(Result result);
+  void close_sockets();
+};
+
+//
+// Resolver::Query
+//
+// Asks for both A and AAAA records of a name, trying the
+// search domains in the order resolv.conf(5) describes. When one
+// family answers first, its addresses go out early: AAAA right away,
+// A after the resolution delay if AAAA is still pending.
+//
+
+class Resolver::Query :
+  public pjs::RefCount<Query>,
+  public pjs::Pooled<Query>
+{
+public:
+  static auto find(const std::string &name) -> Query* {
+    auto i = s_queries.find(name);
+    return i == s_queries.end() ? nullptr : i->second;
+  }
+
+  Query(const std::string &name);
+  ~Query();
+
+  void add(Request *request) {
+    m_requests.push(request);
+    request->m_query = this;
+  }
+
+  void remove(Request *request) {
+    m_requests.remove(request);
+    request->m_query = nullptr;
+  }
+
+  auto config() const -> const Config& { return *m_config; }
+
+  void start();
+  void on_question_done();
+
+private:
+  std::shared_ptr<const Config> m_config;
+  std::string m_name;
+  std::vector<std::string> m_candidates;
+  size_t m_candidate = 0;
+  Question m_a;
+  Question m_aaaa;
+  tcp::resolver m_system_resolver;
+  List<Request> m_requests;
+  Timer m_resolution_delay;
+  double m_negative_ttl = MAX_NEGATIVE_TTL;
+  bool m_delaying = false;
+  bool m_early = false;
+  bool m_failed = false;
+  bool m_done = false;
+
+  void next();
+  void early(const Addresses &addresses);
+  void complete(const Addresses &addresses, const char *error);
+
+  thread_local static std::map<std::string, Query*> s_queries;
+};
+
+thread_local std::map<std::string, Resolver::Query*> Resolver::Query::s_queries;
+
+//
+// Resolver::Question
+//
+
+void Resolver::Question::start(const std::string &name) {
+  m_name = name;
+  m_tries = 0;
+  m_result = Result::PENDING;
+  m_addresses.clear();
+  m_ttl = 0;
+  send();
+}
+
+void Resolver::Question::cancel() {
+  m_result = Result::FAILED;
+  m_timer.cancel();
+  close_sockets();
+}
+
+void Resolver::Question::send() {
+  thread_local static std::mt19937 rng(std::random_device{}());
+
+  const auto &config = m_query->config();
+  const auto &servers = config.nameservers;
+  if (m_tries >= int(servers.size()) * config.attempts) {
+    finish(Result::FAILED);
+    return;
+  }
+
+  m_server = servers[m_tries % servers.size()];
+  m_tries++;
+  m_id = rng();
+
+  close_sockets();
+
+  pjs::Ref<pjs::Object> msg = pjs::Object::make();
+  pjs::Ref<pjs::Object> question = pjs::Object::make();
+  pjs::Ref<pjs::Array> questions = pjs::Array::make();
+  question->set(s_name, pjs::Str::make(m_name));
+  question->set(s_type, m_type == TYPE_AAAA ? s_AAAA.get() : s_A.get());
+  questions->push(question.get());
+  msg->set(s_id, m_id);
+  msg->set(s_rd, 1);
+  msg->set(s_question, questions.get());
+
+  try {
+    Data data;
+    Data::Builder db(data, &s_dp);
+    DNS::encode(msg, db);
+    db.flush();
+    m_packet = data.to_bytes();
+  } catch (std::runtime_error &) {
+    finish(Result::FAILED);
+    return;
+  }
+
+  auto tries = m_tries;
+  m_timer.schedule(
+    config.timeout,
+    [=]() {
+      if (current(tries)) retry();
+    }
+  );
+
+  asio::error_code ec;
+  m_udp.open(m_server.protocol(), ec);
+  if (ec) {
+    m_timer.cancel();
+    send();
+    return;
+  }
+
+  m_udp.async_send_to(
+    asio::buffer(m_packet), m_server,
+    [=](const std::error_code &ec, std::size_t) {
+      if (ec && ec != asio::error::operation_aborted && current(tries)) {
+        m_timer.cancel();
+        send();
+      }
+      m_query->release();
+    }
+  );
+
+  m_query->retain();
+  receive_udp();
+}
+
+void Resolver::Question::retry() {
+  pjs::Ref<Query> ref(m_query);
+  m_timer.cancel();
+  send();
+}
+
+void Resolver::Question::send_tcp() {
+  auto tries = m_tries;
+  m_timer.cancel();
+  m_timer.schedule(
+    m_query->config().timeout,
+    [=]() {
+      if (current(tries)) retry();
+    }
+  );
+
+  close_sockets();
+
+  m_tcp.async_connect(
+    tcp::endpoint(m_server.address(), m_server.port()),
+    [=](const std::error_code &ec) {
+      if (ec != asio::error::operation_aborted && current(tries)) {
+        if (ec) {
+          m_timer.cancel();
+          send();
+        } else {
+          m_length_out[0] = m_packet.size() >> 8;
+          m_length_out[1] = m_packet.size() >> 0;
+          std::vector<asio::const_buffer> buffers;
+          buffers.push_back(asio::buffer(m_length_out));
+          buffers.push_back(asio::buffer(m_packet));
+          asio::async_write(
+            m_tcp, buffers,
+            [=](const std::error_code &ec, std::size_t) {
+              if (ec && ec != asio::error::operation_aborted && current(tries)) {
+                m_timer.cancel();
+                send();
+              }
+              m_query->release();
+            }
+          );
+          m_query->retain();
+          receive_tcp();
+        }
+      }
+      m_query->release();
+    }
+  );
+
+  m_query->retain();
+}
+
+void Resolver::Question::receive_udp() {
+  auto tries = m_tries;
+  m_buffer.resize(MAX_UDP_SIZE);
+  m_udp.async_receive_from(
+    asio::buffer(m_buffer), m_from,
+    [=](const std::error_code &ec, std::size_t n) {
+      if (ec != asio::error::operation_aborted && current(tries)) {
+        if (ec) {
+          m_timer.cancel();
+          send();
+        } else if (m_from != m_server || !receive(n, false)) {
+          receive_udp();
+        }
+      }
+      m_query->release();
+    }
+  );
+
+  m_query->retain();
+}
+
+void Resolver::Question::receive_tcp() {
+  auto tries = m_tries;
+  asio::async_read(
+    m_tcp, asio::buffer(m_length_in),
+    [=](const std::error_code &ec, std::size_t) {
+      if (ec != asio::error::operation_aborted && current(tries)) {
+        if (ec) {
+          m_timer.cancel();
+          send();
+        } else {
+          m_buffer.resize((m_length_in[0] << 8) | m_length_in[1]);
+          asio::async_read(
+            m_tcp, asio::buffer(m_buffer),
+            [=](const std::error_code &ec, std::size_t n) {
+              if (ec != asio::error::operation_aborted && current(tries)) {
+                if (ec || !receive(n, true)) {
+                  m_timer.cancel();
+                  send();
+                }
+              }
+              m_query->release();
+            }
+          );
+          m_query->retain();
+        }
+      }
+      m_query->release();
+    }
+  );
+
+  m_query->retain();
+}
+
+//
+// Returns false if the packet is not an answer to our question
+//
+
+bool Resolver::Question::receive(size_t size, bool is_tcp) {
+  pjs::Ref<pjs::Object> msg;
+  try {
+    msg = DNS::decode(Data(m_buffer.data(), size, &s_dp));
+  } catch (std::runtime_error &) {
+    return false;
+  }
+
+  pjs::Value id, qr, tc, rcode, question;
+  msg->get(s_id, id);
+  msg->get(s_qr, qr);
+  msg->get(s_tc, tc);
+  msg->get(s_rcode, rcode);
+  msg->get(s_question, question);
+
+  if (id.to_int32() != m_id || qr.to_int32() != 1) return false;
+  if (!question.is_array() || question.as<pjs::Array>()->length() != 1) return false;
+
+  pjs::Value q, name;
+  question.as<pjs::Array>()->get(0, q);
+  if (!q.is_object() || !q.o()) return false;
+  q.o()->get(s_name, name);
+  if (!name.is_string() || normalize_name(name.s()->str()) != normalize_name(m_name)) return false;
+
+  if (tc.to_int32() && !is_tcp) {
+    send_tcp();
+    return true;
+  }
+
+  auto rc = rcode.to_int32();
+
+  if (rc == RCODE_NOERROR || rc == RCODE_NXDOMAIN) {
+    auto type = (m_type == TYPE_AAAA ? s_AAAA.get() : s_A.get());
+    auto ttl = MAX_TTL;
+    auto negative_ttl = DEFAULT_NEGATIVE_TTL;
+
+    pjs::Value answer, authority;
+    msg->get(s_answer, answer);
+    msg->get(s_authority, authority);
+
+    if (answer.is_array()) {
+      answer.as<pjs::Array>()->iterate_all(
+        [&](pjs::Value &r, int) {
+          if (!r.is_object() || !r.o()) return;
+          pjs::Value t, d, l;
+          r.o()->get(s_type, t);
+          r.o()->get(s_rdata, d);
+          r.o()->get(s_ttl, l);
+          if (!t.is_string() || t.s() != type || !d.is_string()) return;
+          asio::error_code ec;
+          asio::ip::address addr;
+          if (m_type == TYPE_AAAA) {
+            asio::ip::address_v6::bytes_type bytes;
+            if (d.s()->size() != 32 || utils::decode_hex(bytes.data(), d.s()->c_str(), 32) != 16) return;
+            addr = asio::ip::address_v6(bytes);
+          } else {
+            addr = asio::ip::make_address_v4(d.s()->str(), ec);
+            if (ec) return;
+          }
+          m_addresses.push_back(addr);
+          ttl = std::min(ttl, l.to_number());
+        }
+      );
+    }
+
+    if (authority.is_array()) {
+      authority.as<pjs::Array>()->iterate_all(
+        [&](pjs::Value &r, int) {
+          if (!r.is_object() || !r.o()) return;
+          pjs::Value t, d, l, m;
+          r.o()->get(s_type, t);
+          r.o()->get(s_rdata, d);
+          r.o()->get(s_ttl, l);
+          if (!t.is_string() || t.s() != s_SOA.get() || !d.is_object() || !d.o()) return;
+          d.o()->get(s_minimum, m);
+          negative_ttl = std::min(l.to_number(), m.to_number());
+        }
+      );
+    }
+
+    if (!m_addresses.empty()) {
+      m_ttl = ttl;
+      finish(Result::FOUND);
+    } else {
+      m_ttl = std::min(negative_ttl, MAX_NEGATIVE_TTL);
+      finish(rc == RCODE_NXDOMAIN ? Result::NONEXISTENT : Result::NO_RECORDS);
+    }
+
+  } else {
+    m_timer.cancel();
+    send();
+  }
+
+  return true;
+}
+
+void Resolver::Question::finish(Result result) {
+  m_result = result;
+  m_timer.cancel();
+  close_sockets();
+  m_query->on_question_done();
+}
+
+void Resolver::Question::close_sockets() {
+  asio::error_code ec;
+  if (m_udp.is_open()) m_udp.close(ec);
+  if (m_tcp.is_open()) m_tcp.close(ec);
+}
+
+//
+// Resolver::Query
+//
+
+Resolver::Query::Query(const std::string &name)
+  : m_config(current_config())
+  , m_name(name)
+  , m_a(this, TYPE_A)
+  , m_aaaa(this, TYPE_AAAA)
+  , m_system_resolver(Net::context())
+{
+  s_queries[name] = this;
+  retain();
+
+  if (name.back() == '.') {
+    m_candidates.push_back(name.substr(0, name.length() - 1));
+    return;
+  }
+
+  const auto &search = config().search;
+  auto dots = std::count(name.begin(), name.end(), '.');
+  if (dots >= config().ndots || search.empty()) m_candidates.push_back(name);
+  for (const auto &domain : search) m_candidates.push_back(name + '.' + domain);
+  if (dots < config().ndots && !search.empty()) m_candidates.push_back(name);
+}
+
+Resolver::Query::~Query() {
+}
+
+void Resolver::Query::start() {
+  pjs::Ref<Query> ref(this);
+
+  if (!config().nameservers.empty()) {
+    next();
+    return;
+  }
+
+  m_system_resolver.async_resolve(
+    m_name, std::string(),
+    [this](const std::error_code &ec, tcp::resolver::results_type results) {
+      if (ec != asio::error::operation_aborted) {
+        if (ec) {
+          complete(Addresses(), ec.message().c_str());
+        } else {
+          Addresses addresses, sorted;
+          for (const auto &r : results) addresses.push_back(r.endpoint().address());
+          interleave(addresses, sorted);
+          complete(sorted, nullptr);
+        }
+      }
+      release();
+    }
+  );
+
+  retain();
+}
+
+void Resolver::Query::next() {
+  const auto &name = m_candidates[m_candidate++];
+  Log::debug(Log::OUTBOUND, "[resolver] querying %s", name.c_str());
+  m_a.reset();
+  m_aaaa.reset();
+  m_resolution_delay.cancel();
+  m_delaying = false;
+  if (config().query_v4) m_a.start(name); else m_a.skip();
+  if (config().query_v6) m_aaaa.start(name); else m_aaaa.skip();
+}
+
+void Resolver::Query::on_question_done() {
+  typedef Question::Result Result;
+
+  auto a = m_a.result();
+  auto aaaa = m_aaaa.result();
+
+  if (a == Result::PENDING || aaaa == Result::PENDING) {
+    if (m_early) return;
+    if (aaaa == Result::FOUND) {
+      early(m_aaaa.addresses());
+    } else if (a == Result::FOUND && !m_delaying) {
+      m_delaying = true;
+      m_resolution_delay.schedule(
+        RESOLUTION_DELAY,
+        [this]() {
+          if (m_aaaa.result() == Result::PENDING) {
+            early(m_a.addresses());
+          }
+        }
+      );
+    }
+    return;
+  }
+
+  m_resolution_delay.cancel();
+
+  if (a == Result::FOUND || aaaa == Result::FOUND) {
+    Addresses addresses, sorted;
+    auto ttl = MAX_TTL;
+    for (auto *q : { &m_a, &m_aaaa }) {
+      if (q->result() == Result::FOUND || q->result() == Result::NO_RECORDS) {
+        addresses.insert(addresses.end(), q->addresses().begin(), q->addresses().end());
+        ttl = std::min(ttl, q->ttl());
+      }
+    }
+    interleave(addresses, sorted);
+
+    // Leave it to the next lookup to ask again for a family that failed
+    if (a != Result::FAILED && aaaa != Result::FAILED) {
+      Cache::set(m_name, sorted, ttl);
+    }
+
+    complete(sorted, nullptr);
+    return;
+  }
+
+  if (a == Result::FAILED || aaaa == Result::FAILED) {
+    m_failed = true;
+  } else {
+    for (auto *q : { &m_a, &m_aaaa }) {
+      if (q->result() != Result::SKIPPED) {
+        m_negative_ttl = std::min(m_negative_ttl, q->ttl());
+      }
+    }
+  }
+
+  if (m_candidate < m_candidates.size()) {
+    next();
+  } else if (m_failed) {
+    complete(Addresses(), "no response from nameservers");
+  } else {
+    Cache::set(m_name, Addresses(), m_negative_ttl);
+    complete(Addresses(), "host not found");
+  }
+}
+
+void Resolver::Query::early(const Addresses &addresses) {
+  pjs::Ref<Query> ref(this);
+  m_early = true;
+  for (auto *req = m_requests.head(); req; ) {
+    auto *next = req->next();
+    req->early(addresses);
+    req = next;
+  }
+}
+
+void Resolver::Query::complete(const Addresses &addresses, const char *error) {
+  if (m_done) return;
+  m_done = true;
+  m_resolution_delay.cancel();
+  m_a.cancel();
+  m_aaaa.cancel();
+  s_queries.erase(m_name);
+  while (auto *req = m_requests.head()) {
+    remove(req);
+    req->complete(addresses, error);
+  }
+  release();
+}
+
+//
+// Resolver::Request
+//
+
+void Resolver::Request::resolve(const std::string &name, const Callback &cb, const EarlyCallback &early) {
+  cancel();
+  m_callback = cb;
+  m_early_callback = early;
+
+  // Keep the trailing dot that marks a fully qualified name
+  auto n = normalize_name(name);
+  if (!n.empty() && name.back() == '.') n += '.';
+  Resolver::lookup(this, n);
+}
+
+void Resolver::Request::cancel() {
+  if (m_query) m_query->remove(this);
+  m_callback = nullptr;
+  m_early_callback = nullptr;
+}
+
+void Resolver::Request::early(const Addresses &addresses) {
+  if (m_early_callback) m_early_callback(addresses);
+}
+
+void Resolver::Request::complete(const Addresses &addresses, const char *error) {
+  auto cb = std::move(m_callback);
+  m_callback = nullptr;
+  m_early_callback = nullptr;
+  if (cb) cb(addresses, error);
+}
+
+//
+// Resolver
+//
+
+void Resolver::resolve(const std::string &name, const Callback &cb) {
+  auto *req = new Request;
+  req->resolve(
+    name,
+    [=](const Addresses &addresses, const char *error) {
+      cb(addresses, error);
+      delete req;
+    }
+  );
+}
+
+void Resolver::set_config_files(const std::string &resolv_conf, const std::string &hosts) {
+  if (!resolv_conf.empty()) s_resolv_conf_path = resolv_conf;
+  if (!hosts.empty()) s_hosts_path = hosts;
+}
+
+void Resolver::lookup(Request *request, const std::string &name) {
+  if (name.empty()) {
+    request->complete(Addresses(), "invalid hostname");
+    return;
+  }
+
+  auto host = name;
+  if (host.back() == '.') host.pop_back();
+
+  asio::error_code ec;
+  auto ip = asio::ip::make_address(host, ec);
+  if (!ec) {
+    request->complete(Addresses(1, ip), nullptr);
+    return;
+  }
+
+  auto config = current_config();
+  const auto &hosts = config->hosts;
+  auto i = hosts.find(host);
+  if (i != hosts.end()) {
+    Addresses sorted;
+    interleave(i->second, sorted);
+    request->complete(sorted, nullptr);
+    return;
+  }
+
+  Addresses addresses;
+  if (Cache::get(name, addresses)) {
+    request->complete(addresses, addresses.empty() ? "host not found" : nullptr);
+    return;
+  }
+
+  auto *query = Query::find(name);
+  if (query) {
+    query->add(request);
+  } else {
+    query = new Query(name);
+    query->add(request);
+    query->start();
+  }
+}
+
+} // namespace pipy
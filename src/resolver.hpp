@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RESOLVER_HPP
+#define RESOLVER_HPP
+
+#include "net.hpp"
+#include "list.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace pipy {
+
+//
+// Resolver
+//
+// Non-blocking stub resolver that talks to the nameservers listed in
+// /etc/resolv.conf over UDP, retrying over TCP when an answer is
+// truncated. IP literals and names in /etc/hosts are answered locally.
+// Changes to either file are picked up within seconds. Answers, both
+// positive and negative, are cached process-wide for as long as their
+// TTLs allow, and concurrent lookups of the same name in one thread
+// share a single query. Where there is no resolv.conf, lookups go to
+// the system resolver instead. Names ending with a dot are taken as
+// fully qualified and never tried with the search domains.
+//
+
+class Resolver {
+  class Question;
+  class Query;
+
+public:
+  typedef std::vector<asio::ip::address> Addresses;
+
+  // Addresses come with IPv6 and IPv4 interleaved, IPv6 first.
+  // Error is null on success.
+  typedef std::function<void(const Addresses &addresses, const char *error)> Callback;
+
+  // Addresses of the first family to answer, handed out before the
+  // other family is done (RFC 8305 Section 3). A later Callback always
+  // comes with the full answer.
+  typedef std::function<void(const Addresses &addresses)> EarlyCallback;
+
+  //
+  // Resolver::Request
+  //
+  // Callbacks can be called before resolve() returns when the answer
+  // is already known. Destroying a request cancels it. An early callback
+  // must not cancel requests other than its own.
+  //
+
+  class Request : public List<Request>::Item {
+  public:
+    ~Request() { cancel(); }
+
+    void resolve(const std::string &name, const Callback &cb, const EarlyCallback &early = nullptr);
+    void cancel();
+    bool pending() const { return m_query; }
+
+  private:
+    Query* m_query = nullptr;
+    Callback m_callback;
+    EarlyCallback m_early_callback;
+
+    void early(const Addresses &addresses);
+    void complete(const Addresses &addresses, const char *error);
+
+    friend class Resolver;
+  };
+
+  // Fire-and-forget version of Request::resolve()
+  static void resolve(const std::string &name, const Callback &cb);
+
+  // Replaces /etc/resolv.conf and /etc/hosts, for testing mostly.
+  // Only to be called before any lookups.
+  static void set_config_files(const std::string &resolv_conf, const std::string &hosts);
+
+private:
+  static void lookup(Request *request, const std::string &name);
+};
+
+} // namespace pipy
+
+#endif // RESOLVER_HPP
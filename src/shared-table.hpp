@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SHARED_TABLE_HPP
+#define SHARED_TABLE_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace pipy {
+
+//
+// SharedTable
+//
+// Process-wide registry of immutable lookup tables keyed by the input
+// they were built from. Objects created from the same input, typically
+// one in each worker thread, get the same table, so it is built once
+// and kept in memory once. Only weak references are kept here, so a
+// table goes away with the last object using it, and expired entries
+// are swept whenever a new table is built.
+//
+
+template<class T>
+class SharedTable {
+public:
+  static auto get(const std::string &key, const std::function<T*()> &build) -> std::shared_ptr<const T> {
+    static auto *tables = new std::map<std::string, std::weak_ptr<const T>>;
+    static auto *mutex = new std::mutex;
+
+    std::lock_guard<std::mutex> lock(*mutex);
+    auto &slot = (*tables)[key];
+    if (auto table = slot.lock()) return table;
+
+    std::shared_ptr<const T> table(build());
+    slot = table;
+
+    for (auto i = tables->begin(); i != tables->end(); ) {
+      if (i->second.expired()) i = tables->erase(i); else i++;
+    }
+
+    return table;
+  }
+};
+
+} // namespace pipy
+
+#endif // SHARED_TABLE_HPP
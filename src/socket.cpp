@@ -26,8 +26,25 @@
 #include "socket.hpp"
 #include "log.hpp"
 
+#include <openssl/crypto.h>
+
+#include <cstring>
 #include <errno.h>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif // __linux__
+
 namespace pipy {
 
 using tcp = asio::ip::tcp;
@@ -85,12 +102,25 @@ Data::Producer SocketTCP::s_dp("TCP Socket");
 
 SocketTCP::~SocketTCP() {
   Ticker::get()->unwatch(this);
+#ifdef PIPY_USE_IO_URING
+  delete m_uring;
+#endif
+#ifdef __linux__
+  unsplice();
+  ktls_discard();
+#endif
 }
 
 void SocketTCP::open() {
   m_socket.set_option(asio::socket_base::keep_alive(m_options.keep_alive));
   m_socket.set_option(tcp::no_delay(m_options.no_delay));
 
+#ifdef PIPY_USE_IO_URING
+  if (auto ring = IOUring::current()) {
+    if (!m_uring) m_uring = new URing(this, ring);
+  }
+#endif
+
   auto t = Ticker::get()->tick();
   m_tick_read = t;
   m_tick_write = t;
@@ -102,10 +132,13 @@ void SocketTCP::open() {
     if (m_state == CLOSED) return;
   }
 
-  if (!m_buffer_send.empty()) {
+  if (!m_buffer_send.empty() || spliced() > 0) {
     FlushTarget::need_flush();
   }
 
+  std::error_code ec;
+  m_socket.non_blocking(true, ec);
+
   receive();
   Ticker::get()->watch(this);
 }
@@ -122,9 +155,17 @@ void SocketTCP::output(Event *evt) {
         on_socket_input(StreamEnd::make(StreamEnd::BUFFER_OVERFLOW));
         close();
       } else {
+#ifdef __linux__
+        if (ktls_pending()) {
+          m_buffer_ktls.push(*data);
+        } else {
+          m_buffer_send.push(*data);
+        }
+#else
         m_buffer_send.push(*data);
+#endif
         auto limit = m_options.congestion_limit;
-        if (limit > 0 && m_buffer_send.size() >= limit) {
+        if (limit > 0 && m_buffer_send.size() + ktls_held() >= limit) {
           m_congestion.begin();
         }
         if (m_state != IDLE) FlushTarget::need_flush();
@@ -147,9 +188,27 @@ void SocketTCP::receive() {
   if (m_receiving) return;
   if (m_paused) return;
 
-  m_buffer_receive.push(Data(RECEIVE_BUFFER_SIZE, &s_dp));
-  m_socket.async_read_some(
-    DataChunks(m_buffer_receive.chunks()),
+#ifdef __linux__
+  if (auto p = m_splice_rx.get()) {
+    if (p->blocked) return;
+    m_socket.async_wait(
+      tcp::socket::wait_read,
+      SpliceReceiveHandler(this)
+    );
+    m_receiving = true;
+    return;
+  }
+#endif
+
+#ifdef PIPY_USE_IO_URING
+  if (m_uring && uring_receive()) {
+    m_receiving = true;
+    return;
+  }
+#endif
+
+  m_socket.async_wait(
+    tcp::socket::wait_read,
     ReceiveHandler(this)
   );
 
@@ -161,6 +220,12 @@ void SocketTCP::send() {
   if (m_sending) return;
 
   if (m_buffer_send.empty()) {
+#ifdef __linux__
+    if (spliced() > 0) {
+      splice_send();
+      return;
+    }
+#endif
     if (m_eos) {
       if (m_eos->error_code() == StreamEnd::NO_ERROR) {
         shutdown_socket();
@@ -182,6 +247,13 @@ void SocketTCP::send() {
     std::cerr << m_buffer_send.size() << std::endl;
   }
 
+#ifdef PIPY_USE_IO_URING
+  if (m_uring && uring_send()) {
+    m_sending = true;
+    return;
+  }
+#endif
+
   m_socket.async_write_some(
     DataChunks(m_buffer_send.chunks()),
     SendHandler(this)
@@ -203,6 +275,19 @@ void SocketTCP::shutdown_socket() {
 }
 
 void SocketTCP::close_socket() {
+#ifdef __linux__
+  unsplice();
+  if (ktls_pending()) {
+    ktls_discard();
+    m_buffer_ktls.clear();
+  }
+#endif
+#ifdef PIPY_USE_IO_URING
+  if (auto u = m_uring) {
+    u->ring->cancel(&u->receive);
+    u->ring->cancel(&u->send);
+  }
+#endif
   if (m_socket.is_open()) {
     std::error_code ec;
     m_socket.close(ec);
@@ -266,6 +351,36 @@ void SocketTCP::on_tick(double tick) {
   }
 }
 
+void SocketTCP::on_readable(const std::error_code &ec) {
+  if (ec || m_state == CLOSED) {
+    on_receive(ec, 0);
+    return;
+  }
+
+  // Read into a buffer shared by all sockets on this thread so that
+  // idle connections hold no receive buffer. Small reads are copied
+  // out into a right-sized chunk and the buffer is kept for reuse.
+  thread_local static Data s_buffer;
+  if (s_buffer.empty()) s_buffer.push(Data(RECEIVE_BUFFER_SIZE, &s_dp));
+
+  std::error_code err;
+  auto n = m_socket.read_some(DataChunks(s_buffer.chunks()), err);
+  if (err == asio::error::would_block || err == asio::error::try_again) {
+    on_receive(std::error_code(), 0);
+    return;
+  }
+
+  if (n > 0) {
+    if (n <= RECEIVE_COPY_SIZE) {
+      m_buffer_receive.push(std::get<0>(*s_buffer.chunks().begin()), n, &s_dp);
+    } else {
+      m_buffer_receive.push(std::move(s_buffer));
+    }
+  }
+
+  on_receive(err, n);
+}
+
 void SocketTCP::on_receive(const std::error_code &ec, std::size_t n) {
   InputContext ic(this);
 
@@ -335,7 +450,13 @@ void SocketTCP::on_send(const std::error_code &ec, std::size_t n) {
       m_state = CLOSED;
       close_socket();
 
-    } else if (m_buffer_send.empty()) {
+#ifdef __linux__
+    } else if (ktls_pending() && m_buffer_send.empty() && !ktls_start_tx()) {
+      m_state = CLOSED;
+      close_socket();
+#endif
+
+    } else if (m_buffer_send.empty() && spliced() == 0) {
       if (m_eos) {
         if (m_eos->error_code() != StreamEnd::NO_ERROR) {
           m_state = CLOSED;
@@ -359,6 +480,302 @@ void SocketTCP::on_send(const std::error_code &ec, std::size_t n) {
   close_async();
 }
 
+#ifdef __linux__
+
+//
+// Kernel TLS offload for the sending direction. ktls_attach() tells
+// whether the kernel can do it at all. Bytes already in the send
+// buffer by the time of ktls_send() were encrypted in userspace and
+// have to go out as they are, so anything output after that is held
+// back until they are written and the kernel has taken the keys.
+//
+
+bool SocketTCP::ktls_attach() {
+  if (!m_socket.is_open() || m_splice_tx || ktls_pending()) return false;
+  auto fd = m_socket.native_handle();
+  return setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0;
+}
+
+bool SocketTCP::ktls_send(const KTLSCryptoInfo &info, size_t size) {
+  if (!m_socket.is_open() || ktls_pending()) return false;
+  if (!size || size > sizeof(info)) return false;
+  auto fd = m_socket.native_handle();
+  if (m_buffer_send.empty() && !m_sending) {
+    return setsockopt(fd, SOL_TLS, TLS_TX, &info, size) == 0;
+  }
+  std::memcpy(&m_ktls_tx_info, &info, size);
+  m_ktls_tx_info_size = size;
+  return true;
+}
+
+bool SocketTCP::ktls_start_tx() {
+  auto fd = m_socket.native_handle();
+  auto ret = setsockopt(fd, SOL_TLS, TLS_TX, &m_ktls_tx_info, m_ktls_tx_info_size);
+  ktls_discard();
+  if (ret < 0) {
+    m_buffer_ktls.clear();
+    log_error("cannot enable kernel TLS", std::error_code(errno, std::generic_category()));
+    return false;
+  }
+  m_buffer_send.push(std::move(m_buffer_ktls));
+  return true;
+}
+
+// The held keys never outlive the socket or a failed handover
+void SocketTCP::ktls_discard() {
+  OPENSSL_cleanse(&m_ktls_tx_info, sizeof(m_ktls_tx_info));
+  m_ktls_tx_info_size = 0;
+}
+
+//
+// Relays between two TCP sockets without anything in between
+// can have the bytes moved by the kernel via splice() through
+// a pipe for each direction, never copying them into userspace.
+// The pipe size is bound by the congestion limit of the receiving
+// end, where spliced bytes count as if they were in the send buffer.
+//
+
+void SocketTCP::splice(SocketTCP *peer) {
+  if (m_splice_rx || peer->m_splice_rx) return;
+
+  pjs::Ref<Pipe> a(new Pipe(peer->m_options.congestion_limit));
+  pjs::Ref<Pipe> b(new Pipe(m_options.congestion_limit));
+  if (a->fds[0] < 0 || b->fds[0] < 0) return;
+
+  a->writer = this; a->reader = peer;
+  b->writer = peer; b->reader = this;
+  m_splice_rx = a; peer->m_splice_tx = a;
+  m_splice_tx = b; peer->m_splice_rx = b;
+
+  std::error_code ec;
+  if (m_socket.is_open()) m_socket.non_blocking(true, ec);
+  if (peer->m_socket.is_open()) peer->m_socket.non_blocking(true, ec);
+}
+
+void SocketTCP::splice_send() {
+  auto p = m_splice_tx.get();
+  auto fd = m_socket.native_handle();
+  std::error_code ec;
+  size_t n = 0;
+
+  while (p->size > 0) {
+    auto ret = ::splice(p->fds[0], nullptr, fd, nullptr, p->size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (ret > 0) {
+      p->size -= ret;
+      n += ret;
+    } else if (ret < 0 && errno == EINTR) {
+      continue;
+    } else {
+      if (ret < 0 && errno != EAGAIN) {
+        ec = std::error_code(errno, asio::error::get_system_category());
+      }
+      break;
+    }
+  }
+
+  if (n > 0) {
+    m_traffic_write += n;
+    m_tick_write = Ticker::get()->tick();
+
+    if (Log::is_enabled(Log::TCP)) {
+      std::cerr << Log::format_elapsed_time();
+      std::cerr << (m_is_inbound ? " tcp <<<< splice " : " tcp splice >>>> ");
+      std::cerr << n << std::endl;
+    }
+
+    if (p->blocked) {
+      p->blocked = false;
+      if (auto w = p->writer) w->receive();
+    }
+  }
+
+  if (ec) {
+    on_send(ec, 0);
+  } else if (p->size > 0) {
+    m_socket.async_wait(
+      tcp::socket::wait_write,
+      SpliceSendHandler(this)
+    );
+    m_sending = true;
+  } else {
+    send();
+  }
+}
+
+void SocketTCP::unsplice() {
+  if (auto p = m_splice_rx.get()) {
+    p->writer = nullptr;
+    m_splice_rx = nullptr;
+  }
+  if (auto p = m_splice_tx.get()) {
+    p->reader = nullptr;
+    m_splice_tx = nullptr;
+  }
+}
+
+void SocketTCP::on_splice_receive(const std::error_code &ec) {
+  if (ec || m_state == CLOSED || !m_splice_rx) {
+    on_receive(ec, 0);
+    return;
+  }
+
+  InputContext ic(this);
+
+  auto p = m_splice_rx.get();
+  auto fd = m_socket.native_handle();
+  std::error_code err;
+  size_t n = 0;
+
+  for (;;) {
+    auto ret = ::splice(fd, nullptr, p->fds[1], nullptr, p->capacity, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (ret > 0) {
+      p->size += ret;
+      n += ret;
+    } else if (ret == 0) {
+      err = asio::error::eof;
+      break;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN) {
+      // Both an empty socket and a full pipe end up here,
+      // so ask the pipe which one it is
+      pollfd pfd = { p->fds[1], POLLOUT, 0 };
+      if (p->size > 0 && ::poll(&pfd, 1, 0) == 0) p->blocked = true;
+      break;
+    } else {
+      err = std::error_code(errno, asio::error::get_system_category());
+      break;
+    }
+  }
+
+  if (n > 0) {
+    m_traffic_read += n;
+
+    if (Log::is_enabled(Log::TCP)) {
+      std::cerr << Log::format_elapsed_time();
+      std::cerr << (m_is_inbound ? " tcp >>>> splice " : " tcp splice <<<< ");
+      std::cerr << n << std::endl;
+    }
+
+    if (auto r = p->reader) r->need_flush();
+  }
+
+  on_receive(err, 0);
+}
+
+void SocketTCP::on_splice_send(const std::error_code &ec) {
+  if (ec || m_state == CLOSED || !m_splice_tx) {
+    on_send(ec, 0);
+  } else {
+    m_sending = false;
+    send();
+    close_async();
+  }
+}
+
+//
+// SocketTCP::Pipe
+//
+
+SocketTCP::Pipe::Pipe(size_t size_limit) {
+  if (pipe2(fds, O_CLOEXEC | O_NONBLOCK)) {
+    fds[0] = fds[1] = -1;
+    return;
+  }
+  if (size_limit > 0) fcntl(fds[1], F_SETPIPE_SZ, int(std::min<size_t>(size_limit, 0x7fffffff)));
+  auto n = fcntl(fds[1], F_GETPIPE_SZ);
+  capacity = n > 0 ? n : 0x10000;
+}
+
+SocketTCP::Pipe::~Pipe() {
+  if (fds[0] >= 0) ::close(fds[0]);
+  if (fds[1] >= 0) ::close(fds[1]);
+}
+
+#endif // __linux__
+
+#ifdef PIPY_USE_IO_URING
+
+bool SocketTCP::uring_receive() {
+  auto u = m_uring;
+  if (u->receive_fallback) return false;
+  auto fd = m_socket.native_handle();
+  if (!u->own_buffer && u->ring->recv(&u->receive, fd)) return true;
+  m_buffer_receive.push(Data(RECEIVE_BUFFER_SIZE, &s_dp));
+  auto buf = std::get<0>(*m_buffer_receive.chunks().begin());
+  if (u->ring->recv(&u->receive, fd, buf, RECEIVE_BUFFER_SIZE)) return true;
+  m_buffer_receive.clear();
+  return false;
+}
+
+bool SocketTCP::uring_send() {
+  auto u = m_uring;
+  if (u->send_fallback) return false;
+  int n = 0;
+  for (const auto c : m_buffer_send.chunks()) {
+    if (n >= URing::MAX_IOV) break;
+    u->iov[n].iov_base = std::get<0>(c);
+    u->iov[n].iov_len = std::get<1>(c);
+    n++;
+  }
+  std::memset(&u->msg, 0, sizeof(u->msg));
+  u->msg.msg_iov = u->iov;
+  u->msg.msg_iovlen = n;
+  return u->ring->sendmsg(&u->send, m_socket.native_handle(), &u->msg);
+}
+
+void SocketTCP::on_uring_receive(int res, unsigned flags) {
+  auto u = m_uring;
+  u->ring->take_buffer(flags, m_buffer_receive);
+  u->own_buffer = false;
+
+  if (res == -ENOBUFS || res == -EAGAIN) {
+    if (res == -ENOBUFS) {
+      u->own_buffer = true;
+    } else {
+      u->receive_fallback = true;
+    }
+    m_buffer_receive.clear();
+    m_receiving = false;
+    receive();
+    close_async();
+    return;
+  }
+
+  if (res > 0) {
+    on_receive(std::error_code(), res);
+  } else {
+    m_buffer_receive.clear();
+    if (res == 0) {
+      on_receive(asio::error::eof, 0);
+    } else if (res == -EINTR) {
+      on_receive(asio::error::operation_aborted, 0);
+    } else {
+      on_receive(std::error_code(-res, asio::error::get_system_category()), 0);
+    }
+  }
+}
+
+void SocketTCP::on_uring_send(int res) {
+  if (res == -EAGAIN) {
+    m_uring->send_fallback = true;
+    m_sending = false;
+    send();
+    close_async();
+    return;
+  }
+
+  if (res >= 0) {
+    on_send(std::error_code(), res);
+  } else if (res == -EINTR) {
+    on_send(asio::error::operation_aborted, 0);
+  } else {
+    on_send(std::error_code(-res, asio::error::get_system_category()), 0);
+  }
+}
+
+#endif // PIPY_USE_IO_URING
+
 //
 // SocketUDP
 //
@@ -32,6 +32,11 @@
 #include "data.hpp"
 #include "buffer.hpp"
 #include "timer.hpp"
+#include "io-uring.hpp"
+
+#ifdef __linux__
+#include <linux/tls.h>
+#endif
 
 namespace pipy {
 
@@ -81,6 +86,20 @@ class SocketTCP :
   public FlushTarget,
   public Ticker::Watcher
 {
+public:
+#ifdef __linux__
+  union KTLSCryptoInfo {
+    tls12_crypto_info_aes_gcm_128 aes_gcm_128;
+    tls12_crypto_info_aes_gcm_256 aes_gcm_256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    tls12_crypto_info_chacha20_poly1305 chacha20_poly1305;
+#endif
+  };
+
+  bool ktls_attach();
+  bool ktls_send(const KTLSCryptoInfo &info, size_t size);
+#endif
+
 protected:
   SocketTCP(bool is_inbound, const Options &options)
     : SocketBase(is_inbound, options)
@@ -90,12 +109,16 @@ protected:
   ~SocketTCP();
 
   auto socket() -> asio::ip::tcp::socket& { return m_socket; }
-  auto buffered() const -> size_t { return m_buffer_send.size(); }
+  auto buffered() const -> size_t { return m_buffer_send.size() + spliced() + ktls_held(); }
 
   void open();
   void output(Event *evt);
   void close();
 
+#ifdef __linux__
+  void splice(SocketTCP *peer);
+#endif
+
 private:
   enum State {
     IDLE,
@@ -130,13 +153,14 @@ private:
   virtual void on_flush() override;
   virtual void on_tick(double tick) override;
 
+  void on_readable(const std::error_code &ec);
   void on_receive(const std::error_code &ec, std::size_t n);
   void on_send(const std::error_code &ec, std::size_t n);
 
   struct ReceiveHandler : public SelfHandler<SocketTCP> {
     using SelfHandler::SelfHandler;
     ReceiveHandler(const ReceiveHandler &r) : SelfHandler(r) {}
-    void operator()(const std::error_code &ec, std::size_t n) { self->on_receive(ec, n); }
+    void operator()(const std::error_code &ec) { self->on_readable(ec); }
   };
 
   struct SendHandler : public SelfHandler<SocketTCP> {
@@ -145,6 +169,102 @@ private:
     void operator()(const std::error_code &ec, std::size_t n) { self->on_send(ec, n); }
   };
 
+#ifdef PIPY_USE_IO_URING
+
+  //
+  // SocketTCP::URing
+  //
+
+  struct URing : public pjs::Pooled<URing> {
+    enum { MAX_IOV = 16 };
+
+    struct Receive : public IOUring::Request {
+      SocketTCP* self;
+      virtual void on_complete(int res, unsigned flags) override { self->on_uring_receive(res, flags); }
+    };
+
+    struct Send : public IOUring::Request {
+      SocketTCP* self;
+      virtual void on_complete(int res, unsigned flags) override { self->on_uring_send(res); }
+    };
+
+    URing(SocketTCP *s, IOUring *r) : ring(r) { receive.self = s; send.self = s; }
+
+    IOUring* ring;
+    Receive receive;
+    Send send;
+    iovec iov[MAX_IOV];
+    msghdr msg;
+    bool own_buffer = false;
+    bool receive_fallback = false;
+    bool send_fallback = false;
+  };
+
+  URing* m_uring = nullptr;
+
+  bool uring_receive();
+  bool uring_send();
+  void on_uring_receive(int res, unsigned flags);
+  void on_uring_send(int res);
+
+#endif // PIPY_USE_IO_URING
+
+#ifdef __linux__
+
+  //
+  // SocketTCP::Pipe
+  //
+
+  struct Pipe : public pjs::RefCount<Pipe>, public pjs::Pooled<Pipe> {
+    Pipe(size_t size_limit);
+    ~Pipe();
+
+    int fds[2] = { -1, -1 };
+    size_t capacity = 0;
+    size_t size = 0;
+    SocketTCP* writer = nullptr;
+    SocketTCP* reader = nullptr;
+    bool blocked = false;
+  };
+
+  pjs::Ref<Pipe> m_splice_rx;
+  pjs::Ref<Pipe> m_splice_tx;
+
+  auto spliced() const -> size_t { return m_splice_tx ? m_splice_tx->size : 0; }
+
+  void splice_send();
+  void unsplice();
+  void on_splice_receive(const std::error_code &ec);
+  void on_splice_send(const std::error_code &ec);
+
+  KTLSCryptoInfo m_ktls_tx_info;
+  size_t m_ktls_tx_info_size = 0;
+  Data m_buffer_ktls;
+
+  auto ktls_held() const -> size_t { return m_buffer_ktls.size(); }
+  bool ktls_pending() const { return m_ktls_tx_info_size > 0; }
+  bool ktls_start_tx();
+  void ktls_discard();
+
+  struct SpliceReceiveHandler : public SelfHandler<SocketTCP> {
+    using SelfHandler::SelfHandler;
+    SpliceReceiveHandler(const SpliceReceiveHandler &r) : SelfHandler(r) {}
+    void operator()(const std::error_code &ec) { self->on_splice_receive(ec); }
+  };
+
+  struct SpliceSendHandler : public SelfHandler<SocketTCP> {
+    using SelfHandler::SelfHandler;
+    SpliceSendHandler(const SpliceSendHandler &r) : SelfHandler(r) {}
+    void operator()(const std::error_code &ec) { self->on_splice_send(ec); }
+  };
+
+#else // !__linux__
+
+  auto spliced() const -> size_t { return 0; }
+  auto ktls_held() const -> size_t { return 0; }
+
+#endif // __linux__
+
   static Data::Producer s_dp;
 };
 
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+
+namespace pipy {
+
+//
+// SPSCQueue
+//
+// Unbounded single-producer single-consumer queue made of a chain
+// of fixed-size rings. push() is only ever called from one thread
+// and pop() from one (possibly different) thread.
+//
+
+template<class T, size_t N = 256>
+class SPSCQueue {
+public:
+  SPSCQueue() {
+    m_head = m_tail = new Segment;
+  }
+
+  ~SPSCQueue() {
+    for (auto *s = m_head; s; ) {
+      auto *p = s; s = s->next.load(std::memory_order_relaxed);
+      delete p;
+    }
+  }
+
+  void push(const T &item) {
+    auto *s = m_tail;
+    auto i = s->write.load(std::memory_order_relaxed);
+    if (i == N) {
+      auto *n = new Segment;
+      n->items[0] = item;
+      n->write.store(1, std::memory_order_relaxed);
+      s->next.store(n, std::memory_order_release);
+      m_tail = n;
+    } else {
+      s->items[i] = item;
+      s->write.store(i + 1, std::memory_order_release);
+    }
+  }
+
+  bool pop(T &item) {
+    auto *s = m_head;
+    if (m_read == N) {
+      auto *n = s->next.load(std::memory_order_acquire);
+      if (!n) return false;
+      delete s;
+      m_head = s = n;
+      m_read = 0;
+    }
+    if (m_read >= s->write.load(std::memory_order_acquire)) return false;
+    item = s->items[m_read++];
+    return true;
+  }
+
+private:
+  struct Segment {
+    T items[N];
+    std::atomic<size_t> write;
+    std::atomic<Segment*> next;
+    Segment() : write(0), next(nullptr) {}
+  };
+
+  // Keep producer and consumer ends on separate cache lines. Padded
+  // explicitly since C++11 operator new ignores extended alignment.
+  Segment* m_tail;
+  char m_padding[64 - sizeof(Segment*)];
+  Segment* m_head;
+  size_t m_read = 0;
+};
+
+} // namespace pipy
+
+#endif // SPSC_QUEUE_HPP
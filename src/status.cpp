@@ -353,6 +353,7 @@ void Status::update_local() {
       chunks.insert({
         producer->name()->str(),
         producer->count(),
+        producer->size(),
       });
     });
   }
@@ -588,14 +589,15 @@ void Status::dump_objects(Data::Builder &db) {
 }
 
 void Status::dump_chunks(Data::Builder &db) {
-  std::list<std::array<std::string, 2>> rows;
+  std::list<std::array<std::string, 3>> rows;
   for (const auto &i : chunks) {
     rows.push_back({
       i.name,
-      std::to_string(DATA_CHUNK_SIZE * i.count / 1024),
+      std::to_string(i.size / 1024),
+      std::to_string(i.count),
     });
   }
-  print_table(db, { "DATA", "SIZE(KB)" }, rows);
+  print_table(db, { "DATA", "SIZE(KB)", "#CHUNKS" }, rows);
 }
 
 void Status::dump_buffers(Data::Builder &db) {
@@ -694,7 +696,7 @@ void Status::dump_json(Data::Builder &db) {
     db.push('"');
     db.push(i.name);
     db.push("\":");
-    db.push(std::to_string(DATA_CHUNK_SIZE * i.count / 1024));
+    db.push(std::to_string(i.size / 1024));
   }
   db.push("},\"buffers\":{");
   first = true;
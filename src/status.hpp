@@ -99,6 +99,7 @@ public:
   struct ChunkInfo {
     std::string name;
     mutable size_t count;
+    mutable size_t size;
 
     bool operator<(const ChunkInfo &r) const {
       return name < r.name;
@@ -106,6 +107,7 @@ public:
 
     auto operator+=(const ChunkInfo &r) const -> const ChunkInfo& {
       count += r.count;
+      size += r.size;
       return *this;
     }
   };
@@ -88,6 +88,16 @@ public:
   StrMap(const std::list<std::string> &strings);
   ~StrMap();
 
+  auto find(const char *str, size_t len) const -> pjs::Str* {
+    Parser p(*this);
+    pjs::Str *found = nullptr;
+    for (size_t i = 0; i < len; i++) {
+      found = p.parse(str[i]);
+      if (found == pjs::Str::empty) return nullptr;
+    }
+    return found;
+  }
+
 private:
   void insert_string(const std::string &str);
   auto create_node(pjs::Str *str, uint8_t start, uint8_t end) -> Node*;
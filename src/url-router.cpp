@@ -0,0 +1,384 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "url-router.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace pipy {
+
+//
+// Pattern tokens
+//
+
+struct URLRouteToken {
+  enum Type {
+    LITERAL,
+    PARAM,
+    LABEL,
+    CATCH_ALL,
+  };
+
+  Type type;
+  std::string text;
+};
+
+static void parse_url_pattern(const std::string &pattern, std::vector<URLRouteToken> &tokens) {
+  auto i = pattern.find('/');
+  if (i == std::string::npos) throw std::runtime_error("invalid URL pattern");
+
+  auto host = pattern.substr(0, i);
+  if (host.find(':') != std::string::npos) throw std::runtime_error("invalid URL pattern");
+
+  std::string literal;
+  auto flush = [&]() {
+    if (!literal.empty()) {
+      tokens.push_back({ URLRouteToken::LITERAL, literal });
+      literal.clear();
+    }
+  };
+
+  if (host == "*" || (host.length() > 1 && host[0] == '*' && host[1] == '.')) {
+    tokens.push_back({ URLRouteToken::LABEL, std::string() });
+    literal = host.substr(1);
+  } else {
+    literal = host;
+  }
+
+  // Empty segments are ignored in prefix patterns
+  auto last = pattern.rfind('/');
+  bool is_prefix = (last + 1 < pattern.length() && pattern[last + 1] == '*');
+
+  int captures = 0;
+  auto p = i;
+  while (p < pattern.length()) {
+    p++;
+    auto e = pattern.find('/', p);
+    if (e == std::string::npos) e = pattern.length();
+    auto seg = pattern.substr(p, e - p);
+    if (seg.empty() && is_prefix && e < pattern.length()) {
+      p = e;
+      continue;
+    }
+    literal += '/';
+    if (seg.length() > 1 && seg[0] == ':') {
+      flush();
+      tokens.push_back({ URLRouteToken::PARAM, seg.substr(1) });
+      captures++;
+    } else if (!seg.empty() && seg[0] == '*' && e == pattern.length()) {
+      flush();
+      tokens.push_back({ URLRouteToken::CATCH_ALL, seg.length() > 1 ? seg.substr(1) : seg });
+      captures++;
+    } else {
+      literal += seg;
+    }
+    p = e;
+  }
+
+  flush();
+
+  if (captures > URLRouteTable::MAX_CAPTURES) {
+    throw std::runtime_error("too many parameters in URL pattern");
+  }
+}
+
+void URLRouteTable::validate(const std::string &pattern) {
+  std::vector<URLRouteToken> tokens;
+  parse_url_pattern(pattern, tokens);
+}
+
+//
+// URLRouteTable::Builder
+//
+
+struct URLRouteTable::Builder::Node {
+  std::string prefix;
+  std::vector<Node*> children;
+  Node* param = nullptr;
+  Node* label = nullptr;
+  int route = -1;
+  int catch_all = -1;
+  bool is_implicit = false;
+
+  ~Node() {
+    for (auto *c : children) delete c;
+    delete param;
+    delete label;
+  }
+};
+
+URLRouteTable::Builder::Builder()
+  : m_root(new Node)
+{
+}
+
+URLRouteTable::Builder::~Builder() {
+  delete m_root;
+}
+
+void URLRouteTable::Builder::add(const std::string &pattern, int id) {
+  std::vector<URLRouteToken> tokens;
+  parse_url_pattern(pattern, tokens);
+
+  std::vector<std::string> names;
+  auto *node = m_root;
+  Node *last_literal_parent = nullptr;
+  const std::string *last_literal = nullptr;
+
+  for (const auto &t : tokens) {
+    switch (t.type) {
+      case URLRouteToken::LITERAL:
+        last_literal_parent = node;
+        last_literal = &t.text;
+        node = insert(node, t.text);
+        break;
+      case URLRouteToken::PARAM:
+        if (!node->param) node->param = new Node;
+        node = node->param;
+        names.push_back(t.text);
+        break;
+      case URLRouteToken::LABEL:
+        if (!node->label) node->label = new Node;
+        node = node->label;
+        break;
+      case URLRouteToken::CATCH_ALL: {
+        // "/a/*" also matches "/a" itself, unless "/a" is added explicitly
+        if (last_literal && last_literal->back() == '/') {
+          auto *n = insert(last_literal_parent, last_literal->substr(0, last_literal->length() - 1));
+          set_route(n->route, n->is_implicit, true, id, names);
+        }
+        names.push_back(t.text);
+        bool dummy = false;
+        set_route(node->catch_all, dummy, false, id, names);
+        return;
+      }
+    }
+  }
+
+  set_route(node->route, node->is_implicit, false, id, names);
+}
+
+void URLRouteTable::Builder::set_route(int &slot, bool &implicit, bool is_implicit, int id, const std::vector<std::string> &names) {
+  if (slot >= 0) {
+    if (is_implicit && !implicit) return;
+    m_routes[slot] = { id, names };
+  } else {
+    slot = m_routes.size();
+    m_routes.push_back({ id, names });
+  }
+  implicit = is_implicit;
+}
+
+auto URLRouteTable::Builder::insert(Node *node, const std::string &str) -> Node* {
+  size_t p = 0;
+  while (p < str.length()) {
+    Node *child = nullptr;
+    size_t i = 0;
+    for (; i < node->children.size(); i++) {
+      if (node->children[i]->prefix[0] == str[p]) {
+        child = node->children[i];
+        break;
+      }
+    }
+    if (!child) {
+      child = new Node;
+      child->prefix = str.substr(p);
+      node->children.push_back(child);
+      return child;
+    }
+    const auto &prefix = child->prefix;
+    size_t k = 0;
+    while (k < prefix.length() && p + k < str.length() && prefix[k] == str[p+k]) k++;
+    if (k < prefix.length()) {
+      auto *mid = new Node;
+      mid->prefix = prefix.substr(0, k);
+      child->prefix = prefix.substr(k);
+      mid->children.push_back(child);
+      node->children[i] = mid;
+      child = mid;
+    }
+    node = child;
+    p += k;
+  }
+  return node;
+}
+
+auto URLRouteTable::Builder::build() -> URLRouteTable* {
+  auto *table = new URLRouteTable;
+
+  // Breadth-first so that static children of a node are contiguous
+  std::vector<Node*> queue;
+  queue.push_back(m_root);
+  for (size_t i = 0; i < queue.size(); i++) {
+    auto *b = queue[i];
+    std::sort(
+      b->children.begin(), b->children.end(),
+      [](Node *a, Node *b) { return (unsigned char)a->prefix[0] < (unsigned char)b->prefix[0]; }
+    );
+    URLRouteTable::Node n;
+    n.prefix = table->m_chars.length();
+    n.prefix_length = b->prefix.length();
+    n.children = queue.size();
+    n.child_count = b->children.size();
+    table->m_chars += b->prefix;
+    for (auto *c : b->children) queue.push_back(c);
+    if (b->param) { n.param = queue.size(); queue.push_back(b->param); }
+    if (b->label) { n.label = queue.size(); queue.push_back(b->label); }
+    n.route = b->route;
+    n.catch_all = b->catch_all;
+    table->m_nodes.push_back(n);
+    table->m_first_chars.push_back(b->prefix.empty() ? 0 : b->prefix[0]);
+  }
+
+  for (const auto &r : m_routes) {
+    table->m_routes.push_back({ r.id, uint32_t(table->m_names.size()), uint32_t(r.names.size()) });
+    for (const auto &name : r.names) table->m_names.push_back(name);
+  }
+
+  return table;
+}
+
+//
+// URLRouteTable
+//
+
+int URLRouteTable::find(const std::string &url, Params *params) const {
+  auto path_start = url.find('/');
+  if (path_start == std::string::npos) return -1;
+
+  auto path_end = url.find('?', path_start);
+  if (path_end == std::string::npos) path_end = url.length();
+
+  auto host_end = url.find_last_of(':', path_start);
+  if (host_end == std::string::npos) host_end = path_start;
+
+  Capture caps[MAX_CAPTURES];
+  int cap_count = 0;
+  int route = -1;
+  const char *key = nullptr;
+  size_t len = 0;
+  std::string buf;
+
+  if (host_end > 0) {
+    if (host_end == path_start) {
+      key = url.c_str();
+      len = path_end;
+    } else {
+      buf = url.substr(0, host_end);
+      buf.append(url, path_start, path_end - path_start);
+      key = buf.c_str();
+      len = buf.length();
+    }
+    route = match(0, key, len, 0, caps, cap_count);
+  }
+
+  if (route < 0) {
+    key = url.c_str() + path_start;
+    len = path_end - path_start;
+    cap_count = 0;
+    route = match(0, key, len, 0, caps, cap_count);
+    if (route < 0) return -1;
+  }
+
+  const auto &r = m_routes[route];
+  if (params) {
+    params->clear();
+    for (int i = 0; i < cap_count && i < int(r.name_count); i++) {
+      params->emplace_back(
+        m_names[r.names + i],
+        std::string(key + caps[i].offset, caps[i].length)
+      );
+    }
+  }
+
+  return r.id;
+}
+
+//
+// Matching backtracks from static children to parameters, labels and
+// the catch-all, but every edge consumes a part of the key that only
+// depends on where it starts: a static prefix, up to the next '/' for
+// a parameter, or up to the next '.' or '/' for a host label. Since a
+// node is only reachable through one chain of edges, it is entered at
+// one position at most, so no node is visited twice and a lookup costs
+// O(nodes * key length) in the worst case, never exponential.
+//
+
+int URLRouteTable::match(int n, const char *key, size_t len, size_t pos, Capture *caps, int &cap_count) const {
+  const auto &node = m_nodes[n];
+
+  if (auto l = node.prefix_length) {
+    if (len - pos < l) return -1;
+    if (std::memcmp(key + pos, &m_chars[node.prefix], l)) return -1;
+    pos += l;
+  }
+
+  if (pos == len) {
+    if (node.route >= 0) return node.route;
+
+  } else {
+    // Static children first, then parameters, then the catch-all
+    auto c = key[pos];
+    auto *first = &m_first_chars[node.children];
+    for (uint32_t i = 0; i < node.child_count; i++) {
+      if (first[i] == c) {
+        auto r = match(node.children + i, key, len, pos, caps, cap_count);
+        if (r >= 0) return r;
+        break;
+      }
+    }
+
+    if (node.param >= 0 && cap_count < MAX_CAPTURES) {
+      auto e = pos;
+      while (e < len && key[e] != '/') e++;
+      if (e > pos) {
+        caps[cap_count++] = { uint32_t(pos), uint32_t(e - pos) };
+        auto r = match(node.param, key, len, e, caps, cap_count);
+        if (r >= 0) return r;
+        cap_count--;
+      }
+    }
+
+    if (node.label >= 0) {
+      auto e = pos;
+      while (e < len && key[e] != '.' && key[e] != '/') e++;
+      if (e > pos) {
+        auto r = match(node.label, key, len, e, caps, cap_count);
+        if (r >= 0) return r;
+      }
+    }
+  }
+
+  if (node.catch_all >= 0 && cap_count < MAX_CAPTURES) {
+    caps[cap_count++] = { uint32_t(pos), uint32_t(len - pos) };
+    return node.catch_all;
+  }
+
+  return -1;
+}
+
+} // namespace pipy
@@ -0,0 +1,120 @@
+/*
+ *  Copyright (c) 2019 by flomesh.io
+ *
+ *  Unless prior written consent has been obtained from the copyright
+ *  owner, the following shall not be allowed.
+ *
+ *  1. The distribution of any source codes, header files, make files,
+ *     or libraries of the software.
+ *
+ *  2. Disclosure of any source codes pertaining to the software to any
+ *     additional parties.
+ *
+ *  3. Alteration or removal of any notices in or on the software or
+ *     within the documentation included within the software.
+ *
+ *  ALL SOURCE CODE AS WELL AS ALL DOCUMENTATION INCLUDED WITH THIS
+ *  SOFTWARE IS PROVIDED IN AN “AS IS” CONDITION, WITHOUT WARRANTY OF ANY
+ *  KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef URL_ROUTER_HPP
+#define URL_ROUTER_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pipy {
+
+//
+// URLRouteTable
+//
+// Immutable radix tree of URL patterns in the form of "host/path".
+// Patterns can have ":name" path segments, a trailing "*" or "*name"
+// segment catching the rest of the path, and a leading "*" host label.
+// Once built, a table is never modified so it can be shared read-only
+// by all threads.
+//
+
+class URLRouteTable {
+public:
+  typedef std::vector<std::pair<std::string, std::string>> Params;
+
+  static const int MAX_CAPTURES = 32;
+
+  //
+  // URLRouteTable::Builder
+  //
+
+  class Builder {
+  public:
+    Builder();
+    ~Builder();
+
+    // Throws std::runtime_error for an invalid pattern
+    void add(const std::string &pattern, int id);
+    auto build() -> URLRouteTable*;
+
+  private:
+    struct Node;
+    struct Route {
+      int id;
+      std::vector<std::string> names;
+    };
+
+    Node* m_root;
+    std::vector<Route> m_routes;
+
+    auto insert(Node *node, const std::string &str) -> Node*;
+    void set_route(int &slot, bool &implicit, bool is_implicit, int id, const std::vector<std::string> &names);
+  };
+
+  static void validate(const std::string &pattern);
+
+  // Returns the id of the matching pattern, or -1 if not found
+  int find(const std::string &url, Params *params = nullptr) const;
+
+  auto size() const -> size_t { return m_nodes.size(); }
+
+private:
+  struct Node {
+    uint32_t prefix;
+    uint32_t prefix_length;
+    uint32_t children;
+    uint32_t child_count;
+    int32_t param = -1;
+    int32_t label = -1;
+    int32_t route = -1;
+    int32_t catch_all = -1;
+  };
+
+  struct Route {
+    int id;
+    uint32_t names;
+    uint32_t name_count;
+  };
+
+  struct Capture {
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  std::vector<Node> m_nodes;
+  std::vector<char> m_first_chars;
+  std::string m_chars;
+  std::vector<Route> m_routes;
+  std::vector<std::string> m_names;
+
+  int match(int n, const char *key, size_t len, size_t pos, Capture *caps, int &cap_count) const;
+};
+
+} // namespace pipy
+
+#endif // URL_ROUTER_HPP
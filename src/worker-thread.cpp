@@ -28,13 +28,20 @@
 #include "codebase.hpp"
 #include "pipeline-lb.hpp"
 #include "timer.hpp"
+#include "api/algo.hpp"
 #include "api/configuration.hpp"
 #include "api/console.hpp"
+#include "api/logging.hpp"
 #include "api/pipy.hpp"
 #include "net.hpp"
 #include "log.hpp"
 #include "utils.hpp"
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace pipy {
 
 thread_local WorkerThread* WorkerThread::s_current = nullptr;
@@ -279,6 +286,24 @@ bool WorkerThread::stop(bool force) {
   }
 }
 
+void WorkerThread::pin_cpu() {
+  const auto &cpus = m_manager->m_cpu_affinity;
+  if (cpus.empty()) return;
+  auto cpu = cpus[m_index % cpus.size()];
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+    Log::warn("[thread] Cannot pin thread %d to CPU %d", m_index, cpu);
+  } else {
+    Log::debug(Log::THREAD, "[thread] Thread %d pinned to CPU %d", m_index, cpu);
+  }
+#else
+  Log::warn("[thread] CPU affinity is not supported on this platform");
+#endif
+}
+
 void WorkerThread::init_metrics() {
   pjs::Ref<pjs::Array> label_names = pjs::Array::make();
 
@@ -390,6 +415,50 @@ void WorkerThread::init_metrics() {
     }
   );
 
+  stats::Gauge::make(
+    pjs::Str::make("pipy_chunk_size"),
+    label_names,
+    [](stats::Gauge *gauge) {
+      if (WorkerThread::current()->index() > 0) return;
+      double total = 0;
+      Data::Producer::for_each([&](Data::Producer *producer) {
+        if (auto n = producer->size()) {
+          pjs::Ref<pjs::Str> str(pjs::Str::make(producer->name()));
+          pjs::Str *name = str.get();
+          auto metric = gauge->with_labels(&name, 1);
+          metric->set(n);
+          total += n;
+        }
+      });
+      gauge->set(total);
+    }
+  );
+
+  //
+  // Stats - # of log messages dropped
+  //
+
+  label_names->length(1);
+  label_names->set(0, "file");
+
+  stats::Gauge::make(
+    pjs::Str::make("pipy_log_dropped_count"),
+    label_names,
+    [](stats::Gauge *gauge) {
+      if (WorkerThread::current()->index() > 0) return;
+      double total = 0;
+      logging::Logger::FileTarget::for_each_dropped(
+        [&](const std::string &filename, size_t n) {
+          pjs::Ref<pjs::Str> str(pjs::Str::make(filename));
+          pjs::Str *name = str.get();
+          gauge->with_labels(&name, 1)->set(n);
+          total += n;
+        }
+      );
+      gauge->set(total);
+    }
+  );
+
   //
   // Stats - # of pipelines
   //
@@ -420,6 +489,51 @@ void WorkerThread::init_metrics() {
       gauge->set(total);
     }
   );
+
+  //
+  // Stats - shared caches
+  //
+
+  label_names->length(1);
+  label_names->set(0, "cache");
+
+  typedef algo::Cache::Shared::Stats CacheStats;
+
+  static const struct {
+    const char *name;
+    double (*value)(const CacheStats &);
+  } cache_metrics[] = {
+    { "pipy_cache_hit_count", [](const CacheStats &s) -> double { return s.hits; } },
+    { "pipy_cache_miss_count", [](const CacheStats &s) -> double { return s.misses; } },
+    { "pipy_cache_eviction_count", [](const CacheStats &s) -> double { return s.evictions; } },
+    { "pipy_cache_expiration_count", [](const CacheStats &s) -> double { return s.expirations; } },
+    { "pipy_cache_entry_count", [](const CacheStats &s) -> double { return s.entries; } },
+    { "pipy_cache_size", [](const CacheStats &s) -> double { return s.bytes; } },
+  };
+
+  for (const auto &m : cache_metrics) {
+    auto value = m.value;
+    stats::Gauge::make(
+      pjs::Str::make(m.name),
+      label_names,
+      [=](stats::Gauge *gauge) {
+        if (WorkerThread::current()->index() > 0) return;
+        double total = 0;
+        algo::Cache::Shared::for_each(
+          [&](algo::Cache::Shared *cache) {
+            CacheStats stats;
+            cache->stats(stats);
+            pjs::Ref<pjs::Str> str(pjs::Str::make(cache->name()));
+            pjs::Str *name = str.get();
+            auto n = value(stats);
+            gauge->with_labels(&name, 1)->set(n);
+            total += n;
+          }
+        );
+        gauge->set(total);
+      }
+    );
+  }
 }
 
 void WorkerThread::shutdown_all(bool force) {
@@ -431,6 +545,7 @@ void WorkerThread::shutdown_all(bool force) {
 void WorkerThread::main() {
   Log::init();
   Pipy::argv(m_manager->m_argv);
+  pin_cpu();
 
   m_new_worker = Worker::make(
     pjs::Promise::Period::current(),
@@ -541,6 +656,10 @@ void WorkerManager::argv(const std::vector<std::string> &argv) {
   m_argv = argv;
 }
 
+void WorkerManager::cpu_affinity(const std::vector<int> &cpus) {
+  m_cpu_affinity = cpus;
+}
+
 bool WorkerManager::start(int concurrency, bool force) {
   if (started()) return false;
 
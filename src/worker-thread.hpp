@@ -103,6 +103,7 @@ private:
   static void shutdown_all(bool force);
 
   void main();
+  void pin_cpu();
 
   thread_local static WorkerThread* s_current;
 };
@@ -122,6 +123,8 @@ public:
   void on_done(const std::function<void()> &cb) { m_on_done = cb; }
   void on_ended(const std::function<void()> &cb) { m_on_ended = cb; }
   void argv(const std::vector<std::string> &argv);
+  void cpu_affinity(const std::vector<int> &cpus);
+  auto cpu_affinity() const -> const std::vector<int>& { return m_cpu_affinity; }
   bool started() const { return !m_worker_threads.empty(); }
   bool start(int concurrency = 1, bool force = false);
   auto status() -> Status&;
@@ -178,6 +181,7 @@ private:
 
   std::vector<WorkerThread*> m_worker_threads;
   std::vector<std::string> m_argv;
+  std::vector<int> m_cpu_affinity;
   pjs::Ref<PipelineLoadBalancer> m_running_pipeline_lb;
   pjs::Ref<PipelineLoadBalancer> m_loading_pipeline_lb;
   Status m_status;
@@ -0,0 +1,215 @@
+//
+// Microbenchmark for HPACK Huffman coding: compares the table-driven
+// decoder and word-packing encoder in src/huffman.cpp against the
+// bit-by-bit tree walk and bit-by-bit packing they replaced.
+//
+
+#include "huffman.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace pipy::http2;
+
+static const char *s_samples[] = {
+  "GET",
+  "https",
+  "/api/v1/namespaces/default/pods?labelSelector=app%3Dnginx&limit=500",
+  "www.example.com",
+  "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36",
+  "text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8",
+  "gzip, deflate, br",
+  "en-US,en;q=0.9",
+  "max-age=0",
+  "application/grpc",
+  "Wed, 21 Oct 2015 07:28:00 GMT",
+  "session=3b1f0e6c2a9d4c8e8a7d5f2b1c0e9a8d; theme=dark; lang=en",
+  "Bearer eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9.eyJzdWIiOiIxMjM0NTY3ODkwIn0",
+  "\"33a64df551425fcc55e4d42a148795d9f25f89d4\"",
+};
+
+//
+// Reference implementation
+//
+
+struct TreeNode {
+  uint16_t left = 0;
+  uint16_t right = 0;
+};
+
+static std::vector<TreeNode> s_tree;
+
+static void build_tree() {
+  s_tree.resize(1);
+  for (int i = 0; i < 257; i++) {
+    auto &p = s_hpack_huffman_table[i];
+    int ptr = 0;
+    for (int b = p.bits - 1; b >= 0; b--) {
+      bool bit = (p.code >> b) & 1;
+      int next = bit ? s_tree[ptr].right : s_tree[ptr].left;
+      if (!next) {
+        next = s_tree.size();
+        (bit ? s_tree[ptr].right : s_tree[ptr].left) = next;
+        s_tree.emplace_back();
+      }
+      ptr = next;
+    }
+    s_tree[ptr].right = i;
+  }
+}
+
+static auto tree_decode(const uint8_t *data, size_t len, std::string &out) -> bool {
+  int ptr = 0;
+  for (size_t i = 0; i < len; i++) {
+    auto c = data[i];
+    for (int b = 7; b >= 0; b--) {
+      ptr = ((c >> b) & 1) ? s_tree[ptr].right : s_tree[ptr].left;
+      auto &node = s_tree[ptr];
+      if (!node.left) {
+        if (node.right == 256) return false;
+        out.push_back(char(node.right));
+        ptr = 0;
+      }
+    }
+  }
+  return true;
+}
+
+static void bitwise_encode(const std::string &s, std::string &out) {
+  uint8_t byte = 0;
+  int n = 0;
+  for (auto c : s) {
+    auto &p = s_hpack_huffman_table[uint8_t(c)];
+    for (int b = p.bits - 1; b >= 0; b--) {
+      byte = (byte << 1) | ((p.code >> b) & 1);
+      if (++n == 8) {
+        out.push_back(char(byte));
+        byte = 0;
+        n = 0;
+      }
+    }
+  }
+  if (n > 0) {
+    byte = (byte << (8 - n)) | ((1 << (8 - n)) - 1);
+    out.push_back(char(byte));
+  }
+}
+
+//
+// Table-driven implementation
+//
+
+static auto table_decode(const uint8_t *data, size_t len, std::string &out) -> bool {
+  HuffmanDecoder decoder;
+  decoder.reset();
+  for (size_t i = 0; i < len; i++) {
+    uint8_t sym[2];
+    auto n = decoder.decode(data[i], sym);
+    if (n < 0) return false;
+    for (int j = 0; j < n; j++) out.push_back(char(sym[j]));
+  }
+  return decoder.accepted();
+}
+
+static void packed_encode(const std::string &s, std::string &out) {
+  auto size = HuffmanEncoder::encoded_size(s.c_str(), s.length(), false);
+  auto offset = out.size();
+  out.resize(offset + size);
+  HuffmanEncoder::encode(s.c_str(), s.length(), false, (uint8_t *)&out[offset]);
+}
+
+//
+// Driver
+//
+
+template<typename F>
+static auto measure(const char *name, size_t bytes, F f) -> double {
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  auto t1 = std::chrono::steady_clock::now();
+  auto sec = std::chrono::duration<double>(t1 - t0).count();
+  std::printf("%-16s %8.1f MB/s\n", name, bytes / sec / 1e6);
+  return sec;
+}
+
+int main(int argc, char *argv[]) {
+  int rounds = argc > 1 ? std::atoi(argv[1]) : 200000;
+
+  build_tree();
+
+  std::vector<std::string> plain, encoded;
+  size_t plain_size = 0, encoded_size = 0;
+  for (auto s : s_samples) {
+    std::string a, b;
+    bitwise_encode(s, a);
+    packed_encode(s, b);
+    if (a != b) {
+      std::fprintf(stderr, "encoder mismatch: %s\n", s);
+      return 1;
+    }
+    std::string x, y;
+    if (!tree_decode((const uint8_t *)b.data(), b.size(), x) ||
+        !table_decode((const uint8_t *)b.data(), b.size(), y) ||
+        x != s || y != s
+    ) {
+      std::fprintf(stderr, "decoder mismatch: %s\n", s);
+      return 1;
+    }
+    plain.push_back(s);
+    encoded.push_back(b);
+    plain_size += plain.back().size();
+    encoded_size += encoded.back().size();
+  }
+
+  size_t sink = 0;
+  std::string out;
+  out.reserve(4096);
+
+  auto t_tree = measure("decode (tree)", encoded_size * rounds, [&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (const auto &s : encoded) {
+        out.clear();
+        tree_decode((const uint8_t *)s.data(), s.size(), out);
+        sink += out.size();
+      }
+    }
+  });
+
+  auto t_table = measure("decode (table)", encoded_size * rounds, [&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (const auto &s : encoded) {
+        out.clear();
+        table_decode((const uint8_t *)s.data(), s.size(), out);
+        sink += out.size();
+      }
+    }
+  });
+
+  auto t_bitwise = measure("encode (bitwise)", plain_size * rounds, [&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (const auto &s : plain) {
+        out.clear();
+        bitwise_encode(s, out);
+        sink += out.size();
+      }
+    }
+  });
+
+  auto t_packed = measure("encode (packed)", plain_size * rounds, [&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (const auto &s : plain) {
+        out.clear();
+        packed_encode(s, out);
+        sink += out.size();
+      }
+    }
+  });
+
+  std::printf("decode speedup   %8.2fx\n", t_tree / t_table);
+  std::printf("encode speedup   %8.2fx\n", t_bitwise / t_packed);
+  return sink ? 0 : 1;
+}
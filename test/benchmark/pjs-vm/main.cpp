@@ -0,0 +1,166 @@
+//
+// PipyJS microbenchmarks: runs each script with the tree-walking
+// evaluator and with the bytecode VM in src/pjs/bytecode.cpp, checks
+// that both produce the same result and reports the time per run.
+//
+
+#include "pjs.hpp"
+#include "bytecode.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+using namespace pjs;
+
+class BenchGlobal : public ObjectTemplate<BenchGlobal, Global> {};
+
+template<> void ClassDef<BenchGlobal>::init() {
+  ctor();
+}
+
+//
+// Benchmark scripts
+//
+// Each script evaluates to a function that is called repeatedly.
+// PipyJS has no loop statements, so iteration is done by recursive
+// range splitting to keep the stack shallow.
+//
+
+#define RANGE(name, body) \
+  "function " name "(lo, hi) {" \
+  "  return hi - lo === 1 ? (" body ") : " name "(lo, (lo + hi) >> 1) + " name "((lo + hi) >> 1, hi)" \
+  "}"
+
+static const struct {
+  const char *name;
+  const char *script;
+  int rounds;
+} s_benchmarks[] = {
+  {
+    "fib",
+    "function fib(n) { return n < 2 ? n : fib(n - 1) + fib(n - 2) }"
+    "() => fib(20)",
+    20,
+  },
+  {
+    "arithmetic",
+    "function poly(x) { return ((x * 3 + 7) * x - 11) / (x % 13 + 1) + (x << 2) - (x >> 1) + (x & 255 | 7) }"
+    RANGE("range", "poly(lo)")
+    "() => range(0, 50000)",
+    20,
+  },
+  {
+    "properties",
+    "function read(o, i) { return o.a.b + o.a.c + o.d[i % 3] + o.d.length + o.s.length }"
+    RANGE("range", "read(obj, lo)")
+    "var obj = { a: { b: 1, c: 2 }, d: [1, 2, 3], s: 'xyz' };"
+    "() => range(0, 50000)",
+    20,
+  },
+  {
+    "shapes",
+    "function read(o) { return o.x + o.y * o.x - (o.y > o.x ? o.y : o.x) }"
+    RANGE("range", "read(shapes[lo % 4])")
+    "var shapes = [{ x: 1, y: 2 }, { y: 3, x: 4 }, { x: 5, y: 6, z: 7 }, { w: 0, x: 8, y: 9 }];"
+    "() => range(0, 50000)",
+    20,
+  },
+  {
+    "logic",
+    "function pick(x) { return x > 100 && x < 200 || x === 7 ? 1 : (x % 3 !== 0 ? null : 2) ?? 3 }"
+    RANGE("range", "pick(lo)")
+    "() => range(0, 50000)",
+    20,
+  },
+  {
+    "strings",
+    "function label(i) { return 'item-' + i + (i % 2 === 0 ? '-even' : '-odd') }"
+    RANGE("range", "label(lo).length")
+    "() => range(0, 50000)",
+    20,
+  },
+  {
+    "templates",
+    "function line(i) { return `${i % 2 === 0 ? 'GET' : 'POST'} /api/items/${i} ${200 + i % 5} ${i / 8}ms` }"
+    RANGE("range", "line(lo).length")
+    "() => range(0, 50000)",
+    20,
+  },
+  {
+    "closures",
+    "function make(k) { return x => x * k + 1 }"
+    RANGE("range", "make(lo)(lo)")
+    "() => range(0, 50000)",
+    20,
+  },
+};
+
+static bool run(
+  Context &ctx, const char *script, int rounds,
+  std::string &result, double &ms
+) {
+  Module module(ctx.instance());
+  module.load("bench", script);
+  std::string error;
+  int error_line, error_column;
+  if (!module.compile(error, error_line, error_column)) {
+    std::fprintf(stderr, "syntax error at line %d column %d: %s\n", error_line, error_column, error.c_str());
+    return false;
+  }
+
+  Value f;
+  module.execute(ctx, -1, nullptr, f);
+  if (!ctx.ok() || !f.is_function()) {
+    std::fprintf(stderr, "script did not evaluate to a function\n");
+    return false;
+  }
+
+  Value ret;
+  auto best = 0.0;
+  for (int i = 0; i < rounds; i++) {
+    auto t0 = std::chrono::steady_clock::now();
+    (*f.as<Function>())(ctx, 0, nullptr, ret);
+    auto t1 = std::chrono::steady_clock::now();
+    if (!ctx.ok()) {
+      std::fprintf(stderr, "runtime error: %s\n", ctx.error().message.c_str());
+      return false;
+    }
+    auto t = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    if (i == 0 || t < best) best = t;
+  }
+
+  auto s = ret.to_string();
+  result = s->str();
+  s->release();
+  ms = best;
+  return true;
+}
+
+int main() {
+  auto instance = new Instance(BenchGlobal::make());
+  Context ctx(instance);
+
+  std::printf("%-12s %14s %14s %9s\n", "benchmark", "ast (ms)", "bytecode (ms)", "speedup");
+
+  for (const auto &b : s_benchmarks) {
+    std::string result_ast, result_vm;
+    double t_ast, t_vm;
+
+    Bytecode::set_enabled(false);
+    if (!run(ctx, b.script, b.rounds, result_ast, t_ast)) return 1;
+
+    Bytecode::set_enabled(true);
+    if (!run(ctx, b.script, b.rounds, result_vm, t_vm)) return 1;
+
+    if (result_ast != result_vm) {
+      std::fprintf(stderr, "%s: result mismatch: %s vs %s\n", b.name, result_ast.c_str(), result_vm.c_str());
+      return 1;
+    }
+
+    std::printf("%-12s %14.2f %14.2f %8.2fx\n", b.name, t_ast, t_vm, t_ast / t_vm);
+  }
+
+  return 0;
+}
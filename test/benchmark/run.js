@@ -22,6 +22,8 @@ const baselineExe = os.platform() === 'win32' ? 'baseline.exe' : 'baseline';
 const binPath = join(currentDir, binName);
 const allTests = [];
 const testResults = {};
+const testOptions = [];
+const testThreads = [];
 const testResultVariances = {};
 
 fs.readdirSync(currentDir, { withFileTypes: true })
@@ -104,34 +106,29 @@ async function start(id) {
     log('Starting', chalk.magenta('baseline'), '...');
     procs.push(await startBaseline());
 
-    if (id === undefined) {
+    if (id === undefined || id in allTests) {
+      const instances = [];
+      let port = 8001;
+
       for (const i in allTests) {
-        const name = allTests[i];
-        const port = 8000 + (i|0);
-        const path = join(currentDir, name, 'main.js');
-        log('Starting', chalk.magenta(name), '...');
-        procs.push(await startPipy([ path ], { LISTEN: `0.0.0.0:${port}` }));
+        if (id !== undefined && i !== id) continue;
+        const path = join(currentDir, allTests[i], 'main.js');
+        for (const { suffix, options } of variants()) {
+          const name = allTests[i] + suffix;
+          log('Starting', chalk.magenta(name), '...');
+          procs.push(await startPipy([ ...options, path ], { LISTEN: `0.0.0.0:${port}` }));
+          instances.push({ name, port: port++ });
+        }
       }
 
       await benchmark('baseline', 8000);
 
-      for (const i in allTests) {
-        const name = allTests[i];
-        const port = 8000 + (i|0);
+      for (const { name, port } of instances) {
         await benchmark(name, port);
       }
 
       await summary();
 
-    } else if (id in allTests) {
-      const name = allTests[id];
-      const path = join(currentDir, name, 'main.js');
-      log('Starting', chalk.magenta(name), '...');
-      procs.push(await startPipy([ path ], { LISTEN: '0.0.0.0:8001' }));
-      await benchmark('baseline', 8000);
-      await benchmark(name, 8001);
-      await summary();
-
     } else {
       error('Unknown test ID');
     }
@@ -147,6 +144,16 @@ async function start(id) {
   }
 }
 
+function variants() {
+  if (testThreads.length === 0) {
+    return [{ suffix: '', options: testOptions }];
+  }
+  return testThreads.map(n => ({
+    suffix: ` (${n} thread${n > 1 ? 's' : ''})`,
+    options: [ ...testOptions, `--threads=${n}`, '--reuse-port' ],
+  }));
+}
+
 async function wait(time, msg) {
   for (let i = 0; i < time; i++) {
     log(`${msg} for ${time-i}s...`);
@@ -283,5 +290,11 @@ function startPipy(args, env) {
 
 program
   .argument('[testcase-id]')
-  .action(id => start(id))
+  .option('-o, --options <options>', 'extra options for the Pipy instances being tested, e.g. "--io-uring"')
+  .option('-t, --threads <list>', 'sweep the number of worker threads of the Pipy instances being tested, e.g. "1,2,4,8"')
+  .action((id, opts) => {
+    if (opts.options) testOptions.push(...opts.options.split(' ').filter(s => s));
+    if (opts.threads) testThreads.push(...opts.threads.split(',').map(s => parseInt(s)).filter(n => n > 0));
+    return start(id);
+  })
   .parse(process.argv)
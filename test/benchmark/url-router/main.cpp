@@ -0,0 +1,241 @@
+//
+// Route-table benchmark: looks up request URLs in a table of ~20k
+// routes with the radix tree in src/url-router.cpp and with the
+// per-segment std::map tree it replaced.
+//
+
+#include "url-router.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace pipy;
+
+//
+// Reference implementation
+//
+
+static auto split(const std::string &str, char sep) -> std::list<std::string> {
+  std::list<std::string> list;
+  size_t i = 0;
+  for (;;) {
+    auto j = str.find(sep, i);
+    if (j == std::string::npos) {
+      list.push_back(str.substr(i));
+      return list;
+    }
+    list.push_back(str.substr(i, j - i));
+    i = j + 1;
+  }
+}
+
+class MapRouter {
+public:
+  MapRouter() : m_root(new Node) {}
+  ~MapRouter() { delete m_root; }
+
+  void add(const std::string &url, int value) {
+    auto segs = split(url, '/');
+    auto domain = segs.front();
+    segs.pop_front();
+    auto node = m_root;
+    if (!domain.empty()) {
+      for (const auto &seg : split(domain, '.')) node = node->new_child(seg);
+    }
+    node = node->new_child("/");
+    if (segs.back() == "*") {
+      for (const auto &seg : segs) {
+        if (!seg.empty()) node = node->new_child(seg);
+      }
+      node->value = value;
+    } else {
+      node->new_child(url.substr(url.find('/')))->value = value;
+    }
+  }
+
+  int find(const std::string &url) {
+    static const std::string s_slash("/");
+    static const std::string s_asterisk("*");
+
+    auto path_start = url.find_first_of('/');
+    if (path_start == std::string::npos) return -1;
+    auto path_end = url.find_first_of('?', path_start);
+    if (path_end == std::string::npos) path_end = url.length();
+    auto domain_end = url.find_last_of(':', path_start);
+    if (domain_end == std::string::npos) domain_end = path_start;
+
+    std::function<Node*(Node*, int)> find_host, find_path;
+
+    find_host = [&](Node *node, int p) -> Node* {
+      auto i = p;
+      while (i < domain_end && url[i] != '.') i++;
+      auto s = url.substr(p, i - p);
+      node = node->child(s);
+      if (!node) return nullptr;
+      p = i + 1;
+      if (p <= domain_end) return find_host(node, p);
+      node = node->child(s_slash);
+      if (!node) return nullptr;
+      if (auto exact = node->child(url.substr(path_start, path_end - path_start))) return exact;
+      return find_path(node, path_start + 1);
+    };
+
+    find_path = [&](Node *node, int p) -> Node* {
+      auto i = p;
+      while (i < path_end && url[i] != '/') i++;
+      auto s = url.substr(p, i - p);
+      if (auto c = node->child(s)) {
+        p = i + 1;
+        c = p >= path_end ? c->child(s_asterisk) : find_path(c, p);
+        if (c) return c;
+      }
+      if (auto c = node->child(s_asterisk)) return c;
+      return nullptr;
+    };
+
+    auto node = find_host(m_root, 0);
+    if (!node) {
+      auto i = 0;
+      while (i < domain_end && url[i] != '.') i++;
+      if (i < domain_end) {
+        if (auto c = m_root->child(s_asterisk)) node = find_host(c, i + 1);
+      }
+    }
+    if (!node) {
+      if (auto c = m_root->child(s_slash)) {
+        if (auto exact = c->child(url.substr(path_start, path_end - path_start))) {
+          node = exact;
+        } else {
+          node = find_path(c, path_start + 1);
+        }
+      }
+    }
+    return node ? node->value : -1;
+  }
+
+private:
+  struct Node {
+    std::map<std::string, Node*> children;
+    int value = -1;
+    auto child(const std::string &name) -> Node* {
+      auto i = children.find(name);
+      return i == children.end() ? nullptr : i->second;
+    }
+    auto new_child(const std::string &name) -> Node* {
+      auto i = children.find(name);
+      if (i != children.end()) return i->second;
+      return children[name] = new Node;
+    }
+    ~Node() { for (auto &i : children) delete i.second; }
+  };
+
+  Node* m_root;
+};
+
+//
+// Driver
+//
+
+template<typename F>
+static auto measure(const char *name, size_t count, F f) -> double {
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  auto t1 = std::chrono::steady_clock::now();
+  auto sec = std::chrono::duration<double>(t1 - t0).count();
+  std::printf("%-24s %8.2f M lookups/s\n", name, count / sec / 1e6);
+  return sec;
+}
+
+int main(int argc, char *argv[]) {
+  int rounds = argc > 1 ? std::atoi(argv[1]) : 20;
+
+  static const char *verbs[] = { "list", "get", "create", "update", "delete", "watch", "status", "logs" };
+
+  // ~20k routes: per-service exact endpoints and prefixes, some host-bound
+  std::vector<std::string> routes;
+  for (int svc = 0; svc < 500; svc++) {
+    auto base = "/api/v" + std::to_string(svc % 3 + 1) + "/service-" + std::to_string(svc);
+    for (int res = 0; res < 5; res++) {
+      auto path = base + "/resource-" + std::to_string(res);
+      for (auto v : verbs) routes.push_back(path + "/" + v);
+      routes.push_back(path + "/*");
+    }
+    routes.push_back(base + "/*");
+    if (svc % 10 == 0) {
+      auto host = "svc" + std::to_string(svc) + ".example.com";
+      for (auto v : verbs) routes.push_back(host + "/" + v);
+      routes.push_back(host + "/*");
+      routes.push_back("*." + host + "/*");
+    }
+  }
+  routes.push_back("/*");
+
+  MapRouter map_router;
+  URLRouteTable::Builder builder;
+  for (size_t i = 0; i < routes.size(); i++) {
+    map_router.add(routes[i], i);
+    builder.add(routes[i], i);
+  }
+  std::unique_ptr<URLRouteTable> table(builder.build());
+
+  std::mt19937 rng(1);
+  std::vector<std::string> urls;
+  for (int i = 0; i < 10000; i++) {
+    auto svc = rng() % 550;
+    auto res = rng() % 6;
+    std::string url;
+    if (rng() % 8 == 0) url = "svc" + std::to_string(svc / 10 * 10) + ".example.com";
+    if (rng() % 16 == 0) url = "a.svc" + std::to_string(svc / 10 * 10) + ".example.com:8080";
+    url += "/api/v" + std::to_string(svc % 3 + 1) + "/service-" + std::to_string(svc);
+    url += "/resource-" + std::to_string(res);
+    url += "/";
+    url += verbs[rng() % 8];
+    if (rng() % 4 == 0) url += "/extra/" + std::to_string(rng() % 100);
+    if (rng() % 4 == 0) url += "?limit=100";
+    urls.push_back(url);
+  }
+
+  for (const auto &url : urls) {
+    auto a = map_router.find(url);
+    auto b = table->find(url);
+    if (a != b) {
+      std::fprintf(stderr, "mismatch: %s => %d vs %d\n", url.c_str(), a, b);
+      return 1;
+    }
+  }
+
+  std::printf("%zu routes, %zu radix nodes\n", routes.size(), table->size());
+
+  size_t sink = 0;
+  auto count = urls.size() * rounds;
+
+  auto t_map = measure("find (std::map)", count, [&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (const auto &url : urls) sink += map_router.find(url);
+    }
+  });
+
+  auto t_radix = measure("find (radix)", count, [&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (const auto &url : urls) sink += table->find(url);
+    }
+  });
+
+  URLRouteTable::Params params;
+  measure("find (radix, params)", count, [&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (const auto &url : urls) sink += table->find(url, &params);
+    }
+  });
+
+  std::printf("speedup: %.1fx\n", t_map / t_radix);
+  return sink == 0;
+}
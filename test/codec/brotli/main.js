@@ -0,0 +1,5 @@
+pipy.read('input', $=>$
+  .compress('br')
+  .decompress('brotli')
+  .tee('-')
+)
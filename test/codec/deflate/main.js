@@ -0,0 +1,5 @@
+pipy.read('input', $=>$
+  .compress('deflate')
+  .decompress('inflate')
+  .tee('-')
+)
@@ -0,0 +1,17 @@
+((
+  www = new http.Directory('/', { compression: () => 'gzip' }),
+) =>
+
+pipy.read('input', $=>$
+  .replaceStreamStart(evt => [new MessageStart, evt])
+  .replaceMessage(
+    () => www.serve(
+      new Message({ method: 'GET', path: '/input', headers: { 'accept-encoding': 'gzip' } })
+    )
+  )
+  .decompressHTTP()
+  .replaceMessage(msg => msg.body)
+  .tee('-')
+)
+
+)()
@@ -0,0 +1,38 @@
+((
+  buffer = new Data,
+  started = false,
+  size = 0,
+
+  // Prints the payload of every HEADERS frame the encoder writes
+  dump = () => void (
+    buffer.size >= 9 && (
+      size = 9 + (h => (h[0] << 16) | (h[1] << 8) | h[2])(buffer.toArray()),
+      size <= buffer.size && (
+        (frame => frame[3] === 1 && println(new Data(frame.slice(9)).toString('hex')))(buffer.shift(size).toArray()),
+        dump()
+      )
+    )
+  ),
+
+) =>
+
+pipy.read('input', $=>$
+  .replaceStreamStart(evt => [new MessageStart, evt])
+  .replaceMessage(
+    msg => JSON.decode(msg.body).map(
+      headers => new Message({ method: 'GET', path: '/', headers })
+    )
+  )
+  .demux().to($=>$
+    .muxHTTP(() => 'hpack', { version: 2 }).to($=>$
+      .handleData(data => (
+        buffer.push(data),
+        started || (buffer.shift(24), started = true),
+        dump()
+      ))
+      .dummy()
+    )
+  )
+)
+
+)()
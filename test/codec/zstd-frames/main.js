@@ -0,0 +1,4 @@
+pipy.read('input', $=>$
+  .decompress('zstd')
+  .tee('-')
+)
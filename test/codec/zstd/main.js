@@ -0,0 +1,5 @@
+pipy.read('input', $=>$
+  .compress('zstd')
+  .decompress('zstd')
+  .tee('-')
+)
@@ -0,0 +1,68 @@
+((
+  requests = {},
+  count = path => requests[path] = (requests[path] || 0) + 1,
+) =>
+
+pipy()
+
+.listen(8080)
+.serveHTTP(
+  msg => (
+    (path = msg.head.path) => (
+      path === '/stats' ? new Message(
+        Object.keys(requests).sort().map(k => `${k} ${requests[k]}\n`).join('')
+      ) : path === '/fresh' ? new Message(
+        { headers: { 'cache-control': 'max-age=60' } },
+        `fresh ${count(path)}\n`
+      ) : path === '/etag' ? (
+        msg.head.headers['if-none-match'] === '"v1"' ? (
+          count('/etag 304'),
+          new Message({ status: 304, headers: { 'etag': '"v1"', 'cache-control': 'max-age=0' } })
+        ) : new Message(
+          { headers: { 'etag': '"v1"', 'cache-control': 'max-age=0' } },
+          `etag ${count(path)}\n`
+        )
+      ) : path === '/slow' ? (
+        count(path),
+        new Timeout(1).wait().then(
+          new Message({ headers: { 'cache-control': 'max-age=60' } }, 'slow\n')
+        )
+      ) : path === '/stuck' ? (
+        count(path),
+        new Timeout(1).wait().then(
+          new Message({ headers: { 'cache-control': 'max-age=60' } }, 'stuck\n')
+        )
+      ) : path === '/hop' ? new Message(
+        {
+          headers: {
+            'cache-control': 'max-age=60',
+            'proxy-authenticate': 'Basic',
+            'proxy-connection': 'keep-alive',
+            'x-end': 'end',
+          }
+        },
+        `hop ${count(path)}\n`
+      ) : new Message({ status: 404 }, 'not found\n')
+    )
+  )()
+)
+
+.listen(8000)
+.demuxHTTP().to($=>$
+  .cacheHTTP().to($=>$
+    .muxHTTP().to($=>$
+      .connect('localhost:8080')
+    )
+  )
+)
+
+.listen(8001)
+.demuxHTTP().to($=>$
+  .cacheHTTP({ store: 'timeout', coalesceTimeout: 0.2 }).to($=>$
+    .muxHTTP().to($=>$
+      .connect('localhost:8080')
+    )
+  )
+)
+
+)()
@@ -0,0 +1,25 @@
+@echo off
+
+echo Miss then hit
+curl -s http://localhost:8000/fresh
+curl -s http://localhost:8000/fresh
+
+echo Revalidation
+curl -s http://localhost:8000/etag
+curl -s http://localhost:8000/etag
+
+echo Client validators
+curl -s -o NUL -w "%%{http_code}\n" -H "If-None-Match: \"v1\"" http://localhost:8000/etag
+
+echo Coalescing
+curl -s -Z --parallel-immediate --no-progress-meter http://localhost:8000/slow http://localhost:8000/slow http://localhost:8000/slow
+
+echo Coalescing timeout
+curl -s -Z --parallel-immediate --no-progress-meter http://localhost:8001/stuck http://localhost:8001/stuck http://localhost:8001/stuck
+
+echo Hop-by-hop headers
+curl -s -o NUL http://localhost:8000/hop
+curl -s -D - -o NUL http://localhost:8000/hop | findstr /i /b "x- proxy-"
+
+echo Upstream requests
+curl -s http://localhost:8080/stats
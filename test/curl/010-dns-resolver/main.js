@@ -0,0 +1,115 @@
+//
+// Fake nameserver on port 5300 (UDP and TCP) for the resolver,
+// which reads resolv.conf and hosts from this directory:
+//
+// - both.test, short.example.test: one A record each
+// - local.test: 127.0.0.1, with AAAA answers delayed over UDP
+// - big.test: truncated over UDP, three A records over TCP
+// - anything else: NXDOMAIN
+//
+// AAAA questions get no records so that results are the same
+// with or without IPv6 routes. Port 8003 connects to local.test:8002,
+// going ahead with the A answer before AAAA arrives.
+//
+
+((
+  records = {
+    'both.test': ['192.0.2.1'],
+    'local.test': ['127.0.0.1'],
+    'short.example.test': ['192.0.2.2'],
+    'big.test': ['192.0.2.10', '192.0.2.11', '192.0.2.12'],
+  },
+
+  soa = name => ({
+    name, type: 'SOA', ttl: 60,
+    rdata: {
+      mname: 'ns.test', rname: 'admin.test',
+      serial: 1, refresh: 60, retry: 60, expire: 60, minimum: 60,
+    },
+  }),
+
+  queries = {},
+
+  answer = (req, proto) => (
+    (q = req.question[0], name = q.name.toLowerCase(), list = records[name]) => (
+      q.type === 'A' && (
+        (k => queries[k] = (queries[k] || 0) + 1)(`${name} ${proto}`)
+      ),
+      DNS.encode(
+        !list ? {
+          id: req.id, qr: 1, rd: 1, ra: 1, rcode: 3,
+          question: req.question, authority: [soa(name)],
+        } : q.type !== 'A' ? {
+          id: req.id, qr: 1, rd: 1, ra: 1,
+          question: req.question, authority: [soa(name)],
+        } : name === 'big.test' && proto === 'udp' ? {
+          id: req.id, qr: 1, rd: 1, ra: 1, tc: 1,
+          question: req.question,
+        } : {
+          id: req.id, qr: 1, rd: 1, ra: 1,
+          question: req.question,
+          answer: list.map(ip => ({ name: q.name, type: 'A', ttl: 60, rdata: ip })),
+        }
+      )
+    )
+  )(),
+
+) => pipy({
+  _buf: null,
+})
+
+.listen(5300, { protocol: 'udp' })
+.replaceData(
+  data => (
+    (req = DNS.decode(data), q = req.question[0]) => (
+      q.type === 'AAAA' && q.name === 'local.test' ? (
+        new Timeout(0.5).wait().then(() => answer(req, 'udp'))
+      ) : answer(req, 'udp')
+    )
+  )()
+)
+
+.listen(5300)
+.replaceData(
+  data => (
+    _buf = _buf ? (_buf.push(data), _buf) : new Data(data),
+    (
+      (head = _buf.toArray().slice(0, 2), len = (head[0] << 8) | head[1]) => (
+        _buf.size < 2 + len ? new Data : (
+          _buf.shift(2),
+          (
+            (msg = answer(DNS.decode(_buf.shift(len)), 'tcp')) => (
+              new Data([msg.size >> 8, msg.size & 255]).push(msg)
+            )
+          )()
+        )
+      )
+    )()
+  )
+)
+
+.listen(8000)
+.serveHTTP(
+  msg => DNS.resolve(msg.head.path.substring(1)).then(
+    addresses => new Message(JSON.stringify(addresses) + '\n')
+  )
+)
+
+.listen(8002)
+.serveHTTP(new Message('hello\n'))
+
+.listen(8003)
+.demuxHTTP().to($=>$
+  .muxHTTP().to($=>$
+    .connect('local.test:8002')
+  )
+)
+
+.listen(8001)
+.serveHTTP(
+  () => new Message(
+    Object.keys(queries).sort().map(k => `${k} ${queries[k]}\n`).join('')
+  )
+)
+
+)()
@@ -0,0 +1,28 @@
+#!/bin/bash
+
+echo 'Hosts file'
+curl -s http://localhost:8000/static.test
+curl -s http://localhost:8000/STATIC.TEST.
+
+echo 'Answer then cache'
+curl -s http://localhost:8000/both.test
+curl -s http://localhost:8000/both.test
+
+echo 'Search domains'
+curl -s http://localhost:8000/short
+
+echo 'Fully qualified name'
+curl -s http://localhost:8000/short.
+
+echo 'Nonexistent name'
+curl -s http://localhost:8000/missing.test
+curl -s http://localhost:8000/missing.test
+
+echo 'Truncated over UDP'
+curl -s http://localhost:8000/big.test
+
+echo 'Connect by name'
+curl -s http://localhost:8003/
+
+echo 'Queries'
+curl -s http://localhost:8001/
@@ -115,10 +115,21 @@ async function test(name) {
   }
 }
 
+// Extra options for pipy can be listed one per line in an 'options'
+// file next to main.js, with pathnames relative to the test directory
+function readOptions(dirname) {
+  try {
+    return fs.readFileSync(join(dirname, 'options')).toString().split('\n').map(l => l.trim()).filter(l => l);
+  } catch (e) {
+    return [];
+  }
+}
+
 async function startPipy(filename) {
   log('Starting Pipy...');
   log(pipyBinPath, filename);
-  const proc = spawn(pipyBinPath, [filename, '--log-level=debug:thread']);
+  const cwd = dirname(filename);
+  const proc = spawn(pipyBinPath, [filename, '--log-level=debug:thread', ...readOptions(cwd)], { cwd });
   const lineBuffer = [];
   let started = false;
   return await Promise.race([
@@ -0,0 +1,70 @@
+((
+  seed = 1,
+  rand = n => (seed = (seed * 69069 + 1) % 4294967296, Math.floor(seed / 4294967296 * n)),
+
+  v4 = n => [n >>> 24, (n >>> 16) & 255, (n >>> 8) & 255, n & 255].join('.'),
+  v4mask = len => len === 0 ? 0 : (0xffffffff << (32 - len)) >>> 0,
+  v4block = (base, len) => v4((base & v4mask(len)) >>> 0) + '/' + len,
+  v4within = (base, len) => v4(((base & v4mask(len)) | (rand(4294967296) & ~v4mask(len))) >>> 0),
+
+  v6 = groups => groups.map(g => g.toString(16)).join(':'),
+  v6mask = (len, i) => (
+    (bits = Math.max(0, Math.min(16, len - i * 16))) => bits === 0 ? 0 : (0xffff << (16 - bits)) & 0xffff
+  )(),
+  v6groups = () => new Array(8).fill(0).map(() => rand(65536)),
+  v6block = (base, len) => v6(base.map((g, i) => g & v6mask(len, i))) + '/' + len,
+  v6within = (base, len) => v6(base.map((g, i) => (g & v6mask(len, i)) | (rand(65536) & ~v6mask(len, i) & 0xffff))),
+
+  blocks4 = {},
+  blocks6 = {},
+  bases4 = new Array(50).fill(0).map(() => rand(4294967296)),
+  bases6 = new Array(50).fill(0).map(() => v6groups()),
+
+  _ = (
+    bases4.forEach((b, i) => [8, 12, 16, 20, 24, 28, 32].forEach((len, j) => (j + i) % 2 === 0 && (blocks4[v4block(b, len)] = `v4-${i}-${len}`))),
+    bases6.forEach((b, i) => [16, 32, 48, 64, 96, 112, 128].forEach((len, j) => (j + i) % 2 === 0 && (blocks6[v6block(b, len)] = `v6-${i}-${len}`))),
+    blocks4['0.0.0.0/0'] = 'v4-default',
+    blocks6['::/0'] = 'v6-default'
+  ),
+
+  masks4 = Object.entries(blocks4).map(([k, v]) => [new Netmask(k), v]),
+  masks6 = Object.entries(blocks6).map(([k, v]) => [new Netmask(k), v]),
+
+  map = new IPMap(Object.assign({}, blocks4, blocks6)),
+
+  scan = (masks, ip) => masks.reduce(
+    (best, [mask, value]) => (
+      mask.contains(ip) && (!best || mask.bitmask > best[0].bitmask) ? [mask, value] : best
+    ),
+    null
+  )?.[1],
+
+  check = (name, masks, addresses) => (
+    (mismatches = addresses.filter(ip => map.find(ip) !== scan(masks, ip))) => (
+      `${name}: ${addresses.length} lookups, ${mismatches.length} mismatches\n`
+    )
+  )(),
+
+  addresses4 = new Array(2000).fill(0).map(
+    (_, i) => i % 4 === 0 ? v4(rand(4294967296)) : v4within(bases4[rand(50)], [8, 12, 16, 20, 24, 28, 32][rand(7)])
+  ),
+  addresses6 = new Array(2000).fill(0).map(
+    (_, i) => i % 4 === 0 ? v6(v6groups()) : v6within(bases6[rand(50)], [16, 32, 48, 64, 96, 112, 128][rand(7)])
+  ),
+) =>
+
+pipy.read('input', $=>$
+  .replaceStreamStart(evt => [new MessageStart, evt])
+  .replaceMessageBody(
+    data => new Data(
+      check('IPv4', masks4, addresses4) +
+      check('IPv6', masks6, addresses6) +
+      data.toString().split('\n').filter(ip => ip).map(
+        ip => `${ip} => ${map.find(ip)}\n`
+      ).join('')
+    )
+  )
+  .tee('-')
+)
+
+)()
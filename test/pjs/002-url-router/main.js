@@ -0,0 +1,26 @@
+((
+  router = new algo.URLRouter({
+    '/': 'root',
+    '/foo': 'foo',
+    '/foo/*': 'foo/*',
+    '/foo/bar': 'foo/bar',
+    '/foo/bar/*': 'foo/bar/*',
+    'example.com/*': 'example.com/*',
+    '*.example.com/api/*': '*.example.com/api/*',
+    'www.example.com/index.html': 'www.example.com/index.html',
+  }),
+) =>
+
+pipy.read('input', $=>$
+  .replaceStreamStart(evt => [new MessageStart, evt])
+  .replaceMessageBody(
+    data => new Data(
+      data.toString().split('\n').filter(url => url).map(
+        url => `${url} => ${router.find(url)}\n`
+      ).join('')
+    )
+  )
+  .tee('-')
+)
+
+)()
@@ -0,0 +1,79 @@
+((
+  rejects = pattern => (() => {
+    try {
+      new RegExp(pattern);
+      return 'accepted';
+    } catch (e) {
+      return 'rejected';
+    }
+  })(),
+
+  steps = (re, str, n) => new Array(n).fill(0).map(
+    () => ((m = re.exec(str)) => m ? `${m[0]}@${re.lastIndex}` : `null@${re.lastIndex}`)()
+  ).join(' '),
+
+  tests = (re, str, n) => new Array(n).fill(0).map(
+    () => `${re.test(str)}@${re.lastIndex}`
+  ).join(' '),
+
+  lastIndex = (re, str, i) => (
+    re.lastIndex = i,
+    ((m = re.exec(str)) => `${i} => ${m ? m[0] : null}@${re.lastIndex}`)()
+  ),
+
+  chunked = new Data('x'.repeat(16380) + 'needle' + 'y'.repeat(16380)),
+
+  cases = [
+    ['replace', 'a-b-c'.replace(new RegExp('-'), '+')],
+    ['replace g', 'a-b-c'.replace(new RegExp('-', 'g'), '+')],
+    ['replace i', 'A-b-C'.replace(new RegExp('[a-c]', 'gi'), '*')],
+    ['match', 'a1b22'.match(new RegExp('(\\d)(\\d)?'))],
+    ['match g', 'a1b22c333'.match(new RegExp('\\d+', 'g'))],
+    ['match g none', 'abc'.match(new RegExp('\\d', 'g'))],
+    ['exec g', steps(new RegExp('o', 'g'), 'foo boo', 5)],
+    ['test g', tests(new RegExp('o', 'g'), 'foo', 4)],
+    ['lastIndex', lastIndex(new RegExp('o', 'g'), 'foo boo', 4)],
+    ['lastIndex negative', lastIndex(new RegExp('o', 'g'), 'foo boo', -5)],
+    ['lastIndex NaN', lastIndex(new RegExp('o', 'g'), 'foo boo', NaN)],
+    ['lastIndex clamped', ((re = new RegExp('o', 'g')) => (re.lastIndex = -5, re.lastIndex))()],
+    ['lastIndex past end', lastIndex(new RegExp('o', 'g'), 'foo boo', 100)],
+    ['lastIndex no g', lastIndex(new RegExp('o'), 'foo boo', 4)],
+    ['$n', 'john smith'.replace(new RegExp('(\\w+)\\s(\\w+)'), '$2, $1')],
+    ['$$', 'cost'.replace(new RegExp('cost'), '$$5')],
+    ['$& $` $\'', 'abc'.replace(new RegExp('b'), "[$`|$&|$']")],
+    ['$10 with one group', 'ab'.replace(new RegExp('(a)'), '$10')],
+    ['$nn', 'abcdefghijk'.replace(new RegExp('(a)(b)(c)(d)(e)(f)(g)(h)(i)(j)(k)'), '$11$10$1')],
+    ['unmatched group', 'a'.replace(new RegExp('(a)|(b)'), '[$2]')],
+    ['unknown escape', 'a'.replace(new RegExp('a'), '$x$')],
+    ['empty match replace', 'abc'.replace(new RegExp('', 'g'), '-')],
+    ['empty match utf-8', 'héllo'.replace(new RegExp('', 'g'), '.')],
+    ['empty match match', 'abc'.match(new RegExp('x*', 'g'))],
+    ['optional empty', 'aab'.replace(new RegExp('a*?', 'g'), '-')],
+    ['backreference', rejects('(a)\\1')],
+    ['lookahead', rejects('a(?=b)')],
+    ['negative lookahead', rejects('a(?!b)')],
+    ['lookbehind', rejects('(?<=a)b')],
+    ['negative lookbehind', rejects('(?<!a)b')],
+    ['non-capturing group', rejects('(?:ab)+')],
+    ['oversized thread state', rejects('((a?){0,300}){0,30}')],
+    ['long input', ('x'.repeat(60000) + 'ab').match(new RegExp('(a)(b)'))],
+    ['long input loops', ((m = new RegExp('((a?)b){2,}!').exec('ab'.repeat(30000) + '!')) => [m[0].length, m[1], m[2]])()],
+    ['Data.test', new Data('hello world').test(new RegExp('wor'))],
+    ['Data.test miss', new Data('hello world').test(new RegExp('^world'))],
+    ['Data.test chunks', chunked.test(new RegExp('xneedley'))],
+    ['Data.test chunks anchored', chunked.test(new RegExp('^x+needley+$'))],
+    ['Data.test chunks miss', chunked.test(new RegExp('needlex'))],
+  ],
+) =>
+
+pipy.read('input', $=>$
+  .replaceStreamStart(evt => [new MessageStart, evt])
+  .replaceMessageBody(
+    () => new Data(
+      cases.map(([name, result]) => `${name}: ${JSON.stringify(result)}\n`).join('')
+    )
+  )
+  .tee('-')
+)
+
+)()
@@ -0,0 +1,28 @@
+((
+  router = new algo.URLRouter({
+    '/users/:id': 'user',
+    '/users/me': 'me',
+    '/users/:id/posts/:post': 'post',
+    '/files/*path': 'files',
+    '/a/*': 'a/*',
+    '/a/b': 'a/b',
+    '/x/y': 'x/y',
+    '/x/:p': 'x/:p',
+    '/x/:p/z': 'x/:p/z',
+    '/x/*rest': 'x/*rest',
+  }),
+) =>
+
+pipy.read('input', $=>$
+  .replaceStreamStart(evt => [new MessageStart, evt])
+  .replaceMessageBody(
+    data => new Data(
+      data.toString().split('\n').filter(url => url).map(
+        url => `${url} => ${JSON.stringify(router.match(url))}\n`
+      ).join('')
+    )
+  )
+  .tee('-')
+)
+
+)()
@@ -0,0 +1,7 @@
+#!/usr/bin/env node
+
+import url from 'url';
+import { dirname } from 'path';
+import { run } from '../run-dir.js';
+
+run(dirname(url.fileURLToPath(import.meta.url)));